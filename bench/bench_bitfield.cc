@@ -0,0 +1,23 @@
+#include "config.h"
+
+#include "torrent/bitfield.h"
+
+#include "benchmark.h"
+
+// Bitfield::update recounts the set bits after the data has been
+// modified directly, e.g. when loading a peer's bitfield message.
+void
+bench_bitfield() {
+  torrent::Bitfield bitfield;
+
+  bitfield.set_size_bits(1 << 20);
+  bitfield.allocate();
+
+  for (torrent::Bitfield::iterator itr = bitfield.begin(); itr != bitfield.end(); itr++)
+    *itr = (itr - bitfield.begin()) * 73;
+
+  benchmark::run("bitfield_update_1m", [&bitfield](uint64_t iterations) {
+      for (uint64_t itr = 0; itr < iterations; itr++)
+        bitfield.update();
+    });
+}
@@ -0,0 +1,51 @@
+#include "config.h"
+
+#include <cstring>
+#include <vector>
+#include <rak/socket_address.h>
+
+#include "dht/dht_bucket.h"
+#include "dht/dht_node.h"
+#include "torrent/hash_string.h"
+
+#include "benchmark.h"
+
+// Fills a full-range bucket with nodes and splits it, the routing
+// table operation performed whenever the home bucket overflows.
+void
+bench_dht_bucket() {
+  rak::socket_address sa;
+  sa.sa_inet()->clear();
+  sa.sa_inet()->set_port(6881);
+
+  torrent::HashString range_begin;
+  torrent::HashString range_end;
+
+  std::memset(range_begin.data(), 0, torrent::HashString::size_data);
+  std::memset(range_end.data(), 0xff, torrent::HashString::size_data);
+
+  std::vector<torrent::DhtNode*> nodes;
+
+  for (unsigned int itr = 0; itr < torrent::DhtBucket::num_nodes; itr++) {
+    torrent::HashString id;
+
+    for (unsigned int pos = 0; pos < torrent::HashString::size_data; pos++)
+      id.data()[pos] = itr * 37 + pos * 11;
+
+    nodes.push_back(new torrent::DhtNode(id, &sa));
+  }
+
+  benchmark::run("dht_bucket_split", [&](uint64_t iterations) {
+      for (uint64_t itr = 0; itr < iterations; itr++) {
+        torrent::DhtBucket bucket(range_begin, range_end);
+
+        for (std::vector<torrent::DhtNode*>::iterator node = nodes.begin(); node != nodes.end(); node++)
+          bucket.add_node(*node);
+
+        delete bucket.split(range_begin);
+      }
+    });
+
+  for (std::vector<torrent::DhtNode*>::iterator itr = nodes.begin(); itr != nodes.end(); itr++)
+    delete *itr;
+}
@@ -0,0 +1,63 @@
+#include "config.h"
+
+#include <sstream>
+#include <string>
+
+#include "torrent/object.h"
+#include "torrent/object_stream.h"
+
+#include "benchmark.h"
+
+// A multi-file torrent shaped like the real thing; synthesized here
+// rather than shipped as a binary fixture so the corpus stays in
+// plain sight and scales with one constant.
+static std::string
+make_torrent_corpus() {
+  torrent::Object root = torrent::Object::create_map();
+
+  root.insert_key("announce", "http://bench.invalid/announce");
+  root.insert_key("creation date", (int64_t)1000000000);
+
+  torrent::Object& info = root.insert_key("info", torrent::Object::create_map());
+
+  info.insert_key("name", "bench");
+  info.insert_key("piece length", (int64_t)(256 * 1024));
+  info.insert_key("pieces", std::string(20 * 1200, 'x'));
+
+  torrent::Object& files = root.get_key("info").insert_key("files", torrent::Object::create_list());
+
+  for (int itr = 0; itr < 500; itr++) {
+    torrent::Object& file = *files.as_list().insert(files.as_list().end(), torrent::Object::create_map());
+
+    file.insert_key("length", (int64_t)(itr * 4096 + 1));
+
+    torrent::Object& path = file.insert_key("path", torrent::Object::create_list());
+
+    path.as_list().push_back(torrent::Object("directory"));
+    path.as_list().push_back(torrent::Object("file-" + std::to_string(itr)));
+  }
+
+  std::stringstream stream;
+  torrent::object_write_bencode(&stream, &root);
+
+  return stream.str();
+}
+
+void
+bench_object_stream() {
+  std::string corpus = make_torrent_corpus();
+
+  benchmark::run("bencode_parse_torrent", [&corpus](uint64_t iterations) {
+      for (uint64_t itr = 0; itr < iterations; itr++) {
+        torrent::Object result;
+        torrent::object_read_bencode_c(corpus.c_str(), corpus.c_str() + corpus.size(), &result, 128);
+      }
+    });
+
+  benchmark::run("bencode_parse_torrent_borrow", [&corpus](uint64_t iterations) {
+      for (uint64_t itr = 0; itr < iterations; itr++) {
+        torrent::Object result;
+        torrent::object_read_bencode_borrow_c(corpus.c_str(), corpus.c_str() + corpus.size(), &result, 128);
+      }
+    });
+}
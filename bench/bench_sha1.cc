@@ -0,0 +1,29 @@
+#include "config.h"
+
+#include <vector>
+
+#include "utils/sha1.h"
+
+#include "benchmark.h"
+
+// Hashes a 256KiB buffer per iteration, roughly one piece worth of
+// data for a typical torrent.
+void
+bench_sha1() {
+  std::vector<char> buffer(256 * 1024);
+
+  for (size_t itr = 0; itr < buffer.size(); itr++)
+    buffer[itr] = itr * 31;
+
+  benchmark::run("sha1_256k", [&buffer](uint64_t iterations) {
+      char hash[20];
+
+      for (uint64_t itr = 0; itr < iterations; itr++) {
+        torrent::Sha1 sha1;
+
+        sha1.init();
+        sha1.update(buffer.data(), buffer.size());
+        sha1.final_c(hash);
+      }
+    });
+}
@@ -0,0 +1,48 @@
+#include "config.h"
+
+#include <vector>
+
+#include "net/throttle_list.h"
+#include "net/throttle_node.h"
+
+#include "benchmark.h"
+
+// One quota distribution pass over a list of active nodes, the work
+// done per throttle tick for every throttled connection.
+void
+bench_throttle_list() {
+  torrent::ThrottleList list;
+  list.enable();
+
+  std::vector<torrent::ThrottleNode*> nodes;
+
+  for (int itr = 0; itr < 200; itr++) {
+    torrent::ThrottleNode* node = new torrent::ThrottleNode(30);
+
+    node->set_list_iterator(list.end());
+    list.insert(node);
+    nodes.push_back(node);
+  }
+
+  // A full tick: every node draws and spends quota, deactivates
+  // waiting for more, and update_quota redistributes and reactivates.
+  benchmark::run("throttle_tick_200", [&list, &nodes](uint64_t iterations) {
+      for (uint64_t itr = 0; itr < iterations; itr++) {
+        for (std::vector<torrent::ThrottleNode*>::iterator node = nodes.begin(); node != nodes.end(); node++) {
+          if (!list.is_active(*node))
+            continue;
+
+          list.node_used(*node, list.node_quota(*node) / 2);
+          list.node_deactivate(*node);
+        }
+
+        list.update_quota(1 << 20);
+        list.activate_pending(~uint32_t());
+      }
+    });
+
+  for (std::vector<torrent::ThrottleNode*>::iterator itr = nodes.begin(); itr != nodes.end(); itr++) {
+    list.erase(*itr);
+    delete *itr;
+  }
+}
@@ -0,0 +1,63 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cinttypes>
+#include <time.h>
+
+#include "benchmark.h"
+
+namespace benchmark {
+
+int64_t
+now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Medians over wall-clock batches of ~10ms give repeatable numbers
+// without cycle counters or pinned cores; the best batch is printed
+// alongside as the low-noise floor.
+void
+run(const char* name, slot_batch slot) {
+  const int64_t      target_batch_ns = 10 * 1000000;
+  const unsigned int sample_count    = 9;
+
+  uint64_t iterations = 1;
+
+  while (true) {
+    int64_t elapsed = -now_ns();
+    slot(iterations);
+    elapsed += now_ns();
+
+    if (elapsed >= target_batch_ns)
+      break;
+
+    if (elapsed <= 0)
+      iterations *= 16;
+    else
+      iterations = std::max<uint64_t>(iterations * 2, iterations * target_batch_ns / elapsed / 2);
+  }
+
+  int64_t samples[sample_count];
+
+  for (unsigned int itr = 0; itr < sample_count; itr++) {
+    int64_t elapsed = -now_ns();
+    slot(iterations);
+    elapsed += now_ns();
+
+    samples[itr] = elapsed;
+  }
+
+  std::sort(samples, samples + sample_count);
+
+  std::printf("%-28s %12" PRIu64 " iters %12.1f ns/op median %12.1f ns/op best\n",
+              name,
+              iterations,
+              (double)samples[sample_count / 2] / iterations,
+              (double)samples[0] / iterations);
+}
+
+}
@@ -0,0 +1,20 @@
+#ifndef LIBTORRENT_BENCH_BENCHMARK_H
+#define LIBTORRENT_BENCH_BENCHMARK_H
+
+#include <functional>
+#include <cstdint>
+
+namespace benchmark {
+
+typedef std::function<void (uint64_t)> slot_batch;
+
+int64_t now_ns();
+
+// Calibrates an iteration count so a batch runs for roughly 10ms,
+// then times several batches and reports the median and best ns per
+// iteration. The slot receives the number of iterations to run.
+void run(const char* name, slot_batch slot);
+
+}
+
+#endif
@@ -0,0 +1,26 @@
+#include "config.h"
+
+#include <rak/timer.h>
+
+#include "globals.h"
+
+void bench_sha1();
+void bench_bitfield();
+void bench_object_stream();
+void bench_throttle_list();
+void bench_dht_bucket();
+
+int
+main() {
+  // Several of the benched classes read cachedTime, which the client
+  // event loop normally keeps current.
+  torrent::cachedTime = rak::timer::current();
+
+  bench_sha1();
+  bench_bitfield();
+  bench_object_stream();
+  bench_throttle_list();
+  bench_dht_bucket();
+
+  return 0;
+}
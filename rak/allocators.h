@@ -98,6 +98,55 @@ bool operator!= (const cacheline_allocator<T1>&, const cacheline_allocator<T2>&)
   return false;
 }
 
+
+// Free-list pool of equally sized, cacheline aligned blocks. Freed
+// blocks are kept for reuse rather than handed back to the system,
+// avoiding allocator churn for small objects with a high turnover
+// rate. Not thread safe; each pool belongs to one thread.
+class memory_pool {
+public:
+  memory_pool(size_t block_size) :
+    m_block_size(block_size < sizeof(void*) ? sizeof(void*) : block_size),
+    m_free_list(NULL) { }
+
+  ~memory_pool() { clear(); }
+
+  size_t block_size() const { return m_block_size; }
+
+  void* allocate() {
+    if (m_free_list == NULL)
+      return cacheline_allocator<>::alloc_size(m_block_size);
+
+    void* ptr = m_free_list;
+    m_free_list = *(void**)ptr;
+
+    return ptr;
+  }
+
+  void deallocate(void* ptr) {
+    if (ptr == NULL)
+      return;
+
+    *(void**)ptr = m_free_list;
+    m_free_list = ptr;
+  }
+
+  void clear() {
+    while (m_free_list != NULL) {
+      void* next = *(void**)m_free_list;
+      ::free(m_free_list);
+      m_free_list = next;
+    }
+  }
+
+private:
+  memory_pool(const memory_pool&);
+  void operator = (const memory_pool&);
+
+  size_t m_block_size;
+  void*  m_free_list;
+};
+
 }
 
 //
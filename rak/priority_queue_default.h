@@ -37,6 +37,8 @@
 #ifndef RAK_PRIORITY_QUEUE_DEFAULT_H
 #define RAK_PRIORITY_QUEUE_DEFAULT_H
 
+#include <cinttypes>
+#include <cstring>
 #include <functional>
 #include <rak/allocators.h>
 #include <rak/priority_queue.h>
@@ -46,11 +48,13 @@
 
 namespace rak {
 
+class timer_wheel;
+
 class priority_item {
 public:
   typedef std::function<void (void)> slot_void;
 
-  priority_item() {}
+  priority_item() : m_next(NULL), m_pprev(NULL), m_wheelSlot(~uint32_t()) {}
   ~priority_item() {
     if (is_queued())
       throw torrent::internal_error("priority_item::~priority_item() called on a queued item.");
@@ -74,8 +78,15 @@ private:
   priority_item(const priority_item&);
   void operator = (const priority_item&);
 
+  friend class timer_wheel;
+
   timer               m_time;
   slot_void           m_slot;
+
+  // Intrusive hooks managed by timer_wheel.
+  priority_item*      m_next;
+  priority_item**     m_pprev;
+  uint32_t            m_wheelSlot;
 };
 
 struct priority_compare {
@@ -86,7 +97,272 @@ struct priority_compare {
 
 typedef std::equal_to<priority_item*> priority_equal;
 typedef priority_queue<priority_item*, priority_compare, priority_equal,
-                       cacheline_allocator<priority_item*> > priority_queue_default;
+                       cacheline_allocator<priority_item*> > priority_queue_heap;
+
+// Hashed hierarchical timer wheel. Scheduling and cancelling are O(1)
+// with intrusively linked slot lists, while finding the earliest item
+// scans the occupancy bitmaps and cascades higher levels only when
+// the lower ones run dry. Time is bucketed into ~1ms ticks with 256
+// slots per level, so six levels cover any realistic timer.
+
+class timer_wheel {
+public:
+  static const int      slot_bits = 8;
+  static const int      num_slots = 1 << slot_bits;
+  static const int      num_levels = 6;
+  static const int      granularity_bits = 10;
+
+  static const uint32_t invalid_slot = ~uint32_t();
+
+  timer_wheel() : m_size(0), m_base(0), m_top(NULL) {
+    std::memset(m_slots, 0, sizeof(m_slots));
+    std::memset(m_bitmap, 0, sizeof(m_bitmap));
+  }
+
+  bool            empty() const { return m_size == 0; }
+  size_t          size() const  { return m_size; }
+
+  bool            contains(const priority_item* item) const { return item->m_wheelSlot != invalid_slot; }
+
+  priority_item*  top();
+  void            pop();
+
+  void            push(priority_item* item);
+  bool            erase(priority_item* item);
+
+  void            clear();
+
+private:
+  timer_wheel(const timer_wheel&);
+  void operator = (const timer_wheel&);
+
+  static int64_t  tick_of(const timer& t) { return t.usec() >> granularity_bits; }
+
+  void            insert_link(priority_item* item);
+  void            remove_link(priority_item* item);
+
+  priority_item*  slot_min(int level, int slot) const;
+  int             first_slot(int level, int from) const;
+
+  void            cascade(int level, int slot);
+
+  size_t          m_size;
+  int64_t         m_base;
+  priority_item*  m_top;
+
+  priority_item*  m_slots[num_levels][num_slots];
+  uint64_t        m_bitmap[num_levels][num_slots / 64];
+};
+
+// An item's level is the highest base-256 digit in which its tick
+// differs from the wheel's base; due and overdue items coalesce in
+// the base's own level 0 slot.
+inline void
+timer_wheel::insert_link(priority_item* item) {
+  int64_t tick = tick_of(item->time());
+  int level = 0;
+  int slot;
+
+  if (tick > m_base) {
+    int64_t diff = tick ^ m_base;
+
+    while (level != num_levels - 1 && (diff >> ((level + 1) * slot_bits)) != 0)
+      level++;
+
+    slot = (tick >> (level * slot_bits)) & (num_slots - 1);
+
+  } else {
+    slot = m_base & (num_slots - 1);
+  }
+
+  item->m_wheelSlot = (level << slot_bits) | slot;
+  item->m_next = m_slots[level][slot];
+
+  if (item->m_next != NULL)
+    item->m_next->m_pprev = &item->m_next;
+
+  item->m_pprev = &m_slots[level][slot];
+  m_slots[level][slot] = item;
+
+  m_bitmap[level][slot >> 6] |= uint64_t(1) << (slot & 63);
+}
+
+inline void
+timer_wheel::remove_link(priority_item* item) {
+  int level = item->m_wheelSlot >> slot_bits;
+  int slot = item->m_wheelSlot & (num_slots - 1);
+
+  *item->m_pprev = item->m_next;
+
+  if (item->m_next != NULL)
+    item->m_next->m_pprev = item->m_pprev;
+
+  item->m_next = NULL;
+  item->m_pprev = NULL;
+  item->m_wheelSlot = invalid_slot;
+
+  if (m_slots[level][slot] == NULL)
+    m_bitmap[level][slot >> 6] &= ~(uint64_t(1) << (slot & 63));
+}
+
+inline priority_item*
+timer_wheel::slot_min(int level, int slot) const {
+  priority_item* min = m_slots[level][slot];
+
+  for (priority_item* itr = min->m_next; itr != NULL; itr = itr->m_next)
+    if (itr->time() < min->time())
+      min = itr;
+
+  return min;
+}
+
+inline int
+timer_wheel::first_slot(int level, int from) const {
+  int word = from >> 6;
+  uint64_t bits = m_bitmap[level][word] & (~uint64_t(0) << (from & 63));
+
+  while (true) {
+    if (bits != 0)
+      return (word << 6) + __builtin_ctzll(bits);
+
+    if (++word == num_slots / 64)
+      return -1;
+
+    bits = m_bitmap[level][word];
+  }
+}
+
+// Empty a slot and re-place its items against an updated base; the
+// slot's earliest item becomes the new base, which guarantees it
+// drops to level 0.
+inline void
+timer_wheel::cascade(int level, int slot) {
+  priority_item* head = m_slots[level][slot];
+
+  if (head == NULL)
+    throw torrent::internal_error("timer_wheel::cascade(...) called on an empty slot.");
+
+  int64_t min_tick = tick_of(slot_min(level, slot)->time());
+
+  if (min_tick > m_base)
+    m_base = min_tick;
+
+  m_slots[level][slot] = NULL;
+  m_bitmap[level][slot >> 6] &= ~(uint64_t(1) << (slot & 63));
+
+  while (head != NULL) {
+    priority_item* next = head->m_next;
+    insert_link(head);
+    head = next;
+  }
+}
+
+inline priority_item*
+timer_wheel::top() {
+  if (m_top != NULL)
+    return m_top;
+
+  if (m_size == 0)
+    return NULL;
+
+  while (true) {
+    // Within the current window each level 0 slot ahead of the base
+    // holds a single tick, so the first occupied one is the earliest.
+    int slot = first_slot(0, m_base & (num_slots - 1));
+
+    if (slot != -1) {
+      m_base = (m_base & ~(int64_t)(num_slots - 1)) | slot;
+      return m_top = slot_min(0, slot);
+    }
+
+    int level = 1;
+
+    for (; level != num_levels; level++) {
+      int from = (m_base >> (level * slot_bits)) & (num_slots - 1);
+      int found = first_slot(level, from);
+
+      if (found == -1)
+        found = first_slot(level, 0);
+
+      if (found == -1)
+        continue;
+
+      cascade(level, found);
+      break;
+    }
+
+    if (level == num_levels) {
+      // Only items lingering behind the base's level 0 slot remain.
+      if (first_slot(0, 0) == -1)
+        throw torrent::internal_error("timer_wheel::top() queue is in an inconsistent state.");
+
+      m_base &= ~(int64_t)(num_slots - 1);
+    }
+  }
+}
+
+inline void
+timer_wheel::push(priority_item* item) {
+  insert_link(item);
+  m_size++;
+
+  if (m_top != NULL && item->time() < m_top->time())
+    m_top = item;
+}
+
+inline bool
+timer_wheel::erase(priority_item* item) {
+  if (!contains(item))
+    return false;
+
+  remove_link(item);
+  m_size--;
+
+  if (m_top == item)
+    m_top = NULL;
+
+  return true;
+}
+
+// Drop all items without dispatching them, resetting their intrusive
+// hooks so they may be reinserted; the items' own time and slot are
+// left untouched, as with the container clear() this replaces.
+inline void
+timer_wheel::clear() {
+  for (int level = 0; level != num_levels; level++)
+    for (int slot = 0; slot != num_slots; slot++) {
+      priority_item* itr = m_slots[level][slot];
+
+      while (itr != NULL) {
+        priority_item* next = itr->m_next;
+
+        itr->m_next = NULL;
+        itr->m_pprev = NULL;
+        itr->m_wheelSlot = invalid_slot;
+
+        itr = next;
+      }
+    }
+
+  std::memset(m_slots, 0, sizeof(m_slots));
+  std::memset(m_bitmap, 0, sizeof(m_bitmap));
+
+  m_size = 0;
+  m_base = 0;
+  m_top = NULL;
+}
+
+inline void
+timer_wheel::pop() {
+  priority_item* item = top();
+
+  if (item == NULL)
+    throw torrent::internal_error("timer_wheel::pop() called on an empty queue.");
+
+  erase(item);
+}
+
+typedef timer_wheel priority_queue_default;
 
 inline void
 priority_queue_perform(priority_queue_default* queue, timer t) {
@@ -110,7 +386,7 @@ priority_queue_insert(priority_queue_default* queue, priority_item* item, timer
   if (item->is_queued())
     throw torrent::internal_error("priority_queue_insert(...) called on an already queued item.");
 
-  if (queue->find(item) != queue->end())
+  if (queue->contains(item))
     throw torrent::internal_error("priority_queue_insert(...) item found in queue.");
 
   item->set_time(t);
@@ -133,7 +409,7 @@ priority_queue_erase(priority_queue_default* queue, priority_item* item) {
   if (!queue->erase(item))
     throw torrent::internal_error("priority_queue_erase(...) could not find item in queue.");
 
-  if (queue->find(item) != queue->end())
+  if (queue->contains(item))
     throw torrent::internal_error("priority_queue_erase(...) item still in queue.");
 }
 
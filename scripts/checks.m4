@@ -210,6 +210,100 @@ AC_DEFUN([TORRENT_WITH_POSIX_FALLOCATE], [
     ])
 ])
 
+AC_DEFUN([TORRENT_CHECK_IO_URING], [
+  AC_MSG_CHECKING(for io_uring)
+
+  AC_LINK_IFELSE([AC_LANG_SOURCE([
+      #include <liburing.h>
+      int main() {
+        struct io_uring ring;
+        io_uring_queue_init(16, &ring, 0);
+        io_uring_queue_exit(&ring);
+        return 0;
+      }
+      ])],
+    [
+      AC_DEFINE(USE_IO_URING, 1, Use io_uring for async disk I/O.)
+      LIBS="$LIBS -luring"
+      AC_MSG_RESULT(yes)
+    ], [
+      AC_MSG_RESULT(no)
+    ])
+])
+
+AC_DEFUN([TORRENT_WITHOUT_IO_URING], [
+  AC_ARG_WITH(io_uring,
+    AC_HELP_STRING([--without-io_uring], [do not check for io_uring support]),
+    [
+      if test "$withval" = "yes"; then
+        TORRENT_CHECK_IO_URING
+      fi
+    ], [
+        TORRENT_CHECK_IO_URING
+    ])
+])
+
+
+AC_DEFUN([TORRENT_CHECK_SYNC_FILE_RANGE], [
+  AC_MSG_CHECKING(for sync_file_range)
+
+  AC_LINK_IFELSE([AC_LANG_SOURCE([
+      #include <fcntl.h>
+      int main() {
+        sync_file_range(0, 0, 0, SYNC_FILE_RANGE_WRITE);
+        return 0;
+      }
+      ])],
+    [
+      AC_DEFINE(HAVE_SYNC_FILE_RANGE, 1, Have sync_file_range for writeback hints.)
+      AC_MSG_RESULT(yes)
+    ], [
+      AC_MSG_RESULT(no)
+    ])
+])
+
+
+AC_DEFUN([TORRENT_CHECK_SENDFILE], [
+  AC_MSG_CHECKING(for sendfile)
+
+  AC_LINK_IFELSE([AC_LANG_SOURCE([
+      #include <sys/sendfile.h>
+      int main() {
+        off_t offset = 0;
+        sendfile(1, 0, &offset, 0);
+        return 0;
+      }
+      ])],
+    [
+      AC_DEFINE(HAVE_SENDFILE, 1, Have sendfile for file to socket transfers.)
+      AC_MSG_RESULT(yes)
+    ], [
+      AC_MSG_RESULT(no)
+    ])
+])
+
+
+AC_DEFUN([TORRENT_CHECK_MMSG], [
+  AC_MSG_CHECKING(for recvmmsg and sendmmsg)
+
+  AC_LINK_IFELSE([AC_LANG_SOURCE([
+      #define _GNU_SOURCE
+      #include <sys/socket.h>
+      int main() {
+        recvmmsg(0, 0, 0, 0, 0);
+        sendmmsg(0, 0, 0, 0);
+        return 0;
+      }
+      ])],
+    [
+      AC_DEFINE(HAVE_MMSG, 1, Have recvmmsg and sendmmsg for batched datagram transfers.)
+      AC_MSG_RESULT(yes)
+    ], [
+      AC_MSG_RESULT(no)
+    ])
+])
+
+
 AC_DEFUN([TORRENT_CHECK_STATVFS], [
   AC_CHECK_HEADERS(sys/vfs.h sys/statvfs.h sys/statfs.h)
 
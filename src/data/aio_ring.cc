@@ -0,0 +1,182 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2011, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include "aio_ring.h"
+
+#include "torrent/exceptions.h"
+
+namespace torrent {
+
+#ifdef USE_IO_URING
+
+bool
+AioRing::initialize(unsigned int depth) {
+  if (m_active)
+    throw internal_error("AioRing::initialize() called on an active ring.");
+
+  if (io_uring_queue_init(depth, &m_ring, 0) < 0)
+    return false;
+
+  m_active = true;
+  m_pending = 0;
+
+  return true;
+}
+
+void
+AioRing::cleanup() {
+  if (!m_active)
+    return;
+
+  io_uring_queue_exit(&m_ring);
+  m_active = false;
+}
+
+bool
+AioRing::push_read(int fd, void* buffer, uint32_t length, uint64_t offset, void* data) {
+  if (!m_active)
+    return false;
+
+  io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+
+  if (sqe == NULL)
+    return false;
+
+  io_uring_prep_read(sqe, fd, buffer, length, offset);
+  io_uring_sqe_set_data(sqe, data);
+
+  if (io_uring_submit(&m_ring) < 0)
+    return false;
+
+  m_pending++;
+  return true;
+}
+
+bool
+AioRing::push_write(int fd, const void* buffer, uint32_t length, uint64_t offset, void* data) {
+  if (!m_active)
+    return false;
+
+  io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+
+  if (sqe == NULL)
+    return false;
+
+  io_uring_prep_write(sqe, fd, buffer, length, offset);
+  io_uring_sqe_set_data(sqe, data);
+
+  if (io_uring_submit(&m_ring) < 0)
+    return false;
+
+  m_pending++;
+  return true;
+}
+
+unsigned int
+AioRing::perform() {
+  if (!m_active)
+    return 0;
+
+  unsigned int count = 0;
+  io_uring_cqe* cqe;
+
+  while (io_uring_peek_cqe(&m_ring, &cqe) == 0) {
+    void* data = io_uring_cqe_get_data(cqe);
+    int result = cqe->res;
+
+    io_uring_cqe_seen(&m_ring, cqe);
+    m_pending--;
+    count++;
+
+    if (m_slot_request_done)
+      m_slot_request_done(data, result);
+  }
+
+  return count;
+}
+
+unsigned int
+AioRing::perform_wait() {
+  if (!m_active || m_pending == 0)
+    return 0;
+
+  // A failed wait is usually just an interrupted syscall; the caller
+  // loops on its pending count either way.
+  io_uring_cqe* cqe;
+  io_uring_wait_cqe(&m_ring, &cqe);
+
+  return perform();
+}
+
+#else
+
+// Stubbed out when built without liburing; callers check is_active()
+// or the return value of push_* and use the synchronous path.
+
+bool
+AioRing::initialize(unsigned int) {
+  return false;
+}
+
+void
+AioRing::cleanup() {
+}
+
+bool
+AioRing::push_read(int, void*, uint32_t, uint64_t, void*) {
+  return false;
+}
+
+bool
+AioRing::push_write(int, const void*, uint32_t, uint64_t, void*) {
+  return false;
+}
+
+unsigned int
+AioRing::perform() {
+  return 0;
+}
+
+unsigned int
+AioRing::perform_wait() {
+  return 0;
+}
+
+#endif
+
+}
@@ -0,0 +1,105 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2011, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_DATA_AIO_RING_H
+#define LIBTORRENT_DATA_AIO_RING_H
+
+#include "config.h"
+
+#include <cinttypes>
+#include <functional>
+
+#ifdef USE_IO_URING
+#include <liburing.h>
+#endif
+
+namespace torrent {
+
+// Wrapper around an io_uring submission/completion queue pair, owned
+// by the disk thread. When io_uring is not available, or
+// initialization fails at runtime (e.g. old kernel), push_read and
+// push_write return false and the caller is expected to fall back to
+// SocketFile's synchronous pread/pwrite path.
+
+class AioRing {
+public:
+  static const unsigned int default_depth = 64;
+
+  typedef std::function<void (void*, int)> slot_aio_result;
+
+  AioRing() : m_active(false), m_pending(0) {}
+  ~AioRing() { cleanup(); }
+
+  bool                is_active() const  { return m_active; }
+
+  unsigned int        pending() const    { return m_pending; }
+
+  bool                initialize(unsigned int depth = default_depth);
+  void                cleanup();
+
+  // Submission may fail when the queue is full; the caller retains
+  // ownership of the buffer until the completion slot is called with
+  // the same data pointer.
+  bool                push_read(int fd, void* buffer, uint32_t length, uint64_t offset, void* data);
+  bool                push_write(int fd, const void* buffer, uint32_t length, uint64_t offset, void* data);
+
+  // Reap and dispatch any finished requests, returning the number
+  // handled. Does not block.
+  unsigned int        perform();
+
+  // As perform(), but blocks until at least one completion is ready
+  // when requests are pending.
+  unsigned int        perform_wait();
+
+  slot_aio_result&    slot_request_done() { return m_slot_request_done; }
+
+private:
+  AioRing(const AioRing&);
+  void operator = (const AioRing&);
+
+  bool                m_active;
+  unsigned int        m_pending;
+
+  slot_aio_result     m_slot_request_done;
+
+#ifdef USE_IO_URING
+  io_uring            m_ring;
+#endif
+};
+
+}
+
+#endif
@@ -43,9 +43,11 @@
 #include <csetjmp>
 
 #include "torrent/exceptions.h"
+#include "torrent/chunk_manager.h"
 
 #include "chunk.h"
 #include "chunk_iterator.h"
+#include "manager.h"
 
 jmp_buf jmp_disk_full;
 
@@ -58,6 +60,19 @@ bus_handler(int sig, siginfo_t *si, void *vuctx)
 
 namespace torrent {
 
+void*
+Chunk::operator new(size_t size) {
+  if (size != sizeof(Chunk))
+    throw internal_error("Chunk::operator new(...) size != sizeof(Chunk).");
+
+  return manager->chunk_manager()->chunk_pool()->allocate();
+}
+
+void
+Chunk::operator delete(void* ptr) {
+  manager->chunk_manager()->chunk_pool()->deallocate(ptr);
+}
+
 bool
 Chunk::is_all_valid() const {
   return !empty() && std::find_if(begin(), end(), std::not1(std::mem_fun_ref(&ChunkPart::is_valid))) == end();
@@ -179,6 +194,28 @@ Chunk::sync(int flags) {
   return success;
 }
 
+// Sync only the chunk parts intersecting [first,last>.
+bool
+Chunk::sync(uint32_t first, uint32_t last, int flags) {
+  if (first >= last || last > m_chunkSize)
+    throw internal_error("Chunk::sync(...) received out-of-range input.");
+
+  bool success = true;
+
+  for (iterator itr = at_position(first), itrEnd = end(); itr != itrEnd && itr->position() < last; ++itr) {
+    if (itr->size() == 0)
+      continue;
+
+    uint32_t part_first = std::max(first, itr->position());
+    uint32_t part_last  = std::min(last, itr->position() + itr->size());
+
+    if (!itr->chunk().sync(part_first - itr->position(), part_last - part_first, flags))
+      success = false;
+  }
+
+  return success;
+}
+
 void
 Chunk::preload(uint32_t position, uint32_t length, bool useAdvise) {
   if (position >= m_chunkSize)
@@ -69,6 +69,11 @@ public:
   Chunk() : m_chunkSize(0), m_prot(~0) {}
   ~Chunk() { clear(); }
 
+  // Chunk objects churn with every chunk mapped and unmapped, so they
+  // are allocated from a pool owned by ChunkManager.
+  void* operator new(size_t size);
+  void  operator delete(void* ptr);
+
   bool                is_all_valid() const;
 
   // All permissions are set for empty chunks.
@@ -96,6 +101,7 @@ public:
   uint32_t            incore_length(uint32_t pos, uint32_t length = ~uint32_t());
 
   bool                sync(int flags);
+  bool                sync(uint32_t first, uint32_t last, int flags);
 
   void                preload(uint32_t position, uint32_t length, bool useAdvise);
 
@@ -36,19 +36,30 @@
 
 #include "config.h"
 
+#include <cstring>
+#include <sys/mman.h>
+#include <zlib.h>
 #include <rak/error_number.h>
 #include <rak/functional.h>
 
 #include "torrent/exceptions.h"
 #include "torrent/chunk_manager.h"
+#include "torrent/data/block.h"
+#include "torrent/data/block_list.h"
 #include "torrent/data/download_data.h"
+#include "torrent/data/file.h"
 #include "torrent/utils/log.h"
 #include "utils/instrumentation.h"
+#include "utils/tracepoints.h"
 
 #include "chunk_list.h"
 #include "chunk.h"
 #include "globals.h"
 
+#ifdef HAVE_SYNC_FILE_RANGE
+#include <fcntl.h>
+#endif
+
 #define LT_LOG_THIS(log_level, log_fmt, ...)                              \
   lt_log_print_data(LOG_STORAGE_##log_level, m_data, "chunk_list", log_fmt, __VA_ARGS__);
 
@@ -71,6 +82,35 @@ struct chunk_list_sort_index {
   }
 };
 
+// Sync order priority of a node; the highest priority among the files
+// its parts touch.
+static priority_t
+chunk_list_node_priority(ChunkListNode* node) {
+  priority_t priority = PRIORITY_OFF;
+
+  for (Chunk::iterator itr = node->chunk()->begin(), last = node->chunk()->end(); itr != last; itr++)
+    if (itr->file() != NULL && itr->file()->priority() > priority)
+      priority = itr->file()->priority();
+
+  return priority;
+}
+
+// High-priority files flush ahead of the rest, so their completion
+// waiters and post-download moves aren't stuck behind bulk data.
+// Within a priority class the index order is kept, so the writeback
+// range coalescing still sees contiguous runs.
+struct chunk_list_sort_sync_order {
+  bool operator () (ChunkListNode* node1, ChunkListNode* node2) {
+    priority_t priority1 = chunk_list_node_priority(node1);
+    priority_t priority2 = chunk_list_node_priority(node2);
+
+    if (priority1 != priority2)
+      return priority1 > priority2;
+
+    return node1->index() < node2->index();
+  }
+};
+
 inline bool
 ChunkList::is_queued(ChunkListNode* node) {
   return std::find(m_queue.begin(), m_queue.end(), node) != m_queue.end();
@@ -112,6 +152,11 @@ ChunkList::clear() {
 
   m_queue.clear();
 
+  for (iterator itr = begin(), last = end(); itr != last; ++itr)
+    release_compressed(&*itr);
+
+  m_cache_queue.clear();
+
   if (std::find_if(begin(), end(), std::mem_fun_ref(&ChunkListNode::chunk)) != end())
     throw internal_error("ChunkList::clear() called but a node with a valid chunk was found.");
 
@@ -127,6 +172,33 @@ ChunkList::clear() {
   base_type::clear();
 }
 
+void
+ChunkList::detach_queue_chunks(std::vector<Chunk*>* flush_list) {
+  Queue::iterator split = m_queue.begin();
+
+  for (Queue::iterator itr = m_queue.begin(), last = m_queue.end(); itr != last; ++itr) {
+    ChunkListNode* node = *itr;
+
+    // Nodes someone else still holds a handle to can't be detached,
+    // so leave those queued for the caller to deal with normally.
+    if (node->references() != 1 || node->writable() != 1) {
+      *split++ = node;
+      continue;
+    }
+
+    node->dec_rw();
+
+    flush_list->push_back(node->chunk());
+    node->set_chunk(NULL);
+    node->clear_partial_hash();
+    node->dirty_ranges()->clear();
+
+    m_manager->deallocate(m_chunk_size);
+  }
+
+  m_queue.erase(split, m_queue.end());
+}
+
 ChunkHandle
 ChunkList::get(size_type index, int flags) {
   LT_LOG_THIS(DEBUG, "Get: index:%" PRIu32 " flags:%#x.", index, flags);
@@ -138,6 +210,11 @@ ChunkList::get(size_type index, int flags) {
   int allocate_flags = (flags & get_dont_log) ? ChunkManager::allocate_dont_log : 0;
   int prot_flags = MemoryChunk::prot_read | ((flags & get_writable) ? MemoryChunk::prot_write : 0);
 
+  // A write invalidates the deflated copy kept by the retention tier,
+  // as it no longer matches what the chunk will contain.
+  if (flags & get_writable)
+    release_compressed(node);
+
   if (!node->is_valid()) {
     if (!m_manager->allocate(m_chunk_size, allocate_flags)) {
       LT_LOG_THIS(DEBUG, "Could not allocate: memory:%" PRIu64 " block:%" PRIu32 ".",
@@ -145,7 +222,14 @@ ChunkList::get(size_type index, int flags) {
       return ChunkHandle::from_error(rak::error_number::e_nomem);
     }
 
-    Chunk* chunk = m_slot_create_chunk(index, prot_flags);
+    // Read-only requests for chunks retained by the compressed tier
+    // inflate from RAM instead of faulting cold pages in from disk.
+    Chunk* chunk = inflate_compressed(node);
+
+    if (chunk != NULL)
+      m_manager->inc_stats_compressed_hits();
+    else
+      chunk = m_slot_create_chunk(index, prot_flags);
 
     if (chunk == NULL) {
       rak::error_number current_error = rak::error_number::current();
@@ -160,6 +244,9 @@ ChunkList::get(size_type index, int flags) {
     node->set_chunk(chunk);
     node->set_time_modified(rak::timer());
 
+    if (flags & get_writable)
+      node->init_partial_hash();
+
   } else if (flags & get_writable && !node->chunk()->is_writable()) {
     if (node->blocking() != 0) {
       if ((flags & get_nonblock))
@@ -177,6 +264,7 @@ ChunkList::get(size_type index, int flags) {
 
     node->set_chunk(chunk);
     node->set_time_modified(rak::timer());
+    node->init_partial_hash();
   }
 
   node->inc_references();
@@ -240,6 +328,7 @@ ChunkList::release(ChunkHandle* handle, int release_flags) {
       if (is_queued(handle->object()))
         throw internal_error("ChunkList::release(...) tried to unmap a queued chunk.");
 
+      cache_compressed(handle->object());
       clear_chunk(handle->object(), release_flags);
     }
   }
@@ -254,18 +343,177 @@ ChunkList::clear_chunk(ChunkListNode* node, int flags) {
 
   delete node->chunk();
   node->set_chunk(NULL);
+  node->clear_partial_hash();
+  node->dirty_ranges()->clear();
 
   m_manager->deallocate(m_chunk_size, (flags & get_dont_log) ? ChunkManager::allocate_dont_log : 0);
 }
 
+// Deflate the chunk data into the retention tier before the mapping
+// goes away. Only complete, hash-checked chunks are worth keeping;
+// the deflated copy must mirror what is on disk since a re-request
+// serves it in place of the file. The tail chunk is skipped so the
+// inflated size is always m_chunk_size.
+void
+ChunkList::cache_compressed(ChunkListNode* node) {
+  if (m_manager == NULL || m_manager->compressed_cache_size() == 0 ||
+      node->compressed_data() != NULL || node->compress_failed() ||
+      node->chunk()->chunk_size() != m_chunk_size)
+    return;
+
+  if (m_data == NULL || m_data->completed_bitfield()->empty() ||
+      !m_data->completed_bitfield()->get(node->index()))
+    return;
+
+  uLong bound = compressBound(m_chunk_size);
+  char* scratch = new char[bound];
+
+  z_stream stream;
+  std::memset(&stream, 0, sizeof(stream));
+
+  if (deflateInit(&stream, Z_BEST_SPEED) != Z_OK) {
+    delete [] scratch;
+    return;
+  }
+
+  stream.next_out = (Bytef*)scratch;
+  stream.avail_out = bound;
+
+  // Chunk parts are separate mappings, so stream them through one
+  // deflate context rather than gathering into a bounce buffer.
+  int result = Z_STREAM_END;
+
+  for (Chunk::iterator itr = node->chunk()->begin(), last = node->chunk()->end(); itr != last; itr++) {
+    stream.next_in = (Bytef*)itr->chunk().begin();
+    stream.avail_in = itr->size();
+
+    result = deflate(&stream, itr + 1 == last ? Z_FINISH : Z_NO_FLUSH);
+
+    if (result == Z_STREAM_ERROR || stream.avail_out == 0)
+      break;
+  }
+
+  uint32_t compressed_size = stream.total_out;
+  deflateEnd(&stream);
+
+  // Data that doesn't shrink by at least an eighth isn't worth the
+  // inflate on the other end; remember not to retry it.
+  if (result != Z_STREAM_END || compressed_size >= m_chunk_size - m_chunk_size / 8) {
+    node->set_compress_failed(true);
+    delete [] scratch;
+    return;
+  }
+
+  if (!m_manager->compressed_cache_allocate(compressed_size)) {
+    delete [] scratch;
+    return;
+  }
+
+  char* data = new char[compressed_size];
+  std::memcpy(data, scratch, compressed_size);
+  delete [] scratch;
+
+  node->set_compressed_data(data, compressed_size);
+  m_cache_queue.push_back(node->index());
+
+  LT_LOG_THIS(DEBUG, "Cached compressed: index:%" PRIu32 " size:%" PRIu32 ".", node->index(), compressed_size);
+}
+
+// Inflate the retained copy into an anonymous mapping serving as the
+// chunk. The part carries no File so the sendfile path falls back to
+// writing from the mapping, and a later writable get replaces it with
+// a real file mapping. The copy is kept for the next eviction, which
+// then skips the deflate.
+Chunk*
+ChunkList::inflate_compressed(ChunkListNode* node) {
+  if (node->compressed_data() == NULL)
+    return NULL;
+
+  char* ptr = (char*)mmap(NULL, m_chunk_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+
+  if (ptr == MAP_FAILED)
+    return NULL;
+
+  uLongf inflated_size = m_chunk_size;
+
+  if (uncompress((Bytef*)ptr, &inflated_size, (const Bytef*)node->compressed_data(), node->compressed_size()) != Z_OK ||
+      inflated_size != m_chunk_size) {
+    munmap(ptr, m_chunk_size);
+    release_compressed(node);
+    return NULL;
+  }
+
+  Chunk* chunk = new Chunk;
+  chunk->push_back(ChunkPart::MAPPED_MMAP, MemoryChunk(ptr, ptr, ptr + m_chunk_size, MemoryChunk::prot_read, MAP_PRIVATE | MAP_ANON));
+
+  return chunk;
+}
+
+void
+ChunkList::release_compressed(ChunkListNode* node) {
+  if (node->compressed_data() == NULL)
+    return;
+
+  if (m_manager != NULL)
+    m_manager->compressed_cache_deallocate(node->compressed_size());
+
+  delete [] node->compressed_data();
+  node->set_compressed_data(NULL, 0);
+}
+
+bool
+ChunkList::evict_compressed() {
+  while (!m_cache_queue.empty()) {
+    ChunkListNode* node = &base_type::at(m_cache_queue.front());
+    m_cache_queue.pop_front();
+
+    if (node->compressed_data() == NULL)
+      continue;
+
+    release_compressed(node);
+    return true;
+  }
+
+  return false;
+}
+
 inline bool
 ChunkList::sync_chunk(ChunkListNode* node, std::pair<int,bool> options) {
   if (node->references() <= 0 || node->writable() <= 0)
     throw internal_error("ChunkList::sync_chunk(...) got a node with invalid reference count.");
 
-  if (!node->chunk()->sync(options.first))
+  rak::timer sync_started = rak::timer::current();
+
+  bool sync_success;
+  uint32_t sync_bytes = 0;
+
+  // Flush only the byte ranges written since the last sync when they
+  // have been tracked, cutting write amplification for sparse endgame
+  // writes; an empty set means we can't tell and sync the whole chunk.
+  if (!node->dirty_ranges()->empty()) {
+    sync_success = true;
+
+    for (ranges<uint32_t>::iterator itr = node->dirty_ranges()->begin(), last = node->dirty_ranges()->end(); itr != last; itr++) {
+      if (!node->chunk()->sync(itr->first, itr->second, options.first))
+        sync_success = false;
+
+      sync_bytes += itr->second - itr->first;
+    }
+
+    if (sync_success)
+      node->dirty_ranges()->clear();
+
+  } else {
+    sync_success = node->chunk()->sync(options.first);
+    sync_bytes = node->chunk()->chunk_size();
+  }
+
+  if (!sync_success)
     return false;
 
+  if (m_data != NULL)
+    m_data->add_synced(sync_bytes, (rak::timer::current() - sync_started).usec());
+
   node->set_sync_triggered(true);
 
   // When returning here we're not properly deallocating the piece.
@@ -285,6 +533,7 @@ ChunkList::sync_chunk(ChunkListNode* node, std::pair<int,bool> options) {
 uint32_t
 ChunkList::sync_chunks(int flags) {
   LT_LOG_THIS(DEBUG, "Sync chunks: flags:%#x.", flags);
+  LT_SDT2(chunk_sync_begin, m_queue.size(), flags);
 
   Queue::iterator split;
 
@@ -299,8 +548,8 @@ ChunkList::sync_chunks(int flags) {
   // How does this interact with timers, should be make it so that
   // only areas with timers are (preferably) synced?
 
-  std::sort(split, m_queue.end());
-  
+  std::sort(split, m_queue.end(), chunk_list_sort_sync_order());
+
   // If we got enough diskspace and have not requested safe syncing,
   // then sync all chunks with MS_ASYNC.
   if (!(flags & (sync_safe | sync_sloppy))) {
@@ -314,6 +563,10 @@ ChunkList::sync_chunks(int flags) {
   if ((flags & sync_use_timeout) && !(flags & sync_force))
     split = partition_optimize(split, m_queue.end(), 50, 5, false);
 
+#ifdef LT_INSTRUMENTATION
+  rak::timer sync_start = rak::timer::current();
+#endif
+
   uint32_t failed = 0;
 
   for (Queue::iterator itr = split, last = m_queue.end(); itr != last; ++itr) {
@@ -340,6 +593,14 @@ ChunkList::sync_chunks(int flags) {
       std::iter_swap(itr, split++);
   }
 
+  sync_file_ranges(split, m_queue.end());
+
+#ifdef LT_INSTRUMENTATION
+  instrumentation_record(INSTRUMENTATION_HISTOGRAM_SYNC_LATENCY, (rak::timer::current() - sync_start).usec());
+#endif
+
+  LT_SDT2(chunk_sync_end, std::distance(split, m_queue.end()), failed);
+
   if (lt_log_is_valid(LOG_INSTRUMENTATION_MINCORE)) {
     instrumentation_update(INSTRUMENTATION_MINCORE_SYNC_SUCCESS, std::distance(split, m_queue.end()));
     instrumentation_update(INSTRUMENTATION_MINCORE_SYNC_FAILED, failed);
@@ -357,6 +618,121 @@ ChunkList::sync_chunks(int flags) {
   return failed;
 }
 
+uint64_t
+ChunkList::sample_residency() {
+  uint64_t total = 0;
+
+  for (iterator itr = base_type::begin(), last = base_type::end(); itr != last; itr++) {
+    if (!itr->is_valid())
+      continue;
+
+    uint32_t resident = itr->chunk()->incore_length(0, itr->chunk()->chunk_size());
+
+    itr->set_resident_size(resident);
+    itr->set_time_sampled(cachedTime);
+
+    total += resident;
+  }
+
+  return total;
+}
+
+void
+ChunkList::hash_advance(ChunkListNode* node, BlockList* block_list) {
+  if (node == NULL || !node->is_valid() ||
+      node->hashed_position() == ChunkListNode::invalid_position || block_list == NULL)
+    return;
+
+  uint32_t pos = node->hashed_position();
+
+  BlockList::iterator itr = block_list->begin();
+
+  while (itr != block_list->end() && itr->piece().offset() + itr->piece().length() <= pos)
+    itr++;
+
+  for (; itr != block_list->end() && itr->is_finished() && itr->piece().offset() == pos; itr++) {
+    uint32_t length = itr->piece().length();
+
+    while (length != 0) {
+      Chunk::iterator citr = node->chunk()->at_position(pos);
+
+      uint32_t l = std::min(length, citr->size() - (pos - citr->position()));
+
+      node->partial_hash()->update(citr->chunk().begin() + (pos - citr->position()), l);
+
+      pos    += l;
+      length -= l;
+    }
+  }
+
+  node->set_hashed_position(pos);
+}
+
+// The queue tail is sorted by priority class and index at this point,
+// so adjacent dirty chunks form contiguous runs within each backing
+// file. Coalesce the runs and hand the kernel one writeback hint per
+// run, rather than letting it discover the sequentiality from
+// per-chunk msync calls.
+#ifdef HAVE_SYNC_FILE_RANGE
+static inline void
+chunk_list_flush_range(File* file, uint64_t begin, uint64_t end, bool drop_behind) {
+  sync_file_range(file->file_descriptor(), begin, end - begin, SYNC_FILE_RANGE_WRITE);
+
+  // Only clean pages are evicted; whatever is still dirty gets
+  // dropped on a later sync round.
+  if (drop_behind)
+    posix_fadvise(file->file_descriptor(), begin, end - begin, POSIX_FADV_DONTNEED);
+}
+#endif
+
+void
+ChunkList::sync_file_ranges(Queue::iterator first, Queue::iterator last) {
+#ifdef HAVE_SYNC_FILE_RANGE
+  File*    file = NULL;
+  bool     drop = false;
+  uint64_t range_begin = 0;
+  uint64_t range_end = 0;
+
+  for (; first != last; first++) {
+    if (!(*first)->is_valid())
+      continue;
+
+    // For write-once downloads only drop chunks that have passed the
+    // hash check, so a pending check doesn't fault the pages straight
+    // back in. Memory pressure forces drop-behind regardless of the
+    // configured setting; evicting written data beats the OOM killer.
+    bool node_drop = m_manager->write_drop_behind() ||
+      m_manager->is_memory_pressured() ||
+      (m_data != NULL && m_data->is_write_once() &&
+       !m_data->completed_bitfield()->empty() && m_data->completed_bitfield()->get((*first)->index()));
+
+    for (Chunk::iterator itr = (*first)->chunk()->begin(), part_last = (*first)->chunk()->end(); itr != part_last; itr++) {
+      if (itr->file() == NULL || !itr->file()->is_open())
+        continue;
+
+      uint64_t part_begin = itr->file_offset();
+      uint64_t part_end   = part_begin + itr->size();
+
+      if (itr->file() == file && part_begin == range_end && node_drop == drop) {
+        range_end = part_end;
+        continue;
+      }
+
+      if (file != NULL)
+        chunk_list_flush_range(file, range_begin, range_end, drop);
+
+      file = itr->file();
+      drop = node_drop;
+      range_begin = part_begin;
+      range_end = part_end;
+    }
+  }
+
+  if (file != NULL)
+    chunk_list_flush_range(file, range_begin, range_end, drop);
+#endif
+}
+
 std::pair<int, bool>
 ChunkList::sync_options(ChunkListNode* node, int flags) {
   // Using if statements since some linkers have problem with static
@@ -401,9 +777,18 @@ ChunkList::seek_range(Queue::iterator first, Queue::iterator last) {
 
 inline bool
 ChunkList::check_node(ChunkListNode* node) {
-  return
-    node->time_modified() != rak::timer() &&
-    node->time_modified() + rak::timer::from_seconds(m_manager->timeout_sync()) < cachedTime;
+  if (node->time_modified() == rak::timer())
+    return false;
+
+  // High-priority file data syncs on half the usual timeout, so its
+  // ranges aren't skipped by the optimizer while completion waiters
+  // sit on them.
+  uint32_t timeout = m_manager->timeout_sync();
+
+  if (chunk_list_node_priority(node) == PRIORITY_HIGH)
+    timeout /= 2;
+
+  return node->time_modified() + rak::timer::from_seconds(timeout) < cachedTime;
 }
 
 // Optimize the selection of chunks to sync. Continuous regions are
@@ -37,6 +37,7 @@
 #ifndef LIBTORRENT_DATA_CHUNK_LIST_H
 #define LIBTORRENT_DATA_CHUNK_LIST_H
 
+#include <deque>
 #include <functional>
 #include <string>
 #include <vector>
@@ -47,6 +48,7 @@
 
 namespace torrent {
 
+class BlockList;
 class ChunkManager;
 class Content;
 class download_data;
@@ -124,6 +126,26 @@ public:
   // Returns the number of failed syncs.
   uint32_t            sync_chunks(int flags);
 
+  // Hand over the chunks of the queued dirty nodes whose only
+  // remaining reference is the sync queue itself, releasing the nodes
+  // as if they were synced. The caller takes ownership of the chunks
+  // and must sync and delete them; nodes still referenced elsewhere
+  // stay queued.
+  void                detach_queue_chunks(std::vector<Chunk*>* flush_list);
+
+  // Sample mincore residency over the valid nodes, caching the result
+  // per node and returning the total number of resident bytes.
+  uint64_t            sample_residency();
+
+  // Advance the node's incremental hash over blocks that have become
+  // contiguously finished, while the data is still hot in cache.
+  void                hash_advance(ChunkListNode* node, BlockList* block_list);
+
+  // Drop the oldest deflated chunk copy; called by ChunkManager when
+  // the compressed cache tier is over budget. Returns false if this
+  // list has nothing left to drop.
+  bool                evict_compressed();
+
   slot_string&        slot_storage_error()  { return m_slot_storage_error; }
   slot_chunk_index&   slot_create_chunk()   { return m_slot_create_chunk; }
   slot_value&         slot_free_diskspace() { return m_slot_free_diskspace; }
@@ -138,8 +160,17 @@ private:
   inline void         clear_chunk(ChunkListNode* node, int flags = 0);
   inline bool         sync_chunk(ChunkListNode* node, std::pair<int,bool> options);
 
+  // The compressed retention tier; complete chunks deflate a copy of
+  // their data on eviction and read-only gets inflate it into an
+  // anonymous mapping, trading cheap CPU for avoided seeks.
+  void                cache_compressed(ChunkListNode* node);
+  Chunk*              inflate_compressed(ChunkListNode* node);
+  void                release_compressed(ChunkListNode* node);
+
   Queue::iterator     partition_optimize(Queue::iterator first, Queue::iterator last, int weight, int maxDistance, bool dontSkip);
 
+  void                sync_file_ranges(Queue::iterator first, Queue::iterator last);
+
   inline Queue::iterator seek_range(Queue::iterator first, Queue::iterator last);
   inline bool            check_node(ChunkListNode* node);
 
@@ -149,6 +180,10 @@ private:
   ChunkManager*       m_manager;
   Queue               m_queue;
 
+  // Eviction order for the deflated copies; entries whose node has
+  // since lost its copy are skipped lazily.
+  std::deque<size_type> m_cache_queue;
+
   int                 m_flags;
   uint32_t            m_chunk_size;
 
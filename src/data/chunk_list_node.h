@@ -40,6 +40,9 @@
 #include <cinttypes>
 #include <rak/timer.h>
 
+#include "torrent/utils/ranges.h"
+#include "utils/sha1.h"
+
 namespace torrent {
 
 class Chunk;
@@ -53,7 +56,8 @@ class Chunk;
 
 class lt_cacheline_aligned ChunkListNode {
 public:
-  static const uint32_t invalid_index = ~uint32_t();
+  static const uint32_t invalid_index    = ~uint32_t();
+  static const uint32_t invalid_position = ~uint32_t();
 
   ChunkListNode() :
     m_index(invalid_index),
@@ -61,7 +65,12 @@ public:
     m_references(0),
     m_writable(0),
     m_blocking(0),
-    m_asyncTriggered(false) {}
+    m_asyncTriggered(false),
+    m_residentSize(0),
+    m_hashedPosition(invalid_position),
+    m_compressedData(NULL),
+    m_compressedSize(0),
+    m_compressFailed(false) {}
 
   bool                is_valid() const               { return m_chunk != NULL; }
 
@@ -77,6 +86,40 @@ public:
   const rak::timer&   time_preloaded() const           { return m_timePreloaded; }
   void                set_time_preloaded(rak::timer t) { m_timePreloaded = t; }
 
+  // Bytes found resident by the last mincore sampling pass.
+  uint32_t            resident_size() const            { return m_residentSize; }
+  void                set_resident_size(uint32_t size) { m_residentSize = size; }
+
+  const rak::timer&   time_sampled() const             { return m_timeSampled; }
+  void                set_time_sampled(rak::timer t)   { m_timeSampled = t; }
+
+  // Byte ranges written since the last successful sync; syncing
+  // flushes only these instead of the whole chunk.
+  ranges<uint32_t>*   dirty_ranges()                   { return &m_dirtyRanges; }
+  void                mark_dirty(uint32_t first, uint32_t last) { m_dirtyRanges.insert(first, last); }
+
+  // Incremental hash state advanced over contiguous finished blocks
+  // while the chunk is being downloaded; invalid_position when no
+  // partial state is being kept.
+  Sha1*               partial_hash()                   { return &m_partialHash; }
+
+  uint32_t            hashed_position() const          { return m_hashedPosition; }
+  void                set_hashed_position(uint32_t p)  { m_hashedPosition = p; }
+
+  void                init_partial_hash()              { m_partialHash.init(); m_hashedPosition = 0; }
+  void                clear_partial_hash()             { m_hashedPosition = invalid_position; }
+
+  // Deflated copy of the chunk data retained past eviction, so a
+  // re-request can inflate from RAM instead of seeking the disk.
+  // Owned and accounted for by ChunkList.
+  char*               compressed_data() const        { return m_compressedData; }
+  uint32_t            compressed_size() const        { return m_compressedSize; }
+  void                set_compressed_data(char* data, uint32_t size) { m_compressedData = data; m_compressedSize = size; }
+
+  // Chunks that deflated poorly aren't retried on every eviction.
+  bool                compress_failed() const        { return m_compressFailed; }
+  void                set_compress_failed(bool state) { m_compressFailed = state; }
+
   bool                sync_triggered() const         { return m_asyncTriggered; }
   void                set_sync_triggered(bool v)     { m_asyncTriggered = v; }
 
@@ -107,6 +150,18 @@ private:
 
   rak::timer          m_timeModified;
   rak::timer          m_timePreloaded;
+
+  uint32_t            m_residentSize;
+  rak::timer          m_timeSampled;
+
+  Sha1                m_partialHash;
+  uint32_t            m_hashedPosition;
+
+  ranges<uint32_t>    m_dirtyRanges;
+
+  char*               m_compressedData;
+  uint32_t            m_compressedSize;
+  bool                m_compressFailed;
 };
 
 }
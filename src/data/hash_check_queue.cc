@@ -38,23 +38,135 @@
 
 #include "hash_check_queue.h"
 
+#include <cstdlib>
+#include <sys/mman.h>
+
+#include "data/aio_ring.h"
 #include "data/hash_chunk.h"
+#include "torrent/data/file.h"
 #include "torrent/hash_string.h"
 #include "utils/instrumentation.h"
+#include "utils/tracepoints.h"
 
 namespace torrent {
 
-HashCheckQueue::HashCheckQueue() {
+HashCheckQueue::HashCheckQueue() :
+  m_aio_ring(NULL) {
   pthread_mutex_init(&m_lock, NULL);
 }
 
 HashCheckQueue::~HashCheckQueue() {
   pthread_mutex_destroy(&m_lock);
+
+  for (buffer_pool_type::iterator itr = m_buffer_pool.begin(), last = m_buffer_pool.end(); itr != last; itr++) {
+    munlock(itr->second, itr->first);
+    free(itr->second);
+  }
+}
+
+char*
+HashCheckQueue::acquire_buffer(uint32_t size) {
+  for (buffer_pool_type::iterator itr = m_buffer_pool.begin(), last = m_buffer_pool.end(); itr != last; itr++) {
+    if (itr->first != size)
+      continue;
+
+    char* buffer = itr->second;
+    m_buffer_pool.erase(itr);
+
+    return buffer;
+  }
+
+  char* buffer = NULL;
+
+  if (posix_memalign((void**)&buffer, MemoryChunk::page_size(), size) != 0)
+    throw internal_error("HashCheckQueue::acquire_buffer(...) could not allocate buffer.");
+
+  // Pinning is best effort; an unpinned buffer still works, it just
+  // may fault during hashing if memory is tight.
+  mlock(buffer, size);
+
+  return buffer;
+}
+
+void
+HashCheckQueue::release_buffer(char* buffer, uint32_t size) {
+  if (m_buffer_pool.size() >= max_pool_buffers) {
+    munlock(buffer, size);
+    free(buffer);
+    return;
+  }
+
+  m_buffer_pool.push_back(buffer_pool_type::value_type(size, buffer));
+}
+
+// Queue aio reads covering the whole chunk into a pool buffer. Leaves
+// entry->buffer NULL when the chunk should go through the synchronous
+// paths instead.
+void
+HashCheckQueue::prefetch_start(prefetch_entry* entry, HashChunk* hash_chunk) {
+  entry->hash_chunk = hash_chunk;
+  entry->buffer = NULL;
+  entry->pending = 0;
+  entry->failed = false;
+
+  Chunk* chunk = hash_chunk->chunk()->chunk();
+
+  // Oversized chunks go through the segmented pread path instead so
+  // the prefetch never pins a piece-sized buffer.
+  if (m_aio_ring == NULL || !m_aio_ring->is_active() ||
+      chunk->chunk_size() > max_io_buffer_size ||
+      chunk->incore_length(0) == chunk->chunk_size())
+    return;
+
+  // Submitted reads can't be recalled, so make sure every part has an
+  // open descriptor before queueing anything.
+  for (Chunk::iterator itr = chunk->begin(), last = chunk->end(); itr != last; itr++)
+    if (itr->file() == NULL || !itr->file()->is_open())
+      return;
+
+  entry->buffer = acquire_buffer(chunk->chunk_size());
+
+  for (Chunk::iterator itr = chunk->begin(), last = chunk->end(); itr != last; itr++) {
+    if (itr->size() == 0)
+      continue;
+
+    read_request* request = new read_request;
+    request->entry = entry;
+    request->length = itr->size();
+
+    if (!m_aio_ring->push_read(itr->file()->file_descriptor(), entry->buffer + itr->position(), itr->size(), itr->file_offset(), request)) {
+      delete request;
+      entry->failed = true;
+      break;
+    }
+
+    entry->pending++;
+  }
+}
+
+void
+HashCheckQueue::prefetch_wait(prefetch_entry* entry) {
+  while (entry->pending != 0)
+    m_aio_ring->perform_wait();
+}
+
+void
+HashCheckQueue::receive_read_done(void* data, int result) {
+  read_request* request = static_cast<read_request*>(data);
+
+  // Short reads could be resubmitted, but they only happen on errors
+  // and truncated files; let the synchronous path sort those out.
+  if (result < 0 || (uint32_t)result != request->length)
+    request->entry->failed = true;
+
+  request->entry->pending--;
+
+  delete request;
 }
 
 // Always poke thread_disk after calling this.
 void
-HashCheckQueue::push_back(HashChunk* hash_chunk) {
+HashCheckQueue::push_back(HashChunk* hash_chunk, bool interactive) {
   if (hash_chunk == NULL || !hash_chunk->chunk()->is_loaded() || !hash_chunk->chunk()->is_blocking())
     throw internal_error("Invalid hash chunk passed to HashCheckQueue.");
 
@@ -64,7 +176,10 @@ HashCheckQueue::push_back(HashChunk* hash_chunk) {
   // the chunk) When doing this make sure we verify that the handle is
   // not previously blocked.
 
-  base_type::push_back(hash_chunk);
+  if (interactive)
+    m_interactive.push_back(hash_chunk);
+  else
+    base_type::push_back(hash_chunk);
 
   int64_t size = hash_chunk->chunk()->chunk()->chunk_size();
   instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, 1);
@@ -92,48 +207,142 @@ HashCheckQueue::remove(HashChunk* hash_chunk) {
   pthread_mutex_lock(&m_lock);
 
   bool result;
-  iterator itr = std::find(begin(), end(), hash_chunk);
+  iterator itr = std::find(m_interactive.begin(), m_interactive.end(), hash_chunk);
+
+  if (itr != m_interactive.end()) {
+    m_interactive.erase(itr);
+    result = true;
 
-  if (itr != end()) {
+  } else if ((itr = std::find(begin(), end(), hash_chunk)) != end()) {
     base_type::erase(itr);
     result = true;
 
+  } else {
+    result = false;
+  }
+
+  if (result) {
     int64_t size = hash_chunk->chunk()->chunk()->chunk_size();
     instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, -1);
     instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, -size);
-
-  } else {
-    result = false;
   }
 
   pthread_mutex_unlock(&m_lock);
   return result;
 }
 
+void
+HashCheckQueue::remove_chunks(const std::vector<HashChunk*>& chunks, std::vector<HashChunk*>* removed) {
+  pthread_mutex_lock(&m_lock);
+
+  base_type* lanes[2] = { &m_interactive, this };
+
+  for (unsigned int i = 0; i < 2; i++) {
+    iterator itr = lanes[i]->begin();
+
+    while (itr != lanes[i]->end()) {
+      if (!std::binary_search(chunks.begin(), chunks.end(), *itr)) {
+        itr++;
+        continue;
+      }
+
+      int64_t size = (*itr)->chunk()->chunk()->chunk_size();
+      instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, -1);
+      instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, -size);
+
+      removed->push_back(*itr);
+      itr = lanes[i]->erase(itr);
+    }
+  }
+
+  pthread_mutex_unlock(&m_lock);
+}
+
 void
 HashCheckQueue::perform() {
   pthread_mutex_lock(&m_lock);
 
-  while (!empty()) {
-    HashChunk* hash_chunk = base_type::front();
-    base_type::pop_front();
-    
-    if (!hash_chunk->chunk()->is_loaded())
-      throw internal_error("HashCheckQueue::perform(): !entry.node->is_loaded().");
+  while (!empty() || !m_interactive.empty()) {
+    // Drain a batch of chunks under a single lock acquisition, so
+    // queued work doesn't serialize on the lock against producers
+    // while we hash.
+    HashChunk*   batch[max_batch_size];
+    unsigned int batch_size = 0;
 
-    int64_t size = hash_chunk->chunk()->chunk()->chunk_size();
-    instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, -1);
-    instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, -size);
+    while ((!empty() || !m_interactive.empty()) && batch_size < max_batch_size) {
+      HashChunk* hash_chunk;
+
+      // Interactive checks preempt the bulk rehash backlog, also
+      // between the batches of an ongoing drain.
+      if (!m_interactive.empty()) {
+        hash_chunk = m_interactive.front();
+        m_interactive.pop_front();
+      } else {
+        hash_chunk = base_type::front();
+        base_type::pop_front();
+      }
+
+      if (!hash_chunk->chunk()->is_loaded())
+        throw internal_error("HashCheckQueue::perform(): !entry.node->is_loaded().");
+
+      int64_t size = hash_chunk->chunk()->chunk()->chunk_size();
+      instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_COUNT, -1);
+      instrumentation_update(INSTRUMENTATION_MEMORY_HASHING_CHUNK_USAGE, -size);
+
+      batch[batch_size++] = hash_chunk;
+    }
 
     pthread_mutex_unlock(&m_lock);
 
-    if (!hash_chunk->perform(~uint32_t(), true))
-      throw internal_error("HashCheckQueue::perform(): !hash_chunk->perform(~uint32_t(), true).");
+    // Queue aio reads for every cold chunk in the batch up front, so
+    // the disk works ahead of the hashing and SHA1 doesn't idle on
+    // seeks between chunks.
+    prefetch_entry prefetch[max_batch_size];
+
+    for (unsigned int i = 0; i < batch_size; i++)
+      prefetch_start(&prefetch[i], batch[i]);
+
+    for (unsigned int i = 0; i < batch_size; i++) {
+      HashChunk* hash_chunk = batch[i];
+
+      Chunk* chunk = hash_chunk->chunk()->chunk();
+
+      prefetch_wait(&prefetch[i]);
+
+      if (prefetch[i].buffer != NULL && !prefetch[i].failed) {
+        if (!hash_chunk->perform_prefetched(prefetch[i].buffer, ~uint32_t()))
+          throw internal_error("HashCheckQueue::perform(): !hash_chunk->perform_prefetched(...).");
+
+      } else if (chunk->incore_length(0) != chunk->chunk_size()) {
+        // Cold chunks the ring couldn't read are gathered with pread
+        // into a pool buffer, in buffer-sized segments so huge pieces
+        // hash with bounded memory while the kernel reads ahead.
+        uint32_t buffer_size = chunk->chunk_size() > max_io_buffer_size ? max_io_buffer_size : chunk->chunk_size();
+        char* buffer = acquire_buffer(buffer_size);
+
+        while (hash_chunk->remaining() != 0)
+          if (!hash_chunk->perform_buffer(buffer, buffer_size))
+            throw internal_error("HashCheckQueue::perform(): !hash_chunk->perform_buffer(...).");
+
+        release_buffer(buffer, buffer_size);
+
+      } else if (!hash_chunk->perform(~uint32_t(), true)) {
+        // Freshly downloaded chunks are still resident and hash
+        // straight from the mapping.
+        throw internal_error("HashCheckQueue::perform(): !hash_chunk->perform(~uint32_t(), true).");
+      }
+
+      if (prefetch[i].buffer != NULL)
+        release_buffer(prefetch[i].buffer, chunk->chunk_size());
+
+      HashString hash;
+      hash_chunk->hash_c(hash.data());
+
+      LT_SDT2(hash_chunk_done, hash_chunk->chunk()->index(), chunk->chunk_size());
 
-    HashString hash;
-    hash_chunk->hash_c(hash.data());
+      m_slot_chunk_done(hash_chunk, hash);
+    }
 
-    m_slot_chunk_done(hash_chunk, hash);
     pthread_mutex_lock(&m_lock);
   }
 
@@ -37,14 +37,18 @@
 #ifndef LIBTORRENT_DATA_HASH_CHECK_QUEUE_H
 #define LIBTORRENT_DATA_HASH_CHECK_QUEUE_H
 
+#include <cinttypes>
 #include <deque>
 #include <functional>
+#include <utility>
+#include <vector>
 #include <pthread.h>
 
 #include "rak/allocators.h"
 
 namespace torrent {
 
+class AioRing;
 class HashString;
 class HashChunk;
 
@@ -53,6 +57,18 @@ public:
   typedef std::deque<HashChunk*, rak::cacheline_allocator<HashChunk*> > base_type;
   typedef std::function<void (HashChunk*, const HashString&)>      slot_chunk_handle;
 
+  // Max chunks hashed per lock acquisition in perform().
+  static const unsigned int max_batch_size = 8;
+
+  // Buffers kept pinned between batches; hashing rarely needs more
+  // than the batch pipeline depth, so excess releases are freed.
+  static const unsigned int max_pool_buffers = 4;
+
+  // Largest read buffer; chunks bigger than this are hashed in
+  // buffer-sized segments so torrents with huge pieces don't pin
+  // piece-sized buffers or read a whole piece ahead of the digest.
+  static const uint32_t max_io_buffer_size = (1 << 20);
+
   using base_type::iterator;
 
   using base_type::empty;
@@ -67,17 +83,61 @@ public:
   ~HashCheckQueue();
 
   // Guarded functions for adding new...
-
-  void                push_back(HashChunk* node);
+  //
+  // Interactive chunks, e.g. verification of freshly downloaded
+  // pieces, go on a separate lane that is drained ahead of the bulk
+  // rehash backlog.
+  void                push_back(HashChunk* node, bool interactive);
   void                perform();
 
   bool                remove(HashChunk* node);
 
+  // Erase every queued chunk found in the sorted vector 'chunks' in
+  // one sweep of both lanes, appending the erased chunks to
+  // 'removed'. Chunks not removed are already being hashed.
+  void                remove_chunks(const std::vector<HashChunk*>& chunks, std::vector<HashChunk*>* removed);
+
   slot_chunk_handle&  slot_chunk_done() { return m_slot_chunk_done; }
 
+  // The ring and its completion slot are wired up by the owning
+  // thread_disk; without a ring all chunks go through the synchronous
+  // paths.
+  void                set_aio_ring(AioRing* ring) { m_aio_ring = ring; }
+  void                receive_read_done(void* data, int result);
+
 private:
+  // A chunk being read into a pool buffer ahead of hashing; each
+  // outstanding aio read holds a read_request pointing back here.
+  struct prefetch_entry {
+    HashChunk*      hash_chunk;
+    char*           buffer;
+    uint32_t        pending;
+    bool            failed;
+  };
+
+  struct read_request {
+    prefetch_entry* entry;
+    uint32_t        length;
+  };
+
+  // Free pinned buffers, keyed by the chunk size they were allocated
+  // for. Only touched by the owning disk thread, so no locking.
+  typedef std::vector<std::pair<uint32_t, char*> > buffer_pool_type;
+
+  char*               acquire_buffer(uint32_t size);
+  void                release_buffer(char* buffer, uint32_t size);
+
+  void                prefetch_start(prefetch_entry* entry, HashChunk* hash_chunk);
+  void                prefetch_wait(prefetch_entry* entry);
+
   slot_chunk_handle   m_slot_chunk_done;
   pthread_mutex_t     m_lock;
+
+  // The base deque holds the bulk lane.
+  base_type           m_interactive;
+
+  AioRing*            m_aio_ring;
+  buffer_pool_type    m_buffer_pool;
 };
 
 }
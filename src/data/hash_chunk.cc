@@ -39,9 +39,34 @@
 #include "hash_chunk.h"
 #include "chunk.h"
 #include "chunk_list_node.h"
+#include "socket_file.h"
+
+#include "torrent/data/file.h"
 
 namespace torrent {
 
+void
+HashChunk::set_chunk(ChunkHandle h) {
+  m_chunk = h;
+
+  ChunkListNode* node = h.object();
+
+  // Resume from the incremental hash state advanced while blocks
+  // arrived, so only the out-of-order tail needs to be read back.
+  // Consume the state here, on the main thread, before the disk
+  // thread starts hashing.
+  if (node != NULL && node->hashed_position() != ChunkListNode::invalid_position) {
+    m_position = node->hashed_position();
+    m_hash     = *node->partial_hash();
+
+    node->clear_partial_hash();
+
+  } else {
+    m_position = 0;
+    m_hash.init();
+  }
+}
+
 bool
 HashChunk::perform(uint32_t length, bool force) {
   length = std::min(length, remaining());
@@ -62,6 +87,42 @@ HashChunk::perform(uint32_t length, bool force) {
   return complete;
 }
 
+bool
+HashChunk::perform_buffer(char* buffer, uint32_t length) {
+  length = std::min(length, remaining());
+
+  while (length != 0) {
+    Chunk::iterator itr = m_chunk.chunk()->at_position(m_position);
+
+    uint32_t l = std::min(length, remaining_part(itr, m_position));
+
+    File* file = itr->file();
+
+    // Fall back to hashing from the mapping when the file descriptor
+    // has been closed by the file manager.
+    if (file != NULL && file->is_open() &&
+        SocketFile(file->file_descriptor()).read_chunk(buffer, l, itr->file_offset() + (m_position - itr->position())))
+      m_hash.update(buffer, l);
+    else
+      m_hash.update(itr->chunk().begin() + (m_position - itr->position()), l);
+
+    m_position += l;
+    length     -= l;
+  }
+
+  return true;
+}
+
+bool
+HashChunk::perform_prefetched(const char* buffer, uint32_t length) {
+  length = std::min(length, remaining());
+
+  m_hash.update(buffer + m_position, length);
+  m_position += length;
+
+  return true;
+}
+
 void
 HashChunk::advise_willneed(uint32_t length) {
   if (!m_chunk.is_valid())
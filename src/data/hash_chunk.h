@@ -48,6 +48,13 @@ namespace torrent {
 // This class interface assumes we're always going to check the whole
 // chunk. All we need is control of the (non-)blocking nature, and other
 // stuff related to performance and responsiveness.
+//
+// SHA1 is strictly sequential while blocks arrive out of order from
+// different peers, so set_chunk resumes from the partial state kept
+// on ChunkListNode, advanced over the contiguously finished prefix
+// as blocks arrived; only the out-of-order tail is hashed here.
+// Fresh pieces are additionally queued on the interactive lane so
+// the remaining pass runs while the data is still cached.
 
 class ChunkListNode;
 
@@ -56,7 +63,7 @@ public:
   HashChunk()         {}
   HashChunk(ChunkHandle h)  { set_chunk(h); }
   
-  void                set_chunk(ChunkHandle h)                { m_position = 0; m_chunk = h; m_hash.init(); }
+  void                set_chunk(ChunkHandle h);
 
   ChunkHandle*        chunk()                                 { return &m_chunk; }
   ChunkHandle&        handle()                                { return m_chunk; }
@@ -65,6 +72,15 @@ public:
   // If force is true, then the return value is always true.
   bool                perform(uint32_t length, bool force = true);
 
+  // Hash through a caller-provided buffer using pread instead of the
+  // mapping, for cold chunks where faulting in the mapping one page
+  // at a time dominates.
+  bool                perform_buffer(char* buffer, uint32_t length);
+
+  // Hash from a buffer already populated with the chunk's data at
+  // chunk-relative offsets, e.g. by queued aio reads.
+  bool                perform_prefetched(const char* buffer, uint32_t length);
+
   void                advise_willneed(uint32_t length);
 
   uint32_t            remaining();
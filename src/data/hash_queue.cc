@@ -36,6 +36,7 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <functional>
 #include <rak/functional.h>
 #include <unistd.h>
@@ -51,6 +52,7 @@
 #include "chunk_list_node.h"
 #include "globals.h"
 #include "thread_disk.h"
+#include "utils/instrumentation.h"
 
 #define LT_LOG_DATA(data, log_level, log_fmt, ...)                       \
   lt_log_print_data(LOG_STORAGE_##log_level, data, "hash_queue", log_fmt, __VA_ARGS__);
@@ -80,28 +82,50 @@ struct HashQueueWillneed {
 // everything is in memory, thus we need to throttle.
 
 HashQueue::HashQueue(thread_disk* thread) :
-  m_thread_disk(thread) {
+  m_next_worker(0),
+  m_queued_bytes(0),
+  m_congestion_bytes(64 << 20) {
 
-  pthread_mutex_init(&m_done_chunks_lock, NULL);
-  m_thread_disk->hash_queue()->slot_chunk_done() = std::bind(&HashQueue::chunk_done, this, std::placeholders::_1, std::placeholders::_2);
+  add_worker(thread);
+}
+
+void
+HashQueue::add_worker(thread_disk* thread) {
+  thread->hash_queue()->slot_chunk_done() = std::bind(&HashQueue::chunk_done, this, std::placeholders::_1, std::placeholders::_2);
+  m_workers.push_back(thread);
 }
 
 
 // If we're done immediately, move the chunk to the front of the list so
 // the next work cycle gets stuff done.
 void
-HashQueue::push_back(ChunkHandle handle, HashQueueNode::id_type id, slot_done_type d) {
+HashQueue::push_back(ChunkHandle handle, HashQueueNode::id_type id, slot_done_type d, bool interactive) {
   LT_LOG_DATA(id, DEBUG, "Adding index:%" PRIu32 " to queue.", handle.index());
 
   if (!handle.is_loaded())
     throw internal_error("HashQueue::add(...) received an invalid chunk");
 
   HashChunk* hash_chunk = new HashChunk(handle);
+  instrumentation_alloc(INSTRUMENTATION_ALLOC_DATA, sizeof(HashChunk));
 
   base_type::push_back(HashQueueNode(id, hash_chunk, d));
 
-  m_thread_disk->hash_queue()->push_back(hash_chunk);
-  m_thread_disk->interrupt();
+  HashQueueNode& node = base_type::back();
+  node.set_time_queued(cachedTime);
+
+  // Estimate how much of the chunk will fault in from disk, based on
+  // the last mincore sample if one has been taken.
+  if (handle.object()->time_sampled() != rak::timer())
+    node.set_faulted_bytes(handle.chunk()->chunk_size() -
+                           std::min(handle.object()->resident_size(), handle.chunk()->chunk_size()));
+
+  m_queued_bytes += handle.chunk()->chunk_size();
+  instrumentation_update(INSTRUMENTATION_HASH_QUEUE_QUEUED_BYTES, handle.chunk()->chunk_size());
+
+  thread_disk* worker = m_workers[m_next_worker++ % m_workers.size()];
+
+  worker->hash_queue()->push_back(hash_chunk, interactive);
+  worker->interrupt();
 }
 
 bool
@@ -116,33 +140,57 @@ HashQueue::has(HashQueueNode::id_type id, uint32_t index) {
 
 void
 HashQueue::remove(HashQueueNode::id_type id) {
-  iterator itr = begin();
-  
-  while ((itr = std::find_if(itr, end(), rak::equal(id, std::mem_fun_ref(&HashQueueNode::id)))) != end()) {
-    HashChunk *hash_chunk = itr->get_chunk();
+  // Collect every chunk belonging to the download first, then sweep
+  // each worker's queue once, rather than doing a linear scan per
+  // chunk.
+  std::vector<HashChunk*> chunks;
 
-    LT_LOG_DATA(id, DEBUG, "Removing index:%" PRIu32 " from queue.", hash_chunk->handle().index());
+  for (iterator itr = begin(), last = end(); itr != last; itr++)
+    if (itr->id() == id)
+      chunks.push_back(itr->get_chunk());
+
+  if (chunks.empty())
+    return;
+
+  std::sort(chunks.begin(), chunks.end());
+
+  std::vector<HashChunk*> removed;
 
-    thread_base::release_global_lock();
-    bool result = m_thread_disk->hash_queue()->remove(hash_chunk);
-    thread_base::acquire_global_lock();
+  thread_base::release_global_lock();
 
-    // The hash chunk was not found, so we need to wait until the hash
-    // check finishes.
-    if (!result) {
-      pthread_mutex_lock(&m_done_chunks_lock);
-      done_chunks_type::iterator done_itr;
+  for (worker_list_type::iterator witr = m_workers.begin(), last = m_workers.end(); witr != last; witr++)
+    (*witr)->hash_queue()->remove_chunks(chunks, &removed);
 
-      while ((done_itr = m_done_chunks.find(hash_chunk)) == m_done_chunks.end()) {
-        pthread_mutex_unlock(&m_done_chunks_lock);
-        usleep(100);
-        pthread_mutex_lock(&m_done_chunks_lock);
-      }
+  thread_base::acquire_global_lock();
 
-      m_done_chunks.erase(done_itr);
-      pthread_mutex_unlock(&m_done_chunks_lock);
+  std::sort(removed.begin(), removed.end());
+
+  // Chunks not erased from any worker queue are being hashed right
+  // now; wait for their completions to arrive on the done queue.
+  for (std::vector<HashChunk*>::iterator citr = chunks.begin(), clast = chunks.end(); citr != clast; citr++) {
+    if (std::binary_search(removed.begin(), removed.end(), *citr))
+      continue;
+
+    pop_done_chunks();
+
+    while (m_done_chunks.find(*citr) == m_done_chunks.end()) {
+      usleep(100);
+      pop_done_chunks();
     }
 
+    m_done_chunks.erase(*citr);
+  }
+
+  iterator itr = begin();
+
+  while ((itr = std::find_if(itr, end(), rak::equal(id, std::mem_fun_ref(&HashQueueNode::id)))) != end()) {
+    HashChunk *hash_chunk = itr->get_chunk();
+
+    LT_LOG_DATA(id, DEBUG, "Removing index:%" PRIu32 " from queue.", hash_chunk->handle().index());
+
+    m_queued_bytes -= hash_chunk->chunk()->chunk()->chunk_size();
+    instrumentation_update(INSTRUMENTATION_HASH_QUEUE_QUEUED_BYTES, -(int64_t)hash_chunk->chunk()->chunk()->chunk_size());
+
     itr->slot_done()(*hash_chunk->chunk(), NULL);
     itr->clear();
 
@@ -160,10 +208,18 @@ HashQueue::clear() {
 //   base_type::clear();
 }
 
+void
+HashQueue::pop_done_chunks() {
+  done_chunk_type done_chunk;
+
+  while (m_done_queue.pop_front(&done_chunk))
+    m_done_chunks[done_chunk.first] = done_chunk.second;
+}
+
 void
 HashQueue::work() {
-  pthread_mutex_lock(&m_done_chunks_lock);
-    
+  pop_done_chunks();
+
   while (!m_done_chunks.empty()) {
     HashChunk* hash_chunk = m_done_chunks.begin()->first;
     HashString hash_value = m_done_chunks.begin()->second;
@@ -184,24 +240,30 @@ HashQueue::work() {
                 hash_chunk->handle().index(),
                 hash_string_to_hex_str(hash_value).c_str());
 
+    itr->id()->add_hashed((cachedTime - itr->time_queued()).usec(), itr->faulted_bytes());
+    instrumentation_record(INSTRUMENTATION_HISTOGRAM_HASH_QUEUE_RESIDENCE, (cachedTime - itr->time_queued()).usec());
+
+    m_queued_bytes -= hash_chunk->handle().chunk()->chunk_size();
+    instrumentation_update(INSTRUMENTATION_HASH_QUEUE_QUEUED_BYTES, -(int64_t)hash_chunk->handle().chunk()->chunk_size());
+
     HashQueueNode::slot_done_type slotDone = itr->slot_done();
     base_type::erase(itr);
 
     slotDone(hash_chunk->handle(), hash_value.c_str());
     delete hash_chunk;
+    instrumentation_free(INSTRUMENTATION_ALLOC_DATA, sizeof(HashChunk));
   }
-
-  pthread_mutex_unlock(&m_done_chunks_lock);
 }
 
 void
 HashQueue::chunk_done(HashChunk* hash_chunk, const HashString& hash_value) {
-  pthread_mutex_lock(&m_done_chunks_lock);
-
-  m_done_chunks[hash_chunk] = hash_value;
-  m_slot_has_work(m_done_chunks.empty());
+  m_done_queue.push_back(done_chunk_type(hash_chunk, hash_value));
 
-  pthread_mutex_unlock(&m_done_chunks_lock);
+  // Runs on the disk threads, which must not read the consumer-owned
+  // head of the queue to decide whether an interrupt is needed; ask
+  // for one every time and let the interrupt object coalesce repeat
+  // pokes with a single compare-and-swap.
+  m_slot_has_work(true);
 }
 
 }
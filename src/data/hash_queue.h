@@ -40,9 +40,11 @@
 #include <deque>
 #include <functional>
 #include <map>
-#include <pthread.h>
+#include <utility>
+#include <vector>
 
 #include "torrent/hash_string.h"
+#include "utils/queue_mpsc.h"
 #include "hash_queue_node.h"
 #include "chunk_handle.h"
 
@@ -60,7 +62,10 @@ class thread_disk;
 class lt_cacheline_aligned HashQueue : private std::deque<HashQueueNode> {
 public:
   typedef std::deque<HashQueueNode>                 base_type;
+  typedef std::pair<HashChunk*, torrent::HashString> done_chunk_type;
   typedef std::map<HashChunk*, torrent::HashString> done_chunks_type;
+  typedef queue_mpsc<done_chunk_type>               done_queue_type;
+  typedef std::vector<thread_disk*>                 worker_list_type;
 
   typedef HashQueueNode::slot_done_type   slot_done_type;
   typedef std::function<void (bool)> slot_bool;
@@ -76,9 +81,16 @@ public:
   using base_type::back;
 
   HashQueue(thread_disk* thread);
-  ~HashQueue() { clear(); pthread_mutex_destroy(&m_done_chunks_lock); }
+  ~HashQueue() { clear(); }
 
-  void                push_back(ChunkHandle handle, HashQueueNode::id_type id, slot_done_type d);
+  // Additional disk threads registered here get chunks distributed
+  // round-robin; must be called before any chunks are queued.
+  void                add_worker(thread_disk* thread);
+
+  // Interactive checks, e.g. freshly downloaded pieces, go on a
+  // priority lane in the disk threads and preempt any bulk rehash
+  // backlog.
+  void                push_back(ChunkHandle handle, HashQueueNode::id_type id, slot_done_type d, bool interactive);
 
   bool                has(HashQueueNode::id_type id);
   bool                has(HashQueueNode::id_type id, uint32_t index);
@@ -88,17 +100,34 @@ public:
 
   void                work();
 
+  // Bytes queued for verification but not yet passed back to their
+  // owners. Above the congestion threshold the request pipelines
+  // hold back so chunk memory gets reclaimed before the ceiling is
+  // hit; the threshold tracks ChunkManager's memory limit.
+  uint64_t            queued_bytes() const            { return m_queued_bytes; }
+  bool                is_congested() const            { return m_queued_bytes > m_congestion_bytes; }
+
+  uint64_t            congestion_bytes() const        { return m_congestion_bytes; }
+  void                set_congestion_bytes(uint64_t b) { m_congestion_bytes = b; }
+
   slot_bool&          slot_has_work() { return m_slot_has_work; }
 
 private:
   void                chunk_done(HashChunk* hash_chunk, const HashString& hash_value);
+  void                pop_done_chunks();
+
+  worker_list_type    m_workers;
+  unsigned int        m_next_worker;
 
-  thread_disk*        m_thread_disk;
+  uint64_t            m_queued_bytes;
+  uint64_t            m_congestion_bytes;
 
+  // Disk threads push completed chunks onto the lock-free queue; only
+  // the main thread moves them into m_done_chunks.
   done_chunks_type    m_done_chunks;
   slot_bool           m_slot_has_work;
 
-  pthread_mutex_t     m_done_chunks_lock lt_cacheline_aligned;
+  done_queue_type     m_done_queue lt_cacheline_aligned;
 };
 
 }
@@ -39,6 +39,7 @@
 #include "hash_chunk.h"
 #include "hash_queue_node.h"
 #include "chunk_list_node.h"
+#include "utils/instrumentation.h"
 
 namespace torrent {
 
@@ -49,6 +50,9 @@ HashQueueNode::get_index() const {
 
 void
 HashQueueNode::clear() {
+  if (m_chunk != NULL)
+    instrumentation_free(INSTRUMENTATION_ALLOC_DATA, sizeof(HashChunk));
+
   delete m_chunk;
   m_chunk = NULL;
 }
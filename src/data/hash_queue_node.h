@@ -40,6 +40,7 @@
 #include <cinttypes>
 #include <functional>
 #include <string>
+#include <rak/timer.h>
 
 #include "chunk_handle.h"
 #include "hash_chunk.h"
@@ -54,7 +55,7 @@ public:
   typedef download_data* id_type;
 
   HashQueueNode(id_type id, HashChunk* c, slot_done_type d) :
-    m_id(id), m_chunk(c), m_willneed(false), m_slot_done(d) {}
+    m_id(id), m_chunk(c), m_willneed(false), m_faultedBytes(0), m_slot_done(d) {}
 
   id_type             id() const                    { return m_id; }
   ChunkHandle&        handle()                      { return *m_chunk->chunk(); }
@@ -74,11 +75,22 @@ public:
 
   slot_done_type&     slot_done()                   { return m_slot_done; }
 
+  // Accounting for the owning download; set when queued, harvested
+  // when the finished chunk is passed back.
+  const rak::timer&   time_queued() const           { return m_timeQueued; }
+  void                set_time_queued(rak::timer t) { m_timeQueued = t; }
+
+  uint32_t            faulted_bytes() const         { return m_faultedBytes; }
+  void                set_faulted_bytes(uint32_t b) { m_faultedBytes = b; }
+
 private:
   id_type             m_id;
   HashChunk*          m_chunk;
   bool                m_willneed;
 
+  rak::timer          m_timeQueued;
+  uint32_t            m_faultedBytes;
+
   slot_done_type      m_slot_done;
 };
 
@@ -44,6 +44,7 @@
 #include "hash_torrent.h"
 #include "hash_queue.h"
 #include "globals.h"
+#include "manager.h"
 
 #define LT_LOG_THIS(log_level, log_fmt, ...)                            \
   lt_log_print_data(LOG_STORAGE_##log_level, m_chunk_list->data(), "hash_torrent", log_fmt, __VA_ARGS__);
@@ -52,6 +53,7 @@ namespace torrent {
 
 HashTorrent::HashTorrent(ChunkList* c) :
   m_position(0),
+  m_checked(0),
   m_outstanding(-1),
   m_errno(0),
 
@@ -81,6 +83,7 @@ HashTorrent::clear() {
 
   m_outstanding = -1;
   m_position = 0;
+  m_checked = 0;
   m_errno = 0;
 
   // Correct?
@@ -121,6 +124,10 @@ HashTorrent::receive_chunkdone(uint32_t index) {
   // Make sure we call chunkdone before torrentDone has a chance to
   // trigger.
   m_outstanding--;
+  m_checked++;
+
+  if (m_slot_progress)
+    m_slot_progress(m_checked, m_chunk_list->size());
 
   queue(false);
 }
@@ -149,8 +156,14 @@ HashTorrent::queue(bool quick) {
   if (!is_checking())
     throw internal_error("HashTorrent::queue() called but it's not running.");
 
+  // Keep enough chunks outstanding to feed every worker in the disk
+  // thread pool; the hash queue hands chunks to the workers round
+  // robin, so the range is effectively partitioned across them.
+  int pool_size = 1 + (int)manager->disk_workers()->size();
+
   while (m_position < m_chunk_list->size()) {
-    if (m_outstanding > 10 && m_outstanding * m_chunk_list->chunk_size() > (128 << 20))
+    if (m_outstanding > 10 * pool_size &&
+        m_outstanding * m_chunk_list->chunk_size() > (uint64_t)pool_size * (128 << 20))
       return;
 
     // Not very efficient, but this is seldomly done.
@@ -53,7 +53,8 @@ class HashTorrent {
 public:
   typedef ranges<uint32_t> Ranges;
 
-  typedef std::function<void (ChunkHandle)> slot_chunk_handle;
+  typedef std::function<void (ChunkHandle)>         slot_chunk_handle;
+  typedef std::function<void (uint32_t, uint32_t)>  slot_progress_type;
 
   HashTorrent(ChunkList* c);
   ~HashTorrent() { clear(); }
@@ -74,6 +75,10 @@ public:
 
   slot_chunk_handle&  slot_check_chunk() { return m_slot_check_chunk; }
 
+  // Called after each checked chunk with the number of chunks checked
+  // so far and the total, for progress reporting during long rehashes.
+  slot_progress_type& slot_progress()    { return m_slot_progress; }
+
   rak::priority_item& delay_checked()                        { return m_delayChecked; }
 
   void                receive_chunkdone(uint32_t index);
@@ -83,6 +88,7 @@ private:
   void                queue(bool quick);
 
   unsigned int        m_position;
+  unsigned int        m_checked;
   int                 m_outstanding;
   Ranges              m_ranges;
 
@@ -91,6 +97,7 @@ private:
   ChunkList*          m_chunk_list;
 
   slot_chunk_handle   m_slot_check_chunk;
+  slot_progress_type  m_slot_progress;
 
   rak::priority_item  m_delayChecked;
 };
@@ -71,6 +71,7 @@ const int MemoryChunk::advice_random;
 const int MemoryChunk::advice_sequential;
 const int MemoryChunk::advice_willneed;
 const int MemoryChunk::advice_dontneed;
+const int MemoryChunk::advice_hugepage;
 
 inline void
 MemoryChunk::align_pair(uint32_t* offset, uint32_t* length) const {
@@ -146,6 +147,11 @@ MemoryChunk::advise(uint32_t offset, uint32_t length, int advice) {
   if (madvise(m_ptr + offset, length, advice) == 0)
     return true;
 
+  // Hugepage advice is best effort; older kernels reject it outright
+  // or for file-backed mappings.
+  else if (advice == advice_hugepage)
+    return false;
+
   else if (errno == EINVAL || (errno == ENOMEM && advice != advice_willneed) || errno == EBADF)
     throw internal_error("MemoryChunk::advise(...) " + std::string(strerror(errno)));
   
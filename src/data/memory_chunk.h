@@ -67,6 +67,11 @@ class MemoryChunk {
   static const int advice_sequential      = 2;
   static const int advice_willneed        = 3;
   static const int advice_dontneed        = 4;
+#endif
+#if defined(USE_MADVISE) && defined(MADV_HUGEPAGE)
+  static const int advice_hugepage        = MADV_HUGEPAGE;
+#else
+  static const int advice_hugepage        = 5;
 #endif
   static const int sync_sync              = MS_SYNC;
   static const int sync_async             = MS_ASYNC;
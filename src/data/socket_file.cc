@@ -152,6 +152,48 @@ SocketFile::set_size(uint64_t size, int flags) const {
   return false;
 }
 
+bool
+SocketFile::read_chunk(void* buffer, uint32_t length, uint64_t offset) const {
+  if (!is_open())
+    throw internal_error("SocketFile::read_chunk() called on a closed file");
+
+  char* itr = (char*)buffer;
+
+  while (length != 0) {
+    ssize_t result = pread(m_fd, itr, length, offset);
+
+    if (result <= 0)
+      return false;
+
+    itr += result;
+    offset += result;
+    length -= result;
+  }
+
+  return true;
+}
+
+bool
+SocketFile::write_chunk(const void* buffer, uint32_t length, uint64_t offset) const {
+  if (!is_open())
+    throw internal_error("SocketFile::write_chunk() called on a closed file");
+
+  const char* itr = (const char*)buffer;
+
+  while (length != 0) {
+    ssize_t result = pwrite(m_fd, itr, length, offset);
+
+    if (result <= 0)
+      return false;
+
+    itr += result;
+    offset += result;
+    length -= result;
+  }
+
+  return true;
+}
+
 MemoryChunk
 SocketFile::create_chunk(uint64_t offset, uint32_t length, int prot, int flags) const {
   if (!is_open())
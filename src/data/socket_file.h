@@ -73,7 +73,13 @@ public:
   bool                set_size(uint64_t s, int flags = 0) const;
 
   MemoryChunk         create_chunk(uint64_t offset, uint32_t length, int prot, int flags) const;
-  
+
+  // Synchronous positioned read/write, used as the fallback when the
+  // async ring is unavailable or full. Retries on partial transfers.
+  bool                read_chunk(void* buffer, uint32_t length, uint64_t offset) const;
+  bool                write_chunk(const void* buffer, uint32_t length, uint64_t offset) const;
+
+
   fd_type             fd() const                                        { return m_fd; }
 
 private:
@@ -39,7 +39,8 @@
 
 #include "config.h"
 
-#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "dht_node.h"
 #include "dht_tracker.h"
@@ -94,13 +95,187 @@ struct hashstring_hash : public std::unary_function<HashString, size_t> {
 
 // Compare HashString pointers by dereferencing them.
 struct hashstring_ptr_equal : public std::binary_function<const HashString*, const HashString*, bool> {
-  size_t operator () (const HashString* one, const HashString* two) const 
+  size_t operator () (const HashString* one, const HashString* two) const
   { return *one == *two; }
 };
 
-class DhtNodeList : public std::unordered_map<const HashString*, DhtNode*, hashstring_ptr_hash, hashstring_ptr_equal> {
+// Flat open-addressing table keeping the slots in a contiguous
+// vector, so the lookups done for every DHT packet probe adjacent
+// cache lines instead of walking heap-allocated buckets. The hashed
+// ID bytes are uniformly distributed, keeping the probe runs short.
+template <typename Slot, typename Traits>
+class dht_hash_table {
 public:
-  typedef std::unordered_map<const HashString*, DhtNode*, hashstring_ptr_hash, hashstring_ptr_equal> base_type;
+  typedef Slot        value_type;
+  typedef size_t      size_type;
+
+  static const uint8_t slot_empty  = 0;
+  static const uint8_t slot_used   = 1;
+  static const uint8_t slot_erased = 2;
+
+  template <typename Table, typename Value>
+  class iterator_base {
+  public:
+    iterator_base() : m_table(NULL), m_index(0) {}
+    iterator_base(Table* table, size_type index) : m_table(table), m_index(index) { forward(); }
+
+    template <typename T2, typename V2>
+    iterator_base(const iterator_base<T2, V2>& itr) : m_table(itr.table()), m_index(itr.index()) {}
+
+    Value& operator * () const  { return m_table->slot_at(m_index); }
+    Value* operator -> () const { return &m_table->slot_at(m_index); }
+
+    iterator_base& operator ++ ()    { m_index++; forward(); return *this; }
+    iterator_base  operator ++ (int) { iterator_base tmp = *this; m_index++; forward(); return tmp; }
+
+    template <typename T2, typename V2>
+    bool operator == (const iterator_base<T2, V2>& itr) const { return m_index == itr.index(); }
+    template <typename T2, typename V2>
+    bool operator != (const iterator_base<T2, V2>& itr) const { return m_index != itr.index(); }
+
+    Table*              table() const { return m_table; }
+    size_type           index() const { return m_index; }
+
+  private:
+    void forward() { while (m_index != m_table->bucket_count() && m_table->flag_at(m_index) != slot_used) m_index++; }
+
+    Table*              m_table;
+    size_type           m_index;
+  };
+
+  typedef iterator_base<dht_hash_table, value_type>             iterator;
+  typedef iterator_base<const dht_hash_table, const value_type> const_iterator;
+
+  iterator            begin()       { return iterator(this, 0); }
+  iterator            end()         { return iterator(this, bucket_count()); }
+  const_iterator      begin() const { return const_iterator(this, 0); }
+  const_iterator      end() const   { return const_iterator(this, bucket_count()); }
+
+  bool                empty() const { return m_size == 0; }
+  size_type           size() const  { return m_size; }
+
+  iterator find(const typename Traits::key_type& key) {
+    if (m_flags.empty())
+      return end();
+
+    size_type mask = bucket_count() - 1;
+    size_type idx = Traits::hash(key) & mask;
+
+    while (m_flags[idx] != slot_empty) {
+      if (m_flags[idx] == slot_used && Traits::equal(Traits::key(m_slots[idx]), key))
+        return iterator(this, idx);
+
+      idx = (idx + 1) & mask;
+    }
+
+    return end();
+  }
+
+  std::pair<iterator, bool> insert(const value_type& value) {
+    if (m_flags.empty() || (m_fill + 1) * 4 >= bucket_count() * 3)
+      rebuild();
+
+    size_type mask = bucket_count() - 1;
+    size_type idx = Traits::hash(Traits::key(value)) & mask;
+    size_type insertIdx = bucket_count();
+
+    while (m_flags[idx] != slot_empty) {
+      if (m_flags[idx] == slot_used && Traits::equal(Traits::key(m_slots[idx]), Traits::key(value)))
+        return std::make_pair(iterator(this, idx), false);
+
+      if (m_flags[idx] == slot_erased && insertIdx == bucket_count())
+        insertIdx = idx;
+
+      idx = (idx + 1) & mask;
+    }
+
+    // Reuse the first tombstone passed, else take the empty slot.
+    if (insertIdx == bucket_count()) {
+      insertIdx = idx;
+      m_fill++;
+    }
+
+    m_flags[insertIdx] = slot_used;
+    m_slots[insertIdx] = value;
+    m_size++;
+
+    return std::make_pair(iterator(this, insertIdx), true);
+  }
+
+  void erase(const iterator& itr) {
+    m_flags[itr.index()] = slot_erased;
+    m_size--;
+  }
+
+  // Internal to the iterators.
+  size_type           bucket_count() const          { return m_flags.size(); }
+  uint8_t             flag_at(size_type idx) const  { return m_flags[idx]; }
+  value_type&         slot_at(size_type idx)        { return m_slots[idx]; }
+  const value_type&   slot_at(size_type idx) const  { return m_slots[idx]; }
+
+protected:
+  dht_hash_table() : m_size(0), m_fill(0) {}
+
+private:
+  dht_hash_table(const dht_hash_table&);
+  void operator = (const dht_hash_table&);
+
+  void rebuild() {
+    size_type tableSize = 64;
+
+    while (tableSize < 2 * (m_size + 1))
+      tableSize *= 2;
+
+    std::vector<value_type> used;
+    used.reserve(m_size);
+
+    for (size_type idx = 0, last = bucket_count(); idx != last; idx++)
+      if (m_flags[idx] == slot_used)
+        used.push_back(m_slots[idx]);
+
+    m_flags.assign(tableSize, uint8_t(slot_empty));
+    m_slots.assign(tableSize, value_type());
+    m_fill = m_size;
+
+    size_type mask = tableSize - 1;
+
+    for (typename std::vector<value_type>::iterator itr = used.begin(), last = used.end(); itr != last; itr++) {
+      size_type idx = Traits::hash(Traits::key(*itr)) & mask;
+
+      while (m_flags[idx] != slot_empty)
+        idx = (idx + 1) & mask;
+
+      m_flags[idx] = slot_used;
+      m_slots[idx] = *itr;
+    }
+  }
+
+  size_type               m_size;
+  size_type               m_fill;
+
+  std::vector<uint8_t>    m_flags;
+  std::vector<value_type> m_slots;
+};
+
+struct dht_node_slot_traits {
+  typedef const HashString* key_type;
+
+  static key_type key(const std::pair<const HashString*, DhtNode*>& slot) { return slot.first; }
+  static size_t   hash(key_type k)                                        { return hashstring_ptr_hash()(k); }
+  static bool     equal(key_type one, key_type two)                       { return *one == *two; }
+};
+
+struct dht_tracker_slot_traits {
+  typedef HashString key_type;
+
+  static const key_type& key(const std::pair<HashString, DhtTracker*>& slot) { return slot.first; }
+  static size_t          hash(const key_type& k)                             { return hashstring_hash()(k); }
+  static bool            equal(const key_type& one, const key_type& two)     { return one == two; }
+};
+
+class DhtNodeList : public dht_hash_table<std::pair<const HashString*, DhtNode*>, dht_node_slot_traits> {
+public:
+  typedef dht_hash_table<std::pair<const HashString*, DhtNode*>, dht_node_slot_traits> base_type;
 
   // Define accessor iterator with more convenient access to the key and
   // element values.  Allows changing the map definition more easily if needed.
@@ -119,9 +294,9 @@ public:
 
 };
 
-class DhtTrackerList : public std::unordered_map<HashString, DhtTracker*, hashstring_hash> {
+class DhtTrackerList : public dht_hash_table<std::pair<HashString, DhtTracker*>, dht_tracker_slot_traits> {
 public:
-  typedef std::unordered_map<HashString, DhtTracker*, hashstring_hash> base_type;
+  typedef dht_hash_table<std::pair<HashString, DhtTracker*>, dht_tracker_slot_traits> base_type;
 
   template<typename T>
   struct accessor_wrapper : public T {
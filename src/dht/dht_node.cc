@@ -37,11 +37,14 @@
 #include "config.h"
 #include "globals.h"
 
+#include <vector>
+
 #include "torrent/exceptions.h"
 #include "torrent/object.h"
 #include "torrent/utils/log.h"
 
 #include "net/address_list.h" // For SA.
+#include "utils/instrumentation.h"
 
 #include "dht_node.h"
 
@@ -50,6 +53,59 @@
 
 namespace torrent {
 
+// Node records come from contiguous slabs, with the free list
+// threaded through the unused records. Slabs are kept for reuse if
+// the DHT is stopped and restarted, and released at process exit.
+static const unsigned int dht_nodes_per_slab = 128;
+
+static void* dht_node_free_list = NULL;
+
+struct dht_node_slab_list : public std::vector<char*> {
+  ~dht_node_slab_list() { while (!empty()) { ::operator delete(back()); pop_back(); } }
+};
+
+static dht_node_slab_list dht_node_slabs;
+
+void*
+DhtNode::operator new(std::size_t size) {
+  instrumentation_alloc(INSTRUMENTATION_ALLOC_DHT, size);
+
+  if (size != sizeof(DhtNode))
+    return ::operator new(size);
+
+  if (dht_node_free_list == NULL) {
+    char* slab = static_cast<char*>(::operator new(dht_nodes_per_slab * sizeof(DhtNode)));
+    dht_node_slabs.push_back(slab);
+
+    for (unsigned int i = 0; i < dht_nodes_per_slab; i++) {
+      void* record = slab + i * sizeof(DhtNode);
+      *reinterpret_cast<void**>(record) = dht_node_free_list;
+      dht_node_free_list = record;
+    }
+  }
+
+  void* result = dht_node_free_list;
+  dht_node_free_list = *reinterpret_cast<void**>(result);
+
+  return result;
+}
+
+void
+DhtNode::operator delete(void* ptr, std::size_t size) {
+  if (ptr == NULL)
+    return;
+
+  instrumentation_free(INSTRUMENTATION_ALLOC_DHT, size);
+
+  if (size != sizeof(DhtNode)) {
+    ::operator delete(ptr);
+    return;
+  }
+
+  *reinterpret_cast<void**>(ptr) = dht_node_free_list;
+  dht_node_free_list = ptr;
+}
+
 DhtNode::DhtNode(const HashString& id, const rak::socket_address* sa) :
   HashString(id),
   m_socketAddress(*sa),
@@ -87,6 +143,29 @@ DhtNode::DhtNode(const std::string& id, const Object& cache) :
   update();
 }
 
+DhtNode::DhtNode(const char* cacheRecord) :
+  HashString(*HashString::cast_from(cacheRecord)),
+  m_recentlyActive(false),
+  m_recentlyInactive(0),
+  m_bucket(NULL) {
+
+  SocketAddressCompact compact;
+  std::memcpy(&compact, cacheRecord + HashString::size_data, sizeof(compact));
+
+  rak::socket_address_inet* sa = m_socketAddress.sa_inet();
+
+  sa->set_family();
+  sa->set_address_n(compact.addr);
+  sa->set_port_n(compact.port);
+
+  const unsigned char* stamp = reinterpret_cast<const unsigned char*>(cacheRecord) + HashString::size_data + sizeof(compact);
+  m_lastSeen = (stamp[0] << 24) | (stamp[1] << 16) | (stamp[2] << 8) | stamp[3];
+
+  LT_LOG_THIS("initializing (address:%s)", sa->address_str().c_str());
+
+  update();
+}
+
 char*
 DhtNode::store_compact(char* buffer) const {
   HashString::cast_from(buffer)->assign(data());
@@ -97,6 +176,18 @@ DhtNode::store_compact(char* buffer) const {
   return buffer + 26;
 }
 
+char*
+DhtNode::store_cache_record(char* buffer) const {
+  buffer = store_compact(buffer);
+
+  *buffer++ = m_lastSeen >> 24;
+  *buffer++ = m_lastSeen >> 16;
+  *buffer++ = m_lastSeen >> 8;
+  *buffer++ = m_lastSeen;
+
+  return buffer;
+}
+
 Object*
 DhtNode::store_cache(Object* container) const {
   if (m_socketAddress.family() == rak::socket_address::af_inet6) {
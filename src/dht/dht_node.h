@@ -57,8 +57,20 @@ public:
   // A node is considered bad if it failed to reply to this many queries.
   static const unsigned int max_failed_replies = 5;
 
+  // Size of a flat cache record: compact node information followed by
+  // the 32-bit last-seen time in network byte order.
+  static const unsigned int size_cache_record = 26 + 4;
+
   DhtNode(const HashString& id, const rak::socket_address* sa);
   DhtNode(const std::string& id, const Object& cache);
+  DhtNode(const char* cacheRecord);
+
+  // Nodes are allocated from contiguous slabs so that bucket and
+  // search walks touch a handful of cache lines instead of chasing
+  // individually allocated objects. DhtRouter subclasses DhtNode;
+  // anything not exactly a node falls back to the global allocator.
+  void*                       operator new(std::size_t size);
+  void                        operator delete(void* ptr, std::size_t size);
 
   const HashString&           id() const                 { return *this; }
   raw_string                  id_raw_string() const      { return raw_string(data(), size_data); }
@@ -93,6 +105,10 @@ public:
   // Store node cache in the given container object and return it.
   Object*                     store_cache(Object* container) const;
 
+  // Store the node as a flat cache record in the given buffer and
+  // return pointer to end of stored information.
+  char*                       store_cache_record(char* buffer) const;
+
 private:
   DhtNode();
 
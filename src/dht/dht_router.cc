@@ -37,6 +37,7 @@
 #include "config.h"
 #include "globals.h"
 
+#include <algorithm>
 #include <sstream>
 #include <rak/functional.h>
 
@@ -99,15 +100,32 @@ DhtRouter::DhtRouter(const Object& cache, const rak::socket_address* sa) :
   m_routingTable.insert(std::make_pair(bucket()->id_range_end(), bucket()));
 
   if (cache.has_key("nodes")) {
-    const Object::map_type& nodes = cache.get_key_map("nodes");
+    const Object& nodes = cache.get_key("nodes");
 
-    LT_LOG_THIS("adding nodes (size:%zu)", nodes.size());
+    // Version 2 caches store the nodes as flat cache records in a
+    // single string, version 1 used a map with one object per node.
+    if (nodes.is_string()) {
+      const std::string& records = nodes.as_string();
 
-    for (Object::map_type::const_iterator itr = nodes.begin(); itr != nodes.end(); ++itr) {
-      if (itr->first.length() != HashString::size_data)
-        throw bencode_error("Loading cache: Invalid node hash.");
+      if (records.size() % DhtNode::size_cache_record != 0)
+        throw bencode_error("Loading cache: Invalid node record list.");
 
-      add_node_to_bucket(m_nodes.add_node(new DhtNode(itr->first, itr->second)));
+      LT_LOG_THIS("adding nodes (size:%zu)", records.size() / DhtNode::size_cache_record);
+
+      for (size_t offset = 0; offset != records.size(); offset += DhtNode::size_cache_record)
+        add_node_to_bucket(m_nodes.add_node(new DhtNode(records.c_str() + offset)));
+
+    } else {
+      const Object::map_type& nodeMap = nodes.as_map();
+
+      LT_LOG_THIS("adding nodes (size:%zu)", nodeMap.size());
+
+      for (Object::map_type::const_iterator itr = nodeMap.begin(); itr != nodeMap.end(); ++itr) {
+        if (itr->first.length() != HashString::size_data)
+          throw bencode_error("Loading cache: Invalid node hash.");
+
+        add_node_to_bucket(m_nodes.add_node(new DhtNode(itr->first, itr->second)));
+      }
     }
   }
 
@@ -150,11 +168,15 @@ DhtRouter::start(int port) {
   // Set timeout slot and schedule it to be called immediately for initial bootstrapping if necessary.
   m_taskTimeout.slot() = std::bind(&DhtRouter::receive_timeout_bootstrap, this);
   priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(1)).round_seconds());
+
+  m_taskRefresh.slot() = std::bind(&DhtRouter::receive_timeout_refresh, this);
 }
 
 void
 DhtRouter::stop() {
   priority_queue_erase(&taskScheduler, &m_taskTimeout);
+  priority_queue_erase(&taskScheduler, &m_taskRefresh);
+  m_refreshQueue.clear();
   m_server.stop();
 }
 
@@ -350,14 +372,25 @@ DhtRouter::node_invalid(const HashString& id) {
 Object*
 DhtRouter::store_cache(Object* container) const {
   container->insert_key("self_id", str());
+  container->insert_key("version", int64_t(cache_version));
+
+  // Store all non-bad nodes as flat cache records in a single string;
+  // only af_inet addresses fit the compact record format.
+  std::string nodes;
+  nodes.reserve(m_nodes.size() * DhtNode::size_cache_record);
+
+  char buffer[DhtNode::size_cache_record];
 
-  // Insert all nodes.
-  Object& nodes = container->insert_key("nodes", Object::create_map());
   for (DhtNodeList::const_accessor itr = m_nodes.begin(); itr != m_nodes.end(); ++itr) {
-    if (!itr.node()->is_bad())
-      itr.node()->store_cache(&nodes.insert_key(itr.id().str(), Object::create_map()));
+    if (itr.node()->is_bad() || itr.node()->address()->family() != rak::socket_address::af_inet)
+      continue;
+
+    itr.node()->store_cache_record(buffer);
+    nodes.append(buffer, sizeof(buffer));
   }
 
+  container->insert_key("nodes", std::move(nodes));
+
   // Insert contacts, if we have any.
   if (m_contacts != NULL) {
     Object& contacts = container->insert_key("contacts", Object::create_list());
@@ -442,6 +475,21 @@ DhtRouter::receive_timeout_bootstrap() {
   }
 }
 
+// Orders buckets by refresh priority, lowest first: our own bucket is
+// the most important, after that the stalest buckets go first.
+struct bucket_refresh_closer {
+  bucket_refresh_closer(const DhtBucket* own) : m_own(own) {}
+
+  bool operator () (const DhtBucket* b1, const DhtBucket* b2) const {
+    if (b1 == m_own || b2 == m_own)
+      return b2 == m_own;
+
+    return b1->age() < b2->age();
+  }
+
+  const DhtBucket* m_own;
+};
+
 void
 DhtRouter::receive_timeout() {
   priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(timeout_update)).round_seconds());
@@ -468,14 +516,24 @@ DhtRouter::receive_timeout() {
   }
 
   // If bucket isn't full yet or hasn't received replies/queries from
-  // its nodes for a while, try to find new nodes now.
+  // its nodes for a while, queue it for a refresh. The queue is
+  // drained in bounded batches so a full routing table doesn't start
+  // all its searches in a single tick.
+  priority_queue_erase(&taskScheduler, &m_taskRefresh);
+  m_refreshQueue.clear();
+
   for (DhtBucketList::const_iterator itr = m_routingTable.begin(); itr != m_routingTable.end(); ++itr) {
     itr->second->update();
 
     if (!itr->second->is_full() || itr->second == bucket() || itr->second->age() > timeout_bucket_bootstrap)
-      bootstrap_bucket(itr->second);
+      m_refreshQueue.push_back(itr->second);
   }
 
+  std::sort(m_refreshQueue.begin(), m_refreshQueue.end(), bucket_refresh_closer(bucket()));
+
+  if (!m_refreshQueue.empty())
+    receive_timeout_refresh();
+
   // Remove old peers and empty torrents from the tracker.
   for (DhtTrackerList::accessor itr = m_trackers.begin(); itr != m_trackers.end(); ) {
     itr.tracker()->prune(timeout_peer_announce);
@@ -494,6 +552,17 @@ DhtRouter::receive_timeout() {
   m_numRefresh++;
 }
 
+void
+DhtRouter::receive_timeout_refresh() {
+  for (unsigned int i = 0; i != max_bucket_refresh && !m_refreshQueue.empty(); i++) {
+    bootstrap_bucket(m_refreshQueue.back());
+    m_refreshQueue.pop_back();
+  }
+
+  if (!m_refreshQueue.empty())
+    priority_queue_insert(&taskScheduler, &m_taskRefresh, (cachedTime + rak::timer::from_seconds(timeout_refresh_batch)).round_seconds());
+}
+
 char*
 DhtRouter::generate_token(const rak::socket_address* sa, int token, char buffer[20]) {
   Sha1 sha;
@@ -37,6 +37,7 @@
 #ifndef LIBTORRENT_DHT_ROUTER_H
 #define LIBTORRENT_DHT_ROUTER_H
 
+#include <vector>
 #include <rak/priority_queue_default.h>
 #include <rak/socket_address.h>
 
@@ -62,11 +63,16 @@ public:
   // How many bytes to return and verify from the 20-byte SHA token.
   static const unsigned int size_token = 8;
 
+  // Version of the node cache format; version 2 stores the nodes as
+  // flat cache records in a single string.
+  static const unsigned int cache_version = 2;
+
   static const unsigned int timeout_bootstrap_retry  =          60;  // Retry initial bootstrapping every minute.
   static const unsigned int timeout_update           =     15 * 60;  // Regular housekeeping updates every 15 minutes.
   static const unsigned int timeout_bucket_bootstrap =     15 * 60;  // Bootstrap idle buckets after 15 minutes.
   static const unsigned int timeout_remove_node      = 4 * 60 * 60;  // Remove unresponsive nodes after 4 hours.
   static const unsigned int timeout_peer_announce    =     30 * 60;  // Remove peers which haven't reannounced for 30 minutes.
+  static const unsigned int timeout_refresh_batch    =           5;  // Drain the bucket refresh queue in batches this far apart.
 
   // A node ID of all zero.
   static HashString zero_id;
@@ -154,13 +160,22 @@ private:
   void                bootstrap();
   void                bootstrap_bucket(const DhtBucket* bucket);
 
+  // Maximum number of bucket refresh searches started per batch.
+  static const unsigned int max_bucket_refresh = 4;
+
   void                receive_timeout();
   void                receive_timeout_bootstrap();
+  void                receive_timeout_refresh();
 
   // buffer needs to hold an SHA1 hash (20 bytes), not just the token (8 bytes)
   char*               generate_token(const rak::socket_address* sa, int token, char buffer[20]);
 
   rak::priority_item  m_taskTimeout;
+  rak::priority_item  m_taskRefresh;
+
+  // Buckets due for a refresh, drained in bounded batches with the
+  // highest priority bucket at the back.
+  std::vector<DhtBucket*> m_refreshQueue;
 
   DhtServer           m_server;
   DhtNodeList         m_nodes;
@@ -39,6 +39,7 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <rak/functional.h>
 
 #include "torrent/exceptions.h"
@@ -57,6 +58,7 @@
 #include "dht_transaction.h"
 
 #include "manager.h"
+#include "utils/tracepoints.h"
 
 #define LT_LOG_THIS(log_fmt, ...)                                       \
   lt_log_print_subsystem(torrent::LOG_DHT_SERVER, "dht_server", log_fmt, __VA_ARGS__);
@@ -112,6 +114,13 @@ private:
 DhtServer::DhtServer(DhtRouter* router) :
   m_router(router),
 
+  m_timeoutWheel(timeout_wheel_size, NULL),
+  m_wheelTime(cachedTime.seconds()),
+
+  m_queryRate(query_rate_max),
+  m_queryTokens(query_rate_max),
+  m_queryTokenTime(cachedTime.seconds()),
+
   m_uploadNode(60),
   m_downloadNode(60),
 
@@ -280,6 +289,22 @@ DhtServer::update() {
   // any valid packets. This allows detecting when the entire network goes
   // down, and prevents all nodes from getting removed as unresponsive.
   m_networkUp = false;
+
+  m_packetFilter.rotate();
+}
+
+bool
+DhtServer::admit_query() {
+  if (cachedTime.seconds() != m_queryTokenTime) {
+    m_queryTokenTime = cachedTime.seconds();
+    m_queryTokens = std::min(m_queryTokens + m_queryRate, 2 * m_queryRate);
+  }
+
+  if (m_queryTokens == 0)
+    return false;
+
+  m_queryTokens--;
+  return true;
 }
 
 void
@@ -287,8 +312,15 @@ DhtServer::process_query(const HashString& id, const rak::socket_address* sa, co
   m_queriesReceived++;
   m_networkUp = true;
 
+  // Drop the query when out of tokens; not replying is cheaper than
+  // an error packet, and the node will retry against other nodes.
+  if (!admit_query())
+    return;
+
   raw_string query = msg[key_q].as_raw_string();
 
+  LT_SDT2(dht_process_query, query.data(), query.size());
+
   // Construct reply.
   DhtMessage reply;
 
@@ -345,7 +377,8 @@ DhtServer::create_get_peers_response(const DhtMessage& req, const rak::socket_ad
     reply[key_r_nodes] = nodes;
 
   } else {
-    reply[key_r_values] = tracker->get_peers();
+    reply[key_r_values] = tracker->get_peers(reply.data_end);
+    reply.data_end += reply[key_r_values].as_raw_list().size();
   }
 }
 
@@ -366,6 +399,8 @@ DhtServer::create_announce_peer_response(const DhtMessage& req, const rak::socke
 void
 DhtServer::process_response(const HashString& id, const rak::socket_address* sa, const DhtMessage& response) {
   int transactionId = (unsigned char)response[key_t].as_raw_string().data()[0];
+
+  LT_SDT1(dht_process_response, transactionId);
   transaction_itr itr = m_transactions.find(DhtTransaction::key(sa, transactionId));
 
   // Response to a transaction we don't have in our table. At this point it's
@@ -647,6 +682,9 @@ DhtServer::add_transaction(DhtTransaction* transaction, int priority) {
   // We know where to insert it, so pass that as hint.
   insertItr = m_transactions.insert(insertItr, std::make_pair(transaction->key(id), transaction));
 
+  transaction->set_map_key(insertItr->first);
+  add_timeout(transaction, transaction->has_quick_timeout() ? transaction->quick_timeout() : transaction->timeout());
+
   create_query(insertItr, id, transaction->address(), priority);
 
   start_write();
@@ -710,124 +748,219 @@ DhtServer::clear_transactions() {
   m_transactions.clear();
 }
 
+DhtServer::PacketFilter::PacketFilter() :
+  m_badCurrent(0),
+  m_rateTime(cachedTime.seconds()) {
+
+  std::memset(m_badFilter, 0, sizeof(m_badFilter));
+  std::memset(m_rateCounter, 0, sizeof(m_rateCounter));
+}
+
+void
+DhtServer::PacketFilter::hash_address(const rak::socket_address* sa, uint32_t* h1, uint32_t* h2) {
+  uint32_t addr = sa->sa_inet()->address_n();
+
+  *h1 = addr * 2654435761u;
+  *h2 = (addr ^ (addr >> 16)) * 0x45d9f3bu;
+}
+
+bool
+DhtServer::PacketFilter::drop(const rak::socket_address* sa) {
+  uint32_t h1, h2;
+  hash_address(sa, &h1, &h2);
+
+  // Start a fresh rate window once the old one has passed.
+  if (cachedTime.seconds() - m_rateTime >= rate_window) {
+    std::memset(m_rateCounter, 0, sizeof(m_rateCounter));
+    m_rateTime = cachedTime.seconds();
+  }
+
+  uint8_t* c1 = m_rateCounter + (h1 & (rate_slots - 1));
+  uint8_t* c2 = m_rateCounter + (h2 & (rate_slots - 1));
+
+  if (*c1 < 255)
+    (*c1)++;
+
+  if (*c2 < 255)
+    (*c2)++;
+
+  // Only addresses for which both counters exceed the limit are
+  // dropped, so unrelated addresses sharing one counter with a
+  // flooding source remain unaffected.
+  if (*c1 > rate_limit && *c2 > rate_limit)
+    return true;
+
+  uint32_t b1 = h1 & (filter_bits - 1);
+  uint32_t b2 = h2 & (filter_bits - 1);
+
+  for (int i = 0; i < 2; i++)
+    if ((m_badFilter[i][b1 / 32] & (uint32_t(1) << (b1 % 32))) &&
+        (m_badFilter[i][b2 / 32] & (uint32_t(1) << (b2 % 32))))
+      return true;
+
+  return false;
+}
+
+void
+DhtServer::PacketFilter::insert_bad(const rak::socket_address* sa) {
+  uint32_t h1, h2;
+  hash_address(sa, &h1, &h2);
+
+  uint32_t b1 = h1 & (filter_bits - 1);
+  uint32_t b2 = h2 & (filter_bits - 1);
+
+  m_badFilter[m_badCurrent][b1 / 32] |= uint32_t(1) << (b1 % 32);
+  m_badFilter[m_badCurrent][b2 / 32] |= uint32_t(1) << (b2 % 32);
+}
+
+// Clearing the older generation ages out stale entries and false
+// positives; an entry survives at least one and at most two rotation
+// periods.
+void
+DhtServer::PacketFilter::rotate() {
+  m_badCurrent ^= 1;
+  std::memset(m_badFilter[m_badCurrent], 0, sizeof(m_badFilter[m_badCurrent]));
+}
+
 void
 DhtServer::event_read() {
   uint32_t total = 0;
 
-  while (true) {
-    Object request;
-    rak::socket_address sa;
-    int type = '?';
-    DhtMessage message;
-    const HashString* nodeId = NULL;
+  char buffers[max_datagram_vector][2048];
+  datagram_type datagrams[max_datagram_vector];
 
-    try {
-      char buffer[2048];
-      int32_t read = read_datagram(buffer, sizeof(buffer), &sa);
+  int received;
 
-      if (read < 0)
-        break;
+  do {
+    for (unsigned int i = 0; i < max_datagram_vector; i++) {
+      datagrams[i].buffer = buffers[i];
+      datagrams[i].length = sizeof(buffers[i]);
+    }
 
-      // We can currently only process mapped-IPv4 addresses, not real IPv6.
-      // Translate them to an af_inet socket_address.
-      if (sa.family() == rak::socket_address::af_inet6)
-        sa = sa.sa_inet6()->normalize_address();
+    received = read_datagrams(datagrams, max_datagram_vector);
 
-      if (sa.family() != rak::socket_address::af_inet)
-        continue;
+    for (int i = 0; i < received; i++)
+      total += process_datagram(buffers[i], datagrams[i].length, datagrams[i].address);
 
-      total += read;
+    // A partial batch means the socket has been drained.
+  } while (received == (int)max_datagram_vector);
 
-      // If it's not a valid bencode dictionary at all, it's probably not a DHT
-      // packet at all, so we don't throw an error to prevent bounce loops.
-      try {
-        static_map_read_bencode(buffer, buffer + read, message);
-      } catch (bencode_error& e) {
-        continue;
-      }
+  m_downloadThrottle->node_used_unthrottled(total);
+  m_downloadNode.rate()->insert(total);
 
-      if (!message[key_t].is_raw_string())
-        throw dht_error(dht_error_protocol, "No transaction ID");
+  start_write();
+}
 
-      // Restrict the length of Transaction IDs. We echo them in our replies.
-      if(message[key_t].as_raw_string().size() > 20) {
-		  throw dht_error(dht_error_protocol, "Transaction ID length too long");
-      }
+uint32_t
+DhtServer::process_datagram(const char* buffer, uint32_t length, rak::socket_address sa) {
+  Object request;
+  int type = '?';
+  DhtMessage message;
+  const HashString* nodeId = NULL;
 
-      if (!message[key_y].is_raw_string())
-        throw dht_error(dht_error_protocol, "No message type");
+  try {
+    // We can currently only process mapped-IPv4 addresses, not real IPv6.
+    // Translate them to an af_inet socket_address.
+    if (sa.family() == rak::socket_address::af_inet6)
+      sa = sa.sa_inet6()->normalize_address();
 
-      if (message[key_y].as_raw_string().size() != 1)
-        throw dht_error(dht_error_bad_method, "Unsupported message type");
+    if (sa.family() != rak::socket_address::af_inet)
+      return 0;
 
-      type = message[key_y].as_raw_string().data()[0];
+    // Drop known-bad sources and floods before parsing anything.
+    if (m_packetFilter.drop(&sa))
+      return length;
 
-      // Queries and replies have node ID in different dictionaries.
-      if (type == 'r' || type == 'q') {
-        if (!message[type == 'q' ? key_a_id : key_r_id].is_raw_string())
-          throw dht_error(dht_error_protocol, "Invalid `id' value");
+    // If it's not a valid bencode dictionary at all, it's probably not a DHT
+    // packet at all, so we don't throw an error to prevent bounce loops.
+    try {
+      static_map_read_bencode(buffer, buffer + length, message);
+    } catch (bencode_error& e) {
+      return length;
+    }
 
-        raw_string nodeIdStr = message[type == 'q' ? key_a_id : key_r_id].as_raw_string();
+    if (!message[key_t].is_raw_string())
+      throw dht_error(dht_error_protocol, "No transaction ID");
 
-        if (nodeIdStr.size() < HashString::size_data)
-          throw dht_error(dht_error_protocol, "`id' value too short");
+    // Restrict the length of Transaction IDs. We echo them in our replies.
+    if(message[key_t].as_raw_string().size() > 20) {
+		  throw dht_error(dht_error_protocol, "Transaction ID length too long");
+    }
 
-        nodeId = HashString::cast_from(nodeIdStr.data());
-      }
+    if (!message[key_y].is_raw_string())
+      throw dht_error(dht_error_protocol, "No message type");
 
-      // Sanity check the returned transaction ID.
-      if ((type == 'r' || type == 'e') && 
-          (!message[key_t].is_raw_string() || message[key_t].as_raw_string().size() != 1))
-        throw dht_error(dht_error_protocol, "Invalid transaction ID type/length.");
+    if (message[key_y].as_raw_string().size() != 1)
+      throw dht_error(dht_error_bad_method, "Unsupported message type");
 
-      // Stupid broken implementations.
-      if (nodeId != NULL && *nodeId == m_router->id())
-        throw dht_error(dht_error_protocol, "Send your own ID, not mine");
+    type = message[key_y].as_raw_string().data()[0];
 
-      switch (type) {
-        case 'q':
-          process_query(*nodeId, &sa, message);
-          break;
+    // Queries and replies have node ID in different dictionaries.
+    if (type == 'r' || type == 'q') {
+      if (!message[type == 'q' ? key_a_id : key_r_id].is_raw_string())
+        throw dht_error(dht_error_protocol, "Invalid `id' value");
 
-        case 'r':
-          process_response(*nodeId, &sa, message);
-          break;
+      raw_string nodeIdStr = message[type == 'q' ? key_a_id : key_r_id].as_raw_string();
 
-        case 'e':
-          process_error(&sa, message);
-          break;
+      if (nodeIdStr.size() < HashString::size_data)
+        throw dht_error(dht_error_protocol, "`id' value too short");
 
-        default:
-          throw dht_error(dht_error_bad_method, "Unknown message type.");
-      }
+      nodeId = HashString::cast_from(nodeIdStr.data());
+    }
 
-    // If node was querying us, reply with error packet, otherwise mark the node as "query failed",
-    // so that if it repeatedly sends malformed replies we will drop it instead of propagating it
-    // to other nodes.
-    } catch (bencode_error& e) {
-      if ((type == 'r' || type == 'e') && nodeId != NULL) {
-        m_router->node_inactive(*nodeId, &sa);
-      } else {
-        snprintf(message.data_end, message.data + message.data_size - message.data_end - 1, "Malformed packet: %s", e.what());
-        message.data[message.data_size - 1] = '\0';
-        create_error(message, &sa, dht_error_protocol, message.data_end);
-      }
+    // Sanity check the returned transaction ID.
+    if ((type == 'r' || type == 'e') && 
+        (!message[key_t].is_raw_string() || message[key_t].as_raw_string().size() != 1))
+      throw dht_error(dht_error_protocol, "Invalid transaction ID type/length.");
 
-    } catch (dht_error& e) {
-      if ((type == 'r' || type == 'e') && nodeId != NULL)
-        m_router->node_inactive(*nodeId, &sa);
-      else
-        create_error(message, &sa, e.code(), e.what());
+    // Stupid broken implementations.
+    if (nodeId != NULL && *nodeId == m_router->id())
+      throw dht_error(dht_error_protocol, "Send your own ID, not mine");
 
-    } catch (network_error& e) {
+    switch (type) {
+      case 'q':
+        process_query(*nodeId, &sa, message);
+        break;
+
+      case 'r':
+        process_response(*nodeId, &sa, message);
+        break;
 
+      case 'e':
+        process_error(&sa, message);
+        break;
+
+      default:
+        throw dht_error(dht_error_bad_method, "Unknown message type.");
     }
-  }
 
-  m_downloadThrottle->node_used_unthrottled(total);
-  m_downloadNode.rate()->insert(total);
+  // If node was querying us, reply with error packet, otherwise mark the node as "query failed",
+  // so that if it repeatedly sends malformed replies we will drop it instead of propagating it
+  // to other nodes.
+  } catch (bencode_error& e) {
+    m_packetFilter.insert_bad(&sa);
 
-  start_write();
+    if ((type == 'r' || type == 'e') && nodeId != NULL) {
+      m_router->node_inactive(*nodeId, &sa);
+    } else {
+      snprintf(message.data_end, message.data + message.data_size - message.data_end - 1, "Malformed packet: %s", e.what());
+      message.data[message.data_size - 1] = '\0';
+      create_error(message, &sa, dht_error_protocol, message.data_end);
+    }
+
+  } catch (dht_error& e) {
+    m_packetFilter.insert_bad(&sa);
+
+    if ((type == 'r' || type == 'e') && nodeId != NULL)
+      m_router->node_inactive(*nodeId, &sa);
+    else
+      create_error(message, &sa, e.code(), e.what());
+
+  } catch (network_error& e) {
+
+  }
+
+  return length;
 }
 
 bool
@@ -835,58 +968,88 @@ DhtServer::process_queue(packet_queue& queue, uint32_t* quota) {
   uint32_t used = 0;
 
   while (!queue.empty()) {
-    DhtTransactionPacket* packet = queue.front();
-    DhtTransaction::key_type transactionKey = 0;
-    if(packet->has_transaction())
-      transactionKey = packet->transaction()->key(packet->id());
-
-    // Make sure its transaction hasn't timed out yet, if it has/had one
-    // and don't bother sending non-transaction packets (replies) after 
-    // more than 15 seconds in the queue.
-    if (packet->has_failed() || packet->age() > 15) {
-      delete packet;
+    DhtTransactionPacket* packets[max_datagram_vector];
+    datagram_type datagrams[max_datagram_vector];
+    unsigned int count = 0;
+
+    // Gather a batch of packets that fit within the quota.
+    while (!queue.empty() && count != max_datagram_vector) {
+      DhtTransactionPacket* packet = queue.front();
+
+      // Make sure its transaction hasn't timed out yet, if it has/had one
+      // and don't bother sending non-transaction packets (replies) after
+      // more than 15 seconds in the queue.
+      if (packet->has_failed() || packet->age() > 15) {
+        delete packet;
+        queue.pop_front();
+        continue;
+      }
+
+      if (packet->length() > *quota) {
+        if (count != 0)
+          break;
+
+        m_uploadThrottle->node_used(&m_uploadNode, used);
+        return false;
+      }
+
       queue.pop_front();
-      continue;
+
+      datagrams[count].buffer = const_cast<char*>(packet->c_str());
+      datagrams[count].length = packet->length();
+      datagrams[count].address = *packet->address();
+      packets[count] = packet;
+
+      *quota -= packet->length();
+      count++;
     }
 
-    if (packet->length() > *quota) {
-      m_uploadThrottle->node_used(&m_uploadNode, used);
-      return false;
+    if (count == 0)
+      break;
+
+    int written = write_datagrams(datagrams, count);
+
+    // A send failure is reported against the first packet of the
+    // batch; packets the kernel never looked at go back at the head
+    // of the queue and are retried next round.
+    unsigned int handled = written > 0 ? written : 1;
+
+    for (unsigned int i = count; i-- > handled; ) {
+      *quota += packets[i]->length();
+      queue.push_front(packets[i]);
     }
 
-    queue.pop_front();
+    for (unsigned int i = 0; i < handled; i++) {
+      DhtTransactionPacket* packet = packets[i];
+      DhtTransaction::key_type transactionKey = 0;
+      if(packet->has_transaction())
+        transactionKey = packet->transaction()->key(packet->id());
 
-    try {
-      int written = write_datagram(packet->c_str(), packet->length(), packet->address());
+      if (written > 0 && (int)i < written && datagrams[i].length == packet->length()) {
+        used += packet->length();
 
-      if (written == -1)
-        throw network_error();
+      } else {
+        // Couldn't write packet, maybe something wrong with node address or routing, so mark node as bad.
+        *quota += packet->length();
 
-      used += written;
-      *quota -= written;
+        if (packet->has_transaction()) {
+          transaction_itr itr = m_transactions.find(transactionKey);
+          if (itr == m_transactions.end())
+            throw internal_error("DhtServer::process_queue could not find transaction.");
 
-      if ((unsigned int)written != packet->length())
-        throw network_error();
+          failed_transaction(itr, false);
+        }
+      }
 
-    } catch (network_error& e) {
-      // Couldn't write packet, maybe something wrong with node address or routing, so mark node as bad.
       if (packet->has_transaction()) {
+        // here transaction can be already deleted by failed_transaction.
         transaction_itr itr = m_transactions.find(transactionKey);
-        if (itr == m_transactions.end())
-          throw internal_error("DhtServer::process_queue could not find transaction.");
-
-        failed_transaction(itr, false);
+        if (itr != m_transactions.end())
+          packet->transaction()->set_packet(NULL);
       }
-    }
 
-    if (packet->has_transaction()) {
-      // here transaction can be already deleted by failed_transaction.
-      transaction_itr itr = m_transactions.find(transactionKey);
-      if (itr != m_transactions.end())
-        packet->transaction()->set_packet(NULL);
+      delete packet;
     }
-
-    delete packet;
   }
 
   m_uploadThrottle->node_used(&m_uploadNode, used);
@@ -904,10 +1067,16 @@ DhtServer::event_write() {
   uint32_t quota = m_uploadThrottle->node_quota(&m_uploadNode);
 
   if (quota == 0 || !process_queue(m_highQueue, &quota) || !process_queue(m_lowQueue, &quota)) {
+    // The upload throttle is contended; back off the query admission
+    // rate so replies don't compete with peer upload for quota.
+    m_queryRate = std::max(m_queryRate / 2, (uint32_t)query_rate_min);
+
     manager->poll()->remove_write(this);
     m_uploadThrottle->node_deactivate(&m_uploadNode);
 
   } else if (m_highQueue.empty() && m_lowQueue.empty()) {
+    m_queryRate = std::min(m_queryRate + 1, (uint32_t)query_rate_max);
+
     manager->poll()->remove_write(this);
     m_uploadThrottle->erase(&m_uploadNode);
   }
@@ -925,21 +1094,87 @@ DhtServer::start_write() {
   }
 
   if (!m_taskTimeout.is_queued() && !m_transactions.empty())
-    priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(5)).round_seconds());
+    priority_queue_insert(&taskScheduler, &m_taskTimeout, next_timeout().round_seconds());
+}
+
+void
+DhtServer::add_timeout(DhtTransaction* transaction, int expire) {
+  // Slotted at the first second at which the transaction counts as
+  // expired.
+  transaction->wheel_unlink();
+  transaction->wheel_link(&m_timeoutWheel[(expire + 1) & (timeout_wheel_size - 1)]);
+}
+
+// Find the next second with a pending expiry; scheduling per slot
+// instead of on a fixed five second cadence also means quick
+// timeouts fire when due, restarting stalled searches earlier.
+rak::timer
+DhtServer::next_timeout() {
+  for (int32_t time = m_wheelTime + 1, last = m_wheelTime + timeout_wheel_size; time <= last; time++)
+    if (m_timeoutWheel[time & (timeout_wheel_size - 1)] != NULL)
+      return rak::timer::from_seconds(std::max(time, (int32_t)cachedTime.seconds() + 1));
+
+  return cachedTime + rak::timer::from_seconds(5);
 }
 
 void
 DhtServer::receive_timeout() {
-  transaction_itr itr = m_transactions.begin();
-  while (itr != m_transactions.end()) {
-    if (itr->second->has_quick_timeout() && itr->second->quick_timeout() < cachedTime.seconds()) {
-      itr = failed_transaction(itr, true);
+  int32_t now = cachedTime.seconds();
 
-    } else if (itr->second->timeout() < cachedTime.seconds()) {
-      itr = failed_transaction(itr, false);
+  // The wheel wraps every timeout_wheel_size seconds; if we were not
+  // woken for longer than that, clamp so each slot is processed at
+  // most once.
+  if (now - m_wheelTime > (int32_t)timeout_wheel_size)
+    m_wheelTime = now - timeout_wheel_size;
 
-    } else {
-      ++itr;
+  std::vector<DhtTransaction*> due;
+
+  while (m_wheelTime < now) {
+    m_wheelTime++;
+
+    DhtTransaction** slot = &m_timeoutWheel[m_wheelTime & (timeout_wheel_size - 1)];
+
+    // Detach the due transactions first; processing a failure may add
+    // new transactions to the wheel, including to this slot.
+    due.clear();
+
+    while (*slot != NULL) {
+      due.push_back(*slot);
+      (*slot)->wheel_unlink();
+    }
+
+    std::vector<DhtTransaction*>::iterator dueItr = due.begin();
+
+    try {
+      for (; dueItr != due.end(); ++dueItr) {
+        DhtTransaction* transaction = *dueItr;
+        transaction_itr itr = m_transactions.find(transaction->map_key());
+
+        if (itr == m_transactions.end() || itr->second != transaction)
+          throw internal_error("DhtServer::receive_timeout could not find transaction.");
+
+        if (transaction->has_quick_timeout() && transaction->quick_timeout() < now) {
+          // Move to the final timeout slot before processing, in case
+          // an exception unwinds past us.
+          add_timeout(transaction, transaction->timeout());
+          failed_transaction(itr, true);
+
+        } else if (transaction->timeout() < now) {
+          failed_transaction(itr, false);
+
+        } else {
+          // Not due yet; it was added to this slot while draining it.
+          add_timeout(transaction, transaction->has_quick_timeout() ? transaction->quick_timeout() : transaction->timeout());
+        }
+      }
+
+    } catch (...) {
+      // Keep the wheel consistent: re-slot the transactions we did
+      // not get to.
+      while (++dueItr != due.end())
+        add_timeout(*dueItr, (*dueItr)->has_quick_timeout() ? (*dueItr)->quick_timeout() : (*dueItr)->timeout());
+
+      throw;
     }
   }
 
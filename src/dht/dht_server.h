@@ -39,6 +39,7 @@
 
 #include <map>
 #include <deque>
+#include <vector>
 #include <rak/priority_queue_default.h>
 #include <rak/socket_address.h>
 
@@ -68,6 +69,10 @@ public:
 
   const char*         type_name() const { return "dht"; }
 
+  // DHT queries are floodable and yield to transfers in each poll
+  // batch.
+  int                 poll_priority() const { return POLL_PRIORITY_LOW; }
+
   void                start(int port);
   void                stop();
   bool                is_active() const                  { return get_fd().is_valid(); }
@@ -139,6 +144,7 @@ private:
 
   void                start_write();
 
+  uint32_t            process_datagram(const char* buffer, uint32_t length, rak::socket_address sa);
   void                process_query(const HashString& id, const rak::socket_address* sa, const DhtMessage& req);
   void                process_response(const HashString& id, const rak::socket_address* sa, const DhtMessage& req);
   void                process_error(const rak::socket_address* sa, const DhtMessage& error);
@@ -160,6 +166,54 @@ private:
 
   int                 add_transaction(DhtTransaction* t, int priority);
 
+  // Rotating Bloom filter over source addresses, fronting the packet
+  // processing path. Sources that sent malformed packets are dropped
+  // before any parsing is done, and a small per-address packet
+  // counter guards against floods. False positives age out as the
+  // filter generations rotate.
+  class PacketFilter {
+  public:
+    PacketFilter();
+
+    // Returns true if packets from this address should be dropped.
+    bool                drop(const rak::socket_address* sa);
+
+    void                insert_bad(const rak::socket_address* sa);
+    void                rotate();
+
+  private:
+    static const unsigned int filter_bits = 1 << 14;
+    static const unsigned int rate_slots  = 1 << 10;
+
+    static const unsigned int rate_limit  = 96;  // Packets per window, per counter.
+    static const int32_t      rate_window = 16;  // Seconds.
+
+    static void         hash_address(const rak::socket_address* sa, uint32_t* h1, uint32_t* h2);
+
+    uint32_t            m_badFilter[2][filter_bits / 32];
+    int                 m_badCurrent;
+
+    uint8_t             m_rateCounter[rate_slots];
+    int32_t             m_rateTime;
+  };
+
+  // Timing wheel for transaction expiry, one slot per second. The
+  // wheel covers the maximum 30 second transaction timeout with
+  // room to spare.
+  static const unsigned int timeout_wheel_size = 64;
+
+  void                add_timeout(DhtTransaction* transaction, int expire);
+  rak::timer          next_timeout();
+
+  // Token-bucket governor for replying to peer queries. The bucket
+  // refills every second; the rate is halved whenever the upload
+  // throttle runs dry and creeps back up while there is headroom, so
+  // DHT traffic yields to peer upload on saturated links.
+  static const unsigned int query_rate_min = 8;
+  static const unsigned int query_rate_max = 256;
+
+  bool                admit_query();
+
   // This returns the iterator after the given one or end()
   transaction_itr     failed_transaction(transaction_itr itr, bool quick);
 
@@ -173,6 +227,15 @@ private:
   packet_queue        m_lowQueue;
   transaction_map     m_transactions;
 
+  std::vector<DhtTransaction*> m_timeoutWheel;
+  int32_t             m_wheelTime;
+
+  PacketFilter        m_packetFilter;
+
+  uint32_t            m_queryRate;
+  uint32_t            m_queryTokens;
+  int32_t             m_queryTokenTime;
+
   rak::priority_item  m_taskTimeout;
 
   ThrottleNode        m_uploadNode;
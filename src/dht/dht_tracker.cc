@@ -36,6 +36,9 @@
 
 #include "config.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "torrent/object.h"
 
 #include "dht_tracker.h"
@@ -47,72 +50,83 @@ DhtTracker::add_peer(uint32_t addr, uint16_t port) {
   if (port == 0)
     return;
 
-  SocketAddressCompact compact(addr, port);
-
-  unsigned int oldest = 0;
-  uint32_t minSeen = ~uint32_t();
-
-  // Check if peer exists. If not, find oldest peer.
+  // Remove an existing entry for the peer; re-appending it below
+  // refreshes its position in the announce order.
   for (unsigned int i = 0; i < size(); i++) {
-    if (m_peers[i].peer.addr == compact.addr) {
-      m_peers[i].peer.port = compact.port;
-      m_lastSeen[i] = cachedTime.seconds();
-      return;
-
-    } else if (m_lastSeen[i] < minSeen) {
-      minSeen = m_lastSeen[i];
-      oldest = i;
+    if (m_peers[i].addr == addr) {
+      m_peers.erase(m_peers.begin() + i);
+      m_lastSeen.erase(m_lastSeen.begin() + i);
+      break;
     }
   }
 
-  // If peer doesn't exist, append to list if the table is not full.
-  if (size() < max_size) {
-    m_peers.push_back(compact);
-    m_lastSeen.push_back(cachedTime.seconds());
-
-  // Peer doesn't exist and table is full: replace oldest peer.
-  } else {
-    m_peers[oldest] = compact;
-    m_lastSeen[oldest] = cachedTime.seconds();
+  // Table full: replace the oldest announce, ring-buffer style.
+  if (size() == max_size) {
+    m_peers.erase(m_peers.begin());
+    m_lastSeen.erase(m_lastSeen.begin());
   }
+
+  m_peers.push_back(SocketAddressCompact(addr, port));
+  m_lastSeen.push_back(cachedTime.seconds());
+
+  m_cacheLength = 0;
 }
 
-// Return compact info as bencoded string (8 bytes per peer) for up to 30 peers,
-// returning different peers for each call if there are more.
+// Assemble compact info as bencoded strings (8 bytes per peer) into
+// the given buffer, which must hold maxPeers * 8 bytes, returning
+// different peers for each call if there are more.
 raw_list
-DhtTracker::get_peers(unsigned int maxPeers) {
-  if (sizeof(BencodeAddress) != 8)
-    throw internal_error("DhtTracker::BencodeAddress is packed incorrectly.");
+DhtTracker::get_peers(char* buffer, unsigned int maxPeers) {
+  // Serve repeat queries from the cached copy of the last reply.
+  if (maxPeers == max_peers && m_cacheLength != 0 && cachedTime.seconds() < m_cacheExpires) {
+    std::memcpy(buffer, m_cache, m_cacheLength);
+    return raw_list(buffer, m_cacheLength);
+  }
 
-  PeerList::iterator first = m_peers.begin();
-  PeerList::iterator last = m_peers.end();
+  unsigned int first = 0;
+  unsigned int count = m_peers.size();
 
   // If we have more than max_peers, randomly return block of peers.
   // The peers in overlapping blocks get picked twice as often, but
   // that's better than returning fewer peers.
-  if (m_peers.size() > maxPeers) {
-    unsigned int blocks = (m_peers.size() + maxPeers - 1) / maxPeers;
+  if (count > maxPeers) {
+    unsigned int blocks = (count + maxPeers - 1) / maxPeers;
+
+    first = (random() % blocks) * (count - maxPeers) / (blocks - 1);
+    count = maxPeers;
+  }
+
+  char* end = buffer;
+
+  for (unsigned int i = first; i != first + count; i++) {
+    *end++ = '6';
+    *end++ = ':';
+    std::memcpy(end, m_peers[i].c_str(), sizeof(SocketAddressCompact));
+    end += sizeof(SocketAddressCompact);
+  }
 
-    first += (random() % blocks) * (m_peers.size() - maxPeers) / (blocks - 1);
-    last = first + maxPeers;
+  if (maxPeers == max_peers) {
+    std::memcpy(m_cache, buffer, end - buffer);
+    m_cacheLength = end - buffer;
+    m_cacheExpires = cachedTime.seconds() + cache_ttl;
   }
 
-  return raw_list(first->bencode(), last->bencode() - first->bencode());
+  return raw_list(buffer, end - buffer);
 }
 
-// Remove old announces.
+// Remove old announces. Since the entries are ordered by announce
+// time, the expired ones form a prefix.
 void
 DhtTracker::prune(uint32_t maxAge) {
   uint32_t minSeen = cachedTime.seconds() - maxAge;
 
-  for (unsigned int i = 0; i < m_lastSeen.size(); i++)
-    if (m_lastSeen[i] < minSeen) m_peers[i].peer.port = 0;
+  unsigned int count = std::lower_bound(m_lastSeen.begin(), m_lastSeen.end(), minSeen) - m_lastSeen.begin();
 
-  m_peers.erase(std::remove_if(m_peers.begin(), m_peers.end(), std::mem_fun_ref(&BencodeAddress::empty)), m_peers.end());
-  m_lastSeen.erase(std::remove_if(m_lastSeen.begin(), m_lastSeen.end(), std::bind2nd(std::less<uint32_t>(), minSeen)), m_lastSeen.end());
+  m_peers.erase(m_peers.begin(), m_peers.begin() + count);
+  m_lastSeen.erase(m_lastSeen.begin(), m_lastSeen.begin() + count);
 
-  if (m_peers.size() != m_lastSeen.size())
-    throw internal_error("DhtTracker::prune did inconsistent peer pruning.");
+  if (count != 0)
+    m_cacheLength = 0;
 }
 
 }
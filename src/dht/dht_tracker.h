@@ -62,33 +62,39 @@ public:
   // large peer tables for very active torrents.
   static const unsigned int max_size = 128;
 
+  // How long a cached GET_PEERS reply stays valid. Announces drop the
+  // cache immediately; the TTL only bounds how long every requester
+  // sees the same random block of an oversized swarm.
+  static const uint32_t cache_ttl = 10;
+
+  DhtTracker() : m_cacheExpires(0), m_cacheLength(0) {}
+
   bool                empty() const                { return m_peers.empty(); }
   size_t              size() const                 { return m_peers.size(); }
 
   void                add_peer(uint32_t addr, uint16_t port);
-  raw_list            get_peers(unsigned int maxPeers = max_peers);
+  raw_list            get_peers(char* buffer, unsigned int maxPeers = max_peers);
 
   // Remove old announces from the tracker that have not reannounced for
   // more than the given number of seconds.
   void                prune(uint32_t maxAge);
 
 private:
-  // We need to store the address as a bencoded string.
-  struct BencodeAddress {
-    char                 header[2];
-    SocketAddressCompact peer;
-
-    BencodeAddress(const SocketAddressCompact& p) : peer(p) { header[0] = '6'; header[1] = ':'; }
-
-    const char*  bencode() const { return header; }
-
-    bool         empty() const   { return !peer.port; }
-  } __attribute__ ((packed));
-
-  typedef std::vector<BencodeAddress> PeerList;
+  typedef std::vector<SocketAddressCompact> PeerList;
 
+  // Flat array of 6-byte compact entries, ordered by the time of the
+  // last announce with the oldest entry first; m_lastSeen holds the
+  // matching announce times and is thus monotonic.
   PeerList               m_peers;
   std::vector<uint32_t>  m_lastSeen;
+
+  // Serialized copy of the last default-sized reply, analogous to
+  // DhtBucket's full bucket cache. Hot swarms query the same info
+  // hash hundreds of times a minute; this turns those queries into a
+  // plain buffer copy.
+  uint32_t               m_cacheExpires;
+  uint32_t               m_cacheLength;
+  char                   m_cache[max_peers * 8];
 };
 
 }
@@ -51,6 +51,7 @@ DhtSearch::DhtSearch(const HashString& target, const DhtBucket& contacts)
     m_contacted(0),
     m_replied(0),
     m_concurrency(3),
+    m_widen(0),
     m_restart(false),
     m_started(false),
     m_next(end()),
@@ -165,14 +166,38 @@ DhtSearch::trim(bool final) {
   m_restart = false;
 }
 
+// The closest set has stabilized when the closest known non-bad
+// nodes have all replied; replies from nodes further out cannot
+// improve the result set any more.
+bool
+DhtSearch::closest_stable() const {
+  unsigned int count = 0;
+
+  for (const_accessor itr(base_type::begin()); itr != end(); ++itr) {
+    if (itr.node()->is_bad())
+      continue;
+
+    if (!itr.node()->is_good())
+      return false;
+
+    if (++count == DhtBucket::num_nodes)
+      break;
+  }
+
+  return count != 0;
+}
+
 DhtSearch::const_accessor
 DhtSearch::get_contact() {
-  if (m_pending >= m_concurrency)
+  if (m_pending >= m_concurrency + m_widen)
     return end();
 
   if (m_restart)
     trim(false);
 
+  if (m_next != end() && closest_stable())
+    m_next = end();
+
   const_accessor ret = m_next;
   if (ret == end())
     return ret;
@@ -199,8 +224,16 @@ DhtSearch::node_status(const_accessor& n, bool success) {
     n.node()->set_good();
     m_replied++;
 
+    // A reply that brought new candidate nodes means the search is
+    // converging; let it fan out wider to cut down on serial rounds.
+    if (m_restart && m_widen < max_widen)
+      m_widen++;
+
   } else {
     n.node()->set_bad();
+
+    // Narrow again when packets are being lost.
+    m_widen /= 2;
   }
 
   m_pending--;
@@ -252,13 +285,46 @@ DhtAnnounce::start_announce() {
   return const_accessor(begin());
 }
 
+// Free list of recycled packet objects. Bounded so that the burst of
+// packets queued during a flood does not stay resident afterwards.
+static const unsigned int dht_packet_free_max = 64;
+static unsigned int dht_packet_free_count = 0;
+static void* dht_packet_free_list = NULL;
+
+void*
+DhtTransactionPacket::operator new(std::size_t size) {
+  if (size != sizeof(DhtTransactionPacket) || dht_packet_free_list == NULL)
+    return ::operator new(size);
+
+  void* result = dht_packet_free_list;
+  dht_packet_free_list = *reinterpret_cast<void**>(result);
+  dht_packet_free_count--;
+
+  return result;
+}
+
+void
+DhtTransactionPacket::operator delete(void* ptr, std::size_t size) {
+  if (ptr == NULL)
+    return;
+
+  if (size != sizeof(DhtTransactionPacket) || dht_packet_free_count >= dht_packet_free_max) {
+    ::operator delete(ptr);
+    return;
+  }
+
+  *reinterpret_cast<void**>(ptr) = dht_packet_free_list;
+  dht_packet_free_list = ptr;
+  dht_packet_free_count++;
+}
+
 void
 DhtTransactionPacket::build_buffer(const DhtMessage& msg) {
   char buffer[1500];  // If the message would exceed an Ethernet frame, something went very wrong.
   object_buffer_t result = static_map_write_bencode_c(object_write_to_buffer, NULL, std::make_pair(buffer, buffer + sizeof(buffer)), msg);
 
   m_length = result.second - buffer;
-  m_data = new char[m_length];
+  m_data = m_length <= inline_size ? m_inlineData : new char[m_length];
   memcpy(m_data, buffer, m_length);
 }
 
@@ -268,11 +334,16 @@ DhtTransaction::DhtTransaction(int quick_timeout, int timeout, const HashString&
     m_sa(*sa),
     m_timeout(cachedTime.seconds() + timeout),
     m_quickTimeout(cachedTime.seconds() + quick_timeout),
-    m_packet(NULL) {
+    m_packet(NULL),
+    m_mapKey(0),
+    m_wheelNext(NULL),
+    m_wheelPrevNext(NULL) {
 
 }
 
 DhtTransaction::~DhtTransaction() {
+  wheel_unlink();
+
   if (m_packet != NULL)
     m_packet->set_failed();
 }
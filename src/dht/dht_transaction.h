@@ -98,6 +98,10 @@ public:
   // Number of closest nodes we actually announce to.
   static const unsigned int max_announce = 3;
 
+  // Upper bound on the extra concurrent transactions allowed while
+  // replies keep producing new candidate nodes.
+  static const unsigned int max_widen = 5;
+
   DhtSearch(const HashString& target, const DhtBucket& contacts);
   virtual ~DhtSearch();
 
@@ -153,6 +157,7 @@ protected:
   unsigned int         m_contacted;
   unsigned int         m_replied;
   unsigned int         m_concurrency;
+  unsigned int         m_widen;    // Current extra concurrency on top of m_concurrency.
 
   bool                 m_restart;  // If true, trim nodes and reset m_next on the following get_contact call.
   bool                 m_started;
@@ -164,6 +169,7 @@ private:
   DhtSearch(const DhtSearch& s);
 
   bool                 node_uncontacted(const DhtNode* node) const;
+  bool                 closest_stable() const;
 
   HashString           m_target;
 };
@@ -222,14 +228,14 @@ public:
 
   DhtMessage() : data_end(data) {};
 
-  // Must be big enough to hold one of the possible variable-sized reply data.
+  // Must be big enough to hold the possible variable-sized reply data.
   // Currently either:
   // - error message (size doesn't really matter, it'll be truncated at worst)
-  // - announce token (8 bytes, needs 20 bytes buffer to build)
-  // Never more than one of the above.
+  // - announce token (8 bytes, needs 20 bytes buffer to build), plus
+  //   the assembled get_peers values list (max_peers * 8 bytes)
   // And additionally for queries we send:
   // - transaction ID (3 bytes)
-  static const size_t data_size = 64;
+  static const size_t data_size = 320;
   char data[data_size];
   char* data_end;
 };
@@ -245,7 +251,13 @@ public:
   DhtTransactionPacket(const rak::socket_address* s, const DhtMessage& d)
     : m_sa(*s), m_id(-cachedTime.seconds()), m_transaction(NULL) { build_buffer(d); };
 
-  ~DhtTransactionPacket()                               { delete[] m_data; }
+  ~DhtTransactionPacket()                               { if (m_data != m_inlineData) delete[] m_data; }
+
+  // Packets are allocated and freed at a high rate; a bounded free
+  // list recycles the objects so that steady-state replies and
+  // queries, which fit the inline buffer, need no heap allocation.
+  void*                       operator new(std::size_t size);
+  void                        operator delete(void* ptr, std::size_t size);
 
   bool                        has_transaction() const   { return m_id >= -1; }
   bool                        has_failed() const        { return m_id == -1; }
@@ -263,6 +275,10 @@ public:
   DhtTransaction*             transaction()             { return m_transaction; }
 
 private:
+  // Covers find_node and get_peers replies (the largest packets we
+  // build); oversized messages fall back to a heap buffer.
+  static const size_t inline_size = 512;
+
   void                        build_buffer(const DhtMessage& data);
 
   rak::socket_address   m_sa;
@@ -270,6 +286,7 @@ private:
   size_t                m_length;
   int                   m_id;
   DhtTransaction*       m_transaction;
+  char                  m_inlineData[inline_size];
 };
 
 // DHT Transaction classes. DhtTransaction and DhtTransactionSearch
@@ -304,6 +321,17 @@ public:
   int                         quick_timeout()      { return m_quickTimeout; }
   bool                        has_quick_timeout()  { return m_hasQuickTimeout; }
 
+  // The key this transaction is filed under in DhtServer's
+  // transaction map, set when it is added.
+  key_type                    map_key()            { return m_mapKey; }
+  void                        set_map_key(key_type key) { m_mapKey = key; }
+
+  // Intrusive hooks for DhtServer's timeout wheel. The destructor
+  // unlinks the transaction, so it may be deleted from anywhere.
+  DhtTransaction*             wheel_next()         { return m_wheelNext; }
+  void                        wheel_link(DhtTransaction** head);
+  void                        wheel_unlink();
+
   DhtTransactionPacket*       packet()             { return m_packet; }
   void                        set_packet(DhtTransactionPacket* p) { m_packet = p; }
 
@@ -329,6 +357,11 @@ private:
   int                    m_timeout;
   int                    m_quickTimeout;
   DhtTransactionPacket*  m_packet;
+
+  key_type               m_mapKey;
+
+  DhtTransaction*        m_wheelNext;
+  DhtTransaction**       m_wheelPrevNext;
 };
 
 class DhtTransactionSearch : public DhtTransaction {
@@ -420,6 +453,31 @@ dht_compare_closer::operator () (const DhtNode* one, const DhtNode* two) const {
   return DhtSearch::is_closer(*one, *two, m_target);
 }
 
+inline void
+DhtTransaction::wheel_link(DhtTransaction** head) {
+  m_wheelNext = *head;
+
+  if (m_wheelNext != NULL)
+    m_wheelNext->m_wheelPrevNext = &m_wheelNext;
+
+  m_wheelPrevNext = head;
+  *head = this;
+}
+
+inline void
+DhtTransaction::wheel_unlink() {
+  if (m_wheelPrevNext == NULL)
+    return;
+
+  *m_wheelPrevNext = m_wheelNext;
+
+  if (m_wheelNext != NULL)
+    m_wheelNext->m_wheelPrevNext = m_wheelPrevNext;
+
+  m_wheelNext = NULL;
+  m_wheelPrevNext = NULL;
+}
+
 inline DhtTransaction::key_type
 DhtTransaction::key(const rak::socket_address* sa, int id) {
   return ((uint64_t)sa->sa_inet()->address_n() << 32) + id;
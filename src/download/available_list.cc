@@ -41,10 +41,89 @@
 #include <iterator>
 
 #include "torrent/exceptions.h"
+#include "torrent/net/socket_address_key.h"
 #include "available_list.h"
 
 namespace torrent {
 
+// FNV-1a over the canonical address bytes with the port mixed in, as
+// the list treats addresses differing only in port as distinct
+// candidates.
+static uint32_t
+available_list_hash(const rak::socket_address& sa) {
+  socket_address_key key = socket_address_key::from_sockaddr(sa.c_sockaddr());
+  uint16_t port = sa.port();
+
+  uint32_t result = 2166136261u;
+
+  for (const uint8_t* itr = reinterpret_cast<const uint8_t*>(&key), *last = itr + sizeof(key); itr != last; itr++)
+    result = (result ^ *itr) * 16777619u;
+
+  result = (result ^ (port & 0xff)) * 16777619u;
+  result = (result ^ (port >> 8)) * 16777619u;
+
+  return result;
+}
+
+// Returns the slot holding 'sa' if present, otherwise the slot it
+// should be inserted into; the first tombstone on the probe path or
+// the terminating empty slot.
+uint32_t
+AvailableList::hash_probe(const rak::socket_address& sa) const {
+  uint32_t mask = m_hashTable.size() - 1;
+  uint32_t slot = available_list_hash(sa) & mask;
+  uint32_t insertSlot = m_hashTable.size();
+
+  while (true) {
+    uint32_t pos = m_hashTable[slot];
+
+    if (pos == position_empty)
+      return insertSlot != m_hashTable.size() ? insertSlot : slot;
+
+    if (pos == position_erased) {
+      if (insertSlot == m_hashTable.size())
+        insertSlot = slot;
+
+    } else if (*(begin() + pos) == sa) {
+      return slot;
+    }
+
+    slot = (slot + 1) & mask;
+  }
+}
+
+// Grow and rebuild the table before 'count' insertions if the fill
+// factor, tombstones included, would pass three quarters; rebuilding
+// from the vector also drops accumulated tombstones.
+void
+AvailableList::hash_reserve(size_type count) {
+  if (!m_hashTable.empty() && 4 * (m_hashFill + count) < 3 * m_hashTable.size())
+    return;
+
+  uint32_t tableSize = 64;
+
+  while (tableSize < 2 * (size() + count))
+    tableSize <<= 1;
+
+  m_hashTable.assign(tableSize, uint32_t(position_empty));
+  m_hashFill = size();
+
+  for (size_type i = 0; i < size(); i++)
+    m_hashTable[hash_probe(*(begin() + i))] = i;
+}
+
+void
+AvailableList::erase_index(size_type idx) {
+  m_hashTable[hash_probe(*(begin() + idx))] = position_erased;
+
+  if (idx != size() - 1) {
+    m_hashTable[hash_probe(back())] = idx;
+    *(begin() + idx) = back();
+  }
+
+  base_type::pop_back();
+}
+
 AvailableList::value_type
 AvailableList::pop_random() {
   if (empty())
@@ -53,18 +132,24 @@ AvailableList::pop_random() {
   size_type idx = random() % size();
 
   value_type tmp = *(begin() + idx);
-  *(begin() + idx) = back();
-
-  pop_back();
+  erase_index(idx);
 
   return tmp;
 }
 
 void
 AvailableList::push_back(const rak::socket_address* sa) {
-  if (std::find(begin(), end(), *sa) != end())
+  hash_reserve(1);
+
+  uint32_t slot = hash_probe(*sa);
+
+  if (m_hashTable[slot] < size())
     return;
 
+  if (m_hashTable[slot] == position_empty)
+    m_hashFill++;
+
+  m_hashTable[slot] = size();
   base_type::push_back(*sa);
 }
 
@@ -73,27 +158,21 @@ AvailableList::insert(AddressList* l) {
   if (!want_more())
     return;
 
-  std::sort(begin(), end());
+  hash_reserve(l->size());
 
-  // Can i use use the std::remove* semantics for this, and just copy
-  // to 'l'?.
-  //
-  // 'l' is guaranteed to be sorted, so we can just do
-  // std::set_difference.
-  AddressList difference;
-  std::set_difference(l->begin(), l->end(), begin(), end(), std::back_inserter(difference));
-
-  std::copy(difference.begin(), difference.end(), std::back_inserter(*static_cast<base_type*>(this)));
+  for (AddressList::iterator itr = l->begin(), last = l->end(); itr != last; ++itr)
+    push_back(&*itr);
 }
 
 void
 AvailableList::erase(const rak::socket_address& sa) {
-  iterator itr = std::find(begin(), end(), sa);
+  if (m_hashTable.empty())
+    return;
 
-  if (itr != end()) {
-    *itr = back();
-    pop_back();
-  }
+  uint32_t slot = hash_probe(sa);
+
+  if (m_hashTable[slot] < size())
+    erase_index(m_hashTable[slot]);
 }
 
 }
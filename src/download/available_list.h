@@ -62,7 +62,6 @@ public:
   using base_type::capacity;
   using base_type::reserve;
   using base_type::empty;
-  using base_type::clear;
 
   using base_type::back;
   using base_type::pop_back;
@@ -71,32 +70,48 @@ public:
   using base_type::rbegin;
   using base_type::rend;
 
-  AvailableList() : m_maxSize(1000) {}
+  AvailableList() : m_maxSize(1000), m_hashFill(0) {}
 
   value_type          pop_random();
 
+  void                clear()                            { base_type::clear(); m_hashTable.clear(); m_hashFill = 0; }
+
   // Fuzzy size limit.
   size_type           max_size() const                   { return m_maxSize; }
   void                set_max_size(size_type s)          { m_maxSize = s; }
 
   bool                want_more() const                  { return size() <= m_maxSize; }
 
-  // This push is somewhat inefficient as it iterates through the
-  // whole container to see if the address already exists.
   void                push_back(const rak::socket_address* sa);
 
   void                insert(AddressList* l);
   void                erase(const rak::socket_address& sa);
-  void                erase(iterator itr)                 { *itr = back(); pop_back(); }
-  
+  void                erase(iterator itr)                 { erase_index(itr - begin()); }
+
   // A place to temporarily put addresses before re-adding them to the
   // AvailableList.
   AddressList*        buffer()                            { return &m_buffer; }
 
 private:
+  // Open-addressing index mapping each stored address to its position
+  // in the vector; deduping merged tracker/PEX/DHT lists then costs a
+  // probe per address rather than a scan of the whole container.
+  static const uint32_t position_empty  = ~uint32_t();
+  static const uint32_t position_erased = ~uint32_t() - 1;
+
+  typedef std::vector<uint32_t> hash_table_type;
+
+  uint32_t            hash_probe(const rak::socket_address& sa) const;
+  void                hash_reserve(size_type count);
+
+  void                erase_index(size_type idx);
+
   size_type           m_maxSize;
 
   AddressList         m_buffer;
+
+  hash_table_type     m_hashTable;
+  size_type           m_hashFill;
 };
 
 }
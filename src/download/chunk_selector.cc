@@ -53,14 +53,15 @@ void
 ChunkSelector::initialize(ChunkStatistics* cs) {
   m_position = invalid_chunk;
   m_statistics = cs;
+  m_sequentialHint = 0;
+  m_affinity = invalid_chunk;
 
   Bitfield* completed = m_data->mutable_completed_bitfield();
   Bitfield* untouched = m_data->mutable_untouched_bitfield();
 
   untouched->set_size_bits(completed->size_bits());
   untouched->allocate();
-  std::transform(completed->begin(), completed->end(), untouched->begin(), rak::invert<Bitfield::value_type>());
-  untouched->update();
+  untouched->set_not(*completed);
 
   m_sharedQueue.enable(32);
   m_sharedQueue.clear();
@@ -84,15 +85,131 @@ ChunkSelector::update_priorities() {
   if (m_position == invalid_chunk)
     m_position = random() % size();
 
+  // Priorities may have changed under the sequential hint; rewind so
+  // it finds the new in-order edge.
+  m_sequentialHint = 0;
+
   advance_position();
 }
 
+// Find the first chunk the peer has inside the window at the in-order
+// edge. The hint is advanced lazily past chunks that are no longer
+// wanted and rewound when a chunk is given back.
+uint32_t
+ChunkSelector::find_sequential(PeerChunks* pc) {
+  while (m_sequentialHint < size() &&
+         (!m_data->untouched_bitfield()->get(m_sequentialHint) ||
+          (!m_data->high_priority()->has(m_sequentialHint) && !m_data->normal_priority()->has(m_sequentialHint))))
+    m_sequentialHint++;
+
+  uint32_t last = std::min(m_sequentialHint + max_sequential_window, size());
+
+  for (uint32_t index = m_sequentialHint; index < last; index++) {
+    if (!m_data->untouched_bitfield()->get(index))
+      continue;
+
+    if (!m_data->high_priority()->has(index) && !m_data->normal_priority()->has(index))
+      continue;
+
+    if (!pc->bitfield()->get(index))
+      continue;
+
+    return index;
+  }
+
+  return invalid_chunk;
+}
+
+// Walk the rarity buckets for the rarest chunk the peer has that we
+// still want. Returns false if the probe budget ran out before the
+// candidates were exhausted, in which case '*result' is not
+// authoritative and the caller should fall back to scanning.
+//
+// Rarity only orders between buckets; within the rarest bucket found
+// the walk keeps probing for the candidate closest on disk to the
+// last delegated chunk. Chunk index order is file layout order, so
+// this turns the write pattern mostly sequential whenever
+// availability leaves a choice.
+bool
+ChunkSelector::find_rarest(PeerChunks* pc, const download_data::priority_ranges* ranges, uint32_t* result) {
+  uint32_t probesLeft = max_rarity_probes;
+  uint32_t found = invalid_chunk;
+  uint8_t  foundRarity = 0;
+
+  for (uint32_t index = m_statistics->rarest_first(); index != ChunkStatistics::invalid_index; index = m_statistics->rarest_next(index)) {
+    if (probesLeft-- == 0) {
+      if (found == invalid_chunk)
+        return false;
+
+      break;
+    }
+
+    if (found != invalid_chunk && m_statistics->rarity(index) != foundRarity)
+      break;
+
+    if (!m_data->untouched_bitfield()->get(index))
+      continue;
+
+    if (!ranges->has(index))
+      continue;
+
+    if (!pc->bitfield()->get(index))
+      continue;
+
+    if (found == invalid_chunk) {
+      found = index;
+      foundRarity = m_statistics->rarity(index);
+
+      if (m_affinity == invalid_chunk || index == m_affinity + 1)
+        break;
+
+      continue;
+    }
+
+    if (std::min(index - m_affinity, m_affinity - index) < std::min(found - m_affinity, m_affinity - found))
+      found = index;
+
+    // The immediate successor is the best possible pick.
+    if (found == m_affinity + 1)
+      break;
+  }
+
+  *result = found;
+  return true;
+}
+
 uint32_t
 ChunkSelector::find(PeerChunks* pc, __UNUSED bool highPriority) {
   // This needs to be re-enabled.
   if (m_position == invalid_chunk)
     return invalid_chunk;
 
+  // Streaming mode: offer the in-order window first so reading can
+  // keep up with the download; peers without those chunks fall
+  // through to normal selection and stay useful.
+  if (m_sequential) {
+    uint32_t index = find_sequential(pc);
+
+    if (index != invalid_chunk)
+      return index;
+  }
+
+  // Try the rarity bucket index first; it yields a truly rarest-first
+  // pick in a bounded number of probes. The scan below remains as the
+  // fallback for when the budget runs out, e.g. a peer that has none
+  // of the rare chunks.
+  uint32_t rarest = invalid_chunk;
+  bool authoritative = find_rarest(pc, m_data->high_priority(), &rarest);
+
+  if (authoritative && rarest == invalid_chunk)
+    authoritative = find_rarest(pc, m_data->normal_priority(), &rarest);
+
+  if (rarest != invalid_chunk)
+    return rarest;
+
+  if (authoritative)
+    return invalid_chunk;
+
   // When we're a seeder, 'm_sharedQueue' is used. Since the peer's
   // bitfield is guaranteed to be filled we can use the same code as
   // for non-seeders. This generalization does incur a slight
@@ -170,6 +287,8 @@ ChunkSelector::using_index(uint32_t index) {
 
   m_data->mutable_untouched_bitfield()->unset(index);
 
+  m_affinity = index;
+
   // We always know 'm_position' points to a wanted chunk. If it
   // changes, we need to move m_position to the next one.
   if (index == m_position)
@@ -190,6 +309,9 @@ ChunkSelector::not_using_index(uint32_t index) {
   // downloading them event when 'index == invalid_chunk'.
   if (m_position == invalid_chunk)
     m_position = index;
+
+  if (index < m_sequentialHint)
+    m_sequentialHint = index;
 }
 
 // This could propably be split into two functions, one for checking
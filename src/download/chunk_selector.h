@@ -61,7 +61,20 @@ class ChunkSelector {
 public:
   static const uint32_t invalid_chunk = ~(uint32_t)0;
 
-  ChunkSelector(download_data* data) : m_data(data) {}
+  // How many rarity bucket candidates to probe before falling back to
+  // the position scan.
+  static const uint32_t max_rarity_probes = 128;
+
+  // How far past the in-order edge sequential selection may reach.
+  static const uint32_t max_sequential_window = 64;
+
+  ChunkSelector(download_data* data) : m_data(data), m_sequential(false), m_sequentialHint(0) {}
+
+  // Streaming downloads want chunks in rough file order; selection
+  // prefers the window at the in-order edge and falls back to normal
+  // selection for peers that don't have it.
+  bool                is_sequential() const         { return m_sequential; }
+  void                set_sequential(bool state)    { m_sequential = state; }
 
   bool                empty() const                 { return size() == 0; }
   uint32_t            size() const                  { return m_data->untouched_bitfield()->size_bits(); }
@@ -101,6 +114,9 @@ public:
   bool                received_have_chunk(PeerChunks* pc, uint32_t index);
 
 private:
+  uint32_t            find_sequential(PeerChunks* pc);
+  bool                find_rarest(PeerChunks* pc, const download_data::priority_ranges* ranges, uint32_t* result);
+
   bool                search_linear(const Bitfield* bf, rak::partial_queue* pq, const download_data::priority_ranges* ranges, uint32_t first, uint32_t last);
   inline bool         search_linear_range(const Bitfield* bf, rak::partial_queue* pq, uint32_t first, uint32_t last);
   inline bool         search_linear_byte(rak::partial_queue* pq, uint32_t index, Bitfield::value_type wanted);
@@ -118,6 +134,14 @@ private:
   rak::partial_queue  m_sharedQueue;
 
   uint32_t            m_position;
+
+  bool                m_sequential;
+  uint32_t            m_sequentialHint;
+
+  // The most recently delegated chunk; among equally rare candidates
+  // selection prefers its on-disk neighbours, so the write pattern
+  // trends sequential when availability permits.
+  uint32_t            m_affinity;
 };
 
 }
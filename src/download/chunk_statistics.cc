@@ -36,6 +36,9 @@
 
 #include "config.h"
 
+#include <cstring>
+
+#include "torrent/bitfield.h"
 #include "torrent/exceptions.h"
 
 #include "protocol/peer_chunks.h"
@@ -44,17 +47,214 @@
 
 namespace torrent {
 
+const ChunkStatistics::size_type ChunkStatistics::max_accounted;
+const ChunkStatistics::size_type ChunkStatistics::invalid_index;
+
 inline bool
 ChunkStatistics::should_add(PeerChunks* pc) {
   return m_accounted < max_accounted;
 }
 
+inline void
+ChunkStatistics::bucket_insert(size_type n) {
+  size_type bucket = base_type::operator[](n);
+
+  m_bucketPrev[n] = invalid_index;
+  m_bucketNext[n] = m_bucketHeads[bucket];
+
+  if (m_bucketHeads[bucket] != invalid_index)
+    m_bucketPrev[m_bucketHeads[bucket]] = n;
+
+  m_bucketHeads[bucket] = n;
+
+  if (bucket < m_minBucket)
+    m_minBucket = bucket;
+}
+
+inline void
+ChunkStatistics::bucket_remove(size_type n) {
+  size_type bucket = base_type::operator[](n);
+
+  if (m_bucketPrev[n] == invalid_index)
+    m_bucketHeads[bucket] = m_bucketNext[n];
+  else
+    m_bucketNext[m_bucketPrev[n]] = m_bucketNext[n];
+
+  if (m_bucketNext[n] != invalid_index)
+    m_bucketPrev[m_bucketNext[n]] = m_bucketPrev[n];
+}
+
+inline void
+ChunkStatistics::inc_rarity(size_type n) {
+  bucket_remove(n);
+  base_type::operator[](n)++;
+  bucket_insert(n);
+}
+
+inline void
+ChunkStatistics::dec_rarity(size_type n) {
+  bucket_remove(n);
+  base_type::operator[](n)--;
+  bucket_insert(n);
+}
+
+// Bitfield guarantees the unused bits of the last byte are unset, so
+// the whole-byte kernels below never see spurious indices.
+
+void
+ChunkStatistics::accumulate_bitfield(const Bitfield* bitfield, int delta) {
+  const Bitfield::value_type* data = bitfield->begin();
+  iterator counts = base_type::begin();
+
+  size_type full = size() / 8;
+
+  // Branchless expansion of each bit into its count, in a shape the
+  // compiler vectorizes. No saturation is needed; at most
+  // 'max_accounted' peers are ever accounted, so the counts cannot
+  // wrap a uint8_t.
+  for (size_type i = 0; i != full; i++) {
+    Bitfield::value_type b = data[i];
+
+    for (unsigned int j = 0; j != 8; j++)
+      counts[i * 8 + j] += delta * ((b >> (7 - j)) & 1);
+  }
+
+  for (size_type n = full * 8; n != size(); n++)
+    if (bitfield->get(n))
+      base_type::operator[](n) += delta;
+}
+
+void
+ChunkStatistics::rebuild_buckets() {
+  m_bucketHeads.assign(max_accounted + 1, invalid_index);
+  m_minBucket = 0;
+
+  for (size_type i = 0, last = size(); i != last; i++)
+    bucket_insert(i);
+}
+
+void
+ChunkStatistics::add_bitfield(const Bitfield* bitfield) {
+  // A near-complete bitfield touches almost every bucket anyway, so
+  // accumulating the counts wholesale and rebuilding the buckets in
+  // one pass beats moving each chunk through its bucket individually.
+  if (bitfield->size_set() >= bitfield->size_bits() - bitfield->size_bits() / 4) {
+    accumulate_bitfield(bitfield, 1);
+    rebuild_buckets();
+    return;
+  }
+
+  const Bitfield::value_type* data = bitfield->begin();
+  size_type size_bytes = bitfield->size_bytes();
+  size_type i = 0;
+
+  while (i + sizeof(uint64_t) <= size_bytes) {
+    // Skip clear stretches eight bytes at a time; sparse bitfields
+    // are mostly zero words.
+    uint64_t span;
+    std::memcpy(&span, data + i, sizeof(span));
+
+    if (span == 0) {
+      i += sizeof(span);
+      continue;
+    }
+
+    for (size_type last = i + sizeof(span); i != last; i++) {
+      Bitfield::value_type b = data[i];
+
+      for (unsigned int j = 0; b != 0; j++, b <<= 1)
+        if (b & 0x80)
+          inc_rarity(i * 8 + j);
+    }
+  }
+
+  for (; i != size_bytes; i++) {
+    Bitfield::value_type b = data[i];
+
+    for (unsigned int j = 0; b != 0; j++, b <<= 1)
+      if (b & 0x80)
+        inc_rarity(i * 8 + j);
+  }
+}
+
+void
+ChunkStatistics::remove_bitfield(const Bitfield* bitfield) {
+  if (bitfield->size_set() >= bitfield->size_bits() - bitfield->size_bits() / 4) {
+    accumulate_bitfield(bitfield, -1);
+    rebuild_buckets();
+    return;
+  }
+
+  const Bitfield::value_type* data = bitfield->begin();
+  size_type size_bytes = bitfield->size_bytes();
+  size_type i = 0;
+
+  while (i + sizeof(uint64_t) <= size_bytes) {
+    uint64_t span;
+    std::memcpy(&span, data + i, sizeof(span));
+
+    if (span == 0) {
+      i += sizeof(span);
+      continue;
+    }
+
+    for (size_type last = i + sizeof(span); i != last; i++) {
+      Bitfield::value_type b = data[i];
+
+      for (unsigned int j = 0; b != 0; j++, b <<= 1)
+        if (b & 0x80)
+          dec_rarity(i * 8 + j);
+    }
+  }
+
+  for (; i != size_bytes; i++) {
+    Bitfield::value_type b = data[i];
+
+    for (unsigned int j = 0; b != 0; j++, b <<= 1)
+      if (b & 0x80)
+        dec_rarity(i * 8 + j);
+  }
+}
+
+ChunkStatistics::size_type
+ChunkStatistics::rarest_first() {
+  if (empty())
+    return invalid_index;
+
+  // Advance the hint past buckets emptied since the last walk; a
+  // non-empty chunk table always has some non-empty bucket.
+  while (m_bucketHeads[m_minBucket] == invalid_index)
+    m_minBucket++;
+
+  return m_bucketHeads[m_minBucket];
+}
+
+ChunkStatistics::size_type
+ChunkStatistics::rarest_next(size_type n) {
+  if (m_bucketNext[n] != invalid_index)
+    return m_bucketNext[n];
+
+  for (size_type bucket = base_type::operator[](n) + 1; bucket <= max_accounted; bucket++)
+    if (m_bucketHeads[bucket] != invalid_index)
+      return m_bucketHeads[bucket];
+
+  return invalid_index;
+}
+
 void
 ChunkStatistics::initialize(size_type s) {
   if (!empty())
     throw internal_error("ChunkStatistics::initialize(...) called on an initialized object.");
 
   base_type::resize(s);
+
+  m_bucketNext.resize(s);
+  m_bucketPrev.resize(s);
+  m_bucketHeads.assign(max_accounted + 1, invalid_index);
+  m_minBucket = 0;
+
+  for (size_type i = 0; i < s; i++)
+    bucket_insert(i);
 }
 
 void
@@ -63,6 +263,11 @@ ChunkStatistics::clear() {
     throw internal_error("ChunkStatistics::clear() m_complete != 0.");
 
   base_type::clear();
+
+  m_bucketNext.clear();
+  m_bucketPrev.clear();
+  m_bucketHeads.clear();
+  m_minBucket = 0;
 }
 
 void
@@ -79,12 +284,8 @@ ChunkStatistics::received_connect(PeerChunks* pc) {
     // when there's no need.
     pc->set_using_counter(true);
     m_accounted++;
-    
-    iterator itr = base_type::begin();
 
-    // Use a bitfield iterator instead.
-    for (Bitfield::size_type index = 0; index < pc->bitfield()->size_bits(); ++index, ++itr)
-      *itr += pc->bitfield()->get(index);
+    add_bitfield(pc->bitfield());
   }
 }
 
@@ -108,11 +309,7 @@ ChunkStatistics::received_disconnect(PeerChunks* pc) {
 
     m_accounted--;
 
-    iterator itr = base_type::begin();
-
-    // Use a bitfield iterator instead.
-    for (Bitfield::size_type index = 0; index < pc->bitfield()->size_bits(); ++index, ++itr)
-      *itr -= pc->bitfield()->get(index);
+    remove_bitfield(pc->bitfield());
   }
 }
 
@@ -135,19 +332,21 @@ ChunkStatistics::received_have_chunk(PeerChunks* pc, uint32_t index, uint32_t le
   
   if (pc->using_counter()) {
 
-    base_type::operator[](index)++;
+    inc_rarity(index);
 
     // The below code should not cause useless work to be done in case
     // of immediate disconnect.
     if (pc->bitfield()->is_all_set()) {
       if (m_accounted == 0)
 	throw internal_error("ChunkStatistics::received_disconnect(...) m_accounted == 0.");
-      
+
       m_complete++;
       m_accounted--;
-      
-      for (iterator itr = base_type::begin(), last = base_type::end(); itr != last; ++itr)
-	*itr -= 1;
+
+      // The bitfield just became all set, so every count drops by
+      // one; take the bulk path rather than a bucket move per chunk.
+      accumulate_bitfield(pc->bitfield(), -1);
+      rebuild_buckets();
     }
 
   } else {
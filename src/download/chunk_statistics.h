@@ -42,6 +42,7 @@
 
 namespace torrent {
 
+class Bitfield;
 class PeerChunks;
 
 class ChunkStatistics : public std::vector<uint8_t> {
@@ -60,8 +61,9 @@ public:
   using base_type::size;
 
   static const size_type max_accounted = 255;
+  static const size_type invalid_index = ~(size_type)0;
 
-  ChunkStatistics() : m_complete(0), m_accounted(0) {}
+  ChunkStatistics() : m_complete(0), m_accounted(0), m_minBucket(0) {}
   ~ChunkStatistics() {}
 
   size_type           complete() const              { return m_complete; }
@@ -100,14 +102,43 @@ public:
 
   const_reference     operator [] (size_type n) const { return base_type::operator[](n); }
 
+  // Iterate chunk indices from rarest to most common; the buckets are
+  // kept up to date as the counts change, so the walk needs no
+  // scanning. Returns invalid_index when exhausted.
+  size_type           rarest_first();
+  size_type           rarest_next(size_type n);
+
 private:
   inline bool         should_add(PeerChunks* pc);
 
+  inline void         inc_rarity(size_type n);
+  inline void         dec_rarity(size_type n);
+
+  // Bulk add/remove of a whole bitfield. Sparse bitfields iterate
+  // only the set bits, skipping clear stretches a word at a time;
+  // dense ones use a branchless byte-expanded accumulate and rebuild
+  // the rarity buckets in a single pass afterwards.
+  void                add_bitfield(const Bitfield* bitfield);
+  void                remove_bitfield(const Bitfield* bitfield);
+
+  void                accumulate_bitfield(const Bitfield* bitfield, int delta);
+  void                rebuild_buckets();
+
+  inline void         bucket_insert(size_type n);
+  inline void         bucket_remove(size_type n);
+
   ChunkStatistics(const ChunkStatistics&);
   void operator = (const ChunkStatistics&);
 
   size_type           m_complete;
   size_type           m_accounted;
+
+  // Intrusive doubly-linked lists grouping chunk indices by their
+  // availability count, with a lazily advanced minimum bucket hint.
+  std::vector<size_type> m_bucketNext;
+  std::vector<size_type> m_bucketPrev;
+  std::vector<size_type> m_bucketHeads;
+  size_type           m_minBucket;
 };
 
 }
@@ -46,10 +46,15 @@
 #include "torrent/data/block.h"
 #include "torrent/data/block_list.h"
 #include "torrent/data/block_transfer.h"
+#include "torrent/data/file_list.h"
+#include "download/chunk_selector.h"
+#include "download/download_main.h"
 #include "protocol/peer_chunks.h"
 
 #include "delegator.h"
 
+#include "globals.h"
+
 namespace torrent {
 
 struct DelegatorCheckAffinity {
@@ -96,6 +101,22 @@ struct DelegatorCheckPriority {
   const PeerChunks*   m_peerChunks;
 };
 
+struct DelegatorCheckStreaming {
+  DelegatorCheckStreaming(Delegator* delegator, Block** target, const PeerChunks* peerChunks) :
+    m_delegator(delegator), m_target(target), m_peerChunks(peerChunks) {}
+
+  bool operator () (BlockList* d) {
+    return
+      d->priority() == PRIORITY_HIGH &&
+      m_peerChunks->bitfield()->get(d->index()) &&
+      (*m_target = m_delegator->delegate_streaming(d, m_peerChunks->peer_info())) != NULL;
+  }
+
+  Delegator*          m_delegator;
+  Block**             m_target;
+  const PeerChunks*   m_peerChunks;
+};
+
 // TODO: Should this ensure we don't download pieces that are priority off?
 struct DelegatorCheckAggressive {
   DelegatorCheckAggressive(Delegator* delegator, Block** target, uint16_t* o, const PeerChunks* peerChunks) :
@@ -119,44 +140,61 @@ struct DelegatorCheckAggressive {
   const PeerChunks*   m_peerChunks;
 };
 
-BlockTransfer*
-Delegator::delegate(PeerChunks* peerChunks, int affinity) {
+void
+Delegator::redistribute_released() {
+  if (m_download != NULL)
+    m_download->schedule_redistribute_requests();
+}
+
+std::vector<BlockTransfer*>
+Delegator::delegate(PeerChunks* peerChunks, int affinity, bool canDuplicate, uint32_t maxBlocks) {
   // TODO: Make sure we don't queue the same piece several time on the same peer when
   // it timeout cancels them.
   Block* target = NULL;
 
+  if (maxBlocks > max_run_blocks)
+    maxBlocks = max_run_blocks;
+
   // Find piece with same index as affinity. This affinity should ensure that we
   // never start another piece while the chunk this peer used to download is still
   // in progress.
   //
   // TODO: What if the hash failed? Don't want data from that peer again.
-  if (affinity >= 0 && 
+  if (affinity >= 0 &&
       std::find_if(m_transfers.begin(), m_transfers.end(), DelegatorCheckAffinity(this, &target, affinity, peerChunks->peer_info()))
       != m_transfers.end())
-    return target->insert(peerChunks->peer_info());
+    return delegate_run(target, peerChunks, maxBlocks);
 
   if (peerChunks->is_seeder() && (target = delegate_seeder(peerChunks)) != NULL)
-    return target->insert(peerChunks->peer_info());
+    return delegate_run(target, peerChunks, maxBlocks);
 
   // High priority pieces.
   if (std::find_if(m_transfers.begin(), m_transfers.end(), DelegatorCheckPriority(this, &target, PRIORITY_HIGH, peerChunks))
       != m_transfers.end())
-    return target->insert(peerChunks->peer_info());
+    return delegate_run(target, peerChunks, maxBlocks);
 
   // Find normal priority pieces.
   if ((target = new_chunk(peerChunks, true)))
-    return target->insert(peerChunks->peer_info());
+    return delegate_run(target, peerChunks, maxBlocks);
 
   // Normal priority pieces.
   if (std::find_if(m_transfers.begin(), m_transfers.end(), DelegatorCheckPriority(this, &target, PRIORITY_NORMAL, peerChunks))
       != m_transfers.end())
-    return target->insert(peerChunks->peer_info());
+    return delegate_run(target, peerChunks, maxBlocks);
 
   if ((target = new_chunk(peerChunks, false)))
-    return target->insert(peerChunks->peer_info());
+    return delegate_run(target, peerChunks, maxBlocks);
 
-  if (!m_aggressive)
-    return NULL;
+  // While streaming, escalate high priority blocks that have lingered
+  // past their deadline into duplicate requests; a localized endgame
+  // for the window the reader is waiting on.
+  if (m_streaming && canDuplicate &&
+      std::find_if(m_transfers.begin(), m_transfers.end(), DelegatorCheckStreaming(this, &target, peerChunks))
+      != m_transfers.end())
+    return delegate_run(target, peerChunks, maxBlocks);
+
+  if (!m_aggressive || !canDuplicate)
+    return std::vector<BlockTransfer*>();
 
   // Aggressive mode, look for possible downloads that already have
   // one or more queued.
@@ -166,7 +204,35 @@ Delegator::delegate(PeerChunks* peerChunks, int affinity) {
 
   std::find_if(m_transfers.begin(), m_transfers.end(), DelegatorCheckAggressive(this, &target, &overlapped, peerChunks));
 
-  return target ? target->insert(peerChunks->peer_info()) : NULL;
+  if (target == NULL)
+    return std::vector<BlockTransfer*>();
+
+  return delegate_run(target, peerChunks, maxBlocks);
+}
+
+// Assign 'first' to the peer, then keep assigning the immediately
+// following blocks of the same chunk for as long as they are untouched
+// and the run cap allows. The blocks queue and arrive in file order,
+// so both our bookkeeping and the peer's disk reads see one large
+// sequential unit instead of scattered 16KB pieces.
+std::vector<BlockTransfer*>
+Delegator::delegate_run(Block* first, PeerChunks* peerChunks, uint32_t maxBlocks) {
+  std::vector<BlockTransfer*> transfers;
+  transfers.push_back(first->insert(peerChunks->peer_info()));
+
+  BlockList::iterator itr = first;
+  BlockList::iterator last = first->parent()->end();
+
+  // The run stops at the first block someone else has touched;
+  // skipping over it would break the contiguity we're after.
+  while (++itr != last && transfers.size() < maxBlocks) {
+    if (itr->is_finished() || itr->size_all() != 0)
+      break;
+
+    transfers.push_back(itr->insert(peerChunks->peer_info()));
+  }
+
+  return transfers;
 }
   
 Block*
@@ -188,12 +254,14 @@ Delegator::delegate_seeder(PeerChunks* peerChunks) {
 
 Block*
 Delegator::new_chunk(PeerChunks* pc, bool highPriority) {
-  uint32_t index = m_slot_chunk_find(pc, highPriority);
+  uint32_t index = m_slot_chunk_find ? m_slot_chunk_find(pc, highPriority) : m_chunkSelector->find(pc, highPriority);
 
   if (index == ~(uint32_t)0)
     return NULL;
 
-  TransferList::iterator itr = m_transfers.insert(Piece(index, 0, m_slot_chunk_size(index)), block_size);
+  uint32_t chunk_size = m_slot_chunk_size ? m_slot_chunk_size(index) : m_fileList->chunk_index_size(index);
+
+  TransferList::iterator itr = m_transfers.insert(Piece(index, 0, chunk_size), block_size);
 
   (*itr)->set_by_seeder(pc->is_seeder());
 
@@ -209,7 +277,7 @@ Block*
 Delegator::delegate_piece(BlockList* c, const PeerInfo* peerInfo) {
   Block* p = NULL;
 
-  for (BlockList::iterator i = c->begin(); i != c->end(); ++i) {
+  for (BlockList::iterator i = c->first_unfinished(); i != c->end(); ++i) {
     if (i->is_finished() || !i->is_stalled())
       continue;
 
@@ -227,11 +295,36 @@ Delegator::delegate_piece(BlockList* c, const PeerInfo* peerInfo) {
   return p;
 }
 
+// Duplicate a block whose outstanding requests have all lingered past
+// the streaming deadline, capped at three requests per block.
+Block*
+Delegator::delegate_streaming(BlockList* c, const PeerInfo* peerInfo) {
+  int32_t deadline = cachedTime.seconds() - streaming_deadline;
+
+  for (BlockList::iterator i = c->first_unfinished(); i != c->end(); ++i) {
+    if (i->is_finished() || i->size_all() == 0 || i->size_all() >= 3 || i->find(peerInfo) != NULL)
+      continue;
+
+    bool lingering = true;
+
+    for (Block::transfer_list_type::const_iterator itr = i->queued()->begin(), last = i->queued()->end(); lingering && itr != last; ++itr)
+      lingering = (*itr)->request_time() <= deadline;
+
+    for (Block::transfer_list_type::const_iterator itr = i->transfers()->begin(), last = i->transfers()->end(); lingering && itr != last; ++itr)
+      lingering = (*itr)->request_time() <= deadline;
+
+    if (lingering)
+      return &*i;
+  }
+
+  return NULL;
+}
+
 Block*
 Delegator::delegate_aggressive(BlockList* c, uint16_t* overlapped, const PeerInfo* peerInfo) {
   Block* p = NULL;
 
-  for (BlockList::iterator i = c->begin(); i != c->end() && *overlapped != 0; ++i)
+  for (BlockList::iterator i = c->first_unfinished(); i != c->end() && *overlapped != 0; ++i)
     if (!i->is_finished() && i->size_not_stalled() < *overlapped && i->find(peerInfo) == NULL) {
       p = &*i;
       *overlapped = i->size_not_stalled();
@@ -48,6 +48,9 @@ namespace torrent {
 class Block;
 class BlockList;
 class BlockTransfer;
+class ChunkSelector;
+class DownloadMain;
+class FileList;
 class Piece;
 class PeerChunks;
 class PeerInfo;
@@ -59,22 +62,54 @@ public:
 
   static const unsigned int block_size = 1 << 14;
 
-  Delegator() : m_aggressive(false) { }
+  // Cap on the number of blocks handed to one peer in a single
+  // delegation; 8 blocks gives a 128KB contiguous span per call while
+  // each request stays a spec-sized 16KB message on the wire.
+  static const uint32_t max_run_blocks = 8;
+
+  // Seconds an in-flight high priority block may linger before
+  // streaming mode requests it from an additional peer.
+  static const int32_t streaming_deadline = 15;
+
+  Delegator() : m_aggressive(false), m_streaming(false), m_chunkSelector(NULL), m_fileList(NULL), m_download(NULL) { }
 
   TransferList*       transfer_list()                     { return &m_transfers; }
   const TransferList* transfer_list() const               { return &m_transfers; }
 
-  BlockTransfer*     delegate(PeerChunks* peerChunks, int affinity);
+  // Delegate up to 'maxBlocks' blocks to this peer, extending from
+  // the first eligible block over the contiguous untouched blocks
+  // that follow it, so one peer streams a sequential span of the
+  // chunk. 'canDuplicate' allows handing out redundant endgame
+  // requests to this peer; the caller decides based on how well it is
+  // delivering.
+  std::vector<BlockTransfer*> delegate(PeerChunks* peerChunks, int affinity, bool canDuplicate, uint32_t maxBlocks);
 
   bool               get_aggressive()                     { return m_aggressive; }
   void               set_aggressive(bool a)               { m_aggressive = a; }
 
+  bool               get_streaming()                      { return m_streaming; }
+  void               set_streaming(bool s)                { m_streaming = s; }
+
+  // The delegation chain fires per block transfer and its targets
+  // are fixed once the download is assembled, so they are direct
+  // calls through these pointers rather than type-erased slots;
+  // dynamic slots remain only at the public API boundary.
+  void               set_targets(ChunkSelector* cs, FileList* fl, DownloadMain* dm) { m_chunkSelector = cs; m_fileList = fl; m_download = dm; }
+
+  // Test seam: when bound these override the direct targets above, so
+  // the unit tests can inject their own chunk selection and sizing
+  // without assembling a full download.
   slot_peer_chunk&   slot_chunk_find()                    { return m_slot_chunk_find; }
   slot_size&         slot_chunk_size()                    { return m_slot_chunk_size; }
 
+  // Called when a batch of cancelled transfers is released, so the
+  // download can redistribute the freed blocks to other peers.
+  void               redistribute_released();
+
   // Don't call this from the outside.
   Block*             delegate_piece(BlockList* c, const PeerInfo* peerInfo);
   Block*             delegate_aggressive(BlockList* c, uint16_t* overlapped, const PeerInfo* peerInfo);
+  Block*             delegate_streaming(BlockList* c, const PeerInfo* peerInfo);
 
 private:
   // Start on a new chunk, returns .end() if none possible. bf is
@@ -83,12 +118,19 @@ private:
 
   Block*             delegate_seeder(PeerChunks* peerChunks);
 
+  std::vector<BlockTransfer*> delegate_run(Block* first, PeerChunks* peerChunks, uint32_t maxBlocks);
+
   TransferList       m_transfers;
 
   bool               m_aggressive;
+  bool               m_streaming;
 
   // Propably should add a m_slotChunkStart thing, which will take
   // care of enabling etc, and will be possible to listen to.
+  ChunkSelector*     m_chunkSelector;
+  FileList*          m_fileList;
+  DownloadMain*      m_download;
+
   slot_peer_chunk    m_slot_chunk_find;
   slot_size          m_slot_chunk_size;
 };
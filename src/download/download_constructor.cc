@@ -57,11 +57,25 @@
 
 namespace torrent {
 
+// Metainfo loaded through the mmap-backed path is parsed in borrow
+// mode and carries its strings as raw references into the client's
+// buffer; normalize on access so both load paths share the parsing
+// below.
+static inline bool
+download_constructor_is_string(const Object& b) {
+  return b.is_string() || b.is_raw_string();
+}
+
+static inline std::string
+download_constructor_to_string(const Object& b) {
+  return object_create_string(b);
+}
+
 struct download_constructor_is_single_path {
   bool operator () (Object::map_type::const_reference v) const {
     return
       std::strncmp(v.first.c_str(), "name.", sizeof("name.") - 1) == 0 &&
-      v.second.is_string();
+      download_constructor_is_string(v.second);
   }
 };
 
@@ -86,8 +100,8 @@ DownloadConstructor::initialize(Object& b) {
   if (!b.has_key_map("info") && b.has_key_string("magnet-uri"))
     parse_magnet_uri(b, b.get_key_string("magnet-uri"));
 
-  if (b.has_key_string("encoding"))
-    m_defaultEncoding = b.get_key_string("encoding");
+  if (b.has_key("encoding") && download_constructor_is_string(b.get_key("encoding")))
+    m_defaultEncoding = download_constructor_to_string(b.get_key("encoding"));
 
   if (b.has_key_value("creation date"))
     m_download->info()->set_creation_date(b.get_key_value("creation date"));
@@ -111,14 +125,14 @@ DownloadConstructor::parse_name(const Object& b) {
 
   pathList.push_back(Path());
   pathList.back().set_encoding(m_defaultEncoding);
-  pathList.back().push_back(b.get_key_string("name"));
+  pathList.back().push_back(download_constructor_to_string(b.get_key("name")));
 
   for (Object::map_const_iterator itr = b.as_map().begin();
        (itr = std::find_if(itr, b.as_map().end(), download_constructor_is_single_path())) != b.as_map().end();
        ++itr) {
     pathList.push_back(Path());
     pathList.back().set_encoding(itr->first.substr(sizeof("name.") - 1));
-    pathList.back().push_back(itr->second.as_string());
+    pathList.back().push_back(download_constructor_to_string(itr->second));
   }
 
   if (pathList.empty())
@@ -148,7 +162,7 @@ DownloadConstructor::parse_info(const Object& b) {
     m_download->info()->set_flags(DownloadInfo::flag_meta_download);
 
   if (m_download->info()->is_meta_download()) {
-    if (b.get_key_string("pieces").length() != HashString::size_data)
+    if (download_constructor_to_string(b.get_key("pieces")).length() != HashString::size_data)
       throw input_error("Meta-download has invalid piece data.");
 
     chunkSize = 1;
@@ -176,10 +190,15 @@ DownloadConstructor::parse_info(const Object& b) {
     throw input_error("Torrent has zero length.");
 
   // Set chunksize before adding files to make sure the index range is
-  // correct.
-  m_download->set_complete_hash(b.get_key_string("pieces"));
-
-  if (m_download->complete_hash().size() / 20 < fileList->size_chunks())
+  // correct. A pieces key parsed in borrow mode stays referenced in
+  // the client's metainfo mapping, so a large hash blob is never
+  // copied through the heap.
+  if (b.get_key("pieces").is_raw_string())
+    m_download->set_complete_hash(b.get_key("pieces").as_raw_string());
+  else
+    m_download->set_complete_hash(b.get_key_string("pieces"));
+
+  if (m_download->chunk_hash_count() < fileList->size_chunks())
     throw bencode_error("Torrent size and 'info:pieces' length does not match.");
 }
 
@@ -224,10 +243,10 @@ DownloadConstructor::add_tracker_group(const Object& b) {
 
 void
 DownloadConstructor::add_tracker_single(const Object& b, int group) {
-  if (!b.is_string())
+  if (!download_constructor_is_string(b))
     throw bencode_error("Tracker entry not a string");
-    
-  m_download->main()->tracker_list()->insert_url(group, rak::trim_classic(b.as_string()));
+
+  m_download->main()->tracker_list()->insert_url(group, rak::trim_classic(download_constructor_to_string(b)));
 }
 
 void
@@ -237,10 +256,10 @@ DownloadConstructor::add_dht_node(const Object& b) {
 
   Object::list_type::const_iterator el = b.as_list().begin();
 
-  if (!el->is_string())
+  if (!download_constructor_is_string(*el))
     return;
 
-  const std::string& host = el->as_string();
+  std::string host = download_constructor_to_string(*el);
 
   if (!(++el)->is_value())
     return;
@@ -250,12 +269,16 @@ DownloadConstructor::add_dht_node(const Object& b) {
 
 bool
 DownloadConstructor::is_valid_path_element(const Object& b) {
+  if (!download_constructor_is_string(b))
+    return false;
+
+  std::string str = download_constructor_to_string(b);
+
   return
-    b.is_string() &&
-    b.as_string() != "." &&
-    b.as_string() != ".." &&
-    std::find(b.as_string().begin(), b.as_string().end(), '/') == b.as_string().end() &&
-    std::find(b.as_string().begin(), b.as_string().end(), '\0') == b.as_string().end();
+    str != "." &&
+    str != ".." &&
+    std::find(str.begin(), str.end(), '/') == str.end() &&
+    std::find(str.begin(), str.end(), '\0') == str.end();
 }
 
 void
@@ -271,14 +294,14 @@ DownloadConstructor::parse_single_file(const Object& b, uint32_t chunkSize) {
 
   pathList.push_back(Path());
   pathList.back().set_encoding(m_defaultEncoding);
-  pathList.back().push_back(b.get_key_string("name"));
+  pathList.back().push_back(download_constructor_to_string(b.get_key("name")));
 
   for (Object::map_const_iterator itr = b.as_map().begin();
        (itr = std::find_if(itr, b.as_map().end(), download_constructor_is_single_path())) != b.as_map().end();
        ++itr) {
     pathList.push_back(Path());
     pathList.back().set_encoding(itr->first.substr(sizeof("name.") - 1));
-    pathList.back().push_back(itr->second.as_string());
+    pathList.back().push_back(download_constructor_to_string(itr->second));
   }
 
   if (pathList.empty())
@@ -346,7 +369,7 @@ DownloadConstructor::create_path(const Object::list_type& plist, const std::stri
   Path p;
   p.set_encoding(enc);
 
-  std::transform(plist.begin(), plist.end(), std::back_inserter(p), std::mem_fun_ref<const Object::string_type&>(&Object::as_string));
+  std::transform(plist.begin(), plist.end(), std::back_inserter(p), std::ptr_fun(&download_constructor_to_string));
 
   return p;
 }
@@ -478,7 +501,7 @@ DownloadConstructor::parse_magnet_uri(Object& b, const std::string& uri) {
       }
 
     } else if (raw_bencode_equal_c_str(tag, "tr")) {
-      trackers.insert_back(Object::create_list()).insert_back(decoded);
+      trackers.insert_back(Object::create_list()).insert_back(std::move(decoded));
     }
     // could also handle "dn" = display name (torrent name), but we can't really use that
   }
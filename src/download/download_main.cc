@@ -77,8 +77,7 @@ DownloadMain::DownloadMain() :
 
   m_connectionList = new ConnectionList(this);
 
-  m_delegator.slot_chunk_find() = std::bind(&ChunkSelector::find, m_chunkSelector, std::placeholders::_1, std::placeholders::_2);
-  m_delegator.slot_chunk_size() = std::bind(&FileList::chunk_index_size, file_list(), std::placeholders::_1);
+  m_delegator.set_targets(m_chunkSelector, file_list(), this);
 
   m_delegator.transfer_list()->slot_canceled()  = std::bind(&ChunkSelector::not_using_index, m_chunkSelector, std::placeholders::_1);
   m_delegator.transfer_list()->slot_queued()    = std::bind(&ChunkSelector::using_index, m_chunkSelector, std::placeholders::_1);
@@ -86,6 +85,8 @@ DownloadMain::DownloadMain() :
   m_delegator.transfer_list()->slot_corrupt()   = std::bind(&DownloadMain::receive_corrupt_chunk, this, std::placeholders::_1);
 
   m_delayDisconnectPeers.slot() = std::bind(&ConnectionList::disconnect_queued, m_connectionList);
+  m_delayHaveFlush.slot() = std::bind(&DownloadMain::receive_have_flush, this);
+  m_delayRedistributeRequests.slot() = std::bind(&DownloadMain::receive_redistribute_requests, this);
   m_taskTrackerRequest.slot() = std::bind(&DownloadMain::receive_tracker_request, this);
 
   m_chunkList->set_data(file_list()->mutable_data());
@@ -118,12 +119,16 @@ DownloadMain::~DownloadMain() {
 }
 
 std::pair<ThrottleList*, ThrottleList*>
-DownloadMain::throttles(const sockaddr* sa) {
+DownloadMain::throttles(const sockaddr* sa, const sockaddr* local_sa) {
   ThrottlePair pair = ThrottlePair(NULL, NULL);
 
   if (manager->connection_manager()->address_throttle())
     pair = manager->connection_manager()->address_throttle()(sa);
 
+  // Cap each uplink of a multi-homed host at its own line rate.
+  if (pair.first == NULL && pair.second == NULL && local_sa != NULL)
+    pair = manager->connection_manager()->bind_address_throttle(local_sa);
+
   return std::make_pair(pair.first == NULL ? upload_throttle() : pair.first->throttle_list(),
                         pair.second == NULL ? download_throttle() : pair.second->throttle_list());
 }
@@ -176,6 +181,8 @@ void DownloadMain::start() {
   info()->set_flags(DownloadInfo::flag_active);
   chunk_list()->set_flags(ChunkList::flag_active);
 
+  file_list()->prepare_active_files();
+
   m_delegator.set_aggressive(false);
   update_endgame();  
 
@@ -199,6 +206,8 @@ DownloadMain::stop() {
   m_initialSeeding = NULL;
 
   priority_queue_erase(&taskScheduler, &m_delayDisconnectPeers);
+  priority_queue_erase(&taskScheduler, &m_delayHaveFlush);
+  priority_queue_erase(&taskScheduler, &m_delayRedistributeRequests);
   priority_queue_erase(&taskScheduler, &m_taskTrackerRequest);
 
   if (info()->upload_unchoked() != 0 || info()->download_unchoked() != 0)
@@ -264,6 +273,31 @@ DownloadMain::receive_chunk_done(unsigned int index) {
   m_slotHashCheckAdd(handle);
 }
 
+// Wake every connection once per batch of finished chunks; each
+// peer's fill_write_buffer drains all the queued have messages in a
+// single burst rather than being re-armed for every chunk.
+void
+DownloadMain::receive_have_flush() {
+  for (ConnectionList::iterator itr = connection_list()->begin(), last = connection_list()->end(); itr != last; ++itr)
+    (*itr)->m_ptr()->write_insert_poll_safe();
+}
+
+// Cancelled transfers are released in whole batches, either when a
+// choked peer's removal timer expires or when a peer disconnects.
+// Coalesce those batches into a single redistribution pass; a choke
+// cycle typically chokes several peers whose timers expire together.
+void
+DownloadMain::schedule_redistribute_requests() {
+  if (!m_delayRedistributeRequests.is_queued())
+    priority_queue_insert(&taskScheduler, &m_delayRedistributeRequests, cachedTime + rak::timer::from_milliseconds(50));
+}
+
+void
+DownloadMain::receive_redistribute_requests() {
+  for (ConnectionList::iterator itr = connection_list()->begin(), last = connection_list()->end(); itr != last; ++itr)
+    (*itr)->m_ptr()->schedule_request_pieces();
+}
+
 void
 DownloadMain::receive_corrupt_chunk(PeerInfo* peerInfo) {
   peerInfo->set_failed_counter(peerInfo->failed_counter() + 1);
@@ -439,8 +473,9 @@ DownloadMain::do_peer_exchange() {
   m_ut_pex_delta.clear();
 
   // If no peers were added or removed, the initial message is still correct and
-  // the delta message stays emptied. Otherwise generate the appropriate messages.
-  if (!added.empty() || !m_ut_pex_list.empty()) {
+  // the delta message stays emptied. Otherwise generate the appropriate
+  // messages once here; every connection then aliases the same buffers.
+  if (!added.empty() || !removed.empty()) {
     m_ut_pex_delta = ProtocolExtension::generate_ut_pex_message(added, removed);
 
     m_ut_pex_initial.clear();
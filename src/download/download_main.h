@@ -72,7 +72,10 @@ public:
   FileList*           file_list()                                { return &m_fileList; }
   PeerList*           peer_list()                                { return &m_peerList; }
 
-  std::pair<ThrottleList*, ThrottleList*> throttles(const sockaddr* sa);
+  // Throttles to use for a connection to 'sa'; a per-address override
+  // wins, then the throttle of the interface the socket is bound to,
+  // then the download's own throttles.
+  std::pair<ThrottleList*, ThrottleList*> throttles(const sockaddr* sa, const sockaddr* local_sa = NULL);
 
   ThrottleList*       upload_throttle()                          { return m_uploadThrottle; }
   void                set_upload_throttle(ThrottleList* t)       { m_uploadThrottle = t; }
@@ -110,6 +113,11 @@ public:
   void                receive_chunk_done(unsigned int index);
   void                receive_corrupt_chunk(PeerInfo* peerInfo);
 
+  void                receive_have_flush();
+
+  void                schedule_redistribute_requests();
+  void                receive_redistribute_requests();
+
   void                receive_tracker_success();
   void                receive_tracker_request();
 
@@ -124,6 +132,7 @@ public:
   rak::priority_item& delay_partially_restarted() { return m_delay_partially_restarted; }
 
   rak::priority_item& delay_disconnect_peers() { return m_delayDisconnectPeers; }
+  rak::priority_item& delay_have_flush()       { return m_delayHaveFlush; }
 
 private:
   // Disable copy ctor and assignment.
@@ -173,6 +182,8 @@ private:
   rak::priority_item  m_delay_partially_restarted;
 
   rak::priority_item  m_delayDisconnectPeers;
+  rak::priority_item  m_delayHaveFlush;
+  rak::priority_item  m_delayRedistributeRequests;
   rak::priority_item  m_taskTrackerRequest;
 };
 
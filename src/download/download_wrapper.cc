@@ -4,13 +4,16 @@
 #include <stdlib.h>
 #include <rak/file_stat.h>
 
+#include "data/chunk.h"
 #include "data/chunk_list.h"
 #include "data/hash_queue.h"
 #include "data/hash_torrent.h"
 #include "protocol/handshake_manager.h"
 #include "protocol/peer_connection_base.h"
+#include "torrent/chunk_manager.h"
 #include "torrent/exceptions.h"
 #include "torrent/object.h"
+#include "torrent/object_stream.h"
 #include "torrent/tracker_list.h"
 #include "torrent/data/file.h"
 #include "torrent/data/file_list.h"
@@ -20,9 +23,11 @@
 #include "torrent/tracker_controller.h"
 #include "torrent/tracker_list.h"
 #include "torrent/utils/log.h"
+#include "utils/crc32c.h"
 
 #include "available_list.h"
 #include "chunk_selector.h"
+#include "manager.h"
 
 #include "download_wrapper.h"
 
@@ -38,7 +43,10 @@ DownloadWrapper::DownloadWrapper() :
 
   m_bencode(NULL),
   m_hashChecker(NULL),
-  m_connectionType(0) {
+  m_hashData(NULL),
+  m_hashSize(0),
+  m_connectionType(0),
+  m_metadataBuffer(NULL) {
 
   m_main->delay_download_done().slot()       = std::bind(&download_data::call_download_done, data());
   m_main->delay_partially_done().slot()      = std::bind(&download_data::call_partially_done, data());
@@ -66,6 +74,7 @@ DownloadWrapper::~DownloadWrapper() {
   delete m_hashChecker;
   delete m_bencode;
   delete m_main;
+  delete [] m_metadataBuffer;
 }
 
 void
@@ -89,7 +98,7 @@ DownloadWrapper::initialize(const std::string& hash, const std::string& id) {
   m_hashChecker = new HashTorrent(m_main->chunk_list());
 
   // Connect various signals and slots.
-  m_hashChecker->slot_check_chunk() = std::bind(&DownloadWrapper::check_chunk_hash, this, std::placeholders::_1);
+  m_hashChecker->slot_check_chunk() = std::bind(&DownloadWrapper::check_chunk_hash_initial, this, std::placeholders::_1);
   m_hashChecker->delay_checked().slot() = std::bind(&DownloadWrapper::receive_initial_hash, this);
 }
 
@@ -103,10 +112,13 @@ DownloadWrapper::close() {
   // not get passed to HashTorrent.
   hash_queue()->remove(data());
 
-  // This could/should be async as we do not care that much if it
-  // succeeds or not, any chunks not included in that last
-  // hash_resume_save get ignored anyway.
-  m_main->chunk_list()->sync_chunks(ChunkList::sync_all | ChunkList::sync_force | ChunkList::sync_sloppy | ChunkList::sync_ignore_error);
+  // The final flush goes through the disk thread when it is running,
+  // so closing a torrent with a deep write queue doesn't stall the
+  // event loop while the dirty chunks drain to disk. We do not care
+  // that much if it succeeds or not, any chunks not included in that
+  // last hash_resume_save get ignored anyway.
+  if (!manager->chunk_manager()->flush_chunks_async(m_main->chunk_list()))
+    m_main->chunk_list()->sync_chunks(ChunkList::sync_all | ChunkList::sync_force | ChunkList::sync_sloppy | ChunkList::sync_ignore_error);
 
   m_main->close();
 
@@ -145,6 +157,18 @@ DownloadWrapper::receive_initial_hash() {
     data()->slot_initial_hash()();
 }    
 
+// Shadow checksum of a just-verified chunk, taken while the pages are
+// still hot from the SHA1 pass.
+static uint32_t
+download_wrapper_chunk_crc32c(Chunk* chunk) {
+  uint32_t crc = 0;
+
+  for (Chunk::iterator itr = chunk->begin(), last = chunk->end(); itr != last; itr++)
+    crc = crc32c(crc, itr->chunk().begin(), itr->size());
+
+  return crc;
+}
+
 void
 DownloadWrapper::receive_hash_done(ChunkHandle handle, const char* hash) {
   if (!handle.is_valid())
@@ -159,9 +183,13 @@ DownloadWrapper::receive_hash_done(ChunkHandle handle, const char* hash) {
       m_hashChecker->receive_chunk_cleared(handle.index());
 
     } else {
-      if (std::memcmp(hash, chunk_hash(handle.index()), 20) == 0)
+      if (std::memcmp(hash, chunk_hash(handle.index()), 20) == 0) {
         m_main->file_list()->mark_completed(handle.index());
 
+        if (data()->has_chunk_crc32c())
+          data()->set_chunk_crc32c_value(handle.index(), download_wrapper_chunk_crc32c(handle.chunk()));
+      }
+
       m_hashChecker->receive_chunkdone(handle.index());
     }
 
@@ -187,6 +215,9 @@ DownloadWrapper::receive_hash_done(ChunkHandle handle, const char* hash) {
       m_main->delegator()->transfer_list()->hash_succeeded(handle.index(), handle.chunk());
       m_main->update_endgame();
 
+      if (data()->has_chunk_crc32c())
+        data()->set_chunk_crc32c_value(handle.index(), download_wrapper_chunk_crc32c(handle.chunk()));
+
       if (m_main->file_list()->is_done()) {
         finished_download();
 
@@ -201,6 +232,17 @@ DownloadWrapper::receive_hash_done(ChunkHandle handle, const char* hash) {
       else
         m_main->have_queue()->push_front(DownloadMain::have_queue_type::value_type(cachedTime, handle.index()));
 
+      // Keep each peer's wanted-chunk counter in sync so interest
+      // decisions stay O(1).
+      for (ConnectionList::iterator itr = m_main->connection_list()->begin(), last = m_main->connection_list()->end(); itr != last; ++itr)
+        if ((*itr)->m_ptr()->peer_chunks()->has_chunk(handle.index()))
+          (*itr)->m_ptr()->peer_chunks()->dec_wanted_chunks();
+
+      // Accumulate finished chunks for a short while and wake the
+      // peers with a single combined have burst.
+      if (!m_main->delay_have_flush().is_queued())
+        priority_queue_insert(&taskScheduler, &m_main->delay_have_flush(), cachedTime + rak::timer::from_milliseconds(50));
+
     } else {
       // This needs to ensure the chunk is still valid.
       m_main->delegator()->transfer_list()->hash_failed(handle.index(), handle.chunk());
@@ -213,11 +255,24 @@ DownloadWrapper::receive_hash_done(ChunkHandle handle, const char* hash) {
 
 void
 DownloadWrapper::check_chunk_hash(ChunkHandle handle) {
+  // Verification of a freshly downloaded piece; it goes on the
+  // interactive lane so it doesn't wait behind another download's
+  // initial hash check.
+  queue_chunk_hash(handle, true);
+}
+
+void
+DownloadWrapper::check_chunk_hash_initial(ChunkHandle handle) {
+  queue_chunk_hash(handle, false);
+}
+
+void
+DownloadWrapper::queue_chunk_hash(ChunkHandle handle, bool interactive) {
   // TODO: Hack...
   ChunkHandle new_handle = m_main->chunk_list()->get(handle.index(), ChunkList::get_blocking);
   m_main->chunk_list()->release(&handle);
 
-  hash_queue()->push_back(new_handle, data(), std::bind(&DownloadWrapper::receive_hash_done, this, std::placeholders::_1, std::placeholders::_2));
+  hash_queue()->push_back(new_handle, data(), std::bind(&DownloadWrapper::receive_hash_done, this, std::placeholders::_1, std::placeholders::_2), interactive);
 }
 
 void
@@ -246,14 +301,52 @@ DownloadWrapper::receive_tracker_failed(const std::string& msg) {
   rak::slot_list_call(info()->signal_tracker_failed(), msg);
 }
 
+const char*
+DownloadWrapper::serialized_metadata() {
+  if (m_metadataBuffer == NULL) {
+    size_t metadataSize = info()->metadata_size();
+
+    m_metadataBuffer = new char[metadataSize];
+    object_write_bencode_c(object_write_to_buffer, NULL,
+                           object_buffer_t(m_metadataBuffer, m_metadataBuffer + metadataSize),
+                           &m_bencode->get_key("info"));
+  }
+
+  m_timeMetadataUsed = cachedTime;
+  return m_metadataBuffer;
+}
+
+void
+DownloadWrapper::release_serialized_metadata() {
+  delete [] m_metadataBuffer;
+  m_metadataBuffer = NULL;
+}
+
+void
+DownloadWrapper::try_cull_peers() {
+  // Free the PeerInfo's unlinked by the previous cull; getting here
+  // again means the loop went through at least one idle pass, so
+  // nothing can still be holding them from that event.
+  m_main->peer_list()->flush_deferred_peers();
+
+  if (m_timeLastCull + rak::timer::from_seconds(3600) > cachedTime)
+    return;
+
+  m_timeLastCull = cachedTime;
+  m_main->peer_list()->cull_peers(PeerList::cull_old | PeerList::cull_keep_interesting);
+}
+
 void
 DownloadWrapper::receive_tick(uint32_t ticks) {
-  // Trigger culling of PeerInfo's every hour. This should be called
-  // before the is_open check to ensure that stopped torrents reduce
-  // their memory usage.
+  // Trigger culling of PeerInfo's every hour; usually done from the
+  // idle scheduler already. This should be called before the is_open
+  // check to ensure that stopped torrents reduce their memory usage.
   if (ticks % 120 == 0)
-//   if (ticks % 1 == 0)
-    m_main->peer_list()->cull_peers(PeerList::cull_old | PeerList::cull_keep_interesting);
+    try_cull_peers();
+
+  // Drop the serialized metadata cache once requests stop coming.
+  if (m_metadataBuffer != NULL && m_timeMetadataUsed + rak::timer::from_seconds(120) < cachedTime)
+    release_serialized_metadata();
 
   if (!info()->is_open())
     return;
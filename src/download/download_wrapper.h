@@ -38,6 +38,8 @@
 #define LIBTORRENT_DOWNLOAD_WRAPPER_H
 
 #include "data/chunk_handle.h"
+#include "torrent/exceptions.h"
+#include "torrent/object_raw_bencode.h"
 #include "download_main.h"
 
 namespace torrent {
@@ -80,13 +82,29 @@ public:
   HashQueue*          hash_queue()                            { return m_hashQueue; }
   void                set_hash_queue(HashQueue* q)            { m_hashQueue = q; }
 
-  const std::string&  complete_hash()                            { return m_hash; }
-  const char*         chunk_hash(unsigned int index)             { return m_hash.c_str() + 20 * index; }
-  void                set_complete_hash(const std::string& hash) { m_hash = hash; }
+  // The complete piece hash data is either copied into m_hash or,
+  // for metainfo parsed in borrow mode, referenced straight out of
+  // the client's buffer; a borrowed view requires that buffer to
+  // outlive the download.
+  //
+  // Either way the index is one contiguous 20 bytes/piece blob, fixed
+  // at construction and immutable for the download's lifetime, so it
+  // may be read without locking from any thread.
+  const char*         chunk_hash(unsigned int index)             { return m_hashData + 20 * index; }
+  uint32_t            chunk_hash_count() const                   { return m_hashSize / 20; }
+
+  void                set_complete_hash(const std::string& hash) { m_hash = hash; m_hashData = m_hash.c_str(); m_hashSize = m_hash.size(); }
+  void                set_complete_hash(raw_string hash)         { m_hash.clear(); m_hashData = hash.data(); m_hashSize = hash.size(); }
 
   int                 connection_type() const                 { return m_connectionType; }
   void                set_connection_type(int t)              { m_connectionType = t; }
 
+  // Serialized "info" dictionary shared by every peer requesting
+  // metadata; built lazily on the first request and dropped again by
+  // receive_tick once requests stop coming.
+  const char*         serialized_metadata();
+  void                release_serialized_metadata();
+
   //
   // Internal:
   //
@@ -95,6 +113,7 @@ public:
   void                receive_hash_done(ChunkHandle handle, const char* hash);
 
   void                check_chunk_hash(ChunkHandle handle);
+  void                check_chunk_hash_initial(ChunkHandle handle);
 
   void                receive_storage_error(const std::string& str);
   uint32_t            receive_tracker_success(AddressList* l);
@@ -102,6 +121,11 @@ public:
 
   void                receive_tick(uint32_t ticks);
 
+  // Cull PeerInfo's at most once an hour regardless of caller; the
+  // idle scheduler usually gets here first, leaving the tick branch
+  // as a backstop for loops that never go idle.
+  void                try_cull_peers();
+
   void                receive_update_priorities();
 
 private:
@@ -110,14 +134,23 @@ private:
 
   void                finished_download();
 
+  void                queue_chunk_hash(ChunkHandle handle, bool interactive);
+
   DownloadMain*       m_main;
   Object*             m_bencode;
   HashTorrent*        m_hashChecker;
   HashQueue*          m_hashQueue;
 
   std::string         m_hash;
+  const char*         m_hashData;
+  uint32_t            m_hashSize;
 
   int                 m_connectionType;
+
+  rak::timer          m_timeLastCull;
+
+  char*               m_metadataBuffer;
+  rak::timer          m_timeMetadataUsed;
 };
 
 }
@@ -9,6 +9,7 @@
 #include "protocol/handshake_manager.h"
 #include "data/hash_queue.h"
 #include "net/listen.h"
+#include "tracker/tracker_http.h"
 #include "utils/instrumentation.h"
 
 #include "torrent/chunk_manager.h"
@@ -42,7 +43,8 @@ Manager::Manager() :
   m_uploadThrottle(Throttle::create_throttle()),
   m_downloadThrottle(Throttle::create_throttle()),
 
-  m_ticks(0) {
+  m_ticks(0),
+  m_idleCursor(0) {
 
   m_hashQueue = new HashQueue(&m_main_thread_disk);
   m_hashQueue->slot_has_work() =
@@ -51,25 +53,80 @@ Manager::Manager() :
               m_main_thread_main.signal_bitfield()->add_signal(std::bind(&HashQueue::work, m_hashQueue)),
               std::placeholders::_1);
 
+  m_chunkManager->slot_flush_done() =
+    std::bind(&thread_base::send_event_signal,
+              &m_main_thread_main,
+              m_main_thread_main.signal_bitfield()->add_signal(std::bind(&ChunkManager::work_flush_done, m_chunkManager)),
+              true);
+
   m_taskTick.slot() = std::bind(&Manager::receive_tick, this);
 
   priority_queue_insert(&taskScheduler, &m_taskTick, cachedTime.round_seconds());
 
+  m_main_thread_main.add_idle_slice(std::bind(&Manager::receive_idle_work, this));
+
   m_handshakeManager->slot_download_id() =
     std::bind(&DownloadManager::find_main, m_downloadManager, std::placeholders::_1);
   m_handshakeManager->slot_download_obfuscated() =
     std::bind(&DownloadManager::find_main_obfuscated, m_downloadManager, std::placeholders::_1);
+  m_handshakeManager->slot_compute_done() =
+    std::bind(&thread_base::send_event_signal,
+              &m_main_thread_main,
+              m_main_thread_main.signal_bitfield()->add_signal(std::bind(&HandshakeManager::work_compute_done, m_handshakeManager)),
+              true);
+  TrackerHttp::slot_parse_done() =
+    std::bind(&thread_base::send_event_signal,
+              &m_main_thread_main,
+              m_main_thread_main.signal_bitfield()->add_signal(std::bind(&TrackerHttp::work_parse_done)),
+              true);
   m_connectionManager->listen()->slot_accepted() =
     std::bind(&HandshakeManager::add_incoming, m_handshakeManager, std::placeholders::_1, std::placeholders::_2);
+  m_connectionManager->listen()->slot_accept_signal() =
+    std::bind(&thread_base::send_event_signal,
+              &m_main_thread_main,
+              m_main_thread_main.signal_bitfield()->add_signal(std::bind(&Listen::work_accept_queue, m_connectionManager->listen())),
+              true);
 
   m_resourceManager->push_group("default");
   m_resourceManager->group_back()->up_queue()->set_heuristics(choke_queue::HEURISTICS_UPLOAD_LEECH);
   m_resourceManager->group_back()->down_queue()->set_heuristics(choke_queue::HEURISTICS_DOWNLOAD_LEECH);
 }
 
+void
+Manager::create_disk_workers(unsigned int count) {
+  if (!m_disk_workers.empty())
+    throw internal_error("Manager::create_disk_workers(...) called twice.");
+
+  while (count-- != 0) {
+    thread_disk* worker = new thread_disk;
+
+    m_hashQueue->add_worker(worker);
+    m_disk_workers.push_back(worker);
+  }
+}
+
+void
+Manager::create_net_workers(unsigned int count) {
+  if (!m_net_workers.empty())
+    throw internal_error("Manager::create_net_workers(...) called twice.");
+
+  while (count-- != 0)
+    m_net_workers.push_back(new thread_net);
+}
+
+thread_net*
+Manager::net_thread_for_fd(int fd) {
+  if (m_net_workers.empty())
+    return NULL;
+
+  return m_net_workers[fd % m_net_workers.size()];
+}
+
 Manager::~Manager() {
   priority_queue_erase(&taskScheduler, &m_taskTick);
 
+  TrackerHttp::stop_parse_worker();
+
   m_handshakeManager->clear();
   m_downloadManager->clear();
 
@@ -78,6 +135,12 @@ Manager::~Manager() {
   delete m_handshakeManager;
   delete m_hashQueue;
 
+  for (disk_worker_list_type::iterator itr = m_disk_workers.begin(), last = m_disk_workers.end(); itr != last; itr++)
+    delete *itr;
+
+  for (net_worker_list_type::iterator itr = m_net_workers.begin(), last = m_net_workers.end(); itr != last; itr++)
+    delete *itr;
+
   delete m_resourceManager;
   delete m_dhtManager;
   delete m_connectionManager;
@@ -145,4 +208,19 @@ Manager::receive_tick() {
   priority_queue_insert(&taskScheduler, &m_taskTick, (cachedTime + rak::timer::from_seconds(30)).round_seconds());
 }
 
+// Called from the main thread's idle scheduler when the event loop
+// has slack before the next scheduled task. Age out peer lists one
+// download per slice; the hourly tick backstop handles loops that
+// never go idle.
+void
+Manager::receive_idle_work() {
+  if (m_downloadManager->empty())
+    return;
+
+  if (++m_idleCursor >= m_downloadManager->size())
+    m_idleCursor = 0;
+
+  (*(m_downloadManager->begin() + m_idleCursor))->try_cull_peers();
+}
+
 }
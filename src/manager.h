@@ -3,10 +3,12 @@
 
 #include <list>
 #include <string>
+#include <vector>
 #include <rak/priority_queue_default.h>
 
 #include "thread_disk.h"
 #include "thread_main.h"
+#include "thread_net.h"
 #include "net/socket_fd.h"
 
 namespace torrent {
@@ -49,6 +51,23 @@ public:
   thread_main*        main_thread_main()                        { return &m_main_thread_main; }
   thread_disk*        main_thread_disk()                        { return &m_main_thread_disk; }
 
+  typedef std::vector<thread_disk*> disk_worker_list_type;
+
+  // Extra disk threads beyond the main one; created before the
+  // threads are started and registered with the hash queue.
+  disk_worker_list_type* disk_workers()                         { return &m_disk_workers; }
+
+  void                create_disk_workers(unsigned int count);
+
+  typedef std::vector<thread_net*> net_worker_list_type;
+
+  // Network worker threads; sockets are sharded onto them by file
+  // descriptor. An empty pool leaves all sockets on the main thread.
+  net_worker_list_type* net_workers()                           { return &m_net_workers; }
+  thread_net*         net_thread_for_fd(int fd);
+
+  void                create_net_workers(unsigned int count);
+
   EncodingList*       encoding_list()                           { return &m_encodingList; }
 
   Throttle*           upload_throttle()                         { return m_uploadThrottle; }
@@ -58,6 +77,7 @@ public:
   void                cleanup_download(DownloadWrapper* d);
 
   void                receive_tick();
+  void                receive_idle_work();
 
 private:
   DownloadManager*    m_downloadManager;
@@ -74,12 +94,16 @@ private:
   thread_main         m_main_thread_main;
   thread_disk         m_main_thread_disk;
 
+  disk_worker_list_type m_disk_workers;
+  net_worker_list_type  m_net_workers;
+
   EncodingList        m_encodingList;
 
   Throttle*           m_uploadThrottle;
   Throttle*           m_downloadThrottle;
 
   unsigned int        m_ticks;
+  unsigned int        m_idleCursor;
   rak::priority_item  m_taskTick;
 };
 
@@ -72,6 +72,8 @@ AddressList::parse_address_compact(raw_string s) {
   if (sizeof(const SocketAddressCompact) != 6)
     throw internal_error("ConnectionList::AddressList::parse_address_compact(...) bad struct size.");
 
+  reserve(size() + s.size() / sizeof(SocketAddressCompact));
+
   std::copy(reinterpret_cast<const SocketAddressCompact*>(s.data()),
 	    reinterpret_cast<const SocketAddressCompact*>(s.data() + s.size() - s.size() % sizeof(SocketAddressCompact)),
 	    std::back_inserter(*this));
@@ -37,8 +37,9 @@
 #ifndef LIBTORRENT_DOWNLOAD_ADDRESS_LIST_H
 #define LIBTORRENT_DOWNLOAD_ADDRESS_LIST_H
 
-#include <list>
+#include <algorithm>
 #include <string>
+#include <vector>
 #include <rak/socket_address.h>
 
 #include <torrent/object.h>
@@ -46,8 +47,12 @@
 
 namespace torrent {
 
-class AddressList : public std::list<rak::socket_address> {
+// Backed by a vector so a large tracker response lands in one flat
+// buffer instead of a node per address.
+class AddressList : public std::vector<rak::socket_address> {
 public:
+  void                        sort() { std::sort(begin(), end()); }
+
   // Parse normal or compact list of addresses and add to AddressList
   void                        parse_address_normal(const Object::list_type& b);
   void                        parse_address_bencode(raw_list s);
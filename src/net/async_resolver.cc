@@ -0,0 +1,172 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2011, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include <rak/address_info.h>
+
+#include "torrent/exceptions.h"
+#include "torrent/utils/thread_base.h"
+
+#include "async_resolver.h"
+#include "globals.h"
+
+namespace torrent {
+
+AsyncResolver::AsyncResolver() :
+  m_running(false),
+  m_shutdown(false) {
+
+  pthread_mutex_init(&m_lock, NULL);
+  pthread_cond_init(&m_cond, NULL);
+}
+
+AsyncResolver::~AsyncResolver() {
+  pthread_mutex_lock(&m_lock);
+  m_shutdown = true;
+  pthread_cond_signal(&m_cond);
+  pthread_mutex_unlock(&m_lock);
+
+  if (m_running)
+    pthread_join(m_thread, NULL);
+}
+
+AsyncResolver::result_slot*
+AsyncResolver::enqueue(const char* host, int family, int socktype, result_slot slot) {
+  cache_type::iterator cacheItr = m_cache.find(std::make_pair(std::string(host), family));
+
+  if (cacheItr != m_cache.end() && cacheItr->second.expires > cachedTime) {
+    if (cacheItr->second.error != 0)
+      slot(NULL, cacheItr->second.error);
+    else
+      slot(cacheItr->second.address.c_sockaddr(), 0);
+
+    return NULL;
+  }
+
+  if (!m_running)
+    start_thread();
+
+  pthread_mutex_lock(&m_lock);
+
+  m_queue.push_back(query_type());
+
+  query_type& query = m_queue.back();
+
+  query.hostname = host;
+  query.family = family;
+  query.socktype = socktype;
+  query.slot = slot;
+
+  pthread_cond_signal(&m_cond);
+  pthread_mutex_unlock(&m_lock);
+
+  return &query.slot;
+}
+
+void
+AsyncResolver::start_thread() {
+  if (pthread_create(&m_thread, NULL, &AsyncResolver::thread_func, this) != 0)
+    throw internal_error("AsyncResolver::start_thread() could not create thread.");
+
+  m_running = true;
+}
+
+void*
+AsyncResolver::thread_func(void* resolver) {
+  static_cast<AsyncResolver*>(resolver)->run();
+  return NULL;
+}
+
+void
+AsyncResolver::run() {
+  pthread_mutex_lock(&m_lock);
+
+  while (true) {
+    if (m_queue.empty()) {
+      if (m_shutdown)
+        break;
+
+      pthread_cond_wait(&m_cond, &m_lock);
+      continue;
+    }
+
+    // Splicing keeps the element address stable, as the caller holds
+    // a pointer to the stored result slot for cancellation.
+    m_active.splice(m_active.end(), m_queue, m_queue.begin());
+
+    query_type& query = m_active.back();
+
+    pthread_mutex_unlock(&m_lock);
+
+    rak::address_info* ai;
+    int err = rak::address_info::get_address_info(query.hostname.c_str(), query.family, query.socktype, &ai);
+
+    rak::socket_address sa;
+
+    if (err == 0) {
+      sa.copy(*ai->address(), ai->length());
+      rak::address_info::free_address_info(ai);
+    }
+
+    // Deliver under the global lock, matching the environment the
+    // synchronous resolver called its slots in. Invoke a copy of the
+    // slot, as the callback commonly clears the stored one to cancel
+    // further results.
+    thread_base::acquire_global_lock();
+
+    cache_entry entry;
+    entry.address = sa;
+    entry.error = err;
+    entry.expires = cachedTime + rak::timer::from_seconds(err == 0 ? positive_ttl : negative_ttl);
+
+    m_cache[std::make_pair(query.hostname, query.family)] = entry;
+
+    result_slot slot = query.slot;
+
+    if (slot)
+      slot(err == 0 ? sa.c_sockaddr() : NULL, err);
+
+    thread_base::release_global_lock();
+
+    pthread_mutex_lock(&m_lock);
+    m_active.pop_back();
+  }
+
+  pthread_mutex_unlock(&m_lock);
+}
+
+}
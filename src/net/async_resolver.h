@@ -0,0 +1,110 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2011, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_NET_ASYNC_RESOLVER_H
+#define LIBTORRENT_NET_ASYNC_RESOLVER_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <pthread.h>
+#include <rak/socket_address.h>
+#include <rak/timer.h>
+
+#include "torrent/connection_manager.h"
+
+namespace torrent {
+
+// Non-blocking hostname resolution for the ConnectionManager resolver
+// slot. Lookups run on a dedicated thread so a slow DNS server no
+// longer freezes the main loop; results are delivered under the
+// global lock like the old synchronous resolver, so callers see the
+// same locking environment. Resolved and failed lookups are cached
+// for a few minutes so tracker retry storms don't hammer the server.
+
+class LIBTORRENT_NO_EXPORT AsyncResolver {
+public:
+  typedef ConnectionManager::slot_resolver_result_type result_slot;
+
+  static const uint32_t positive_ttl = 300;
+  static const uint32_t negative_ttl = 60;
+
+  AsyncResolver();
+  ~AsyncResolver();
+
+  // Matches the ConnectionManager resolver slot signature; returns a
+  // pointer to the stored result slot which the caller may clear to
+  // cancel, or NULL if the result was served from the cache
+  // synchronously.
+  result_slot*        enqueue(const char* host, int family, int socktype, result_slot slot);
+
+private:
+  struct query_type {
+    std::string         hostname;
+    int                 family;
+    int                 socktype;
+    result_slot         slot;
+  };
+
+  struct cache_entry {
+    rak::socket_address address;
+    int                 error;
+    rak::timer          expires;
+  };
+
+  typedef std::list<query_type>                         queue_type;
+  typedef std::map<std::pair<std::string, int>, cache_entry> cache_type;
+
+  static void*        thread_func(void* resolver);
+  void                run();
+
+  void                start_thread();
+
+  pthread_t           m_thread;
+  pthread_mutex_t     m_lock;
+  pthread_cond_t      m_cond;
+
+  bool                m_running;
+  bool                m_shutdown;
+
+  queue_type          m_queue;
+  queue_type          m_active;
+  cache_type          m_cache;
+};
+
+}
+
+#endif
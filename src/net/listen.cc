@@ -15,6 +15,7 @@
 
 #include "listen.h"
 #include "manager.h"
+#include "thread_net.h"
 
 namespace torrent {
 
@@ -35,6 +36,11 @@ Listen::open(uint16_t first, uint16_t last, int backlog, const rak::socket_addre
       !get_fd().set_reuse_address(true))
     throw resource_error("Could not allocate socket for listening.");
 
+  // When network workers exist the port is sharded onto their polls
+  // with SO_REUSEPORT; the option must be set on every socket sharing
+  // the port before any of them binds, including this primary one.
+  bool shard_ready = !manager->net_workers()->empty() && get_fd().set_reuse_port(true);
+
   rak::socket_address sa;
 
   // TODO: Temporary until we refactor:
@@ -62,6 +68,9 @@ Listen::open(uint16_t first, uint16_t last, int backlog, const rak::socket_addre
       lt_log_print(LOG_CONNECTION_LISTEN, "listen port %" PRIu16 " opened with backlog set to %i",
                    m_port, backlog);
 
+      if (shard_ready)
+        open_shards(sa, backlog);
+
       return true;
 
     }
@@ -76,10 +85,116 @@ Listen::open(uint16_t first, uint16_t last, int backlog, const rak::socket_addre
   return false;
 }
 
+void
+Listen::open_shards(const rak::socket_address& sa, int backlog) {
+  for (Manager::net_worker_list_type::iterator itr = manager->net_workers()->begin(), last = manager->net_workers()->end(); itr != last; itr++) {
+    thread_net* worker = *itr;
+    ListenShard* shard = new ListenShard(this, worker);
+
+    if (!shard->get_fd().open_stream() ||
+        !shard->get_fd().set_nonblock() ||
+        !shard->get_fd().set_reuse_address(true) ||
+        !shard->get_fd().set_reuse_port(true) ||
+        !shard->get_fd().bind(sa) ||
+        !shard->get_fd().listen(backlog)) {
+      lt_log_print(LOG_CONNECTION_LISTEN, "failed to open listen shard on port %" PRIu16, (uint16_t)m_port);
+
+      if (shard->get_fd().is_valid()) {
+        shard->get_fd().close();
+        shard->get_fd().clear();
+      }
+
+      delete shard;
+      continue;
+    }
+
+    manager->connection_manager()->inc_socket_count();
+    m_shards.push_back(shard);
+
+    // The shard joins the worker's poll on the worker's own thread.
+    worker->push_job([shard, worker]() {
+        worker->poll()->open(shard);
+        worker->poll()->insert_read(shard);
+        worker->poll()->insert_error(shard);
+      });
+    worker->interrupt();
+  }
+
+  if (!m_shards.empty())
+    lt_log_print(LOG_CONNECTION_LISTEN, "listen port %" PRIu16 " sharded onto %u network threads",
+                 (uint16_t)m_port, (unsigned)m_shards.size());
+}
+
+void
+Listen::close_shards() {
+  for (std::vector<ListenShard*>::iterator itr = m_shards.begin(), last = m_shards.end(); itr != last; itr++) {
+    ListenShard* shard = *itr;
+    thread_net* worker = shard->worker();
+
+    manager->connection_manager()->dec_socket_count();
+
+    // Leave the poll and free the shard on the owning thread, so no
+    // event for it can be in flight afterwards.
+    worker->push_job([shard, worker]() {
+        worker->poll()->remove_read(shard);
+        worker->poll()->remove_error(shard);
+        worker->poll()->close(shard);
+
+        shard->get_fd().close();
+        shard->get_fd().clear();
+
+        delete shard;
+      });
+    worker->interrupt();
+  }
+
+  m_shards.clear();
+
+  // Sockets the shards accepted but the main thread never drained are
+  // orphaned now.
+  pthread_mutex_lock(&m_accept_lock);
+
+  for (std::vector<accept_type>::iterator itr = m_accept_queue.begin(), last = m_accept_queue.end(); itr != last; itr++)
+    itr->fd.close();
+
+  m_accept_queue.clear();
+  pthread_mutex_unlock(&m_accept_lock);
+}
+
+void
+Listen::push_accepted(const accept_type* accepted, int count) {
+  pthread_mutex_lock(&m_accept_lock);
+  m_accept_queue.insert(m_accept_queue.end(), accepted, accepted + count);
+  pthread_mutex_unlock(&m_accept_lock);
+
+  if (m_slot_accept_signal)
+    m_slot_accept_signal();
+}
+
+void
+Listen::work_accept_queue() {
+  std::vector<accept_type> queue;
+
+  pthread_mutex_lock(&m_accept_lock);
+  queue.swap(m_accept_queue);
+  pthread_mutex_unlock(&m_accept_lock);
+
+  for (std::vector<accept_type>::iterator itr = queue.begin(), last = queue.end(); itr != last; itr++) {
+    // The listen port may have been closed after the shard queued
+    // these.
+    if (is_open())
+      m_slot_accepted(itr->fd, itr->sa);
+    else
+      itr->fd.close();
+  }
+}
+
 void Listen::close() {
   if (!get_fd().is_valid())
     return;
 
+  close_shards();
+
   manager->poll()->remove_read(this);
   manager->poll()->remove_error(this);
   manager->poll()->close(this);
@@ -94,11 +209,25 @@ void Listen::close() {
   
 void
 Listen::event_read() {
-  rak::socket_address sa;
-  SocketFd fd;
+  // Accept in batches so the kernel backlog drains quickly during a
+  // connection storm; the heavier handshake setup runs only after
+  // each batch has been pulled off the socket. The outer loop keeps
+  // going until the backlog is empty, as required by the
+  // edge-triggered poll mode.
+  accept_type accepted[max_accept_burst];
+
+  int count;
 
-  while ((fd = get_fd().accept(&sa)).is_valid())
-    m_slot_accepted(fd, sa);
+  do {
+    count = 0;
+
+    while (count != max_accept_burst && (accepted[count].fd = get_fd().accept_nonblock(&accepted[count].sa)).is_valid())
+      count++;
+
+    for (int i = 0; i < count; i++)
+      m_slot_accepted(accepted[i].fd, accepted[i].sa);
+
+  } while (count == max_accept_burst);
 }
 
 void
@@ -114,4 +243,38 @@ Listen::event_error() {
     throw internal_error("Listener port received an error event: " + std::string(std::strerror(error)));
 }
 
+void
+ListenShard::event_read() {
+  // Same batched drain as the primary socket, but the accepted
+  // sockets cross back to the main thread through the owning Listen's
+  // queue.
+  Listen::accept_type accepted[Listen::max_accept_burst];
+
+  int count;
+
+  do {
+    count = 0;
+
+    while (count != Listen::max_accept_burst && (accepted[count].fd = get_fd().accept_nonblock(&accepted[count].sa)).is_valid())
+      count++;
+
+    if (count != 0)
+      m_listen->push_accepted(accepted, count);
+
+  } while (count == Listen::max_accept_burst);
+}
+
+void
+ListenShard::event_write() {
+  throw internal_error("Listener shard does not support write().");
+}
+
+void
+ListenShard::event_error() {
+  int error = get_fd().get_error();
+
+  if (error != 0)
+    throw internal_error("Listener shard received an error event: " + std::string(std::strerror(error)));
+}
+
 }
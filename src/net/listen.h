@@ -39,6 +39,8 @@
 
 #include <cinttypes>
 #include <functional>
+#include <pthread.h>
+#include <vector>
 #include <rak/socket_address.h>
 
 #include "socket_base.h"
@@ -46,12 +48,47 @@
 
 namespace torrent {
 
+class Listen;
+class thread_net;
+
+// One SO_REUSEPORT shard of the listen port, serviced by a network
+// worker thread's poll. Accepted sockets are queued back to the
+// owning Listen, as the handshake manager only runs on the main
+// thread.
+class ListenShard : public SocketBase {
+public:
+  ListenShard(Listen* listen, thread_net* worker) : m_listen(listen), m_worker(worker) {}
+
+  thread_net*         worker() { return m_worker; }
+
+  virtual void        event_read();
+  virtual void        event_write();
+  virtual void        event_error();
+
+  int                 poll_priority() const { return POLL_PRIORITY_LOW; }
+
+private:
+  Listen*             m_listen;
+  thread_net*         m_worker;
+};
+
 class Listen : public SocketBase {
 public:
   typedef std::function<void (SocketFd, const rak::socket_address&)> slot_connection;
+  typedef std::function<void ()>                                     slot_void;
+
+  // Connections accepted per batch before they are handed off to the
+  // handshake manager; sized to cover a full poll cycle of an
+  // announce-driven storm of several hundred connections a second.
+  static const int max_accept_burst = 128;
+
+  struct accept_type {
+    SocketFd            fd;
+    rak::socket_address sa;
+  };
 
-  Listen() : m_port(0) {}
-  ~Listen() { close(); }
+  Listen() : m_port(0) { pthread_mutex_init(&m_accept_lock, NULL); }
+  ~Listen() { close(); pthread_mutex_destroy(&m_accept_lock); }
 
   bool                open(uint16_t first, uint16_t last, int backlog, const rak::socket_address* bindAddress);
   void                close();
@@ -62,14 +99,36 @@ public:
 
   slot_connection&    slot_accepted() { return m_slot_accepted; }
 
+  // Wired to the main thread's signal bitfield so shard accepts get
+  // drained by work_accept_queue.
+  slot_void&          slot_accept_signal() { return m_slot_accept_signal; }
+
+  // Called by the shards from their worker threads.
+  void                push_accepted(const accept_type* accepted, int count);
+
+  void                work_accept_queue();
+
   virtual void        event_read();
   virtual void        event_write();
   virtual void        event_error();
 
+  // Accepting new connections yields to established transfers in
+  // each poll batch.
+  int                 poll_priority() const { return POLL_PRIORITY_LOW; }
+
 private:
+  void                open_shards(const rak::socket_address& sa, int backlog);
+  void                close_shards();
+
   uint64_t            m_port;
 
+  std::vector<ListenShard*> m_shards;
+
+  std::vector<accept_type>  m_accept_queue;
+  pthread_mutex_t           m_accept_lock;
+
   slot_connection     m_slot_accepted;
+  slot_void           m_slot_accept_signal;
 };
 
 } // namespace torrent
@@ -36,7 +36,13 @@
 
 #include "config.h"
 
+#ifdef HAVE_MMSG
+#define _GNU_SOURCE
+#endif
+
+#include <algorithm>
 #include <cerrno>
+#include <cstring>
 #include <sys/types.h>
 #include <sys/socket.h>
 
@@ -86,4 +92,110 @@ SocketDatagram::write_datagram(const void* buffer, unsigned int length, rak::soc
   return r;
 }
 
+#ifdef HAVE_MMSG
+
+int
+SocketDatagram::read_datagrams(datagram_type* first, unsigned int count) {
+  if (count == 0)
+    throw internal_error("Tried to receive a datagram vector of size 0");
+
+  struct mmsghdr messages[max_datagram_vector];
+  struct iovec vectors[max_datagram_vector];
+
+  count = std::min(count, max_datagram_vector);
+
+  for (unsigned int i = 0; i < count; i++) {
+    vectors[i].iov_base = first[i].buffer;
+    vectors[i].iov_len = first[i].length;
+
+    std::memset(&messages[i].msg_hdr, 0, sizeof(struct msghdr));
+    messages[i].msg_hdr.msg_iov = &vectors[i];
+    messages[i].msg_hdr.msg_iovlen = 1;
+    messages[i].msg_hdr.msg_name = first[i].address.c_sockaddr();
+    messages[i].msg_hdr.msg_namelen = sizeof(rak::socket_address);
+  }
+
+  int result = ::recvmmsg(m_fileDesc, messages, count, MSG_DONTWAIT, NULL);
+
+  for (int i = 0; i < result; i++)
+    first[i].length = messages[i].msg_len;
+
+  return result;
+}
+
+int
+SocketDatagram::write_datagrams(datagram_type* first, unsigned int count) {
+  if (count == 0)
+    throw internal_error("Tried to send a datagram vector of size 0");
+
+  struct mmsghdr messages[max_datagram_vector];
+  struct iovec vectors[max_datagram_vector];
+  rak::socket_address_inet6 mapped[max_datagram_vector];
+
+  count = std::min(count, max_datagram_vector);
+
+  for (unsigned int i = 0; i < count; i++) {
+    vectors[i].iov_base = first[i].buffer;
+    vectors[i].iov_len = first[i].length;
+
+    std::memset(&messages[i].msg_hdr, 0, sizeof(struct msghdr));
+    messages[i].msg_hdr.msg_iov = &vectors[i];
+    messages[i].msg_hdr.msg_iovlen = 1;
+
+    if (m_ipv6_socket && first[i].address.family() == rak::socket_address::pf_inet) {
+      mapped[i] = first[i].address.sa_inet()->to_mapped_address();
+      messages[i].msg_hdr.msg_name = mapped[i].c_sockaddr();
+      messages[i].msg_hdr.msg_namelen = sizeof(rak::socket_address_inet6);
+    } else {
+      messages[i].msg_hdr.msg_name = first[i].address.c_sockaddr();
+      messages[i].msg_hdr.msg_namelen = first[i].address.length();
+    }
+  }
+
+  int result = ::sendmmsg(m_fileDesc, messages, count, 0);
+
+  for (int i = 0; i < result; i++)
+    first[i].length = messages[i].msg_len;
+
+  return result;
+}
+
+#else // HAVE_MMSG
+
+int
+SocketDatagram::read_datagrams(datagram_type* first, unsigned int count) {
+  if (count == 0)
+    throw internal_error("Tried to receive a datagram vector of size 0");
+
+  int r = read_datagram(first->buffer, first->length, &first->address);
+
+  if (r < 0)
+    return r;
+
+  first->length = r;
+  return 1;
+}
+
+int
+SocketDatagram::write_datagrams(datagram_type* first, unsigned int count) {
+  if (count == 0)
+    throw internal_error("Tried to send a datagram vector of size 0");
+
+  unsigned int i = 0;
+
+  while (i != count) {
+    int r = write_datagram(first[i].buffer, first[i].length, &first[i].address);
+
+    if (r < 0)
+      return i != 0 ? (int)i : r;
+
+    first[i].length = r;
+    i++;
+  }
+
+  return i;
+}
+
+#endif // HAVE_MMSG
+
 }
@@ -37,17 +37,37 @@
 #ifndef LIBTORRENT_NET_SOCKET_DGRAM_H
 #define LIBTORRENT_NET_SOCKET_DGRAM_H
 
+#include <rak/socket_address.h>
+
 #include "socket_base.h"
 
 namespace torrent {
 
 class SocketDatagram : public SocketBase {
 public:
+  static const unsigned int max_datagram_vector = 16;
+
+  // Descriptor for batched transfers. For reads the length is the
+  // buffer capacity on input and the datagram size on output; for
+  // writes it is the datagram size on input and the bytes actually
+  // sent on output.
+  struct datagram_type {
+    void*               buffer;
+    unsigned int        length;
+    rak::socket_address address;
+  };
 
   // TODO: Make two seperate functions depending on whetever sa is
   // used.
   int                 read_datagram(void* buffer, unsigned int length, rak::socket_address* sa = NULL);
   int                 write_datagram(const void* buffer, unsigned int length, rak::socket_address* sa = NULL);
+
+  // Transfer up to count datagrams in a single syscall where the
+  // kernel supports it, otherwise fall back to one at a time. Returns
+  // the number of datagrams transferred, or -1 with errno set if none
+  // could be.
+  int                 read_datagrams(datagram_type* first, unsigned int count);
+  int                 write_datagrams(datagram_type* first, unsigned int count);
 };
 
 }
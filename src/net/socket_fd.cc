@@ -45,6 +45,7 @@
 #include <netinet/in.h>
 #include <netinet/in_systm.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 #include <rak/socket_address.h>
 
 #include "torrent/exceptions.h"
@@ -84,6 +85,19 @@ SocketFd::set_reuse_address(bool state) {
   return setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == 0;
 }
 
+bool
+SocketFd::set_reuse_port(bool state) {
+  check_valid();
+
+#ifdef SO_REUSEPORT
+  int opt = state;
+
+  return setsockopt(m_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == 0;
+#else
+  return false;
+#endif
+}
+
 bool
 SocketFd::set_ipv6_v6only(bool state) {
   check_valid();
@@ -111,6 +125,36 @@ SocketFd::set_receive_buffer_size(uint32_t s) {
   return setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt)) == 0;
 }
 
+bool
+SocketFd::set_not_sent_low_water(uint32_t s) {
+  check_valid();
+
+#ifdef TCP_NOTSENT_LOWAT
+  int opt = s;
+
+  return setsockopt(m_fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &opt, sizeof(opt)) == 0;
+#else
+  return false;
+#endif
+}
+
+uint32_t
+SocketFd::get_rtt() const {
+  check_valid();
+
+#ifdef TCP_INFO
+  struct tcp_info info;
+  socklen_t length = sizeof(info);
+
+  if (getsockopt(m_fd, IPPROTO_TCP, TCP_INFO, &info, &length) != 0)
+    return 0;
+
+  return info.tcpi_rtt;
+#else
+  return 0;
+#endif
+}
+
 int
 SocketFd::get_error() const {
   check_valid();
@@ -273,6 +317,27 @@ SocketFd::accept(rak::socket_address* sa) {
   return SocketFd(fd, m_ipv6_socket);
 }
 
+SocketFd
+SocketFd::accept_nonblock(rak::socket_address* sa) {
+  check_valid();
+  socklen_t len = sizeof(rak::socket_address);
+
+#ifdef SOCK_NONBLOCK
+  int fd = ::accept4(m_fd, sa->c_sockaddr(), &len, SOCK_NONBLOCK);
+#else
+  int fd = ::accept(m_fd, sa->c_sockaddr(), &len);
+
+  if (fd != -1)
+    SocketFd(fd, m_ipv6_socket).set_nonblock();
+#endif
+
+  if (fd != -1 && m_ipv6_socket && sa->family() == rak::socket_address::af_inet6) {
+    *sa = sa->sa_inet6()->normalize_address();
+  }
+
+  return SocketFd(fd, m_ipv6_socket);
+}
+
 // unsigned int
 // SocketFd::get_read_queue_size() const {
 //   unsigned int v;
@@ -62,6 +62,12 @@ public:
 
   bool                set_nonblock();
   bool                set_reuse_address(bool state);
+
+  // Allow several sockets to bind the same port so the kernel shards
+  // incoming connections between them; false where SO_REUSEPORT is
+  // unavailable.
+  bool                set_reuse_port(bool state);
+
   bool                set_ipv6_v6only(bool state);
 
   bool                set_priority(priority_type p);
@@ -69,6 +75,14 @@ public:
   bool                set_send_buffer_size(uint32_t s);
   bool                set_receive_buffer_size(uint32_t s);
 
+  // Limit of unsent data in the send buffer before the socket stops
+  // reporting writable; no-op where TCP_NOTSENT_LOWAT is unavailable.
+  bool                set_not_sent_low_water(uint32_t s);
+
+  // Smoothed round-trip time in usec as measured by the TCP stack,
+  // or zero if unavailable.
+  uint32_t            get_rtt() const;
+
   int                 get_error() const;
 
   bool                open_stream();
@@ -92,6 +106,10 @@ public:
   bool                listen(int size);
   SocketFd            accept(rak::socket_address* sa);
 
+  // As accept, but the returned fd is already non-blocking; uses
+  // accept4 where available to save the extra fcntl per connection.
+  SocketFd            accept_nonblock(rak::socket_address* sa);
+
 //   unsigned int        get_read_queue_size() const;
 //   unsigned int        get_write_queue_size() const;
 
@@ -36,47 +36,17 @@
 
 #include "config.h"
 
-#include <algorithm>
-#include <functional>
-
 #include "socket_set.h"
 
 namespace torrent {
 
 const SocketSet::size_type SocketSet::npos;
 
-inline void
-SocketSet::_replace_with_last(size_type idx) {
-  while (!base_type::empty() && base_type::back() == NULL)
-    base_type::pop_back();
-
-  if (idx >= m_table.size())
-    throw internal_error("SocketSet::_replace_with_last(...) input out-of-bounds");
-
-  // This should handle both npos and those that have already been
-  // removed with the above while loop.
-  if (idx >= size())
-    return;
-
-  *(begin() + idx) = base_type::back();
-  _index(base_type::back()) = idx;
-
-  base_type::pop_back();
-}
-
-void
-SocketSet::prepare() {
-  std::for_each(m_erased.begin(), m_erased.end(),
-		std::bind1st(std::mem_fun(&SocketSet::_replace_with_last), this));
-
-  m_erased.clear();
-}
-
 void
 SocketSet::reserve(size_t openMax) {
-  m_table.resize(openMax, npos);
+  slot_type empty_slot = { NULL, 0, 0 };
 
-  base_type::reserve(openMax);
+  m_table.resize(openMax, empty_slot);
 }
 
 }
@@ -37,7 +37,6 @@
 #ifndef LIBTORRENT_NET_SOCKET_SET_H
 #define LIBTORRENT_NET_SOCKET_SET_H
 
-#include <list>
 #include <vector>
 #include <cinttypes>
 #include <rak/allocators.h>
@@ -47,76 +46,82 @@
 
 namespace torrent {
 
-// SocketSet's Base is a vector of active SocketBase
-// instances. 'm_table' is a vector with the size 'openMax', each
-// element of which points to an active instance in the Base vector.
+// SocketSet is a flat array of slots indexed by file descriptor, each
+// stamped with a generation counter that is bumped on every insert
+// and erase. Readiness gathered before the event callbacks ran is
+// validated against the stamp taken at mark time, so there is no
+// erase list and no compaction pass between poll cycles.
 
 // Propably should rename to EventSet...
 
-class SocketSet : private std::vector<Event*, rak::cacheline_allocator<Event*> > {
+class SocketSet {
 public:
   typedef uint32_t    size_type;
 
-  typedef std::vector<Event*, rak::cacheline_allocator<Event*> > base_type;
-  typedef std::vector<size_type, rak::cacheline_allocator<size_type> > Table;
-
   static const size_type npos = static_cast<size_type>(-1);
 
-  using base_type::value_type;
+  struct slot_type {
+    Event*    event;
+    size_type generation;
+    size_type marked;
+  };
+
+  typedef std::vector<slot_type, rak::cacheline_allocator<slot_type> > base_type;
+
+  SocketSet() : m_size(0), m_maxFd(npos) {}
 
-  using base_type::iterator;
-  using base_type::const_iterator;
-  using base_type::reverse_iterator;
-  using base_type::empty;
-  using base_type::size;
+  bool                empty() const                          { return m_size == 0; }
+  size_type           size() const                           { return m_size; }
 
-  using base_type::begin;
-  using base_type::end;
-  using base_type::rbegin;
-  using base_type::rend;
+  bool                has(Event* s) const                    { return _slot(s).event == s; }
 
-  bool                has(Event* s) const                    { return _index(s) != npos; }
+  Event*              event_at(size_type fd)                 { return m_table[fd].event; }
+
+  // Highest occupied file descriptor, or npos when the set is empty;
+  // bounds the iteration over the slot array.
+  size_type           max_fd() const                         { return m_maxFd; }
 
-  iterator            find(Event* s);
   void                insert(Event* s);
   void                erase(Event* s);
 
-  // Remove all erased elements from the container.
-  void                prepare();
+  // Stamp the slot's current generation while gathering the fd sets.
+  void                mark(size_type fd)                     { m_table[fd].marked = m_table[fd].generation; }
+
+  // A readiness bit gathered at mark time is only dispatched if the
+  // slot has seen no insert or erase since; a single bounds and
+  // generation check.
+  bool                is_current(size_type fd) const         { return fd < m_table.size() && m_table[fd].event != NULL && m_table[fd].marked == m_table[fd].generation; }
+
   // Allocate storage for fd's with up to 'openMax' value. TODO: Remove reserve
   void                reserve(size_t openMax);
 
   size_t              max_size() const                       { return m_table.size(); }
 
 private:
-  size_type&          _index(Event* s)                       { return m_table[s->file_descriptor()]; }
-  const size_type&    _index(Event* s) const                 { return m_table[s->file_descriptor()]; }
+  slot_type&          _slot(Event* s)                        { return m_table[s->file_descriptor()]; }
+  const slot_type&    _slot(Event* s) const                  { return m_table[s->file_descriptor()]; }
 
-  inline void         _replace_with_last(size_type idx);
-
-  // TODO: Table of indexes or iterators?
-  Table               m_table;
-  Table               m_erased;
+  base_type           m_table;
+  size_type           m_size;
+  size_type           m_maxFd;
 };
 
-inline SocketSet::iterator
-SocketSet::find(Event* s) {
-  if (_index(s) == npos)
-    return end();
-
-  return begin() + _index(s);
-}
-
 inline void
 SocketSet::insert(Event* s) {
   if (static_cast<size_type>(s->file_descriptor()) >= m_table.size())
     throw internal_error("Tried to insert an out-of-bounds file descriptor to SocketSet");
 
-  if (_index(s) != npos)
+  slot_type& slot = _slot(s);
+
+  if (slot.event != NULL)
     return;
 
-  _index(s) = size();
-  base_type::push_back(s);
+  slot.event = s;
+  slot.generation++;
+  m_size++;
+
+  if (m_maxFd == npos || static_cast<size_type>(s->file_descriptor()) > m_maxFd)
+    m_maxFd = s->file_descriptor();
 }
 
 inline void
@@ -124,15 +129,19 @@ SocketSet::erase(Event* s) {
   if (static_cast<size_type>(s->file_descriptor()) >= m_table.size())
     throw internal_error("Tried to erase an out-of-bounds file descriptor from SocketSet");
 
-  size_type idx = _index(s);
+  slot_type& slot = _slot(s);
 
-  if (idx == npos)
+  if (slot.event != s)
     return;
 
-  _index(s) = npos;
+  slot.event = NULL;
+  slot.generation++;
+  m_size--;
 
-  *(begin() + idx) = NULL;
-  m_erased.push_back(idx);
+  if (static_cast<size_type>(s->file_descriptor()) == m_maxFd)
+    do {
+      m_maxFd = m_maxFd != 0 ? m_maxFd - 1 : npos;
+    } while (m_maxFd != npos && m_table[m_maxFd].event == NULL);
 }
 
 }
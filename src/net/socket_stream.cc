@@ -38,13 +38,31 @@
 
 #include "socket_stream.h"
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdio>
 #include <cstring>
 #include <rak/error_number.h>
 
+#ifdef HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+
+#include <sys/ioctl.h>
+
+#ifdef __linux__
+#include <linux/sockios.h>
+#endif
+
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#endif
+
 namespace torrent {
 
+bool SocketStream::m_useZerocopy = false;
+
 std::string
 int_to_string(int v) {
   char buf[20];
@@ -96,4 +114,237 @@ SocketStream::write_stream_throws(const void* buf, uint32_t length) {
   return r;
 }
 
+uint32_t
+SocketStream::write_queue_size() const {
+#ifdef SIOCOUTQ
+  int queued;
+
+  if (::ioctl(m_fileDesc, SIOCOUTQ, &queued) < 0 || queued < 0)
+    return 0;
+
+  return queued;
+#else
+  // No signal reads as an empty queue.
+  return 0;
+#endif
+}
+
+// Classify a raw syscall result the same way the _throws variants
+// do, but into a status code. The errno is left untouched so callers
+// can log it on stream_failed.
+uint32_t
+SocketStream::stream_result(int r, stream_status* status) {
+  if (r > 0) {
+    *status = stream_ok;
+    return r;
+  }
+
+  if (r == 0) {
+    *status = stream_closed;
+    return 0;
+  }
+
+  if (rak::error_number::current().is_blocked_momentary())
+    *status = stream_ok;
+  else if (rak::error_number::current().is_closed())
+    *status = stream_closed;
+  else if (rak::error_number::current().is_blocked_prolonged())
+    *status = stream_blocked;
+  else
+    *status = stream_failed;
+
+  return 0;
+}
+
+uint32_t
+SocketStream::read_stream_nothrow(void* buf, uint32_t length, stream_status* status) {
+  return stream_result(read_stream(buf, length), status);
+}
+
+uint32_t
+SocketStream::write_stream_nothrow(const void* buf, uint32_t length, stream_status* status) {
+  return stream_result(write_stream(buf, length), status);
+}
+
+uint32_t
+SocketStream::sendfile_stream_throws(int fileDesc, uint64_t offset, uint32_t length) {
+#ifdef HAVE_SENDFILE
+  if (length == 0)
+    throw internal_error("Tried to sendfile length 0.");
+
+  off_t fileOffset = offset;
+
+  ssize_t r = ::sendfile(m_fileDesc, fileDesc, &fileOffset, length);
+
+  if (r == 0)
+    throw close_connection();
+
+  if (r < 0) {
+    if (rak::error_number::current().is_blocked_momentary())
+      return 0;
+    else if (rak::error_number::current().is_closed())
+      throw close_connection();
+    else if (rak::error_number::current().is_blocked_prolonged())
+      throw blocked_connection();
+    else
+      throw connection_error(rak::error_number::current().value());
+  }
+
+  return r;
+#else
+  throw internal_error("SocketStream::sendfile_stream_throws(...) called but sendfile is not supported.");
+#endif
+}
+
+uint32_t
+SocketStream::readv_stream_throws(const struct iovec* vec, unsigned int count) {
+  int r = readv_stream(vec, count);
+
+  if (r == 0)
+    throw close_connection();
+
+  if (r < 0) {
+    if (rak::error_number::current().is_blocked_momentary())
+      return 0;
+    else if (rak::error_number::current().is_closed())
+      throw close_connection();
+    else if (rak::error_number::current().is_blocked_prolonged())
+      throw blocked_connection();
+    else
+      throw connection_error(rak::error_number::current().value());
+  }
+
+  return r;
+}
+
+uint32_t
+SocketStream::writev_stream_throws(const struct iovec* vec, unsigned int count) {
+  int r = writev_stream(vec, count);
+
+  if (r == 0)
+    throw close_connection();
+
+  if (r < 0) {
+    if (rak::error_number::current().is_blocked_momentary())
+      return 0;
+    else if (rak::error_number::current().is_closed())
+      throw close_connection();
+    else if (rak::error_number::current().is_blocked_prolonged())
+      throw blocked_connection();
+    else
+      throw connection_error(rak::error_number::current().value());
+  }
+
+  return r;
+}
+
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+
+bool
+SocketStream::prepare_zerocopy() {
+  if (m_zerocopyState != zerocopy_untried)
+    return m_zerocopyState == zerocopy_enabled;
+
+  int state = 1;
+
+  m_zerocopyState = ::setsockopt(m_fileDesc, SOL_SOCKET, SO_ZEROCOPY, &state, sizeof(state)) == 0 ?
+    zerocopy_enabled : zerocopy_disabled;
+
+  return m_zerocopyState == zerocopy_enabled;
+}
+
+uint32_t
+SocketStream::writev_zerocopy_stream_throws(const struct iovec* vec, unsigned int count) {
+  uint32_t total = 0;
+
+  for (unsigned int i = 0; i < count; i++)
+    total += vec[i].iov_len;
+
+  if (!m_useZerocopy || total < zerocopy_threshold || !prepare_zerocopy())
+    return writev_stream_throws(vec, count);
+
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+
+  msg.msg_iov = const_cast<struct iovec*>(vec);
+  msg.msg_iovlen = count;
+
+  int r = ::sendmsg(m_fileDesc, &msg, MSG_ZEROCOPY);
+
+  if (r > 0) {
+    m_zerocopyPending++;
+    return r;
+  }
+
+  if (r == 0)
+    throw close_connection();
+
+  // The kernel's locked-page budget is exhausted; reap outstanding
+  // completions and copy this round out instead.
+  if (rak::error_number::current().value() == ENOBUFS) {
+    flush_zerocopy();
+    return writev_stream_throws(vec, count);
+  }
+
+  if (rak::error_number::current().is_blocked_momentary())
+    return 0;
+  else if (rak::error_number::current().is_closed())
+    throw close_connection();
+  else if (rak::error_number::current().is_blocked_prolonged())
+    throw blocked_connection();
+  else
+    throw connection_error(rak::error_number::current().value());
+}
+
+bool
+SocketStream::flush_zerocopy() {
+  bool reaped = false;
+
+  while (m_zerocopyPending != 0) {
+    struct msghdr msg;
+    char control[64];
+
+    std::memset(&msg, 0, sizeof(msg));
+
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (::recvmsg(m_fileDesc, &msg, MSG_ERRQUEUE) < 0)
+      break;
+
+    // Each notification covers an inclusive range of send counters,
+    // [ee_info, ee_data].
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      struct sock_extended_err* error = (struct sock_extended_err*)CMSG_DATA(cmsg);
+
+      if (error->ee_errno != 0 || error->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+
+      m_zerocopyPending -= std::min<uint32_t>(error->ee_data - error->ee_info + 1, m_zerocopyPending);
+      reaped = true;
+    }
+  }
+
+  return reaped;
+}
+
+#else
+
+bool
+SocketStream::prepare_zerocopy() {
+  return false;
+}
+
+uint32_t
+SocketStream::writev_zerocopy_stream_throws(const struct iovec* vec, unsigned int count) {
+  return writev_stream_throws(vec, count);
+}
+
+bool
+SocketStream::flush_zerocopy() {
+  return false;
+}
+
+#endif
+
 }
@@ -39,6 +39,7 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "torrent/exceptions.h"
 #include "socket_base.h"
@@ -47,14 +48,74 @@ namespace torrent {
 
 class SocketStream : public SocketBase {
 public:
+  static const unsigned int max_write_vector = 16;
+  static const unsigned int max_read_vector = 16;
+
+  // Zero-copy sends pin user pages until the kernel reports
+  // completion, so payloads below this aren't worth the bookkeeping.
+  static const uint32_t zerocopy_threshold = (16 << 10);
+
+  SocketStream() : m_zerocopyState(zerocopy_untried), m_zerocopyPending(0) {}
+
   int                 read_stream(void* buf, uint32_t length);
   int                 write_stream(const void* buf, uint32_t length);
+  int                 readv_stream(const struct iovec* vec, unsigned int count);
+  int                 writev_stream(const struct iovec* vec, unsigned int count);
 
   // Returns the number of bytes read, or zero if the socket is
   // blocking. On errors or closed sockets it will throw an
   // appropriate exception.
   uint32_t            read_stream_throws(void* buf, uint32_t length);
   uint32_t            write_stream_throws(const void* buf, uint32_t length);
+  uint32_t            readv_stream_throws(const struct iovec* vec, unsigned int count);
+  uint32_t            writev_stream_throws(const struct iovec* vec, unsigned int count);
+
+  // Outcome of the nothrow variants below. Everything but stream_ok
+  // means the connection is finished; the mapping mirrors the
+  // exceptions thrown by the _throws variants.
+  enum stream_status {
+    stream_ok,       // Bytes transferred, or blocked momentarily.
+    stream_closed,   // EOF or connection reset; as close_connection.
+    stream_blocked,  // Prolonged block; as blocked_connection.
+    stream_failed    // Socket error; as connection_error, errno preserved.
+  };
+
+  // As the _throws variants, but EOF and socket errors are reported
+  // through 'status' instead of thrown exceptions. Hung-up peers are
+  // the common outcome on the connection event handlers' hot path,
+  // and during swarm death the unwind per disconnect adds up; only
+  // internal misuse still throws.
+  uint32_t            read_stream_nothrow(void* buf, uint32_t length, stream_status* status);
+  uint32_t            write_stream_nothrow(const void* buf, uint32_t length, stream_status* status);
+
+  // Kernel file-to-socket transfer, bypassing user space entirely.
+  // Only available when the platform provides sendfile.
+  uint32_t            sendfile_stream_throws(int fileDesc, uint64_t offset, uint32_t length);
+
+  // As writev_stream_throws, but sends large payloads with
+  // MSG_ZEROCOPY when the engine is enabled. The source memory must
+  // stay unmodified until the completion is flushed. Falls back to a
+  // copying writev for small payloads and unsupported sockets.
+  uint32_t            writev_zerocopy_stream_throws(const struct iovec* vec, unsigned int count);
+
+  // Global opt-in for the zero-copy send engine; sockets probe for
+  // SO_ZEROCOPY support on their first eligible write.
+  static bool         use_zerocopy()               { return m_useZerocopy; }
+  static void         set_use_zerocopy(bool state) { m_useZerocopy = state; }
+
+  bool                zerocopy_pending() const     { return m_zerocopyPending != 0; }
+
+  // Bytes sitting in the kernel send queue, not yet acked by the
+  // peer. A deep queue means the peer's TCP is already backed up, so
+  // it serves as a congestion signal for ranking and pipelining
+  // decisions. Returns zero where the platform has no SIOCOUTQ.
+  uint32_t            write_queue_size() const;
+
+  // Reap completed zero-copy sends off the socket error queue.
+  // Pending completions raise poll error events, so error handlers
+  // must flush before treating the event as a socket failure; returns
+  // true if any completions were reaped.
+  bool                flush_zerocopy();
 
   // Handles all the error catching etc. Returns true if the buffer is
   // finished reading/writing.
@@ -62,6 +123,20 @@ public:
   bool                write_buffer(const void* buf, uint32_t length, uint32_t& pos);
 
   uint32_t            ignore_stream_throws(uint32_t length) { return read_stream_throws(m_nullBuffer, length); }
+
+private:
+  static const int zerocopy_untried  = -1;
+  static const int zerocopy_disabled = 0;
+  static const int zerocopy_enabled  = 1;
+
+  bool                prepare_zerocopy();
+
+  static uint32_t     stream_result(int r, stream_status* status);
+
+  static bool         m_useZerocopy;
+
+  int                 m_zerocopyState;
+  uint32_t            m_zerocopyPending;
 };
 
 inline bool
@@ -94,6 +169,22 @@ SocketStream::write_stream(const void* buf, uint32_t length) {
   return ::send(m_fileDesc, buf, length, 0);
 }
 
+inline int
+SocketStream::readv_stream(const struct iovec* vec, unsigned int count) {
+  if (count == 0)
+    throw internal_error("Tried to read a vector of length 0.");
+
+  return ::readv(m_fileDesc, vec, count);
+}
+
+inline int
+SocketStream::writev_stream(const struct iovec* vec, unsigned int count) {
+  if (count == 0)
+    throw internal_error("Tried to write a vector of length 0.");
+
+  return ::writev(m_fileDesc, vec, count);
+}
+
 }
 
 #endif
@@ -44,6 +44,7 @@
 #include "net/throttle_list.h"
 #include "torrent/exceptions.h"
 #include "torrent/throttle.h"
+#include "utils/instrumentation.h"
 
 #include "globals.h"
 
@@ -55,19 +56,82 @@ namespace torrent {
 // allow us to remove us from the task scheduler when we're full. Also
 // this would let us be abit more flexible with the interval.
 
+// Every enabled root throttle is ticked from this one shared task
+// over a flat registry, so per-tracker and per-group shaping setups
+// with dozens of roots queue a single timer instead of one each. A
+// root keeps its own cadence by skipping rounds that arrive before
+// its interval has passed.
+typedef std::vector<ThrottleInternal*> ThrottleRootList;
+
+static ThrottleRootList   throttle_root_list;
+static rak::priority_item throttle_root_task;
+
+void
+ThrottleInternal::tick_roots() {
+  uint32_t next_interval = std::numeric_limits<uint32_t>::max();
+
+  for (ThrottleRootList::iterator itr = throttle_root_list.begin(), last = throttle_root_list.end(); itr != last; itr++) {
+    ThrottleInternal* root = *itr;
+
+    if (cachedTime > root->m_timeLastTick + rak::timer(9 * (uint64_t)root->m_tickInterval / 10))
+      root->receive_tick();
+
+    next_interval = std::min(next_interval, root->m_tickInterval);
+  }
+
+  if (!throttle_root_list.empty())
+    priority_queue_insert(&taskScheduler, &throttle_root_task, cachedTime + next_interval);
+}
+
+void
+ThrottleInternal::register_root() {
+  if (std::find(throttle_root_list.begin(), throttle_root_list.end(), this) != throttle_root_list.end())
+    return;
+
+  throttle_root_list.push_back(this);
+
+  if (!throttle_root_task.slot())
+    throttle_root_task.slot() = std::bind(&ThrottleInternal::tick_roots);
+
+  // Pull the shared task forward if this root wants a shorter cadence
+  // than whatever it is currently queued for.
+  rak::timer next = cachedTime + m_tickInterval;
+
+  if (throttle_root_task.is_queued() && throttle_root_task.time() <= next)
+    return;
+
+  priority_queue_erase(&taskScheduler, &throttle_root_task);
+  priority_queue_insert(&taskScheduler, &throttle_root_task, next);
+}
+
+void
+ThrottleInternal::unregister_root() {
+  ThrottleRootList::iterator itr = std::find(throttle_root_list.begin(), throttle_root_list.end(), this);
+
+  if (itr != throttle_root_list.end())
+    throttle_root_list.erase(itr);
+
+  if (throttle_root_list.empty())
+    priority_queue_erase(&taskScheduler, &throttle_root_task);
+}
+
 ThrottleInternal::ThrottleInternal(int flags) :
   m_flags(flags),
   m_nextSlave(m_slaveList.end()),
   m_unusedQuota(0),
-  m_timeLastTick(cachedTime) {
+  m_tickInterval(100000),
+  m_timeLastTick(cachedTime),
+  m_staggerRemaining(0) {
 
   if (is_root())
-    m_taskTick.slot() = std::bind(&ThrottleInternal::receive_tick, this);
+    m_taskStagger.slot() = std::bind(&ThrottleInternal::receive_stagger, this);
 }
 
 ThrottleInternal::~ThrottleInternal() {
-  if (is_root())
-    priority_queue_erase(&taskScheduler, &m_taskTick);
+  if (is_root()) {
+    unregister_root();
+    priority_queue_erase(&taskScheduler, &m_taskStagger);
+  }
 
   std::for_each(m_slaveList.begin(), m_slaveList.end(), rak::call_delete<ThrottleInternal>());
 }
@@ -82,6 +146,8 @@ ThrottleInternal::enable() {
     // to a value that gives an reasonable initial quota.
     m_timeLastTick = cachedTime - rak::timer::from_seconds(1);
     receive_tick();
+
+    register_root();
   }
 }
 
@@ -90,8 +156,10 @@ ThrottleInternal::disable() {
   m_throttleList->disable();
   std::for_each(m_slaveList.begin(), m_slaveList.end(), std::mem_fun(&ThrottleInternal::disable));
 
-  if (is_root())
-    priority_queue_erase(&taskScheduler, &m_taskTick);
+  if (is_root()) {
+    unregister_root();
+    priority_queue_erase(&taskScheduler, &m_taskStagger);
+  }
 }
 
 ThrottleInternal*
@@ -99,6 +167,7 @@ ThrottleInternal::create_slave() {
   ThrottleInternal* slave = new ThrottleInternal(flag_none);
 
   slave->m_maxRate = m_maxRate;
+  slave->m_adaptiveTick = m_adaptiveTick;
   slave->m_throttleList = new ThrottleList();
 
   if (m_throttleList->is_enabled())
@@ -112,16 +181,55 @@ ThrottleInternal::create_slave() {
 
 void
 ThrottleInternal::receive_tick() {
-  if (cachedTime <= m_timeLastTick + rak::timer::from_milliseconds(90))
+  if (cachedTime <= m_timeLastTick + rak::timer(9 * (uint64_t)m_tickInterval / 10))
     throw internal_error("ThrottleInternal::receive_tick() called at a to short interval.");
 
+  rak::timer tick_start = rak::timer::current();
+
   uint32_t quota = ((uint64_t)(cachedTime.usec() - m_ptr()->m_timeLastTick.usec())) * m_maxRate / 1000000;
   uint32_t fraction = ((uint64_t)(cachedTime.usec() - m_ptr()->m_timeLastTick.usec())) * fraction_base / 1000000;
 
   receive_quota(quota, fraction);
 
-  priority_queue_insert(&taskScheduler, &m_taskTick, cachedTime + calculate_interval());
+  m_tickInterval = calculate_interval();
   m_timeLastTick = cachedTime;
+
+  // Release the poll write re-arms in slices over the tick window
+  // rather than all at once, turning the sawtooth egress at tick
+  // boundaries into a roughly constant stream.
+  m_staggerRemaining = stagger_slices;
+  receive_stagger();
+
+  instrumentation_update(INSTRUMENTATION_POLLING_TIME_THROTTLE_TICKS, (rak::timer::current() - tick_start).usec());
+}
+
+uint32_t
+ThrottleInternal::stagger_pending() {
+  uint32_t pending = m_throttleList->pending_activations();
+
+  for (SlaveList::iterator itr = m_slaveList.begin(), last = m_slaveList.end(); itr != last; itr++)
+    pending += (*itr)->stagger_pending();
+
+  return pending;
+}
+
+void
+ThrottleInternal::activate_staggered(uint32_t slices) {
+  m_throttleList->activate_pending((m_throttleList->pending_activations() + slices - 1) / slices);
+
+  for (SlaveList::iterator itr = m_slaveList.begin(), last = m_slaveList.end(); itr != last; itr++)
+    (*itr)->activate_staggered(slices);
+}
+
+void
+ThrottleInternal::receive_stagger() {
+  if (m_staggerRemaining == 0 || stagger_pending() == 0)
+    return;
+
+  activate_staggered(m_staggerRemaining);
+
+  if (--m_staggerRemaining != 0 && stagger_pending() != 0)
+    priority_queue_insert(&taskScheduler, &m_taskStagger, cachedTime + m_tickInterval / stagger_slices);
 }
 
 int32_t
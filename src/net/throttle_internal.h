@@ -65,9 +65,24 @@ private:
   static const uint32_t fraction_bits = 16;
   static const uint32_t fraction_base = (1 << fraction_bits);
 
+  // Number of slices the tick window is divided into when staggering
+  // poll write re-arms after quota distribution.
+  static const uint32_t stagger_slices = 4;
+
   typedef std::vector<ThrottleInternal*>  SlaveList;
 
+  // All enabled roots are driven from one shared tick task walking a
+  // flat registry, instead of each root arming its own timer.
+  static void         tick_roots();
+
+  void                register_root();
+  void                unregister_root();
+
   void                receive_tick();
+  void                receive_stagger();
+
+  uint32_t            stagger_pending();
+  void                activate_staggered(uint32_t slices);
 
   // Distribute quota, return amount of quota used. May be negative
   // if it had more unused quota than is now allowed.
@@ -79,8 +94,14 @@ private:
 
   uint32_t            m_unusedQuota;
 
+  // The interval scheduled for the current tick, in usec; guards
+  // against ticks firing early.
+  uint32_t            m_tickInterval;
+
   rak::timer          m_timeLastTick;
-  rak::priority_item  m_taskTick;
+
+  uint32_t            m_staggerRemaining;
+  rak::priority_item  m_taskStagger;
 };
 
 }
@@ -62,12 +62,12 @@ ThrottleList::ThrottleList() :
 
 bool
 ThrottleList::is_active(const ThrottleNode* node) const {
-  return std::find(begin(), (const_iterator)m_splitActive, node) != m_splitActive;
+  return node->state() == ThrottleNode::state_active;
 }
 
 bool
 ThrottleList::is_inactive(const ThrottleNode* node) const {
-  return std::find((const_iterator)m_splitActive, end(), node) != end();
+  return node->state() == ThrottleNode::state_inactive;
 }
 
 bool
@@ -108,6 +108,10 @@ ThrottleList::disable() {
 
   m_enabled = false;
 
+  // Any deferred poll re-arms must happen now, as the stagger task
+  // will not run while disabled.
+  activate_pending(m_pendingActivations.size());
+
   m_outstandingQuota = 0;
   m_unallocatedQuota = 0;
   m_unusedUnthrottledQuota = 0;
@@ -115,6 +119,9 @@ ThrottleList::disable() {
   std::for_each(begin(), end(), std::mem_fun(&ThrottleNode::clear_quota));
   std::for_each(m_splitActive, end(), std::mem_fun(&ThrottleNode::activate));
 
+  // When disabled all nodes count as active.
+  std::for_each(begin(), end(), std::bind(&ThrottleNode::set_state, std::placeholders::_1, (int)ThrottleNode::state_active));
+
   m_splitActive = end();
 }
 
@@ -140,7 +147,11 @@ ThrottleList::update_quota(uint32_t quota) {
     if ((*m_splitActive)->quota() < m_minChunkSize)
       break;
 
-    (*m_splitActive)->activate();
+    // The node becomes active immediately so quota accounting works,
+    // but the poll write re-arm is deferred to activate_pending(...)
+    // so the owner can pace the writes over the tick window.
+    (*m_splitActive)->set_state(ThrottleNode::state_active);
+    m_pendingActivations.push_back(*m_splitActive);
     m_splitActive++;
   }
 
@@ -156,6 +167,21 @@ ThrottleList::update_quota(uint32_t quota) {
   return used;
 }
 
+uint32_t
+ThrottleList::activate_pending(uint32_t max_count) {
+  uint32_t count = 0;
+
+  while (count != max_count && !m_pendingActivations.empty()) {
+    ThrottleNode* node = m_pendingActivations.front();
+    m_pendingActivations.pop_front();
+
+    node->activate();
+    count++;
+  }
+
+  return count;
+}
+
 uint32_t
 ThrottleList::node_quota(ThrottleNode* node) {
   if (!m_enabled) {
@@ -178,14 +204,14 @@ ThrottleList::node_quota(ThrottleNode* node) {
 
 void
 ThrottleList::add_rate(uint32_t used) {
-  m_rateSlow.insert(used);
+  m_rateSlow.insert_batched(used);
   m_rateAdded += used;
 }
 
 uint32_t
 ThrottleList::node_used(ThrottleNode* node, uint32_t used) {
   add_rate(used);
-  node->rate()->insert(used);
+  node->rate()->insert_batched(used);
 
   if (used == 0 || !m_enabled || node->list_iterator() == end())
     return used;
@@ -223,6 +249,10 @@ ThrottleList::node_deactivate(ThrottleNode* node) {
                          "ThrottleList::node_deactivate(...) could not find node.");
 
   base_type::splice(end(), *this, node->list_iterator());
+  node->set_state(ThrottleNode::state_inactive);
+
+  m_pendingActivations.erase(std::remove(m_pendingActivations.begin(), m_pendingActivations.end(), node),
+                             m_pendingActivations.end());
 
   if (m_splitActive == end())
     m_splitActive = node->list_iterator();
@@ -245,6 +275,7 @@ ThrottleList::insert(ThrottleNode* node) {
     allocate_quota(node);
   }
 
+  node->set_state(ThrottleNode::state_active);
   m_size++;
 }
 
@@ -270,8 +301,12 @@ ThrottleList::erase(ThrottleNode* node) {
   else
     base_type::erase(node->list_iterator());
 
+  m_pendingActivations.erase(std::remove(m_pendingActivations.begin(), m_pendingActivations.end(), node),
+                             m_pendingActivations.end());
+
   node->clear_quota();
   node->set_list_iterator(end());
+  node->set_state(ThrottleNode::state_erased);
   m_size--;
 }
 
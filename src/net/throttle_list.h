@@ -37,6 +37,7 @@
 #ifndef LIBTORRENT_NET_THROTTLE_LIST_H
 #define LIBTORRENT_NET_THROTTLE_LIST_H
 
+#include <deque>
 #include <list>
 
 #include "torrent/rate.h"
@@ -80,6 +81,12 @@ public:
   // quota left over from the last call that was more than is now allowed.
   int32_t             update_quota(uint32_t quota);
 
+  // Nodes that received quota in update_quota(...) wait here for
+  // their poll write re-arm, so the caller can stagger the writes
+  // across the tick window instead of releasing every node at once.
+  uint32_t            pending_activations() const    { return m_pendingActivations.size(); }
+  uint32_t            activate_pending(uint32_t max_count);
+
   uint32_t            size() const                   { return m_size; }
 
   uint32_t            outstanding_quota() const      { return m_outstandingQuota; }
@@ -130,6 +137,8 @@ private:
   // to transmit, but are blocking. These are sorted from the longest
   // blocking node.
   iterator            m_splitActive;
+
+  std::deque<ThrottleNode*> m_pendingActivations;
 };
 
 }
@@ -54,7 +54,16 @@ public:
 
   typedef std::function<void ()> slot_void;
 
-  ThrottleNode(uint32_t rateSpan) : m_rate(rateSpan)  { clear_quota(); }
+  // Which segment of the ThrottleList the node is in, kept here so
+  // membership checks don't have to scan the list.
+  static const int state_erased   = 0;
+  static const int state_active   = 1;
+  static const int state_inactive = 2;
+
+  ThrottleNode(uint32_t rateSpan) : m_state(state_erased), m_rate(rateSpan) { clear_quota(); }
+
+  int                 state() const                   { return m_state; }
+  void                set_state(int s)                { m_state = s; }
 
   Rate*               rate()                          { return &m_rate; }
   const Rate*         rate() const                    { return &m_rate; }
@@ -75,6 +84,8 @@ private:
   ThrottleNode(const ThrottleNode&);
   void operator = (const ThrottleNode&);
 
+  int                 m_state;
+
   uint32_t            m_quota;
   iterator            m_listIterator;
 
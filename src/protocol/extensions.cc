@@ -398,20 +398,18 @@ ProtocolExtension::send_metadata_piece(size_t piece) {
     return;
   }
 
-  // These messages will be rare, so we'll just build the
-  // metadata here instead of caching it uselessly.
-  char* buffer = new char[metadataSize];
-  object_write_bencode_c(object_write_to_buffer, NULL, object_buffer_t(buffer, buffer + metadataSize), 
-                         &(*manager->download_manager()->find(m_download->info()))->bencode()->get_key("info"));
+  // Serve from the download's shared serialized-metadata buffer, so a
+  // burst of magnet peers doesn't re-serialize the info dictionary
+  // once per request per peer.
+  const char* metadata = (*manager->download_manager()->find(m_download->info()))->serialized_metadata();
 
   // data: { "msg_type" => 1, "piece" => ..., "total_size" => ... } followed by piece data (outside of dictionary)
   size_t length = piece == pieceEnd - 1 ? m_download->info()->metadata_size() % metadata_piece_size : metadata_piece_size;
   m_pendingType = UT_METADATA;
   m_pending = build_bencode((2 * sizeof(size_t)) + length + 120, "d8:msg_typei1e5:piecei%zue10:total_sizei%zuee", piece, metadataSize);
 
-  memcpy(m_pending.end(), buffer + (piece << metadata_piece_shift), length);
+  memcpy(m_pending.end(), metadata + (piece << metadata_piece_shift), length);
   m_pending.set(m_pending.data(), m_pending.end() + length, m_pending.owned());
-  delete [] buffer;
 }
 
 bool
@@ -82,6 +82,36 @@ Handshake::~Handshake() {
   m_encryption.cleanup();
 }
 
+void
+Handshake::reset(SocketFd fd, int encryptionOptions) {
+  if (m_state != INACTIVE)
+    throw internal_error("Handshake::reset(...) called on an active object.");
+
+  if (get_fd().is_valid())
+    throw internal_error("Handshake::reset(...) called but m_fd is still open.");
+
+  m_peerInfo = NULL;
+  m_download = NULL;
+  m_bitfield.clear();
+
+  // Use global throttles until we know which download it is.
+  m_uploadThrottle = manager->upload_throttle()->throttle_list();
+  m_downloadThrottle = manager->download_throttle()->throttle_list();
+
+  m_readDone = false;
+  m_writeDone = false;
+
+  m_encryption.reset(encryptionOptions);
+  m_extensions = m_manager->default_extensions();
+
+  set_fd(fd);
+
+  m_readBuffer.reset();
+  m_writeBuffer.reset();
+
+  m_taskTimeout.clear_time();
+}
+
 void
 Handshake::initialize_incoming(const rak::socket_address& sa) {
   m_incoming = true;
@@ -126,6 +156,11 @@ Handshake::deactivate_connection() {
   if (!get_fd().is_valid())
     throw internal_error("Handshake::deactivate_connection called but m_fd is not open.");
 
+  // An offloaded computation may still reference this object; drop
+  // or wait out the job before tearing down.
+  if (m_state == DH_COMPUTE)
+    m_manager->offload_cancel(this);
+
   m_state = INACTIVE;
 
   priority_queue_erase(&taskScheduler, &m_taskTimeout);
@@ -258,22 +293,48 @@ Handshake::read_encryption_key() {
   if (m_incoming)
     prepare_key_plus_pad();
 
-  if(!m_encryption.key()->compute_secret(m_readBuffer.position(), 96))
-    throw handshake_error(ConnectionManager::handshake_failed, e_handshake_invalid_encryption);
-  m_readBuffer.consume(96);
+  // Computing the DH secret costs around a millisecond, enough for a
+  // storm of encrypted handshakes to stall the event loop. Park the
+  // connection and hand the computation to the crypto workers; the
+  // state machine resumes in receive_compute_secret_done.
+  manager->poll()->remove_read(this);
 
-  // Determine the synchronisation string.
-  if (m_incoming)
-    m_encryption.hash_req1_to_sync();
-  else
-    m_encryption.encrypt_vc_to_sync(m_download->info()->hash().c_str());
+  m_state = DH_COMPUTE;
+  m_manager->offload_compute_secret(this);
 
-  // also put as much as we can write so far in the buffer
-  if (!m_incoming)
-    prepare_enc_negotiation();
+  return false;
+}
 
-  m_state = READ_ENC_SYNC;
-  return true;
+void
+Handshake::receive_compute_secret_done(bool result) {
+  try {
+    if (m_state != DH_COMPUTE)
+      throw internal_error("Handshake::receive_compute_secret_done(...) called in invalid state.");
+
+    if (!result)
+      throw handshake_error(ConnectionManager::handshake_failed, e_handshake_invalid_encryption);
+
+    m_readBuffer.consume(96);
+
+    // Determine the synchronisation string.
+    if (m_incoming)
+      m_encryption.hash_req1_to_sync();
+    else
+      m_encryption.encrypt_vc_to_sync(m_download->info()->hash().c_str());
+
+    // also put as much as we can write so far in the buffer
+    if (!m_incoming)
+      prepare_enc_negotiation();
+
+    m_state = READ_ENC_SYNC;
+    manager->poll()->insert_read(this);
+
+  } catch (handshake_error& e) {
+    m_manager->receive_failed(this, e.type(), e.error());
+    return;
+  }
+
+  event_read();
 }
 
 // Handshake::read_encryption_sync()
@@ -511,10 +572,31 @@ Handshake::read_peer() {
   // bitfield. Pretend we wrote it already.
   if (m_download->file_list()->bitfield()->is_all_unset() || m_download->initial_seeding() != NULL) {
     m_writePos = m_download->file_list()->bitfield()->size_bytes();
-    m_writeBuffer.write_32(0);
+
+    if (m_peerInfo->supports_fast_extension()) {
+      m_writeBuffer.write_32(1);
+      m_writeBuffer.write_8(protocol_have_none);
+
+      if (m_encryption.info()->is_encrypted())
+        m_encryption.info()->encrypt(m_writeBuffer.end() - 5, 5);
+
+    } else {
+      m_writeBuffer.write_32(0);
+
+      if (m_encryption.info()->is_encrypted())
+        m_encryption.info()->encrypt(m_writeBuffer.end() - 4, 4);
+    }
+
+  } else if (m_peerInfo->supports_fast_extension() && m_download->file_list()->bitfield()->is_all_set()) {
+    // A single HAVE_ALL message replaces the full bitfield transfer
+    // for every seed-to-seed and seed-to-leech connection.
+    m_writePos = m_download->file_list()->bitfield()->size_bytes();
+
+    m_writeBuffer.write_32(1);
+    m_writeBuffer.write_8(protocol_have_all);
 
     if (m_encryption.info()->is_encrypted())
-      m_encryption.info()->encrypt(m_writeBuffer.end() - 4, 4);
+      m_encryption.info()->encrypt(m_writeBuffer.end() - 5, 5);
 
   } else {
     prepare_bitfield();
@@ -539,6 +621,13 @@ Handshake::read_bitfield() {
       m_encryption.info()->decrypt(m_bitfield.begin() + m_readPos, length);
 
     m_readPos += length;
+
+    // Count availability per slice while the bytes are still hot,
+    // instead of rescanning the whole bitmap once it has arrived.
+    if (m_readPos == m_bitfield.size_bytes())
+      m_bitfield.clear_tail();
+
+    m_bitfield.update_range_bytes(m_readPos - length, m_readPos);
   }
 
   return m_readPos == m_bitfield.size_bytes();
@@ -628,11 +717,12 @@ Handshake::read_done() {
     m_bitfield.set_size_bits(m_download->file_list()->bitfield()->size_bits());
     m_bitfield.allocate();
     m_bitfield.unset_all();
-
-  } else {
-    m_bitfield.update();
   }
 
+  // The set count was updated per received slice in read_bitfield(),
+  // and the have-all/have-none paths use set_all()/unset_all(), so no
+  // full rescan is needed here.
+
   // Should've started to write post handshake data already, but we were
   // still reading the bitfield/extension and postponed it. If we had no
   // bitfield to send, we need to send a keep-alive now.
@@ -777,8 +867,36 @@ restart:
         std::memcpy(m_bitfield.begin(), m_readBuffer.position(), m_readPos);
         m_readBuffer.consume(m_readPos);
 
+        if (m_readPos == m_bitfield.size_bytes())
+          m_bitfield.clear_tail();
+
+        m_bitfield.update_range_bytes(0, m_readPos);
+
         m_state = READ_BITFIELD;
 
+      } else if (m_readBuffer.peek_8_at(4) == protocol_have_all || m_readBuffer.peek_8_at(4) == protocol_have_none) {
+        // Fast extension (BEP 6) replacement for the bitfield; sets
+        // up the peer's bitfield without transferring any of it.
+        if (!m_bitfield.empty() || m_readBuffer.read_32() != 1)
+          throw handshake_error(ConnectionManager::handshake_failed, e_handshake_invalid_value);
+
+        uint8_t message = m_readBuffer.read_8();
+
+        m_bitfield.set_size_bits(m_download->file_list()->bitfield()->size_bits());
+        m_bitfield.allocate();
+
+        if (message == protocol_have_all)
+          m_bitfield.set_all();
+        else
+          m_bitfield.unset_all();
+
+        if (!m_peerInfo->supports_extensions() || !m_extensions->is_initial_handshake()) {
+          read_done();
+          break;
+        }
+
+        goto restart;
+
       } else if (m_readBuffer.peek_8_at(4) == protocol_extension && m_extensions->is_initial_handshake()) {
         m_readPos = 0;
         m_state = READ_EXT;
@@ -1014,6 +1132,7 @@ Handshake::prepare_handshake() {
 
   std::memset(m_writeBuffer.end(), 0, 8);
   *(m_writeBuffer.end()+5) |= 0x10;    // support extension protocol
+  *(m_writeBuffer.end()+7) |= 0x04;    // fast extension (BEP 6)
   if (manager->dht_manager()->is_active())
     *(m_writeBuffer.end()+7) |= 0x01;  // DHT support, enable PORT message
   m_writeBuffer.move_end(8);
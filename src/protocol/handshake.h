@@ -60,6 +60,8 @@ public:
 
   static const uint32_t protocol_bitfield  = 5;
   static const uint32_t protocol_port      = 9;
+  static const uint32_t protocol_have_all  = 14;
+  static const uint32_t protocol_have_none = 15;
   static const uint32_t protocol_extension = 20;
 
   static const uint32_t enc_negotiation_size = 8 + 4 + 2;
@@ -79,6 +81,7 @@ public:
     PROXY_DONE,
 
     READ_ENC_KEY,
+    DH_COMPUTE,
     READ_ENC_SYNC,
     READ_ENC_SKEY,
     READ_ENC_NEGOT,
@@ -96,6 +99,10 @@ public:
   Handshake(SocketFd fd, HandshakeManager* m, int encryption_options);
   ~Handshake();
 
+  // Reinitialize a pooled object for a new connection attempt,
+  // reusing the buffer and encryption allocations.
+  void                reset(SocketFd fd, int encryption_options);
+
   const char*         type_name() const { return "handshake"; }
 
   bool                is_active() const             { return m_state != INACTIVE; }
@@ -128,6 +135,10 @@ public:
   virtual void        event_write();
   virtual void        event_error();
 
+  // Called on the main thread when the offloaded DiffieHellman
+  // computation finishes; resumes the state machine.
+  void                receive_compute_secret_done(bool result);
+
   HandshakeEncryption* encryption()                 { return &m_encryption; }
   ProtocolExtension*   extensions()                  { return m_extensions; }
 
@@ -101,6 +101,19 @@ public:
   bool                initialize();
   void                cleanup();
 
+  // Return the object to its freshly constructed state so it can be
+  // reused for a new connection attempt.
+  void                reset(int options) {
+    cleanup();
+
+    m_info = EncryptionInfo();
+    m_options = options;
+    m_crypto = 0;
+    m_retry = RETRY_NONE;
+    m_syncLength = 0;
+    m_lengthIA = 0;
+  }
+
   void                initialize_decrypt(const char* origHash, bool incoming);
   void                initialize_encrypt(const char* origHash, bool incoming);
 
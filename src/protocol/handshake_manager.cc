@@ -1,13 +1,21 @@
 #include "config.h"
 
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
 #include <rak/socket_address.h>
 
 #include "torrent/exceptions.h"
+#include "utils/diffie_hellman.h"
 #include "torrent/error.h"
 #include "download/download_main.h"
+#include "download/download_wrapper.h"
 #include "torrent/connection_manager.h"
 #include "torrent/download_info.h"
+#include "torrent/download/download_manager.h"
+#include "torrent/peer/peer.h"
 #include "torrent/peer/peer_info.h"
+#include "torrent/peer/peer_list.h"
 #include "torrent/peer/client_list.h"
 #include "torrent/peer/connection_list.h"
 #include "torrent/utils/log.h"
@@ -18,6 +26,8 @@
 
 #include "manager.h"
 
+#include "globals.h"
+
 #define LT_LOG_SA(sa, log_fmt, ...)                                     \
   lt_log_print(LOG_CONNECTION_HANDSHAKE, "handshake_manager->%s: " log_fmt, (sa)->address_str().c_str(), __VA_ARGS__);
 #define LT_LOG_SA_C(sa, log_fmt, ...)                                   \
@@ -36,25 +46,210 @@ handshake_manager_delete_handshake(Handshake* h) {
   delete h;
 }
 
+HandshakeManager::~HandshakeManager() {
+  clear();
+
+  std::for_each(m_handshake_pool.begin(), m_handshake_pool.end(), rak::call_delete<Handshake>());
+  m_handshake_pool.clear();
+
+  stop_compute_workers();
+
+  pthread_mutex_destroy(&m_compute_lock);
+  pthread_cond_destroy(&m_compute_cond);
+}
+
+void
+HandshakeManager::start_compute_workers() {
+  for (unsigned int i = 0; i < compute_worker_count; i++)
+    if (pthread_create(&m_compute_threads[i], NULL, &HandshakeManager::compute_thread_func, this) != 0)
+      throw internal_error("HandshakeManager::start_compute_workers() could not create thread.");
+
+  m_compute_running = true;
+}
+
+void
+HandshakeManager::stop_compute_workers() {
+  if (!m_compute_running)
+    return;
+
+  pthread_mutex_lock(&m_compute_lock);
+  m_compute_shutdown = true;
+  pthread_cond_broadcast(&m_compute_cond);
+  pthread_mutex_unlock(&m_compute_lock);
+
+  for (unsigned int i = 0; i < compute_worker_count; i++)
+    pthread_join(m_compute_threads[i], NULL);
+
+  m_compute_running = false;
+}
+
+void
+HandshakeManager::offload_compute_secret(Handshake* handshake) {
+  if (!m_compute_running)
+    start_compute_workers();
+
+  pthread_mutex_lock(&m_compute_lock);
+  m_compute_queue.push_back(handshake);
+  pthread_cond_signal(&m_compute_cond);
+  pthread_mutex_unlock(&m_compute_lock);
+}
+
+// Called with the handshake parked in DH_COMPUTE before it is torn
+// down; either unqueues the job or waits for the worker to let go of
+// the object.
+void
+HandshakeManager::offload_cancel(Handshake* handshake) {
+  if (!m_compute_running)
+    return;
+
+  pthread_mutex_lock(&m_compute_lock);
+
+  compute_queue_type::iterator itr = std::find(m_compute_queue.begin(), m_compute_queue.end(), handshake);
+
+  if (itr != m_compute_queue.end()) {
+    m_compute_queue.erase(itr);
+    pthread_mutex_unlock(&m_compute_lock);
+    return;
+  }
+
+  while (true) {
+    compute_done_type::iterator done_itr = m_compute_done.begin();
+
+    while (done_itr != m_compute_done.end() && done_itr->first != handshake)
+      done_itr++;
+
+    if (done_itr != m_compute_done.end()) {
+      m_compute_done.erase(done_itr);
+      break;
+    }
+
+    // Not queued, running or done; the result was already delivered.
+    if (std::find(m_compute_active.begin(), m_compute_active.end(), handshake) == m_compute_active.end())
+      break;
+
+    pthread_mutex_unlock(&m_compute_lock);
+    usleep(100);
+    pthread_mutex_lock(&m_compute_lock);
+  }
+
+  pthread_mutex_unlock(&m_compute_lock);
+}
+
+void*
+HandshakeManager::compute_thread_func(void* manager) {
+  static_cast<HandshakeManager*>(manager)->compute_run();
+  return NULL;
+}
+
+void
+HandshakeManager::compute_run() {
+  pthread_mutex_lock(&m_compute_lock);
+
+  while (!m_compute_shutdown) {
+    if (m_compute_queue.empty()) {
+      pthread_cond_wait(&m_compute_cond, &m_compute_lock);
+      continue;
+    }
+
+    Handshake* handshake = m_compute_queue.front();
+    m_compute_queue.pop_front();
+    m_compute_active.push_back(handshake);
+
+    pthread_mutex_unlock(&m_compute_lock);
+
+    // The handshake is parked and unpolled while offloaded, so the
+    // key object and read buffer are stable.
+    bool result = handshake->encryption()->key()->compute_secret(static_cast<const unsigned char*>(handshake->unread_data()), 96);
+
+    pthread_mutex_lock(&m_compute_lock);
+    m_compute_active.erase(std::find(m_compute_active.begin(), m_compute_active.end(), handshake));
+    m_compute_done.push_back(std::make_pair(handshake, result));
+    pthread_mutex_unlock(&m_compute_lock);
+
+    m_slot_compute_done();
+
+    pthread_mutex_lock(&m_compute_lock);
+  }
+
+  pthread_mutex_unlock(&m_compute_lock);
+}
+
+void
+HandshakeManager::work_compute_done() {
+  pthread_mutex_lock(&m_compute_lock);
+
+  while (!m_compute_done.empty()) {
+    Handshake* handshake = m_compute_done.front().first;
+    bool result = m_compute_done.front().second;
+    m_compute_done.pop_front();
+
+    pthread_mutex_unlock(&m_compute_lock);
+    handshake->receive_compute_secret_done(result);
+    pthread_mutex_lock(&m_compute_lock);
+  }
+
+  pthread_mutex_unlock(&m_compute_lock);
+}
+
+Handshake*
+HandshakeManager::acquire_handshake(SocketFd fd, int encryptionOptions) {
+  if (m_handshake_pool.empty())
+    return new Handshake(fd, this, encryptionOptions);
+
+  Handshake* handshake = m_handshake_pool.back();
+  m_handshake_pool.pop_back();
+
+  handshake->reset(fd, encryptionOptions);
+  return handshake;
+}
+
+void
+HandshakeManager::release_handshake(Handshake* handshake) {
+  if (m_handshake_pool.size() >= handshake_pool_max_size) {
+    delete handshake;
+    return;
+  }
+
+  m_handshake_pool.push_back(handshake);
+}
+
 HandshakeManager::size_type
 HandshakeManager::size_info(DownloadMain* info) const {
-  return std::count_if(base_type::begin(), base_type::end(), rak::equal(info, std::mem_fun(&Handshake::download)));
+  // Queued outgoing attempts count as well, so the caller's handshake
+  // budget covers connects that merely wait for admission tokens.
+  return std::count_if(base_type::begin(), base_type::end(), rak::equal(info, std::mem_fun(&Handshake::download))) +
+    std::count_if(m_queue.begin(), m_queue.end(), rak::equal(info, rak::const_mem_ref(&queue_type::value_type::second)));
 }
 
 void
 HandshakeManager::clear() {
   std::for_each(base_type::begin(), base_type::end(), std::ptr_fun(&handshake_manager_delete_handshake));
   base_type::clear();
+
+  m_key_index.clear();
+  m_key_index_fill = 0;
+
+  m_queue.clear();
+  priority_queue_erase(&taskScheduler, &m_task_queue_tick);
 }
 
 void
 HandshakeManager::erase(Handshake* handshake) {
-  iterator itr = std::find(base_type::begin(), base_type::end(), handshake);
+  uint32_t slot = key_index_find_slot(handshake);
 
-  if (itr == base_type::end())
+  if (slot == m_key_index.size())
     throw internal_error("HandshakeManager::erase(...) could not find handshake.");
 
-  base_type::erase(itr);
+  uint32_t position = m_key_index[slot].position;
+
+  m_key_index[slot].state = slot_erased;
+
+  // Swap-removal from the base vector; the entry moved into the hole
+  // gets its index slot repointed.
+  base_type::erase(base_type::begin() + position);
+
+  if (position != base_type::size())
+    key_index_update_position(*(base_type::begin() + position), base_type::size(), position);
 }
 
 struct handshake_manager_equal : std::binary_function<const rak::socket_address*, const Handshake*, bool> {
@@ -65,7 +260,26 @@ struct handshake_manager_equal : std::binary_function<const rak::socket_address*
 
 bool
 HandshakeManager::find(const rak::socket_address& sa) {
-  return std::find_if(base_type::begin(), base_type::end(), std::bind1st(handshake_manager_equal(), &sa)) != base_type::end();
+  if (m_key_index.empty())
+    return false;
+
+  socket_address_key key = socket_address_key::from_sockaddr(sa.c_sockaddr());
+
+  uint32_t mask = m_key_index.size() - 1;
+  uint32_t slot = key.hash() & mask;
+
+  while (true) {
+    const key_index_slot& entry = m_key_index[slot];
+
+    if (entry.state == slot_empty)
+      return false;
+
+    if (entry.state == slot_used && entry.key == key &&
+        handshake_manager_equal()(&sa, *(base_type::begin() + entry.position)))
+      return true;
+
+    slot = (slot + 1) & mask;
+  }
 }
 
 void
@@ -75,6 +289,114 @@ HandshakeManager::erase_download(DownloadMain* info) {
 
   std::for_each(split, base_type::end(), std::ptr_fun(&handshake_manager_delete_handshake));
   base_type::erase(split, base_type::end());
+
+  // The partition shuffles the vector, so reindex wholesale.
+  key_index_rebuild();
+
+  m_queue.erase(std::remove_if(m_queue.begin(), m_queue.end(),
+                               rak::equal(info, rak::const_mem_ref(&queue_type::value_type::second))),
+                m_queue.end());
+}
+
+// Probes for the slot indexing 'handshake'; returns m_key_index.size()
+// when it is not indexed.
+uint32_t
+HandshakeManager::key_index_find_slot(Handshake* handshake) {
+  if (m_key_index.empty())
+    return m_key_index.size();
+
+  socket_address_key key = socket_address_key::from_sockaddr(handshake->socket_address()->c_sockaddr());
+
+  uint32_t mask = m_key_index.size() - 1;
+  uint32_t slot = key.hash() & mask;
+
+  while (true) {
+    const key_index_slot& entry = m_key_index[slot];
+
+    if (entry.state == slot_empty)
+      return m_key_index.size();
+
+    if (entry.state == slot_used && entry.key == key &&
+        entry.position < base_type::size() && *(base_type::begin() + entry.position) == handshake)
+      return slot;
+
+    slot = (slot + 1) & mask;
+  }
+}
+
+// Insert an index entry for the handshake at 'position', growing the
+// table to keep the fill factor, tombstones included, below three
+// quarters.
+void
+HandshakeManager::key_index_insert(Handshake* handshake, uint32_t position) {
+  if (4 * (m_key_index_fill + 1) >= 3 * m_key_index.size())
+    key_index_rebuild();
+
+  socket_address_key key = socket_address_key::from_sockaddr(handshake->socket_address()->c_sockaddr());
+
+  uint32_t mask = m_key_index.size() - 1;
+  uint32_t slot = key.hash() & mask;
+
+  while (m_key_index[slot].state == slot_used) {
+    // The rebuild indexes the whole vector, including the entry this
+    // call was about to add.
+    if (m_key_index[slot].key == key && m_key_index[slot].position == position)
+      return;
+
+    slot = (slot + 1) & mask;
+  }
+
+  if (m_key_index[slot].state == slot_empty)
+    m_key_index_fill++;
+
+  m_key_index[slot].state = slot_used;
+  m_key_index[slot].key = key;
+  m_key_index[slot].position = position;
+}
+
+void
+HandshakeManager::key_index_update_position(Handshake* handshake, uint32_t old_position, uint32_t new_position) {
+  socket_address_key key = socket_address_key::from_sockaddr(handshake->socket_address()->c_sockaddr());
+
+  uint32_t mask = m_key_index.size() - 1;
+  uint32_t slot = key.hash() & mask;
+
+  while (!(m_key_index[slot].state == slot_used && m_key_index[slot].key == key && m_key_index[slot].position == old_position))
+    slot = (slot + 1) & mask;
+
+  m_key_index[slot].position = new_position;
+}
+
+void
+HandshakeManager::key_index_rebuild() {
+  uint32_t tableSize = 64;
+
+  while (tableSize < 2 * (base_type::size() + 1))
+    tableSize <<= 1;
+
+  key_index_slot empty_slot;
+  empty_slot.state = slot_empty;
+  std::memset(&empty_slot.key, 0, sizeof(empty_slot.key));
+  empty_slot.position = 0;
+
+  m_key_index.assign(tableSize, empty_slot);
+  m_key_index_fill = 0;
+
+  uint32_t mask = tableSize - 1;
+
+  for (uint32_t position = 0; position < base_type::size(); position++) {
+    socket_address_key key = socket_address_key::from_sockaddr((*(base_type::begin() + position))->socket_address()->c_sockaddr());
+
+    uint32_t slot = key.hash() & mask;
+
+    while (m_key_index[slot].state == slot_used)
+      slot = (slot + 1) & mask;
+
+    m_key_index[slot].state = slot_used;
+    m_key_index[slot].key = key;
+    m_key_index[slot].position = position;
+    m_key_index_fill++;
+  }
 }
 
 void
@@ -90,21 +412,139 @@ HandshakeManager::add_incoming(SocketFd fd, const rak::socket_address& sa) {
 
   manager->connection_manager()->inc_socket_count();
 
-  Handshake* h = new Handshake(fd, this, manager->connection_manager()->encryption_options());
+  Handshake* h = acquire_handshake(fd, manager->connection_manager()->encryption_options());
   h->initialize_incoming(sa);
 
   base_type::push_back(h);
+  key_index_insert(h, base_type::size() - 1);
 }
   
+// Score an outgoing candidate for admission when the socket limit is
+// reached. Swarms short of the priority minimum weigh heaviest, then
+// the candidate's history and how the IP filter classes the address.
+uint32_t
+HandshakeManager::rate_candidate(const rak::socket_address& sa, DownloadMain* download) {
+  uint32_t score = score_base;
+
+  if (download->connection_list()->size() < m_priority_peer_min)
+    score += score_swarm_deficit;
+
+  const PeerInfo* peerInfo = download->peer_list()->find_address(sa.c_sockaddr());
+
+  if (peerInfo != NULL) {
+    if (peerInfo->is_preferred())
+      score += score_preferred;
+
+    if (peerInfo->last_connection() != 0)
+      score += score_known_good;
+
+    score -= std::min(score, peerInfo->failed_counter() * score_failed_penalty);
+  }
+
+  return score;
+}
+
+uint32_t
+HandshakeManager::rate_connection(Peer* peer, DownloadMain* download) {
+  uint32_t score = score_base;
+
+  // Peers in swarms at or below the priority minimum are not worth
+  // displacing even when idle.
+  if (download->connection_list()->size() <= m_priority_peer_min)
+    score += score_swarm_deficit;
+
+  if (peer->up_rate()->rate() != 0 || peer->down_rate()->rate() != 0)
+    score += score_active;
+
+  if (peer->peer_info()->is_preferred())
+    score += score_preferred;
+
+  if (peer->up_rate()->total() != 0 || peer->down_rate()->total() != 0)
+    score += score_known_good;
+
+  return score;
+}
+
+// Disconnect the lowest-valued connected peer across all downloads if
+// the candidate scores strictly higher, freeing a socket for the new
+// connection. The displaced address goes back on its swarm's
+// available list.
+bool
+HandshakeManager::try_evict_connection(uint32_t candidate_score) {
+  Peer*         victim = NULL;
+  DownloadMain* victim_download = NULL;
+  uint32_t      victim_score = candidate_score;
+
+  for (DownloadManager::iterator d_itr = manager->download_manager()->begin(),
+         d_last = manager->download_manager()->end(); d_itr != d_last; d_itr++) {
+    DownloadMain* download = (*d_itr)->main();
+
+    if (!download->info()->is_active())
+      continue;
+
+    for (ConnectionList::iterator itr = download->connection_list()->begin(),
+           last = download->connection_list()->end(); itr != last; itr++) {
+      uint32_t score = rate_connection(*itr, download);
+
+      if (score < victim_score) {
+        victim_score = score;
+        victim = *itr;
+        victim_download = download;
+      }
+    }
+  }
+
+  if (victim == NULL)
+    return false;
+
+  LT_LOG_SA(rak::socket_address::cast_from(victim->address()),
+            "Evicting connection for higher-valued candidate: score:%u.", victim_score);
+
+  victim_download->connection_list()->erase(victim, ConnectionList::disconnect_available);
+  return true;
+}
+
 void
 HandshakeManager::add_outgoing(const rak::socket_address& sa, DownloadMain* download) {
-  if (!manager->connection_manager()->can_connect() ||
-      !manager->connection_manager()->filter(sa.c_sockaddr()))
+  if (!manager->connection_manager()->filter(sa.c_sockaddr()))
     return;
 
+  // On a full box score the candidate instead of refusing outright;
+  // a higher-valued candidate displaces the least useful connected
+  // peer.
+  if (!manager->connection_manager()->can_connect() &&
+      !try_evict_connection(rate_candidate(sa, download)))
+    return;
+
+  // Starved downloads handshake immediately; reconnects for swarms
+  // already holding the priority minimum wait for admission tokens.
+  if (download->connection_list()->size() >= m_priority_peer_min) {
+    m_queue.push_back(queue_type::value_type(sa, download));
+
+    if (!m_task_queue_tick.is_queued())
+      priority_queue_insert(&taskScheduler, &m_task_queue_tick, cachedTime + rak::timer::from_seconds(1));
+
+    return;
+  }
+
   create_outgoing(sa, download, manager->connection_manager()->encryption_options());
 }
 
+void
+HandshakeManager::receive_queue_tick() {
+  uint32_t tokens = queue_tokens_per_tick;
+
+  while (tokens-- != 0 && !m_queue.empty() && manager->connection_manager()->can_connect()) {
+    queue_type::value_type entry = m_queue.front();
+    m_queue.pop_front();
+
+    create_outgoing(entry.first, entry.second, manager->connection_manager()->encryption_options());
+  }
+
+  if (!m_queue.empty())
+    priority_queue_insert(&taskScheduler, &m_task_queue_tick, cachedTime + rak::timer::from_seconds(1));
+}
+
 void
 HandshakeManager::create_outgoing(const rak::socket_address& sa, DownloadMain* download, int encryptionOptions) {
   int connection_options = PeerList::connect_keep_handshakes;
@@ -117,8 +557,18 @@ HandshakeManager::create_outgoing(const rak::socket_address& sa, DownloadMain* d
   if (peerInfo == NULL || peerInfo->failed_counter() > max_failed)
     return;
 
+  // Start out in the mode this address negotiated last time, instead
+  // of burning a connection on a mode it is known to reject. A stale
+  // entry still falls back to the normal retry logic.
+  if (!(encryptionOptions & ConnectionManager::encryption_retrying)) {
+    if (peerInfo->is_crypto_rc4() && (encryptionOptions & ConnectionManager::encryption_enable_retry))
+      encryptionOptions |= ConnectionManager::encryption_try_outgoing;
+    else if (peerInfo->is_crypto_plain() && !(encryptionOptions & ConnectionManager::encryption_require))
+      encryptionOptions &= ~ConnectionManager::encryption_try_outgoing;
+  }
+
   SocketFd fd;
-  const rak::socket_address* bindAddress = rak::socket_address::cast_from(manager->connection_manager()->bind_address());
+  const rak::socket_address* bindAddress = rak::socket_address::cast_from(manager->connection_manager()->rotate_bind_address());
   const rak::socket_address* connectAddress = &sa;
 
   if (rak::socket_address::cast_from(manager->connection_manager()->proxy_address())->is_valid()) {
@@ -127,9 +577,8 @@ HandshakeManager::create_outgoing(const rak::socket_address& sa, DownloadMain* d
   }
 
   if (!fd.open_stream() ||
-      !setup_socket(fd) ||
-      (bindAddress->is_bindable() && !fd.bind(*bindAddress)) ||
-      !fd.connect(*connectAddress)) {
+      !fd.set_nonblock() ||
+      !setup_socket(fd)) {
 
     if (fd.is_valid())
       fd.close();
@@ -138,6 +587,20 @@ HandshakeManager::create_outgoing(const rak::socket_address& sa, DownloadMain* d
     return;
   }
 
+  if ((bindAddress->is_bindable() && !fd.bind(*bindAddress)) ||
+      !fd.connect(*connectAddress)) {
+
+    // The source interface is the likely culprit; put it on failover
+    // cooldown so the rotation prefers the other uplinks for a while.
+    if (bindAddress->is_bindable())
+      manager->connection_manager()->bind_address_failed(bindAddress->c_sockaddr());
+
+    fd.close();
+
+    download->peer_list()->disconnected(peerInfo, 0);
+    return;
+  }
+
   int message;
 
   if (encryptionOptions & ConnectionManager::encryption_use_proxy)
@@ -150,10 +613,11 @@ HandshakeManager::create_outgoing(const rak::socket_address& sa, DownloadMain* d
   LT_LOG_SA(&sa, "Adding outcoming connection: encryption:%x message:%x.", encryptionOptions, message);
   manager->connection_manager()->inc_socket_count();
 
-  Handshake* handshake = new Handshake(fd, this, encryptionOptions);
+  Handshake* handshake = acquire_handshake(fd, encryptionOptions);
   handshake->initialize_outgoing(sa, download, peerInfo);
 
   base_type::push_back(handshake);
+  key_index_insert(handshake, base_type::size() - 1);
 }
 
 void
@@ -164,6 +628,11 @@ HandshakeManager::receive_succeeded(Handshake* handshake) {
   erase(handshake);
   handshake->deactivate_connection();
 
+  // Remember the negotiated encryption mode for later reconnects.
+  handshake->peer_info()->unset_flags(PeerInfo::mask_crypto);
+  handshake->peer_info()->set_flags(handshake->encryption()->has_crypto_rc4() ?
+                                    PeerInfo::flag_crypto_rc4 : PeerInfo::flag_crypto_plain);
+
   DownloadMain* download = handshake->download();
   PeerConnectionBase* pcb;
 
@@ -205,7 +674,7 @@ HandshakeManager::receive_succeeded(Handshake* handshake) {
     handshake->destroy_connection();
   }
 
-  delete handshake;
+  release_handshake(handshake);
 }
 
 void
@@ -231,7 +700,7 @@ HandshakeManager::receive_failed(Handshake* handshake, int message, int error) {
     create_outgoing(*sa, download, retry_options);
   }
 
-  delete handshake;
+  release_handshake(handshake);
 }
 
 void
@@ -244,9 +713,8 @@ HandshakeManager::receive_timeout(Handshake* h) {
 
 bool
 HandshakeManager::setup_socket(SocketFd fd) {
-  if (!fd.set_nonblock())
-    return false;
-
+  // Incoming fds arrive non-blocking from accept_nonblock; outgoing
+  // sockets set the flag when opened.
   ConnectionManager* m = manager->connection_manager();
 
   if (m->priority() != ConnectionManager::iptos_default && !fd.set_priority(m->priority()))
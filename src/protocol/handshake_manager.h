@@ -1,14 +1,21 @@
 #ifndef LIBTORRENT_NET_HANDSHAKE_MANAGER_H
 #define LIBTORRENT_NET_HANDSHAKE_MANAGER_H
 
+#include <deque>
 #include <functional>
 #include <inttypes.h>
 #include <string>
+#include <utility>
+#include <vector>
+#include <pthread.h>
 #include <rak/functional.h>
+#include <rak/priority_queue_default.h>
 #include <rak/unordered_vector.h>
 #include <rak/socket_address.h>
 #include <torrent/connection_manager.h>
 
+#include "torrent/net/socket_address_key.h"
+
 #include "net/socket_fd.h"
 
 namespace torrent {
@@ -16,6 +23,7 @@ namespace torrent {
 class Handshake;
 class DownloadManager;
 class DownloadMain;
+class Peer;
 class PeerConnectionBase;
 
 class HandshakeManager : private rak::unordered_vector<Handshake*> {
@@ -24,18 +32,42 @@ public:
   typedef uint32_t                          size_type;
 
   typedef std::function<DownloadMain* (const char*)> slot_download;
+  typedef std::function<void ()>                     slot_void;
 
   // Do not connect to peers with this many or more failed chunks.
   static const unsigned int max_failed = 3;
 
+  // Completed or failed handshakes are recycled through a small pool
+  // so connection storms don't allocate and free the large handshake
+  // buffers for every attempt.
+  static const size_type handshake_pool_max_size = 32;
+
+  // Outgoing handshakes for downloads that already hold at least
+  // priority_peer_min connections are queued and admitted by a token
+  // budget per tick, so a restart spends its connect slots on the
+  // starved swarms before churned reconnects.
+  static const uint32_t priority_peer_min_default = 8;
+  static const uint32_t queue_tokens_per_tick     = 32;
+
   using base_type::empty;
 
-  HandshakeManager() { }
-  ~HandshakeManager() { clear(); }
+  HandshakeManager() : m_key_index_fill(0), m_priority_peer_min(priority_peer_min_default),
+                       m_compute_running(false), m_compute_shutdown(false) {
+    m_task_queue_tick.slot() = std::bind(&HandshakeManager::receive_queue_tick, this);
+
+    pthread_mutex_init(&m_compute_lock, NULL);
+    pthread_cond_init(&m_compute_cond, NULL);
+  }
+  ~HandshakeManager();
 
   size_type           size() const { return base_type::size(); }
   size_type           size_info(DownloadMain* info) const;
 
+  size_type           queue_size() const { return m_queue.size(); }
+
+  uint32_t            priority_peer_min() const         { return m_priority_peer_min; }
+  void                set_priority_peer_min(uint32_t v) { m_priority_peer_min = v; }
+
   void                clear();
 
   bool                find(const rak::socket_address& sa);
@@ -46,6 +78,17 @@ public:
   void                add_incoming(SocketFd fd, const rak::socket_address& sa);
   void                add_outgoing(const rak::socket_address& sa, DownloadMain* info);
 
+  // Admission scoring when the socket limit is reached: outgoing
+  // candidates are valued by swarm deficit, peer history and how the
+  // IP filter classes the address, and may displace the
+  // lowest-valued connected peer.
+  static const uint32_t score_base           = 1;
+  static const uint32_t score_swarm_deficit  = 32;
+  static const uint32_t score_active         = 16;
+  static const uint32_t score_preferred      = 8;
+  static const uint32_t score_known_good     = 4;
+  static const uint32_t score_failed_penalty = 4;
+
   slot_download&      slot_download_id()         { return m_slot_download_id; }
   slot_download&      slot_download_obfuscated() { return m_slot_download_obfuscated; }
 
@@ -57,18 +100,90 @@ public:
   void                receive_failed(Handshake* h, int message, int error);
   void                receive_timeout(Handshake* h);
 
+  // DiffieHellman computations offloaded to the crypto worker
+  // threads; results are delivered back on the main thread through
+  // work_compute_done, wired to the signal bitfield via
+  // slot_compute_done.
+  void                offload_compute_secret(Handshake* h);
+  void                offload_cancel(Handshake* h);
+  void                work_compute_done();
+
+  slot_void&          slot_compute_done()        { return m_slot_compute_done; }
+
   ProtocolExtension*  default_extensions() const                        { return &DefaultExtensions; }
 
 private:
+  static const unsigned int compute_worker_count = 2;
+
+  typedef std::deque<Handshake*>                   compute_queue_type;
+  typedef std::deque<std::pair<Handshake*, bool> > compute_done_type;
+  typedef std::vector<Handshake*>                  pool_type;
+
+  typedef std::deque<std::pair<rak::socket_address, DownloadMain*> > queue_type;
+
   void                create_outgoing(const rak::socket_address& sa, DownloadMain* info, int encryptionOptions);
   void                erase(Handshake* handshake);
 
+  uint32_t            rate_candidate(const rak::socket_address& sa, DownloadMain* download);
+  uint32_t            rate_connection(Peer* peer, DownloadMain* download);
+  bool                try_evict_connection(uint32_t candidate_score);
+
+  void                receive_queue_tick();
+
+  // Open-addressed hash index over the active handshakes, keyed by
+  // the address each handshake was created with. The key drops the
+  // port, so distinct handshakes may share a key and every probe hit
+  // is verified against the base vector entry the slot points at.
+  static const uint8_t slot_empty  = 0;
+  static const uint8_t slot_used   = 1;
+  static const uint8_t slot_erased = 2;
+
+  struct key_index_slot {
+    uint8_t             state;
+    socket_address_key  key;
+    uint32_t            position;
+  };
+
+  typedef std::vector<key_index_slot> key_index_type;
+
+  uint32_t            key_index_find_slot(Handshake* handshake);
+  void                key_index_insert(Handshake* handshake, uint32_t position);
+  void                key_index_update_position(Handshake* handshake, uint32_t old_position, uint32_t new_position);
+  void                key_index_rebuild();
+
+  Handshake*          acquire_handshake(SocketFd fd, int encryption_options);
+  void                release_handshake(Handshake* handshake);
+
   bool                setup_socket(SocketFd fd);
 
+  void                start_compute_workers();
+  void                stop_compute_workers();
+  static void*        compute_thread_func(void* manager);
+  void                compute_run();
+
   static ProtocolExtension DefaultExtensions;
 
+  pool_type           m_handshake_pool;
+
+  key_index_type      m_key_index;
+  uint32_t            m_key_index_fill;
+
+  queue_type          m_queue;
+  uint32_t            m_priority_peer_min;
+  rak::priority_item  m_task_queue_tick;
+
   slot_download       m_slot_download_id;
   slot_download       m_slot_download_obfuscated;
+  slot_void           m_slot_compute_done;
+
+  bool                m_compute_running;
+  bool                m_compute_shutdown;
+  pthread_t           m_compute_threads[compute_worker_count];
+  compute_queue_type  m_compute_queue;
+  compute_queue_type  m_compute_active;
+  compute_done_type   m_compute_done;
+  pthread_mutex_t     m_compute_lock;
+  pthread_cond_t      m_compute_cond;
 };
 
 }
@@ -243,20 +243,37 @@ InitialSeeding::find_next(bool secondary, PeerConnectionBase* pcb) {
     }
 
     // Went through all chunks. Continue with secondary seeding.
-    m_nextChunk--;
   }
 
-  // Secondary seeding: find next chunk that's not done yet.
-  do {
-    if (++m_nextChunk == m_download->file_list()->size_chunks())
-      m_nextChunk = 0;
+  // Secondary seeding: walk the swarm-wide rarity order kept by
+  // ChunkStatistics, so the least distributed chunks get re-offered
+  // first and well-seeded ones aren't stepped through at all. Resume
+  // after the previous offer so consecutive peers get different
+  // chunks.
+  ChunkStatistics* statistics = m_download->chunk_statistics();
+
+  uint32_t index = m_nextChunk < m_download->file_list()->size_chunks()
+    ? statistics->rarest_next(m_nextChunk)
+    : statistics->rarest_first();
+
+  while (true) {
+    if (index == ChunkStatistics::invalid_index) {
+      index = statistics->rarest_first();
+      continue;
+    }
+
+    if (m_peerChunks[index] != chunk_done) {
+      if ((*statistics)[index] > 1)
+        chunk_complete(index, pcb);
 
-    if (m_peerChunks[m_nextChunk] != chunk_done && (*m_download->chunk_statistics())[m_nextChunk] > 1)
-      chunk_complete(m_nextChunk, pcb);
+      if (m_peerChunks[index] != chunk_done)
+        break;
+    }
 
-  } while (m_peerChunks[m_nextChunk] == chunk_done);
+    index = statistics->rarest_next(index);
+  }
 
-  return m_nextChunk;
+  return m_nextChunk = index;
 }
 
 void
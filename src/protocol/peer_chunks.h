@@ -58,6 +58,9 @@ public:
 
   bool                is_seeder() const             { return m_bitfield.is_all_set(); }
 
+  // Answers also while the bitfield is compacted.
+  bool                has_chunk(uint32_t index) const { return m_bitfield.empty() ? m_bitfield.is_all_set() : m_bitfield.get(index); }
+
   PeerInfo*           peer_info()                   { return m_peerInfo; }
   const PeerInfo*     peer_info() const             { return m_peerInfo; }
   void                set_peer_info(PeerInfo* p)    { m_peerInfo = p; }
@@ -65,6 +68,14 @@ public:
   bool                using_counter() const         { return m_usingCounter; }
   void                set_using_counter(bool state) { m_usingCounter = state; }
 
+  // Number of chunks the peer has that we haven't completed yet,
+  // maintained incrementally so interest checks don't need to scan
+  // the bitfields.
+  uint32_t            wanted_chunks() const         { return m_wantedChunks; }
+  void                set_wanted_chunks(uint32_t c) { m_wantedChunks = c; }
+  void                inc_wanted_chunks()           { m_wantedChunks++; }
+  void                dec_wanted_chunks()           { m_wantedChunks--; }
+
   Bitfield*           bitfield()                    { return &m_bitfield; }
   const Bitfield*     bitfield() const              { return &m_bitfield; }
 
@@ -73,6 +84,7 @@ public:
   piece_list_type*       upload_queue()             { return &m_uploadQueue; }
   const piece_list_type* upload_queue() const       { return &m_uploadQueue; }
   piece_list_type*       cancel_queue()             { return &m_cancelQueue; }
+  piece_list_type*       reject_queue()             { return &m_rejectQueue; }
 
   // Timer used to figure out what HAVE_PIECE messages have not been
   // sent.
@@ -91,6 +103,7 @@ private:
   PeerInfo*           m_peerInfo;
 
   bool                m_usingCounter;
+  uint32_t            m_wantedChunks;
 
   Bitfield            m_bitfield;
 
@@ -98,6 +111,7 @@ private:
 
   piece_list_type     m_uploadQueue;
   piece_list_type     m_cancelQueue;
+  piece_list_type     m_rejectQueue;
 
   rak::timer          m_haveTimer;
 
@@ -112,6 +126,7 @@ PeerChunks::PeerChunks() :
   m_peerInfo(NULL),
 
   m_usingCounter(false),
+  m_wantedChunks(0),
 
   m_peerRate(600),
 
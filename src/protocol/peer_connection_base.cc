@@ -40,6 +40,7 @@
 #include <fcntl.h>
 #include <rak/error_number.h>
 #include <rak/functional.h>
+#include <rak/socket_address.h>
 #include <rak/string_manip.h>
 
 #include "data/chunk_iterator.h"
@@ -50,6 +51,9 @@
 #include "net/socket_base.h"
 #include "torrent/exceptions.h"
 #include "torrent/data/block.h"
+#include "torrent/data/file.h"
+#include "torrent/data/transfer_list.h"
+#include "data/hash_queue.h"
 #include "torrent/chunk_manager.h"
 #include "torrent/connection_manager.h"
 #include "torrent/download_info.h"
@@ -92,6 +96,42 @@ log_mincore_stats_func(bool is_incore, bool new_index, bool& continous) {
   continous = is_incore;
 }
 
+// Poll write activations deferred by the choke cycle, drained a batch
+// at a time off the task scheduler. Entries are purged on cleanup so
+// the queue never holds a closed connection.
+static std::vector<PeerConnectionBase*> deferred_write_queue;
+static rak::priority_item               deferred_write_task;
+
+static const size_t  deferred_write_batch = 32;
+static const int64_t deferred_write_interval = 50 * 1000;
+
+static void
+deferred_write_flush() {
+  size_t count = std::min(deferred_write_queue.size(), deferred_write_batch);
+
+  for (size_t i = 0; i < count; i++)
+    deferred_write_queue[i]->write_insert_poll_safe();
+
+  deferred_write_queue.erase(deferred_write_queue.begin(), deferred_write_queue.begin() + count);
+
+  if (!deferred_write_queue.empty())
+    priority_queue_insert(&taskScheduler, &deferred_write_task, cachedTime + deferred_write_interval);
+}
+
+void
+PeerConnectionBase::write_insert_poll_safe_deferred() {
+  if (std::find(deferred_write_queue.begin(), deferred_write_queue.end(), this) != deferred_write_queue.end())
+    return;
+
+  deferred_write_queue.push_back(this);
+
+  if (!deferred_write_task.slot())
+    deferred_write_task.slot() = std::bind(&deferred_write_flush);
+
+  if (!deferred_write_task.is_queued())
+    priority_queue_insert(&taskScheduler, &deferred_write_task, cachedTime + deferred_write_interval);
+}
+
 PeerConnectionBase::PeerConnectionBase() :
   m_download(NULL),
   
@@ -106,12 +146,12 @@ PeerConnectionBase::PeerConnectionBase() :
   m_sendChoked(false),
   m_sendInterested(false),
   m_tryRequest(true),
+  m_incoreContinous(false),
   m_sendPEXMask(0),
 
   m_encryptBuffer(NULL),
-  m_extensions(NULL),
-
-  m_incoreContinous(false) {
+  m_encryption(new EncryptionInfo),
+  m_extensions(NULL) {
 
   m_peerInfo = NULL;
 }
@@ -121,6 +161,7 @@ PeerConnectionBase::~PeerConnectionBase() {
   delete m_down;
 
   delete m_encryptBuffer;
+  delete m_encryption;
 
   if (m_extensions != NULL && !m_extensions->is_default())
     delete m_extensions;
@@ -144,7 +185,7 @@ PeerConnectionBase::initialize(DownloadMain* download, PeerInfo* peerInfo, Socke
   m_peerInfo = peerInfo;
   m_download = download;
 
-  m_encryption = *encryptionInfo;
+  *m_encryption = *encryptionInfo;
   m_extensions = extensions;
 
   m_extensions->set_connection(this);
@@ -155,7 +196,11 @@ PeerConnectionBase::initialize(DownloadMain* download, PeerInfo* peerInfo, Socke
   m_peerChunks.set_peer_info(m_peerInfo);
   m_peerChunks.bitfield()->swap(*bitfield);
 
-  std::pair<ThrottleList*, ThrottleList*> throttles = m_download->throttles(m_peerInfo->socket_address());
+  rak::socket_address localAddress;
+
+  std::pair<ThrottleList*, ThrottleList*> throttles =
+    m_download->throttles(m_peerInfo->socket_address(),
+                          get_fd().getsockname(&localAddress) ? localAddress.c_sockaddr() : NULL);
   m_up->set_throttle(throttles.first);
   m_down->set_throttle(throttles.second);
 
@@ -190,6 +235,17 @@ PeerConnectionBase::initialize(DownloadMain* download, PeerInfo* peerInfo, Socke
 
   m_download->chunk_statistics()->received_connect(&m_peerChunks);
 
+  // One-off word-wide count; afterwards the wanted counter is kept in
+  // sync by the have/completed paths.
+  m_peerChunks.set_wanted_chunks(m_peerChunks.bitfield()->size_and_not(*m_download->file_list()->bitfield()));
+
+  // Seeders and peers with no chunks don't need the bit data until
+  // they send a HAVE or we start requesting; keep only the counters
+  // to save memory on large swarms. Initial seeding checks individual
+  // bits when offering chunks, so leave those alone.
+  if (m_download->initial_seeding() == NULL)
+    m_peerChunks.bitfield()->compact();
+
   // Hmm... cleanup?
 //   update_interested();
 
@@ -225,11 +281,14 @@ PeerConnectionBase::cleanup() {
   if (!m_extensions->is_default())
     m_extensions->cleanup();
 
+  deferred_write_queue.erase(std::remove(deferred_write_queue.begin(), deferred_write_queue.end(), this),
+                             deferred_write_queue.end());
+
   manager->poll()->remove_read(this);
   manager->poll()->remove_write(this);
   manager->poll()->remove_error(this);
   manager->poll()->close(this);
-  
+
   manager->connection_manager()->dec_socket_count();
 
   get_fd().close();
@@ -257,7 +316,7 @@ PeerConnectionBase::receive_upload_choke(bool choke) {
   if (choke == m_upChoke.choked())
     throw internal_error("PeerConnectionBase::receive_upload_choke(...) already set to the same state.");
 
-  write_insert_poll_safe();
+  write_insert_poll_safe_deferred();
 
   m_sendChoked = true;
   m_upChoke.set_unchoked(!choke);
@@ -265,16 +324,16 @@ PeerConnectionBase::receive_upload_choke(bool choke) {
 
   if (choke) {
     m_download->info()->set_upload_unchoked(m_download->info()->upload_unchoked() - 1);
-    m_upChoke.entry()->connection_choked(this);
-    m_upChoke.entry()->connection_queued(this);
+    m_upChoke.entry()->connection_choked(this, &m_upChoke);
+    m_upChoke.entry()->connection_queued(this, &m_upChoke);
 
     m_download->choke_group()->up_queue()->modify_currently_unchoked(-1);
     m_download->choke_group()->up_queue()->modify_currently_queued(1);
 
   } else {
     m_download->info()->set_upload_unchoked(m_download->info()->upload_unchoked() + 1);
-    m_upChoke.entry()->connection_unqueued(this);
-    m_upChoke.entry()->connection_unchoked(this);
+    m_upChoke.entry()->connection_unqueued(this, &m_upChoke);
+    m_upChoke.entry()->connection_unchoked(this, &m_upChoke);
 
     m_download->choke_group()->up_queue()->modify_currently_unchoked(1);
     m_download->choke_group()->up_queue()->modify_currently_queued(-1);
@@ -288,23 +347,23 @@ PeerConnectionBase::receive_download_choke(bool choke) {
   if (choke == m_downChoke.choked())
     throw internal_error("PeerConnectionBase::receive_download_choke(...) already set to the same state.");
 
-  write_insert_poll_safe();
+  write_insert_poll_safe_deferred();
 
   m_downChoke.set_unchoked(!choke);
   m_downChoke.set_time_last_choke(cachedTime.usec());
 
   if (choke) {
     m_download->info()->set_download_unchoked(m_download->info()->download_unchoked() - 1);
-    m_downChoke.entry()->connection_choked(this);
-    m_downChoke.entry()->connection_queued(this);
+    m_downChoke.entry()->connection_choked(this, &m_downChoke);
+    m_downChoke.entry()->connection_queued(this, &m_downChoke);
 
     m_download->choke_group()->down_queue()->modify_currently_unchoked(-1);
     m_download->choke_group()->down_queue()->modify_currently_queued(1);
 
   } else {
     m_download->info()->set_download_unchoked(m_download->info()->download_unchoked() + 1);
-    m_downChoke.entry()->connection_unqueued(this);
-    m_downChoke.entry()->connection_unchoked(this);
+    m_downChoke.entry()->connection_unqueued(this, &m_downChoke);
+    m_downChoke.entry()->connection_unchoked(this, &m_downChoke);
 
     m_download->choke_group()->down_queue()->modify_currently_unchoked(1);
     m_download->choke_group()->down_queue()->modify_currently_queued(-1);
@@ -376,10 +435,23 @@ PeerConnectionBase::load_up_chunk() {
     return;
   }
 
-  up_chunk_release();
-  
-  m_upChunk = m_download->chunk_list()->get(m_upPiece.index());
-  
+  bool is_sequential = m_upChunk.is_valid() && m_upPiece.index() == m_upChunk.index() + 1;
+
+  if (m_upChunkNext.is_valid() && m_upChunkNext.index() == m_upPiece.index()) {
+    // The readahead chunk is the one being requested; promote it
+    // rather than re-acquiring.
+    if (m_upChunk.is_valid())
+      m_download->chunk_list()->release(&m_upChunk);
+
+    m_upChunk = m_upChunkNext;
+    m_upChunkNext.clear();
+
+  } else {
+    up_chunk_release();
+
+    m_upChunk = m_download->chunk_list()->get(m_upPiece.index());
+  }
+
   if (!m_upChunk.is_valid())
     throw storage_error("File chunk read error: " + std::string(m_upChunk.error_number().c_str()));
 
@@ -395,12 +467,31 @@ PeerConnectionBase::load_up_chunk() {
 
   m_incoreContinous = true;
 
+  ChunkManager* cm = manager->chunk_manager();
+
+  // A sequentially consuming peer gets the next chunk faulted in
+  // ahead of its requests.
+  uint32_t next_index = m_upPiece.index() + 1;
+
+  if (is_sequential && !m_upChunkNext.is_valid() &&
+      cm->preload_type() != 0 && !cm->is_memory_pressured() &&
+      next_index < m_download->file_list()->size_chunks() &&
+      m_download->file_list()->bitfield()->get(next_index)) {
+    m_upChunkNext = m_download->chunk_list()->get(next_index);
+
+    if (m_upChunkNext.is_valid()) {
+      m_upChunkNext.object()->set_time_preloaded(cachedTime);
+      m_upChunkNext.chunk()->preload(0, m_upChunkNext.chunk()->chunk_size(), cm->preload_type() == 1);
+    }
+  }
+
   // Also check if we've already preloaded in the recent past, even
   // past unmaps.
-  ChunkManager* cm = manager->chunk_manager();
   uint32_t preloadSize = m_upChunk.chunk()->chunk_size() - m_upPiece.offset();
 
-  if (cm->preload_type() == 0 ||
+  // Preloading is the first thing shed under memory pressure; the
+  // upload degrades to cold faults instead of growing the footprint.
+  if (cm->preload_type() == 0 || cm->is_memory_pressured() ||
       m_upChunk.object()->time_preloaded() >= cachedTime - rak::timer::from_seconds(60) ||
 
       preloadSize < cm->preload_min_size() ||
@@ -415,6 +506,72 @@ PeerConnectionBase::load_up_chunk() {
   m_upChunk.chunk()->preload(m_upPiece.offset(), m_upChunk.chunk()->chunk_size(), cm->preload_type() == 1);
 }
 
+// The first request after an unchoke usually lands on a chunk that
+// hasn't been mapped yet, so the first piece would stall on a cold
+// fault in the write path. Start faulting the chunk in as soon as the
+// request arrives; the fault then overlaps the throttle queue and
+// message round-trips instead of blocking the upload. Requests don't
+// survive a choke in this tree, so request arrival is the earliest
+// the piece is known.
+void
+PeerConnectionBase::warm_up_chunk(uint32_t index) {
+  ChunkManager* cm = manager->chunk_manager();
+
+  // Only the cold-slot case is interesting; a connection with a chunk
+  // handle already open was recently active, and the sequential
+  // readahead in load_up_chunk covers it.
+  if (cm->preload_type() == 0 || cm->is_memory_pressured() ||
+      m_upChunk.is_valid() || m_upChunkNext.is_valid() ||
+      !m_download->file_list()->bitfield()->get(index))
+    return;
+
+  m_upChunkNext = m_download->chunk_list()->get(index);
+
+  if (!m_upChunkNext.is_valid()) {
+    m_upChunkNext.clear();
+    return;
+  }
+
+  // Keep the handle for promotion by load_up_chunk either way, but
+  // don't re-advise a chunk that was preloaded recently.
+  if (m_upChunkNext.object()->time_preloaded() >= cachedTime - rak::timer::from_seconds(60))
+    return;
+
+  m_upChunkNext.object()->set_time_preloaded(cachedTime);
+  m_upChunkNext.chunk()->preload(0, m_upChunkNext.chunk()->chunk_size(), cm->preload_type() == 1);
+}
+
+// Resize the kernel socket buffers to roughly twice the measured
+// bandwidth-delay product, so long-fat-network peers get deep buffers
+// while slow peers don't pin kernel memory they'll never fill. Called
+// from the keepalive tick, which is frequent enough for buffer sizing
+// as rates and RTT shift slowly.
+void
+PeerConnectionBase::update_socket_buffers() {
+  if (!manager->connection_manager()->is_buffer_autotune())
+    return;
+
+  uint32_t rtt = get_fd().get_rtt();
+
+  if (rtt == 0)
+    return;
+
+  uint64_t upBuffer   = 2 * (uint64_t)m_peerChunks.upload_throttle()->rate()->rate() * rtt / 1000000;
+  uint64_t downBuffer = 2 * (uint64_t)m_peerChunks.download_throttle()->rate()->rate() * rtt / 1000000;
+
+  upBuffer   = std::min<uint64_t>(std::max<uint64_t>(upBuffer, ConnectionManager::buffer_autotune_min_size),
+                                  ConnectionManager::buffer_autotune_max_size);
+  downBuffer = std::min<uint64_t>(std::max<uint64_t>(downBuffer, ConnectionManager::buffer_autotune_min_size),
+                                  ConnectionManager::buffer_autotune_max_size);
+
+  get_fd().set_send_buffer_size(upBuffer);
+  get_fd().set_receive_buffer_size(downBuffer);
+
+  // Keep the unsent queue shallow relative to the buffer, so data
+  // stays in the chunk cache until the socket can actually take it.
+  get_fd().set_not_sent_low_water(upBuffer / 4);
+}
+
 void
 PeerConnectionBase::cancel_transfer(BlockTransfer* transfer) {
   if (!get_fd().is_valid())
@@ -435,6 +592,12 @@ PeerConnectionBase::cancel_transfer(BlockTransfer* transfer) {
 
 void
 PeerConnectionBase::event_error() {
+  // Zero-copy completion notifications surface as poll error events;
+  // reap them off the error queue and keep the connection when the
+  // socket itself is healthy.
+  if (zerocopy_pending() && flush_zerocopy() && get_fd().get_error() == 0)
+    return;
+
   m_download->connection_list()->erase(this, 0);
 }
 
@@ -499,6 +662,14 @@ PeerConnectionBase::down_chunk_finished() {
     request_list()->finished();
     m_downChunk.object()->set_time_modified(cachedTime);
 
+    // Feed newly contiguous finished blocks into the chunk's
+    // incremental hash while the data is still hot in cache, leaving
+    // only out-of-order tails for the final pass.
+    TransferList::iterator blockListItr = m_download->delegator()->transfer_list()->find(m_downChunk.index());
+
+    if (blockListItr != m_download->delegator()->transfer_list()->end())
+      m_download->chunk_list()->hash_advance(m_downChunk.object(), *blockListItr);
+
   } else {
     request_list()->skipped();
   }
@@ -543,26 +714,58 @@ PeerConnectionBase::down_chunk() {
   uint32_t bytesTransfered = 0;
   BlockTransfer* transfer = m_request_list.transfer();
 
-  Chunk::data_type data;
-  ChunkIterator itr(m_downChunk.chunk(),
-                    transfer->piece().offset() + transfer->position(),
-                    transfer->piece().offset() + std::min(transfer->position() + quota, transfer->piece().length()));
+  uint32_t chunkPosition = transfer->piece().offset() + transfer->position();
+  uint32_t chunkLast     = transfer->piece().offset() + std::min(transfer->position() + quota, transfer->piece().length());
 
+  // Gather the memory ranges of all the chunk parts the quota covers
+  // and fill them with a single readv call, so blocks spanning file
+  // boundaries don't cost one syscall per file.
   do {
-    data = itr.data();
-    data.second = read_stream_throws(data.first, data.second);
+    struct iovec vec[max_read_vector];
+    unsigned int count = 0;
+    uint32_t gathered = 0;
 
-    if (is_encrypted())
-      m_encryption.decrypt(data.first, data.second);
+    ChunkIterator itr(m_downChunk.chunk(), chunkPosition + bytesTransfered, chunkLast);
+
+    do {
+      Chunk::data_type data = itr.data();
 
-    bytesTransfered += data.second;
+      vec[count].iov_base = data.first;
+      vec[count].iov_len = data.second;
+      gathered += data.second;
+      count++;
 
-  } while (data.second != 0 && itr.forward(data.second));
+    } while (count != max_read_vector && itr.next());
+
+    uint32_t length = readv_stream_throws(vec, count);
+
+    if (is_encrypted()) {
+      uint32_t remaining = length;
+
+      for (unsigned int i = 0; remaining != 0; i++) {
+        uint32_t part = std::min<uint32_t>(remaining, vec[i].iov_len);
+
+        m_encryption->decrypt(vec[i].iov_base, part);
+        remaining -= part;
+      }
+    }
+
+    bytesTransfered += length;
+
+    // A short fill means the socket drained; only go around again
+    // when the gather itself was truncated by max_read_vector.
+    if (length < gathered)
+      break;
+
+  } while (chunkPosition + bytesTransfered < chunkLast);
+
+  if (bytesTransfered != 0)
+    m_downChunk.object()->mark_dirty(chunkPosition, chunkPosition + bytesTransfered);
 
   transfer->adjust_position(bytesTransfered);
 
   m_down->throttle()->node_used(m_peerChunks.download_throttle(), bytesTransfered);
-  m_download->info()->mutable_down_rate()->insert(bytesTransfered);
+  m_download->info()->mutable_down_rate()->insert_batched(bytesTransfered);
 
   return transfer->is_finished();
 }
@@ -599,7 +802,7 @@ PeerConnectionBase::down_chunk_skip() {
   throttle->node_used(m_peerChunks.download_throttle(), length);
 
   if (is_encrypted())
-    m_encryption.decrypt(m_nullBuffer, length);
+    m_encryption->decrypt(m_nullBuffer, length);
 
   if (down_chunk_skip_process(m_nullBuffer, length) != length)
     throw internal_error("PeerConnectionBase::down_chunk_skip() down_chunk_skip_process(m_nullBuffer, length) != length.");
@@ -628,11 +831,13 @@ PeerConnectionBase::down_chunk_process(const void* buffer, uint32_t length) {
   length = std::min(transfer->piece().length() - transfer->position(), length);
 
   m_downChunk.chunk()->from_buffer(buffer, transfer->piece().offset() + transfer->position(), length);
+  m_downChunk.object()->mark_dirty(transfer->piece().offset() + transfer->position(),
+                                   transfer->piece().offset() + transfer->position() + length);
 
   transfer->adjust_position(length);
 
   m_down->throttle()->node_used(m_peerChunks.download_throttle(), length);
-  m_download->info()->mutable_down_rate()->insert(length);
+  m_download->info()->mutable_down_rate()->insert_batched(length);
 
   return length;
 }
@@ -651,8 +856,8 @@ PeerConnectionBase::down_chunk_skip_process(const void* buffer, uint32_t length)
   // Hmm, this might result in more bytes than nessesary being
   // counted.
   m_down->throttle()->node_used(m_peerChunks.download_throttle(), length);
-  m_download->info()->mutable_down_rate()->insert(length);
-  m_download->info()->mutable_skip_rate()->insert(length);
+  m_download->info()->mutable_down_rate()->insert_batched(length);
+  m_download->info()->mutable_skip_rate()->insert_batched(length);
 
   if (!transfer->is_valid()) {
     transfer->adjust_position(length);
@@ -713,7 +918,7 @@ PeerConnectionBase::down_extension() {
     m_down->throttle()->node_used_unthrottled(bytes);
     
     if (is_encrypted())
-      m_encryption.decrypt(m_extensions->read_position(), bytes);
+      m_encryption->decrypt(m_extensions->read_position(), bytes);
 
     m_extensions->read_move(bytes);
   }
@@ -751,12 +956,41 @@ PeerConnectionBase::up_chunk_encrypt(uint32_t quota) {
   }
 
   m_upChunk.chunk()->to_buffer(m_encryptBuffer->end(), m_upPiece.offset() + m_encryptBuffer->remaining(), quota);
-  m_encryption.encrypt(m_encryptBuffer->end(), quota);
+  m_encryption->encrypt(m_encryptBuffer->end(), quota);
   m_encryptBuffer->move_end(quota);
 
   return m_encryptBuffer->remaining();
 }
 
+// Move the payload file-to-socket with sendfile, skipping user space
+// entirely. Only covers the current chunk part; a piece crossing a
+// file boundary continues from the next part on the following write
+// event. Returns false if the transfer couldn't be attempted, in
+// which case the caller must fall back to writing from the mapping.
+inline bool
+PeerConnectionBase::up_chunk_sendfile(uint32_t quota, uint32_t* bytes) {
+#ifdef HAVE_SENDFILE
+  Chunk::iterator partItr = m_upChunk.chunk()->at_position(m_upPiece.offset());
+
+  File* file = partItr->file();
+
+  // The file descriptor may have been closed by the file manager
+  // while the mapping remains valid.
+  if (file == NULL || !file->is_open())
+    return false;
+
+  uint32_t length = std::min(quota, m_upPiece.length());
+  length = std::min(length, partItr->position() + partItr->size() - m_upPiece.offset());
+
+  *bytes = sendfile_stream_throws(file->file_descriptor(),
+                                  partItr->file_offset() + (m_upPiece.offset() - partItr->position()),
+                                  length);
+  return true;
+#else
+  return false;
+#endif
+}
+
 bool
 PeerConnectionBase::up_chunk() {
   if (!m_up->throttle()->is_throttled(m_peerChunks.upload_throttle()))
@@ -784,21 +1018,35 @@ PeerConnectionBase::up_chunk() {
     bytesTransfered = write_stream_throws(m_encryptBuffer->position(), quota);
     m_encryptBuffer->consume(bytesTransfered);
 
-  } else {
-    Chunk::data_type data;
+  } else if (use_zerocopy() || !up_chunk_sendfile(quota, &bytesTransfered)) {
+    // Gather the memory ranges of all the chunk parts the quota
+    // covers and hand them to the kernel in a single writev call, so
+    // pieces spanning file boundaries don't cost one syscall per
+    // file. The data is sent directly from the chunk mapping.
+    //
+    // With the zero-copy engine enabled large payloads go out with
+    // MSG_ZEROCOPY instead of sendfile; the chunk mapping is
+    // read-only and stays pinned by the kernel past release, so
+    // in-flight sends are safe.
+    struct iovec vec[max_write_vector];
+    unsigned int count = 0;
+
     ChunkIterator itr(m_upChunk.chunk(), m_upPiece.offset(), m_upPiece.offset() + std::min(quota, m_upPiece.length()));
 
     do {
-      data = itr.data();
-      data.second = write_stream_throws(data.first, data.second);
+      Chunk::data_type data = itr.data();
 
-      bytesTransfered += data.second;
+      vec[count].iov_base = data.first;
+      vec[count].iov_len = data.second;
+      count++;
 
-    } while (data.second != 0 && itr.forward(data.second));
+    } while (count != max_write_vector && itr.next());
+
+    bytesTransfered = writev_zerocopy_stream_throws(vec, count);
   }
 
   m_up->throttle()->node_used(m_peerChunks.upload_throttle(), bytesTransfered);
-  m_download->info()->mutable_up_rate()->insert(bytesTransfered);
+  m_download->info()->mutable_up_rate()->insert_batched(bytesTransfered);
 
   // Just modifying the piece to cover the remaining data ends up
   // being much cleaner and we avoid an unnessesary position variable.
@@ -808,16 +1056,71 @@ PeerConnectionBase::up_chunk() {
   return m_upPiece.length() == 0;
 }
 
+// Gather-write the tail of the protocol buffer together with the
+// head of the piece payload, saving the separate syscall per queued
+// message batch. Returns true when the buffer is fully flushed; the
+// piece is advanced by however much payload went out alongside it.
+bool
+PeerConnectionBase::up_chunk_with_buffer() {
+  if (!m_up->throttle()->is_throttled(m_peerChunks.upload_throttle()))
+    throw internal_error("PeerConnectionBase::up_chunk_with_buffer() tried to write a piece but is not in throttle list");
+
+  if (!m_upChunk.chunk()->is_readable())
+    throw internal_error("PeerConnectionBase::up_chunk_with_buffer() chunk not readable, permission denided");
+
+  // The message bytes are unthrottled, so they are sent even when
+  // the payload quota is drained; a zero quota then stalls in the
+  // piece state as before.
+  struct iovec vec[max_write_vector];
+
+  vec[0].iov_base = m_up->buffer()->position();
+  vec[0].iov_len  = m_up->buffer()->remaining();
+  unsigned int count = 1;
+
+  uint32_t quota = m_up->throttle()->node_quota(m_peerChunks.upload_throttle());
+  uint32_t payload = std::min(quota, m_upPiece.length());
+
+  if (payload != 0) {
+    ChunkIterator itr(m_upChunk.chunk(), m_upPiece.offset(), m_upPiece.offset() + payload);
+
+    do {
+      Chunk::data_type data = itr.data();
+
+      vec[count].iov_base = data.first;
+      vec[count].iov_len = data.second;
+      count++;
+
+    } while (count != max_write_vector && itr.next());
+  }
+
+  uint32_t bytesTransfered = writev_stream_throws(vec, count);
+
+  uint32_t bufferBytes = std::min<uint32_t>(bytesTransfered, m_up->buffer()->remaining());
+  uint32_t pieceBytes = bytesTransfered - bufferBytes;
+
+  m_up->throttle()->node_used_unthrottled(bufferBytes);
+
+  if (pieceBytes != 0) {
+    m_up->throttle()->node_used(m_peerChunks.upload_throttle(), pieceBytes);
+    m_download->info()->mutable_up_rate()->insert_batched(pieceBytes);
+
+    m_upPiece.set_offset(m_upPiece.offset() + pieceBytes);
+    m_upPiece.set_length(m_upPiece.length() - pieceBytes);
+  }
+
+  return m_up->buffer()->consume(bufferBytes);
+}
+
 bool
 PeerConnectionBase::up_extension() {
   if (m_extensionOffset == extension_must_encrypt) {
     if (m_extensionMessage.owned()) {
-      m_encryption.encrypt(m_extensionMessage.data(), m_extensionMessage.length());
+      m_encryption->encrypt(m_extensionMessage.data(), m_extensionMessage.length());
 
     } else {
       char* buffer = new char[m_extensionMessage.length()];
 
-      m_encryption.encrypt(m_extensionMessage.data(), buffer, m_extensionMessage.length());
+      m_encryption->encrypt(m_extensionMessage.data(), buffer, m_extensionMessage.length());
       m_extensionMessage.set(buffer, buffer + m_extensionMessage.length(), true);
     }
 
@@ -858,6 +1161,9 @@ void
 PeerConnectionBase::up_chunk_release() {
   if (m_upChunk.is_valid())
     m_download->chunk_list()->release(&m_upChunk);
+
+  if (m_upChunkNext.is_valid())
+    m_download->chunk_list()->release(&m_upChunkNext);
 }
 
 void
@@ -875,6 +1181,9 @@ PeerConnectionBase::read_request_piece(const Piece& p) {
   m_peerChunks.upload_queue()->push_back(p);
   write_insert_poll_safe();
 
+  if (m_peerChunks.upload_queue()->size() == 1)
+    warm_up_chunk(p.index());
+
   LT_LOG_PIECE_EVENTS("(up)   request_added    %" PRIu32 " %" PRIu32 " %" PRIu32,
                       p.index(), p.offset(), p.length());
 }
@@ -953,12 +1262,41 @@ PeerConnectionBase::should_request() {
     return m_downStall <= 1 || m_download->info()->down_rate()->rate() < (10 << 10);
 }
 
+void
+PeerConnectionBase::schedule_request_pieces() {
+  if (!m_downUnchoked || !m_downInterested)
+    return;
+
+  uint32_t pipeSize = request_list()->calculate_pipe_size(m_peerChunks.download_throttle()->rate()->rate_ewma());
+
+  // Same threshold as try_request_pieces(); saturated peers gain
+  // nothing from an extra write pass.
+  if (request_list()->pipe_size() >= (pipeSize + 10) / 2)
+    return;
+
+  m_tryRequest = true;
+  write_insert_poll_safe();
+}
+
 bool
 PeerConnectionBase::try_request_pieces() {
+  // The bitfield of an idle seeder is kept compacted; restore the bit
+  // data before the request code reads individual bits.
+  if (m_peerChunks.bitfield()->empty())
+    m_peerChunks.bitfield()->materialize();
+
   if (request_list()->queued_empty())
     m_downStall = 0;
 
-  uint32_t pipeSize = request_list()->calculate_pipe_size(m_peerChunks.download_throttle()->rate()->rate());
+  uint32_t pipeSize = request_list()->calculate_pipe_size(m_peerChunks.download_throttle()->rate()->rate_ewma());
+
+  // When the piece-hash verification backlog grows too deep, shorten
+  // the pipelines so chunk release catches up before the chunk memory
+  // ceiling forces throttling.
+  if (manager->hash_queue()->is_congested()) {
+    instrumentation_update(INSTRUMENTATION_HASH_QUEUE_CONGESTED, 1);
+    pipeSize = pipeSize / 4 + 1;
+  }
 
   // Don't start requesting if we can't do it in large enough chunks.
   if (request_list()->pipe_size() >= (pipeSize + 10) / 2)
@@ -966,25 +1304,41 @@ PeerConnectionBase::try_request_pieces() {
 
   bool success = false;
 
+  // In endgame, only hand duplicate requests to peers that are
+  // delivering at a decent clip; slow peers still get fresh and
+  // stalled blocks. If the whole download has slowed to a crawl,
+  // anyone may duplicate.
+  bool canDuplicate =
+    m_peerChunks.download_throttle()->rate()->rate_ewma() >= (4 << 10) ||
+    m_download->info()->down_rate()->rate() < (10 << 10);
+
   while (request_list()->queued_size() < pipeSize && m_up->can_write_request()) {
 
-    // Delegator should return a vector of pieces, and it should be
-    // passed the number of pieces it should delegate. Try to ensure
-    // it receives large enough request to fill a whole chunk if the
-    // peer is fast enough.
+    // Delegate a contiguous run of blocks in one call, bounded by the
+    // pipeline headroom and by how many request messages still fit in
+    // the write buffer; the requests go out as individual spec-sized
+    // messages, but the bookkeeping and the peer's disk reads see one
+    // sequential unit.
+    uint32_t pipeRoom   = pipeSize - request_list()->queued_size();
+    uint32_t bufferRoom = m_up->buffer()->reserved_left() / ProtocolWrite::sizeof_request;
 
-    const Piece* p = request_list()->delegate();
+    std::vector<const Piece*> pieces = request_list()->delegate(pipeRoom < bufferRoom ? pipeRoom : bufferRoom, canDuplicate);
 
-    if (p == NULL)
+    if (pieces.empty())
       break;
 
-    if (!m_download->file_list()->is_valid_piece(*p) || !m_peerChunks.bitfield()->get(p->index()))
-      throw internal_error("PeerConnectionBase::try_request_pieces() tried to use an invalid piece.");
+    for (std::vector<const Piece*>::const_iterator itr = pieces.begin(), last = pieces.end(); itr != last; ++itr) {
+      const Piece* p = *itr;
+
+      if (!m_download->file_list()->is_valid_piece(*p) || !m_peerChunks.bitfield()->get(p->index()))
+        throw internal_error("PeerConnectionBase::try_request_pieces() tried to use an invalid piece.");
 
-    m_up->write_request(*p);
+      m_up->write_request(*p);
+
+      LT_LOG_PIECE_EVENTS("(down) requesting %" PRIu32 " %" PRIu32 " %" PRIu32,
+                          p->index(), p->offset(), p->length());
+    }
 
-    LT_LOG_PIECE_EVENTS("(down) requesting %" PRIu32 " %" PRIu32 " %" PRIu32,
-                        p->index(), p->offset(), p->length());
     success = true;
   }
 
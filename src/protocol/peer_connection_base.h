@@ -77,8 +77,18 @@ public:
   typedef ProtocolBuffer<16384>  EncryptBuffer;
 #endif
 
-  // Find an optimal number for this.
-  static const uint32_t read_size = 64;
+  // Size of the message decode window read per syscall. Piece payload
+  // streams directly into the chunk mappings, so only message frames
+  // and the head of a payload that happens to share a read with its
+  // header pass through the buffer; a larger window cuts the syscall
+  // count on message bursts while that head is still copied to the
+  // chunk in a single span.
+  static const uint32_t read_size = 256;
+
+  // Peers sustaining download rates above this widen the decode
+  // window to the full buffer, so the message frames of a fast piece
+  // stream are pulled in with fewer, larger reads.
+  static const uint32_t read_fast_rate = 1 << 20;
 
   // Bitmasks for peer exchange messages to send.
   static const int PEX_DO      = (1 << 0);
@@ -90,6 +100,10 @@ public:
   
   const char*         type_name() const { return "pcb"; }
 
+  // Payload transfers dispatch ahead of control traffic in each poll
+  // batch.
+  int                 poll_priority() const { return POLL_PRIORITY_TRANSFER; }
+
   void                initialize(DownloadMain* download, PeerInfo* p, SocketFd fd, Bitfield* bitfield, EncryptionInfo* encryptionInfo, ProtocolExtension* extensions);
   void                cleanup();
 
@@ -107,8 +121,8 @@ public:
   bool                is_seeder() const               { return m_peerChunks.is_seeder(); }
   bool                is_not_seeder() const           { return !m_peerChunks.is_seeder(); }
 
-  bool                is_encrypted() const            { return m_encryption.is_encrypted(); }
-  bool                is_obfuscated() const           { return m_encryption.is_obfuscated(); }
+  bool                is_encrypted() const            { return m_encryption->is_encrypted(); }
+  bool                is_obfuscated() const           { return m_encryption->is_obfuscated(); }
 
   PeerInfo*           mutable_peer_info()             { return m_peerInfo; }
 
@@ -142,10 +156,20 @@ public:
 
   void                cancel_transfer(BlockTransfer* transfer);
 
+  // Wake the connection to top up its request pipeline with blocks
+  // freed by a batch cancel elsewhere; a no-op for peers that can't
+  // request or have no spare pipeline.
+  void                schedule_request_pieces();
+
   // Insert into the poll unless we're blocking for throttling etc.
   void                read_insert_poll_safe();
   void                write_insert_poll_safe();
 
+  // Deferred variant used by the choke cycle; activations are drained
+  // in bounded batches over the following tick window so a cycle does
+  // not trigger one synchronized write burst across every socket.
+  void                write_insert_poll_safe_deferred();
+
   // Communication with the protocol extensions
   virtual void        receive_metadata_piece(uint32_t piece, const char* data, uint32_t length);
 
@@ -158,6 +182,9 @@ protected:
   inline bool         write_remaining();
 
   void                load_up_chunk();
+  void                warm_up_chunk(uint32_t index);
+
+  void                update_socket_buffers();
 
   void                read_request_piece(const Piece& p);
   void                read_cancel_piece(const Piece& p);
@@ -165,6 +192,10 @@ protected:
   void                write_prepare_piece();
   void                write_prepare_extension(int type, const DataBuffer& message);
 
+  // The decode window for this event; grows from read_size to the
+  // full buffer once the peer's download rate crosses read_fast_rate.
+  uint32_t            down_read_window() const;
+
   bool                down_chunk_start(const Piece& p);
   void                down_chunk_finished();
 
@@ -179,7 +210,9 @@ protected:
   bool                down_extension();
 
   bool                up_chunk();
+  bool                up_chunk_with_buffer();
   inline uint32_t     up_chunk_encrypt(uint32_t quota);
+  inline bool         up_chunk_sendfile(uint32_t quota, uint32_t* bytes);
 
   bool                up_extension();
 
@@ -192,19 +225,27 @@ protected:
   bool                send_pex_message();
   bool                send_ext_message();
 
+  // Hot block: state every event_read/event_write pass touches, kept
+  // together at the front of the object so an event strides a couple
+  // of cache lines instead of the whole connection.
   DownloadMain*       m_download;
 
   ProtocolRead*       m_down;
   ProtocolWrite*      m_up;
 
-  PeerChunks          m_peerChunks;
-
-  RequestList         m_request_list;
-  ChunkHandle         m_downChunk;
   uint32_t            m_downStall;
 
-  Piece               m_upPiece;
-  ChunkHandle         m_upChunk;
+  bool                m_downInterested;
+  bool                m_downUnchoked;
+
+  bool                m_sendChoked;
+  bool                m_sendInterested;
+  bool                m_tryRequest;
+  bool                m_incoreContinous;
+
+  int                 m_sendPEXMask;
+
+  rak::timer          m_timeLastRead;
 
   // The interested state no longer follows the spec's wording as it
   // has been swapped.
@@ -219,27 +260,34 @@ protected:
   choke_status        m_upChoke;
   choke_status        m_downChoke;
 
-  bool                m_downInterested;
-  bool                m_downUnchoked;
+  ChunkHandle         m_downChunk;
 
-  bool                m_sendChoked;
-  bool                m_sendInterested;
-  bool                m_tryRequest;
+  Piece               m_upPiece;
+  ChunkHandle         m_upChunk;
 
-  int                 m_sendPEXMask;
+  // Readahead chunk held while the peer consumes sequentially, so the
+  // pages are faulted in before the network path touches them.
+  ChunkHandle         m_upChunkNext;
 
-  rak::timer          m_timeLastRead;
+  PeerChunks          m_peerChunks;
+  RequestList         m_request_list;
 
+  // Cold tail: extension and crypto state only touched on the slower
+  // paths. The RC4 contexts sit behind a pointer so unencrypted
+  // connections don't carry two key schedules inline.
   DataBuffer          m_extensionMessage;
   uint32_t            m_extensionOffset;
 
   EncryptBuffer*      m_encryptBuffer;
-  EncryptionInfo      m_encryption;
+  EncryptionInfo*     m_encryption;
   ProtocolExtension*  m_extensions;
-
-  bool m_incoreContinous;
 };
 
+inline uint32_t
+PeerConnectionBase::down_read_window() const {
+  return m_peerChunks.download_throttle()->rate()->rate() >= read_fast_rate ? ProtocolRead::buffer_size : read_size;
+}
+
 inline void
 PeerConnectionBase::set_peer_exchange(bool state) {
   if (m_extensions->is_default() || !m_extensions->is_remote_supported(ProtocolExtension::UT_PEX))
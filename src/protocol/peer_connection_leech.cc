@@ -38,6 +38,7 @@
 
 #include <cstring>
 #include <sstream>
+#include <rak/error_number.h>
 #include <rak/functional.h>
 #include <rak/string_manip.h>
 
@@ -52,6 +53,7 @@
 #include "torrent/peer/connection_list.h"
 #include "torrent/peer/peer_info.h"
 #include "torrent/utils/log.h"
+#include "utils/tracepoints.h"
 
 #include "extensions.h"
 #include "initial_seed.h"
@@ -99,19 +101,30 @@ PeerConnection<type>::update_interested() {
 
   m_peerChunks.download_cache()->clear();
 
-  if (m_downInterested)
-    return;
+  // The wanted counter is maintained incrementally, so both
+  // transitions are O(1) instead of requiring a bitfield scan. The
+  // counter ignores priorities; delegation checks those, and the
+  // lazy turn-off in fill_write_buffer handles deprioritized chunks.
+  if (m_peerChunks.wanted_chunks() != 0) {
+    if (m_downInterested)
+      return;
+
+    m_sendInterested = true;
+    m_downInterested = true;
 
-  // Consider just setting to interested without checking the
-  // bitfield. The status might change by the time we get unchoked
-  // anyway.
+    // Hmm... does this belong here, or should we insert ourselves into
+    // the queue when we receive the unchoke?
+//     m_download->choke_group()->down_queue()->set_queued(this, &m_downChoke);
+
+  } else {
+    if (!m_downInterested || request_list()->is_interested_in_active())
+      return;
 
-  m_sendInterested = !m_downInterested;
-  m_downInterested = true;
+    m_sendInterested = true;
+    m_downInterested = false;
 
-  // Hmm... does this belong here, or should we insert ourselves into
-  // the queue when we receive the unchoke?
-//   m_download->choke_group()->down_queue()->set_queued(this, &m_downChoke);
+    m_download->choke_group()->down_queue()->set_not_queued(this, &m_downChoke);
+  }
 }
 
 template<Download::ConnectionType type>
@@ -120,6 +133,8 @@ PeerConnection<type>::receive_keepalive() {
   if (cachedTime - m_timeLastRead > rak::timer::from_seconds(240))
     return false;
 
+  update_socket_buffers();
+
   // There's no point in adding ourselves to the write poll if the
   // buffer is full, as that will already have been taken care of.
   if (m_up->get_state() == ProtocolWrite::IDLE &&
@@ -131,7 +146,7 @@ PeerConnection<type>::receive_keepalive() {
     m_up->write_keepalive();
 
     if (is_encrypted())
-      m_encryption.encrypt(old_end, m_up->buffer()->end() - old_end);
+      m_encryption->encrypt(old_end, m_up->buffer()->end() - old_end);
   }
 
   if (type != Download::CONNECTION_LEECH)
@@ -210,6 +225,8 @@ PeerConnection<type>::read_message() {
   // Temporary.
   m_down->set_last_command((ProtocolBase::Protocol)buf->peek_8());
 
+  LT_SDT2(peer_read_message, buf->peek_8(), length);
+
   switch (buf->read_8()) {
   case ProtocolBase::CHOKE:
     if (type != Download::CONNECTION_LEECH)
@@ -274,6 +291,12 @@ PeerConnection<type>::read_message() {
       write_insert_poll_safe();
       read_request_piece(m_down->read_request());
 
+    } else if (m_peerInfo->supports_fast_extension()) {
+      // BEP 6: tell the peer right away that the request was dropped,
+      // instead of leaving it to stall against its request timeout.
+      m_peerChunks.reject_queue()->push_back(m_down->read_request());
+      write_insert_poll_safe();
+
     } else {
       m_down->read_request();
     }
@@ -329,6 +352,34 @@ PeerConnection<type>::read_message() {
     manager->dht_manager()->add_node(m_peerInfo->socket_address(), m_down->buffer()->read_16());
     return true;
 
+  case ProtocolBase::SUGGEST_PIECE:
+    if (!m_down->can_read_have_body())
+      break;
+
+    // We make no attempt at prioritizing suggested pieces yet; the
+    // message is consumed only to keep the stream in sync.
+    buf->read_32();
+    return true;
+
+  case ProtocolBase::REJECT_REQUEST:
+    if (type != Download::CONNECTION_LEECH)
+      throw communication_error("Received a reject request but the connection is strictly for seeding.");
+
+    if (!m_down->can_read_reject_body())
+      break;
+
+    read_reject_piece(m_down->read_request());
+    return true;
+
+  case ProtocolBase::ALLOWED_FAST:
+    if (!m_down->can_read_have_body())
+      break;
+
+    // We never request pieces while choked, so the allowed fast set
+    // is consumed without being acted upon.
+    buf->read_32();
+    return true;
+
   case ProtocolBase::EXTENSION_PROTOCOL:
     if (!m_down->can_read_extension_body())
       break;
@@ -377,29 +428,50 @@ PeerConnection<type>::event_read() {
     
     // Normal read.
     //
-    // We rarely will read zero bytes as the read of 64 bytes will
-    // almost always either not fill up or it will require additional
-    // reads.
+    // We rarely will read zero bytes as the read of 'read_size' bytes
+    // will almost always either not fill up or it will require
+    // additional reads.
     //
-    // Only loop when end hits 64.
+    // Only loop when end hits the read window.
+
+    // Sampled once per event so the read below and the filled-buffer
+    // check agree on the window; a fast peer gets the full buffer per
+    // read so message bursts cost fewer syscalls.
+    uint32_t readWindow = down_read_window();
 
     do {
 
       switch (m_down->get_state()) {
       case ProtocolRead::IDLE:
-        if (m_down->buffer()->size_end() < read_size) {
-          unsigned int length = read_stream_throws(m_down->buffer()->end(), read_size - m_down->buffer()->size_end());
+        if (m_down->buffer()->size_end() < readWindow) {
+          // Hung-up peers are the common outcome of this read, so EOF
+          // and socket errors come back as a status code and are
+          // handled here instead of paying for an unwind through the
+          // exception handlers below.
+          SocketStream::stream_status status;
+          unsigned int length = read_stream_nothrow(m_down->buffer()->end(), readWindow - m_down->buffer()->size_end(), &status);
+
+          if (status != SocketStream::stream_ok) {
+            if (status == SocketStream::stream_failed)
+              LT_LOG_NETWORK_ERRORS("%s network read error: %s",
+                                    rak::socket_address::cast_from(m_peerInfo->socket_address())->address_str().c_str(),
+                                    rak::error_number::current().c_str());
+
+            m_download->connection_list()->erase(this, 0);
+            return;
+          }
+
           m_down->throttle()->node_used_unthrottled(length);
 
           if (is_encrypted())
-            m_encryption.decrypt(m_down->buffer()->end(), length);
+            m_encryption->decrypt(m_down->buffer()->end(), length);
 
           m_down->buffer()->move_end(length);
         }
 
         while (read_message());
-        
-        if (m_down->buffer()->size_end() == read_size) {
+
+        if (m_down->buffer()->size_end() == readWindow) {
           m_down->buffer()->move_unused();
           break;
         } else {
@@ -501,6 +573,12 @@ PeerConnection<type>::fill_write_buffer() {
     if (m_upChoke.choked()) {
       m_up->throttle()->erase(m_peerChunks.upload_throttle());
       up_chunk_release();
+
+      // BEP 6: turn the dropped upload queue into explicit rejects so
+      // the peer can re-request the blocks elsewhere immediately.
+      if (m_peerInfo->supports_fast_extension())
+        m_peerChunks.reject_queue()->splice(m_peerChunks.reject_queue()->end(), *m_peerChunks.upload_queue());
+
       m_peerChunks.upload_queue()->clear();
 
       if (m_encryptBuffer != NULL) {
@@ -537,20 +615,23 @@ PeerConnection<type>::fill_write_buffer() {
     }
   }
 
-  DownloadMain::have_queue_type* haveQueue = m_download->have_queue();
+  // Only the leech variant acquires new chunks, so the others don't
+  // need to touch the have queue at all.
+  if (type == Download::CONNECTION_LEECH) {
+    DownloadMain::have_queue_type* haveQueue = m_download->have_queue();
 
-  if (type == Download::CONNECTION_LEECH && 
-      !haveQueue->empty() &&
-      m_peerChunks.have_timer() <= haveQueue->front().first &&
-      m_up->can_write_have()) {
-    DownloadMain::have_queue_type::iterator last = std::find_if(haveQueue->begin(), haveQueue->end(),
-                                                                rak::greater(m_peerChunks.have_timer(), rak::mem_ref(&DownloadMain::have_queue_type::value_type::first)));
+    if (!haveQueue->empty() &&
+        m_peerChunks.have_timer() <= haveQueue->front().first &&
+        m_up->can_write_have()) {
+      DownloadMain::have_queue_type::iterator last = std::find_if(haveQueue->begin(), haveQueue->end(),
+                                                                  rak::greater(m_peerChunks.have_timer(), rak::mem_ref(&DownloadMain::have_queue_type::value_type::first)));
 
-    do {
-      m_up->write_have((--last)->second);
-    } while (last != haveQueue->begin() && m_up->can_write_have());
+      do {
+        m_up->write_have((--last)->second);
+      } while (last != haveQueue->begin() && m_up->can_write_have());
 
-    m_peerChunks.set_have_timer(last->first + 1);
+      m_peerChunks.set_have_timer(last->first + 1);
+    }
   }
 
   if (type == Download::CONNECTION_INITIAL_SEED && m_up->can_write_have())
@@ -561,6 +642,11 @@ PeerConnection<type>::fill_write_buffer() {
     m_peerChunks.cancel_queue()->pop_front();
   }
 
+  while (!m_peerChunks.reject_queue()->empty() && m_up->can_write_reject()) {
+    m_up->write_reject(m_peerChunks.reject_queue()->front());
+    m_peerChunks.reject_queue()->pop_front();
+  }
+
   if (m_sendPEXMask && m_up->can_write_extension() &&
       send_pex_message()) {
     // Don't do anything else if send_pex_message() succeeded.
@@ -576,8 +662,10 @@ PeerConnection<type>::fill_write_buffer() {
     write_prepare_piece();
   }
 
+  LT_SDT1(peer_write_messages, m_up->buffer()->end() - old_end);
+
   if (is_encrypted())
-    m_encryption.encrypt(old_end, m_up->buffer()->end() - old_end);
+    m_encryption->encrypt(old_end, m_up->buffer()->end() - old_end);
 }
 
 template<Download::ConnectionType type>
@@ -600,8 +688,40 @@ PeerConnection<type>::event_write() {
         m_up->set_state(ProtocolWrite::MSG);
 
       case ProtocolWrite::MSG:
-        if (!m_up->buffer()->consume(m_up->throttle()->node_used_unthrottled(write_stream_throws(m_up->buffer()->position(), m_up->buffer()->remaining()))))
-          return;
+        // When a piece payload follows the queued messages, send the
+        // message tail and the payload head in a single gather write
+        // rather than paying a syscall for each.
+        if (m_up->last_command() == ProtocolBase::PIECE && !is_encrypted() &&
+            m_up->throttle()->is_throttled(m_peerChunks.upload_throttle())) {
+          load_up_chunk();
+
+          if (!up_chunk_with_buffer())
+            return;
+
+          m_up->buffer()->reset();
+          m_up->set_state(m_upPiece.length() == 0 ? ProtocolWrite::IDLE : ProtocolWrite::WRITE_PIECE);
+          break;
+        }
+
+        {
+          // As in event_read, peer disconnects are handled via status
+          // codes on this hot path rather than exceptions.
+          SocketStream::stream_status status;
+          uint32_t written = write_stream_nothrow(m_up->buffer()->position(), m_up->buffer()->remaining(), &status);
+
+          if (status != SocketStream::stream_ok) {
+            if (status == SocketStream::stream_failed)
+              LT_LOG_NETWORK_ERRORS("%s write error: %s",
+                                    rak::socket_address::cast_from(m_peerInfo->socket_address())->address_str().c_str(),
+                                    rak::error_number::current().c_str());
+
+            m_download->connection_list()->erase(this, 0);
+            return;
+          }
+
+          if (!m_up->buffer()->consume(m_up->throttle()->node_used_unthrottled(written)))
+            return;
+        }
 
         m_up->buffer()->reset();
 
@@ -673,9 +793,24 @@ PeerConnection<type>::read_have_chunk(uint32_t index) {
   if (index >= m_peerChunks.bitfield()->size_bits())
     throw communication_error("Peer sent HAVE message with out-of-range index.");
 
+  if (m_peerChunks.bitfield()->empty()) {
+    // Compacted bitfield; an all-set one cannot gain bits, while an
+    // all-unset one needs the bit data back now.
+    if (m_peerChunks.bitfield()->is_all_set())
+      return;
+
+    m_peerChunks.bitfield()->materialize();
+  }
+
   if (m_peerChunks.bitfield()->get(index))
     return;
 
+  // The seeding variants own every chunk, so the local bitfield
+  // lookup can never match; compile the accounting out of their
+  // per-message path.
+  if (type == Download::CONNECTION_LEECH && !m_download->file_list()->bitfield()->get(index))
+    m_peerChunks.inc_wanted_chunks();
+
   m_download->chunk_statistics()->received_have_chunk(&m_peerChunks, index, m_download->file_list()->chunk_size());
 
   if (type == Download::CONNECTION_INITIAL_SEED)
@@ -722,6 +857,18 @@ PeerConnection<type>::read_have_chunk(uint32_t index) {
   }
 }
 
+template<Download::ConnectionType type>
+void
+PeerConnection<type>::read_reject_piece(const Piece& piece) {
+  if (!request_list()->rejected(piece))
+    return;
+
+  // The rejected block may now be delegated to another peer right
+  // away rather than after the stall timeout.
+  m_tryRequest = true;
+  write_insert_poll_safe();
+}
+
 template<>
 void
 PeerConnection<Download::CONNECTION_INITIAL_SEED>::offer_chunk() {
@@ -71,6 +71,7 @@ public:
 private:
   inline bool         read_message();
   void                read_have_chunk(uint32_t index);
+  void                read_reject_piece(const Piece& piece);
 
   void                offer_chunk();
   bool                should_upload();
@@ -90,7 +90,7 @@ PeerConnectionMetadata::receive_keepalive() {
     m_up->write_keepalive();
 
     if (is_encrypted())
-      m_encryption.encrypt(old_end, m_up->buffer()->end() - old_end);
+      m_encryption->encrypt(old_end, m_up->buffer()->end() - old_end);
   }
 
   return true;
@@ -205,6 +205,25 @@ PeerConnectionMetadata::read_message() {
     m_down->set_state(ProtocolRead::READ_SKIP_PIECE);
     return false;
 
+  case ProtocolBase::HAVE_ALL:
+  case ProtocolBase::HAVE_NONE:
+    return true;
+
+  case ProtocolBase::SUGGEST_PIECE:
+  case ProtocolBase::ALLOWED_FAST:
+    if (!m_down->can_read_have_body())
+      break;
+
+    buf->read_32();
+    return true;
+
+  case ProtocolBase::REJECT_REQUEST:
+    if (!m_down->can_read_reject_body())
+      break;
+
+    m_down->read_request();
+    return true;
+
   default:
     throw communication_error("Received unsupported message type.");
   }
@@ -242,7 +261,7 @@ PeerConnectionMetadata::event_read() {
           m_down->throttle()->node_used_unthrottled(length);
 
           if (is_encrypted())
-            m_encryption.decrypt(m_down->buffer()->end(), length);
+            m_encryption->decrypt(m_down->buffer()->end(), length);
 
           m_down->buffer()->move_end(length);
         }
@@ -328,7 +347,7 @@ PeerConnectionMetadata::fill_write_buffer() {
   }
 
   if (is_encrypted())
-    m_encryption.encrypt(old_end, m_up->buffer()->end() - old_end);
+    m_encryption->encrypt(old_end, m_up->buffer()->end() - old_end);
 }
 
 void
@@ -367,6 +386,11 @@ PeerConnectionMetadata::event_write() {
         if (!up_extension())
           return;
 
+        // The extension channel is free again; top up the metadata
+        // request pipeline on the next fill rather than waiting for
+        // the peer to send us something.
+        m_tryRequest = true;
+
         m_up->set_state(ProtocolWrite::IDLE);
         break;
 
@@ -436,11 +460,18 @@ PeerConnectionMetadata::try_request_metadata_pieces() {
   if (!m_up->can_write_extension() || m_extensions->has_pending_message())
     return false;
 
-  const Piece* p = request_list()->delegate();
+  if (m_peerChunks.bitfield()->empty())
+    m_peerChunks.bitfield()->materialize();
 
-  if (p == NULL)
+  // Metadata pieces are requested one at a time through the extension
+  // protocol, so no run batching here.
+  std::vector<const Piece*> pieces = request_list()->delegate(1, true);
+
+  if (pieces.empty())
     return false;
 
+  const Piece* p = pieces.front();
+
   if (!m_download->file_list()->is_valid_piece(*p) || !m_peerChunks.bitfield()->get(p->index()))
     throw internal_error("PeerConnectionMetadata::try_request_metadata_pieces() tried to use an invalid piece.");
 
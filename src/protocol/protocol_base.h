@@ -64,6 +64,13 @@ public:
     CANCEL,
     PORT, // = 9
 
+    // BEP 6 fast extension messages.
+    SUGGEST_PIECE  = 13,
+    HAVE_ALL       = 14,
+    HAVE_NONE      = 15,
+    REJECT_REQUEST = 16,
+    ALLOWED_FAST   = 17,
+
     EXTENSION_PROTOCOL = 20,
 
     NONE,           // These are not part of the protocol
@@ -115,6 +122,9 @@ public:
   void                write_piece(const Piece& p);
   void                write_port(uint16_t port);
   void                write_extension(uint8_t id, uint32_t length);
+  void                write_have_all();
+  void                write_have_none();
+  void                write_reject(const Piece& p);
 
   static const size_type sizeof_keepalive    = 4;
   static const size_type sizeof_choke        = 5;
@@ -132,6 +142,9 @@ public:
   static const size_type sizeof_port_body    = 2;
   static const size_type sizeof_extension    = 6;
   static const size_type sizeof_extension_body=1;
+  static const size_type sizeof_have_all     = 5;
+  static const size_type sizeof_reject       = 17;
+  static const size_type sizeof_reject_body  = 12;
 
   bool                can_write_keepalive() const             { return m_buffer.reserved_left() >= sizeof_keepalive; }
   bool                can_write_choke() const                 { return m_buffer.reserved_left() >= sizeof_choke; }
@@ -143,6 +156,8 @@ public:
   bool                can_write_piece() const                 { return m_buffer.reserved_left() >= sizeof_piece; }
   bool                can_write_port() const                  { return m_buffer.reserved_left() >= sizeof_port; }
   bool                can_write_extension() const             { return m_buffer.reserved_left() >= sizeof_extension; }
+  bool                can_write_have_all() const              { return m_buffer.reserved_left() >= sizeof_have_all; }
+  bool                can_write_reject() const                { return m_buffer.reserved_left() >= sizeof_reject; }
 
   bool                can_read_have_body() const              { return m_buffer.remaining() >= sizeof_have_body; }
   bool                can_read_request_body() const           { return m_buffer.remaining() >= sizeof_request_body; }
@@ -150,6 +165,7 @@ public:
   bool                can_read_piece_body() const             { return m_buffer.remaining() >= sizeof_piece_body; }
   bool                can_read_port_body() const              { return m_buffer.remaining() >= sizeof_port_body; }
   bool                can_read_extension_body() const         { return m_buffer.remaining() >= sizeof_extension_body; }
+  bool                can_read_reject_body() const            { return m_buffer.remaining() >= sizeof_reject_body; }
 
 protected:
   State               m_state;
@@ -247,6 +263,27 @@ ProtocolBase::write_extension(uint8_t id, uint32_t length) {
   m_buffer.write_8(id);
 }
 
+inline void
+ProtocolBase::write_have_all() {
+  m_buffer.write_32(1);
+  write_command(HAVE_ALL);
+}
+
+inline void
+ProtocolBase::write_have_none() {
+  m_buffer.write_32(1);
+  write_command(HAVE_NONE);
+}
+
+inline void
+ProtocolBase::write_reject(const Piece& p) {
+  m_buffer.write_32(13);
+  write_command(REJECT_REQUEST);
+  m_buffer.write_32(p.index());
+  m_buffer.write_32(p.offset());
+  m_buffer.write_32(p.length());
+}
+
 }
 
 #endif
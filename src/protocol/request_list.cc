@@ -1,6 +1,7 @@
 #include "config.h"
 
 #include <algorithm>
+#include <cstdlib>
 #include <functional>
 #include <cinttypes>
 #include <rak/functional.h>
@@ -88,19 +89,33 @@ RequestList::~RequestList() {
   priority_queue_erase(&taskScheduler, &m_delay_process_unordered);
 }
 
-const Piece*
-RequestList::delegate() {
-  BlockTransfer* transfer = m_delegator->delegate(m_peerChunks, m_affinity);
+std::vector<const Piece*>
+RequestList::delegate(uint32_t max_size, bool can_duplicate) {
+  std::vector<BlockTransfer*> transfers = m_delegator->delegate(m_peerChunks, m_affinity, can_duplicate, max_size);
 
-  instrumentation_update(INSTRUMENTATION_TRANSFER_REQUESTS_DELEGATED, 1);
+  instrumentation_update(INSTRUMENTATION_TRANSFER_REQUESTS_DELEGATED, transfers.size());
 
-  if (transfer == NULL)
-    return NULL;
+  std::vector<const Piece*> pieces;
 
-  m_affinity = transfer->index();
-  m_queues.push_back(bucket_queued, transfer);
+  if (transfers.empty())
+    return pieces;
 
-  return &transfer->piece();
+  // Probe the request round-trip whenever the pipe starts out empty.
+  if (!m_pipe_probe_active && pipe_size() == 0 && !is_downloading()) {
+    m_pipe_probe_active = true;
+    m_pipe_probe_time = cachedTime;
+  }
+
+  pieces.reserve(transfers.size());
+
+  for (std::vector<BlockTransfer*>::const_iterator itr = transfers.begin(), last = transfers.end(); itr != last; ++itr) {
+    m_affinity = (*itr)->index();
+    m_queues.push_back(bucket_queued, *itr);
+
+    pieces.push_back(&(*itr)->piece());
+  }
+
+  return pieces;
 }
 
 void
@@ -130,6 +145,7 @@ RequestList::choked() {
   // updated within a short timespan?
 
   m_last_choke = cachedTime;
+  m_pipe_probe_active = false;
 
   if (m_queues.queue_empty(bucket_queued) && m_queues.queue_empty(bucket_unordered))
     return;
@@ -138,9 +154,12 @@ RequestList::choked() {
   m_queues.move_all_to(bucket_unordered, bucket_choked);
   m_queues.move_all_to(bucket_stalled, bucket_choked);
 
+  // Scale the grace period for in-flight pieces by the measured
+  // round-trip; unresponsive peers free their blocks after a few
+  // RTTs rather than the full fixed timeout.
   if (!m_delay_remove_choked.is_queued())
     priority_queue_insert(&taskScheduler, &m_delay_remove_choked,
-                          (cachedTime + rak::timer::from_seconds(timeout_remove_choked)).round_seconds());
+                          cachedTime + rak::timer(request_timeout_usec()));
 }
 
 void
@@ -156,13 +175,21 @@ RequestList::unchoked() {
   // followed unchoke before starting to send pieces.
   if (!m_queues.queue_empty(bucket_choked)) {
     priority_queue_insert(&taskScheduler, &m_delay_remove_choked,
-                          (cachedTime + rak::timer::from_seconds(timeout_remove_choked)).round_seconds());
+                          cachedTime + rak::timer(request_timeout_usec()));
   }
 }
 
 void
 RequestList::delay_remove_choked() {
+  bool released = !m_queues.queue_empty(bucket_choked);
+
   m_queues.clear(bucket_choked);
+
+  // The whole bucket is released in one pass; tell the download so
+  // the freed blocks can be handed to peers with spare pipeline
+  // rather than sitting idle until their next natural request cycle.
+  if (released && m_delegator != NULL)
+    m_delegator->redistribute_released();
 }
 
 void
@@ -201,10 +228,15 @@ RequestList::clear() {
   if (is_downloading())
     skipped();
 
+  bool released = !m_queues.empty();
+
   m_queues.clear(bucket_queued);
   m_queues.clear(bucket_unordered);
   m_queues.clear(bucket_stalled);
   m_queues.clear(bucket_choked);
+
+  if (released && m_delegator != NULL)
+    m_delegator->redistribute_released();
 }
 
 bool
@@ -252,6 +284,21 @@ RequestList::downloading(const Piece& piece) {
     goto downloading_error;
   };
 
+  if (m_pipe_probe_active) {
+    m_pipe_probe_active = false;
+
+    int64_t sample = (cachedTime - m_pipe_probe_time).usec();
+    sample = std::min<int64_t>(std::max<int64_t>(sample, rtt_min_estimate), rtt_max_estimate);
+
+    // The usual retransmit-timer smoothing; the deviation is updated
+    // against the old estimate so a level shift registers as variance
+    // before the estimate catches up.
+    int32_t delta = (int32_t)sample - (int32_t)m_rtt_estimate;
+
+    m_rtt_variance += (std::abs(delta) - (int32_t)m_rtt_variance) / 4;
+    m_rtt_estimate += delta / 8;
+  }
+
   // We received an invalid piece length, propably zero length due to
   // the peer not being able to transfer the requested piece.
   //
@@ -277,6 +324,7 @@ RequestList::downloading(const Piece& piece) {
   // Create a dummy BlockTransfer object to hold the piece
   // information.
   m_transfer = new BlockTransfer();
+  instrumentation_alloc(INSTRUMENTATION_ALLOC_PROTOCOL, sizeof(BlockTransfer));
   Block::create_dummy(m_transfer, m_peerChunks->peer_info(), piece);
 
   instrumentation_update(INSTRUMENTATION_TRANSFER_REQUESTS_UNKNOWN, 1);
@@ -284,6 +332,25 @@ RequestList::downloading(const Piece& piece) {
   return false;
 }
 
+// The peer explicitly told us it won't be sending this piece, so
+// release the transfer right away instead of waiting for the stall or
+// choke timeouts to reclaim the block.
+bool
+RequestList::rejected(const Piece& piece) {
+  std::pair<int, queues_type::iterator> itr =
+    queue_bucket_find_if_in_any(m_queues, request_list_same_piece(piece));
+
+  if (itr.first == request_list_constants::bucket_count)
+    return false;
+
+  if (itr.first == bucket_unordered &&
+      std::distance(m_queues.begin(itr.first), itr.second) < m_last_unordered_position)
+    m_last_unordered_position--;
+
+  Block::release(m_queues.take(itr.first, itr.second));
+  return true;
+}
+
 // Must clear the downloading piece.
 void
 RequestList::finished() {
@@ -320,6 +387,7 @@ RequestList::transfer_dissimilar() {
     throw internal_error("RequestList::transfer_dissimilar() called but no transfer is in progress.");
 
   BlockTransfer* dummy = new BlockTransfer();
+  instrumentation_alloc(INSTRUMENTATION_ALLOC_PROTOCOL, sizeof(BlockTransfer));
   Block::create_dummy(dummy, m_peerChunks->peer_info(), m_transfer->piece());
   dummy->set_position(m_transfer->position());
 
@@ -345,23 +413,36 @@ RequestList::is_interested_in_active() const {
   return false;
 }
 
+uint32_t
+RequestList::request_timeout_usec() const {
+  uint64_t timeout = m_rtt_estimate + 4 * (uint64_t)m_rtt_variance;
+
+  if (timeout < timeout_min_adaptive)
+    return timeout_min_adaptive;
+
+  if (timeout > (uint64_t)timeout_remove_choked * 1000000)
+    return timeout_remove_choked * 1000000;
+
+  return timeout;
+}
+
 uint32_t
 RequestList::calculate_pipe_size(uint32_t rate) {
-  // Change into KB.
-  rate /= 1024;
-
-  if (!m_delegator->get_aggressive()) {
-    if (rate < 20)
-      return rate + 2;
-    else
-      return rate / 5 + 18;
-
-  } else {
-    if (rate < 10)
-      return rate / 5 + 1;
-    else
-      return rate / 10 + 2;
-  }
+  // Size the outstanding window by the bandwidth-delay product so
+  // high-latency peers get enough requests in flight to keep their
+  // link busy, while low-latency peers no longer over-queue. The
+  // quarter-window headroom lets the delivery rate keep growing.
+  uint64_t window = (uint64_t)rate * m_rtt_estimate / 1000000;
+  uint32_t pieces = window / (16 << 10);
+
+  pieces += pieces / 4 + 2;
+
+  if (!m_delegator->get_aggressive())
+    return std::min<uint32_t>(pieces, 256);
+
+  // In endgame mode keep the queue short to limit duplicate
+  // transfers.
+  return std::min<uint32_t>(pieces / 4 + 1, 64);
 }
 
 }
@@ -38,6 +38,7 @@
 #define LIBTORRENT_REQUEST_LIST_H
 
 #include <deque>
+#include <vector>
 
 #include "torrent/data/block_transfer.h"
 #include "utils/instrumentation.h"
@@ -75,12 +76,25 @@ public:
   static const int timeout_choked_received = 60;
   static const int timeout_process_unordered = 60;
 
+  // Bounds for the smoothed request round-trip estimate, in
+  // microseconds.
+  static const uint32_t rtt_initial_estimate = 1000000;
+  static const uint32_t rtt_min_estimate     = 50000;
+  static const uint32_t rtt_max_estimate     = 5000000;
+
+  // Floor for the adaptive request timeout, in microseconds; jitter
+  // on fast links should not reclaim requests that are merely a
+  // scheduling hiccup late.
+  static const uint32_t timeout_min_adaptive = 1000000;
+
   RequestList();
   ~RequestList();
 
-  // Some parameters here, like how fast we are downloading and stuff
-  // when we start considering those.
-  const Piece*         delegate();
+  // Delegate up to 'max_size' blocks in one call; the delegator
+  // extends the run over contiguous untouched blocks so the returned
+  // pieces form a sequential span that is requested, and arrives, in
+  // one burst.
+  std::vector<const Piece*> delegate(uint32_t max_size, bool can_duplicate);
 
   void                 stall_initial();
   void                 stall_prolonged();
@@ -93,6 +107,9 @@ public:
   // The returned transfer must still be valid.
   bool                 downloading(const Piece& piece);
 
+  // The peer explicitly rejected the request (BEP 6).
+  bool                 rejected(const Piece& piece);
+
   void                 finished();
   void                 skipped();
 
@@ -117,6 +134,15 @@ public:
   uint32_t             pipe_size() const;
   uint32_t             calculate_pipe_size(uint32_t rate);
 
+  uint32_t             rtt_estimate() const              { return m_rtt_estimate; }
+  uint32_t             rtt_variance() const              { return m_rtt_variance; }
+
+  // Retransmit-style timeout derived from the smoothed round-trip and
+  // its mean deviation, bounded by the old fixed constant; a dead
+  // peer is given up on after a few round-trips instead of the full
+  // fixed period, while a slow-but-working peer keeps its margin.
+  uint32_t             request_timeout_usec() const;
+
   void                 set_delegator(Delegator* d)       { m_delegator = d; }
   void                 set_peer_chunks(PeerChunks* b)    { m_peerChunks = b; }
 
@@ -144,6 +170,14 @@ private:
   rak::timer           m_last_unchoke;
   size_t               m_last_unordered_position;
 
+  // Smoothed request round-trip and its mean deviation in
+  // microseconds, sampled whenever the first response of an initially
+  // empty pipe arrives.
+  uint32_t             m_rtt_estimate;
+  uint32_t             m_rtt_variance;
+  rak::timer           m_pipe_probe_time;
+  bool                 m_pipe_probe_active;
+
   rak::priority_item   m_delay_remove_choked;
   rak::priority_item   m_delay_process_unordered;
 };
@@ -154,7 +188,10 @@ RequestList::RequestList() :
   m_peerChunks(NULL),
   m_transfer(NULL),
   m_affinity(-1),
-  m_last_unordered_position(0) {
+  m_last_unordered_position(0),
+  m_rtt_estimate(rtt_initial_estimate),
+  m_rtt_variance(rtt_initial_estimate / 2),
+  m_pipe_probe_active(false) {
   m_delay_remove_choked.slot() = std::bind(&RequestList::delay_remove_choked, this);
   m_delay_process_unordered.slot() = std::bind(&RequestList::delay_process_unordered, this);
 }
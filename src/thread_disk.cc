@@ -36,6 +36,8 @@
 
 #include "config.h"
 
+#include <unistd.h>
+
 #include <rak/timer.h>
 
 #include "thread_disk.h"
@@ -47,15 +49,55 @@
 
 namespace torrent {
 
+thread_disk::thread_disk() {
+  pthread_mutex_init(&m_job_lock, NULL);
+}
+
+thread_disk::~thread_disk() {
+  pthread_mutex_destroy(&m_job_lock);
+}
+
 void
-thread_disk::init_thread() {
-  if (!Poll::slot_create_poll())
-    throw internal_error("thread_disk::init_thread(): Poll::slot_create_poll() not valid.");
+thread_disk::push_job(const slot_job& job) {
+  pthread_mutex_lock(&m_job_lock);
+  m_job_queue.push_back(job);
+  pthread_mutex_unlock(&m_job_lock);
+}
+
+void
+thread_disk::perform_jobs() {
+  pthread_mutex_lock(&m_job_lock);
 
-  m_poll = Poll::slot_create_poll()();
+  while (!m_job_queue.empty()) {
+    slot_job job = m_job_queue.front();
+    m_job_queue.pop_front();
+
+    pthread_mutex_unlock(&m_job_lock);
+    job();
+    pthread_mutex_lock(&m_job_lock);
+  }
+
+  pthread_mutex_unlock(&m_job_lock);
+}
+
+void
+thread_disk::init_thread() {
+  if (Poll::slot_create_poll())
+    m_poll = Poll::slot_create_poll()();
+  else
+    m_poll = Poll::create(sysconf(_SC_OPEN_MAX));
   m_state = STATE_INITIALIZED;
 
   m_instrumentation_index = INSTRUMENTATION_POLLING_DO_POLL_DISK - INSTRUMENTATION_POLLING_DO_POLL;
+
+  // A failed ring setup just leaves the synchronous path in place.
+  m_aio_ring.initialize();
+
+  // The hash queue is the ring's only submitter for now, so it owns
+  // the completion slot outright.
+  m_hash_queue.set_aio_ring(&m_aio_ring);
+  m_aio_ring.slot_request_done() = std::bind(&HashCheckQueue::receive_read_done, &m_hash_queue,
+                                             std::placeholders::_1, std::placeholders::_2);
 }
 
 void
@@ -71,6 +113,8 @@ thread_disk::call_events() {
     throw shutdown_exception();
   }
 
+  m_aio_ring.perform();
+  perform_jobs();
   m_hash_queue.perform();
 }
 
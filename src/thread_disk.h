@@ -1,6 +1,11 @@
 #ifndef LIBTORRENT_THREAD_DISK_H
 #define LIBTORRENT_THREAD_DISK_H
 
+#include <deque>
+#include <functional>
+#include <pthread.h>
+
+#include "data/aio_ring.h"
 #include "data/hash_check_queue.h"
 #include "torrent/utils/thread_base.h"
 
@@ -8,8 +13,18 @@ namespace torrent {
 
 class LIBTORRENT_EXPORT thread_disk : public thread_base {
 public:
+  typedef std::function<void ()> slot_job;
+
+  thread_disk();
+  ~thread_disk();
+
   const char*     name() const { return "rtorrent disk"; }
   HashCheckQueue* hash_queue() { return &m_hash_queue; }
+  AioRing*        aio_ring()   { return &m_aio_ring; }
+
+  // Queue a blocking filesystem operation for execution on this
+  // thread; remember to interrupt() afterwards.
+  void            push_job(const slot_job& job);
 
   virtual void    init_thread();
 
@@ -17,7 +32,13 @@ protected:
   virtual void    call_events();
   virtual int64_t next_timeout_usec();
 
+  void            perform_jobs();
+
   HashCheckQueue  m_hash_queue;
+  AioRing         m_aio_ring;
+
+  std::deque<slot_job> m_job_queue;
+  pthread_mutex_t m_job_lock;
 };
 
 }
@@ -36,6 +36,8 @@
 
 #include "config.h"
 
+#include <unistd.h>
+
 #include <rak/timer.h>
 
 #include "thread_main.h"
@@ -52,11 +54,14 @@ void
 thread_main::init_thread() {
   acquire_global_lock();
 
-  if (!Poll::slot_create_poll())
-    throw internal_error("thread_main::init_thread(): Poll::slot_create_poll() not valid.");
+  // Fall back to runtime backend probing when the client did not
+  // install its own create slot.
+  if (Poll::slot_create_poll())
+    m_poll = Poll::slot_create_poll()();
+  else
+    m_poll = Poll::create(sysconf(_SC_OPEN_MAX));
 
-  m_poll = Poll::slot_create_poll()();
-  m_poll->set_flags(Poll::flag_waive_global_lock);
+  m_poll->set_flags(m_poll->flags() | Poll::flag_waive_global_lock);
 
   m_state = STATE_INITIALIZED;
   m_thread = pthread_self();
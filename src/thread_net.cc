@@ -0,0 +1,112 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2011, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include <unistd.h>
+
+#include <rak/timer.h>
+
+#include "thread_net.h"
+
+#include "torrent/exceptions.h"
+#include "torrent/poll.h"
+#include "torrent/utils/log.h"
+#include "utils/instrumentation.h"
+
+namespace torrent {
+
+thread_net::thread_net() {
+  pthread_mutex_init(&m_job_lock, NULL);
+}
+
+thread_net::~thread_net() {
+  pthread_mutex_destroy(&m_job_lock);
+}
+
+void
+thread_net::push_job(const slot_job& job) {
+  pthread_mutex_lock(&m_job_lock);
+  m_job_queue.push_back(job);
+  pthread_mutex_unlock(&m_job_lock);
+}
+
+void
+thread_net::perform_jobs() {
+  pthread_mutex_lock(&m_job_lock);
+
+  while (!m_job_queue.empty()) {
+    slot_job job = m_job_queue.front();
+    m_job_queue.pop_front();
+
+    pthread_mutex_unlock(&m_job_lock);
+    job();
+    pthread_mutex_lock(&m_job_lock);
+  }
+
+  pthread_mutex_unlock(&m_job_lock);
+}
+
+void
+thread_net::init_thread() {
+  if (Poll::slot_create_poll())
+    m_poll = Poll::slot_create_poll()();
+  else
+    m_poll = Poll::create(sysconf(_SC_OPEN_MAX));
+  m_state = STATE_INITIALIZED;
+
+  m_instrumentation_index = INSTRUMENTATION_POLLING_DO_POLL_OTHERS - INSTRUMENTATION_POLLING_DO_POLL;
+}
+
+void
+thread_net::call_events() {
+  if ((m_flags & flag_do_shutdown)) {
+    if ((m_flags & flag_did_shutdown))
+      throw internal_error("Already trigged shutdown.");
+
+    __sync_or_and_fetch(&m_flags, flag_did_shutdown);
+    throw shutdown_exception();
+  }
+
+  perform_jobs();
+}
+
+int64_t
+thread_net::next_timeout_usec() {
+  return rak::timer::from_seconds(10).round_seconds().usec();
+}
+
+}
@@ -0,0 +1,81 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2011, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_THREAD_NET_H
+#define LIBTORRENT_THREAD_NET_H
+
+#include <deque>
+#include <functional>
+#include <pthread.h>
+
+#include "torrent/utils/thread_base.h"
+
+namespace torrent {
+
+// Worker thread for network event sources, with its own poll
+// instance. Sockets are assigned to a worker by file descriptor so an
+// event source always runs on the same thread; event sources still
+// holding the main poll are unaffected.
+
+class LIBTORRENT_EXPORT thread_net : public thread_base {
+public:
+  typedef std::function<void ()> slot_job;
+
+  thread_net();
+  ~thread_net();
+
+  const char*     name() const { return "rtorrent network"; }
+
+  // Queue a callback for execution on this thread, e.g. for opening
+  // or closing one of its sockets; remember to interrupt()
+  // afterwards.
+  void            push_job(const slot_job& job);
+
+  virtual void    init_thread();
+
+protected:
+  virtual void    call_events();
+  virtual int64_t next_timeout_usec();
+
+  void            perform_jobs();
+
+  std::deque<slot_job> m_job_queue;
+  pthread_mutex_t m_job_lock;
+};
+
+}
+
+#endif
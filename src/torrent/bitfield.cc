@@ -37,6 +37,7 @@
 #include "config.h"
 
 #include <algorithm>
+#include <cstring>
 
 #include "rak/algorithm.h"
 #include "utils/instrumentation.h"
@@ -83,6 +84,27 @@ Bitfield::unallocate() {
   instrumentation_update(INSTRUMENTATION_MEMORY_BITFIELDS, -(int64_t)size_bytes());
 }
 
+void
+Bitfield::compact() {
+  if (m_set != 0 && m_set != m_size)
+    return;
+
+  unallocate();
+}
+
+void
+Bitfield::materialize() {
+  if (m_data != NULL)
+    return;
+
+  if (m_set != 0 && m_set != m_size)
+    throw internal_error("Bitfield::materialize() called on a bitfield that was not compacted.");
+
+  allocate();
+  std::memset(m_data, m_set != 0 ? ~value_type(0) : value_type(0), size_bytes());
+  clear_tail();
+}
+
 void
 Bitfield::update() {
   // Clears the unused bits.
@@ -93,9 +115,9 @@ Bitfield::update() {
   iterator itr = m_data;
   iterator last = end();
 
-  while (itr + sizeof(unsigned int) <= last) {
-    m_set += rak::popcount_wrapper(*reinterpret_cast<unsigned int*>(itr));
-    itr += sizeof(unsigned int);
+  while (itr + sizeof(uint64_t) <= last) {
+    m_set += rak::popcount_wrapper(*reinterpret_cast<uint64_t*>(itr));
+    itr += sizeof(uint64_t);
   }
 
   while (itr != last) {
@@ -103,6 +125,28 @@ Bitfield::update() {
   }
 }
 
+void
+Bitfield::update_range_bytes(size_type first, size_type last) {
+  if (first > last || last > size_bytes())
+    throw internal_error("Bitfield::update_range_bytes(...) received an invalid range.");
+
+  iterator itr = m_data + first;
+  iterator range_last = m_data + last;
+
+  // The range may start at any byte, so load the words unaligned.
+  while (itr + sizeof(uint64_t) <= range_last) {
+    uint64_t word;
+    std::memcpy(&word, itr, sizeof(word));
+
+    m_set += rak::popcount_wrapper(word);
+    itr += sizeof(uint64_t);
+  }
+
+  while (itr != range_last) {
+    m_set += rak::popcount_wrapper(*itr++);
+  }
+}
+
 void
 Bitfield::copy(const Bitfield& bf) {
   unallocate();
@@ -140,28 +184,175 @@ Bitfield::unset_all() {
   std::memset(m_data, value_type(), size_bytes());
 }
 
-// Quick hack. Speed improvements would require that m_set is kept
-// up-to-date.
 void
 Bitfield::set_range(size_type first, size_type last) {
-  while (first != last)
-    set(first++);
+  if (first >= last)
+    return;
+
+  size_type first_byte = first / 8;
+  size_type last_byte  = (last - 1) / 8;
+
+  value_type first_mask = mask_from(first % 8);
+  value_type last_mask  = mask_before((last - 1) % 8 + 1);
+
+  if (first_byte == last_byte)
+    first_mask &= last_mask;
+
+  m_set += rak::popcount_wrapper((value_type)(first_mask & ~m_data[first_byte]));
+  m_data[first_byte] |= first_mask;
+
+  if (first_byte == last_byte)
+    return;
+
+  m_set += rak::popcount_wrapper((value_type)(last_mask & ~m_data[last_byte]));
+  m_data[last_byte] |= last_mask;
+
+  // Count what the interior bytes already hold, then fill them whole.
+  for (iterator itr = m_data + first_byte + 1, last_itr = m_data + last_byte; itr != last_itr; ++itr)
+    m_set += 8 - rak::popcount_wrapper(*itr);
+
+  std::memset(m_data + first_byte + 1, ~value_type(), last_byte - first_byte - 1);
 }
 
 void
 Bitfield::unset_range(size_type first, size_type last) {
-  while (first != last)
-    unset(first++);
+  if (first >= last)
+    return;
+
+  size_type first_byte = first / 8;
+  size_type last_byte  = (last - 1) / 8;
+
+  value_type first_mask = mask_from(first % 8);
+  value_type last_mask  = mask_before((last - 1) % 8 + 1);
+
+  if (first_byte == last_byte)
+    first_mask &= last_mask;
+
+  m_set -= rak::popcount_wrapper((value_type)(first_mask & m_data[first_byte]));
+  m_data[first_byte] &= ~first_mask;
+
+  if (first_byte == last_byte)
+    return;
+
+  m_set -= rak::popcount_wrapper((value_type)(last_mask & m_data[last_byte]));
+  m_data[last_byte] &= ~last_mask;
+
+  for (iterator itr = m_data + first_byte + 1, last_itr = m_data + last_byte; itr != last_itr; ++itr)
+    m_set -= rak::popcount_wrapper(*itr);
+
+  std::memset(m_data + first_byte + 1, value_type(), last_byte - first_byte - 1);
 }
 
-// size_type
-// Bitfield::count_range(size_type first, size_type last) {
-//   size_type count = 0;
+// The bitwise primitives work a word at a time; the loops are simple
+// enough for the compiler to vectorize, and update() refreshes the
+// set count with hardware popcount afterwards.
+
+void
+Bitfield::set_and(const Bitfield& bf) {
+  if (bf.m_size != m_size)
+    throw internal_error("Bitfield::set_and(...) bitfield sizes do not match.");
 
-//   // Some archs have bitcounting instructions, look into writing a
-//   // wrapper for those.
-//   for (iterator itr = m_data, last = end(); itr != last; ++itr)
-//     m_set += bit_count_256[*itr];
-// }
+  iterator itr = m_data;
+  const_iterator source = bf.m_data;
+  iterator last = end();
+
+  while (itr + sizeof(uint64_t) <= last) {
+    *reinterpret_cast<uint64_t*>(itr) &= *reinterpret_cast<const uint64_t*>(source);
+    itr += sizeof(uint64_t);
+    source += sizeof(uint64_t);
+  }
+
+  while (itr != last)
+    *itr++ &= *source++;
+
+  update();
+}
+
+void
+Bitfield::set_or(const Bitfield& bf) {
+  if (bf.m_size != m_size)
+    throw internal_error("Bitfield::set_or(...) bitfield sizes do not match.");
+
+  iterator itr = m_data;
+  const_iterator source = bf.m_data;
+  iterator last = end();
+
+  while (itr + sizeof(uint64_t) <= last) {
+    *reinterpret_cast<uint64_t*>(itr) |= *reinterpret_cast<const uint64_t*>(source);
+    itr += sizeof(uint64_t);
+    source += sizeof(uint64_t);
+  }
+
+  while (itr != last)
+    *itr++ |= *source++;
+
+  update();
+}
+
+void
+Bitfield::set_and_not(const Bitfield& bf) {
+  if (bf.m_size != m_size)
+    throw internal_error("Bitfield::set_and_not(...) bitfield sizes do not match.");
+
+  iterator itr = m_data;
+  const_iterator source = bf.m_data;
+  iterator last = end();
+
+  while (itr + sizeof(uint64_t) <= last) {
+    *reinterpret_cast<uint64_t*>(itr) &= ~*reinterpret_cast<const uint64_t*>(source);
+    itr += sizeof(uint64_t);
+    source += sizeof(uint64_t);
+  }
+
+  while (itr != last)
+    *itr++ &= ~*source++;
+
+  update();
+}
+
+Bitfield::size_type
+Bitfield::size_and_not(const Bitfield& bf) const {
+  if (bf.m_size != m_size)
+    throw internal_error("Bitfield::size_and_not(...) bitfield sizes do not match.");
+
+  size_type count = 0;
+
+  const_iterator itr = m_data;
+  const_iterator source = bf.m_data;
+  const_iterator last = end();
+
+  while (itr + sizeof(uint64_t) <= last) {
+    count += rak::popcount_wrapper(*reinterpret_cast<const uint64_t*>(itr) & ~*reinterpret_cast<const uint64_t*>(source));
+    itr += sizeof(uint64_t);
+    source += sizeof(uint64_t);
+  }
+
+  while (itr != last)
+    count += rak::popcount_wrapper((value_type)(*itr++ & ~*source++));
+
+  return count;
+}
+
+void
+Bitfield::set_not(const Bitfield& bf) {
+  if (bf.m_size != m_size)
+    throw internal_error("Bitfield::set_not(...) bitfield sizes do not match.");
+
+  iterator itr = m_data;
+  const_iterator source = bf.m_data;
+  iterator last = end();
+
+  while (itr + sizeof(uint64_t) <= last) {
+    *reinterpret_cast<uint64_t*>(itr) = ~*reinterpret_cast<const uint64_t*>(source);
+    itr += sizeof(uint64_t);
+    source += sizeof(uint64_t);
+  }
+
+  while (itr != last)
+    *itr++ = ~*source++;
+
+  // update() also clears the tail bits the complement set.
+  update();
+}
 
 }
@@ -75,9 +75,21 @@ public:
   // Resize clears the data?
   void                update();
 
+  // Add the set bits of a freshly written byte range to the counter,
+  // for callers filling the data in slices who don't want a full
+  // rescan at the end. The caller must clear_tail() before counting
+  // the slice containing the final byte.
+  void                update_range_bytes(size_type first, size_type last);
+
   void                allocate();
   void                unallocate();
 
+  // Release the bit data while all bits are equal; the size and set
+  // counters still answer queries. Use materialize() to restore the
+  // data before accessing individual bits again.
+  void                compact();
+  void                materialize();
+
   void                clear()                       { unallocate(); m_size = 0; m_set = 0; }
   void                clear_tail()                  { if (m_size % 8) *(end() - 1) &= mask_before(m_size % 8); }
 
@@ -90,6 +102,16 @@ public:
   void                unset_all();
   void                unset_range(size_type first, size_type last);
 
+  // Word-at-a-time bitwise operations; both bitfields must be
+  // allocated and of the same size. The set count is updated.
+  void                set_and(const Bitfield& bf);
+  void                set_or(const Bitfield& bf);
+  void                set_and_not(const Bitfield& bf);
+  void                set_not(const Bitfield& bf);
+
+  // Number of bits set in this bitfield but not in 'bf'.
+  size_type           size_and_not(const Bitfield& bf) const;
+
   // size_type           count_range(size_type first, size_type last) const;
 
   bool                get(size_type idx) const      { return m_data[idx / 8] & mask_at(idx % 8); }
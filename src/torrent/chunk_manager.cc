@@ -36,11 +36,17 @@
 
 #include "config.h"
 
+#include <cinttypes>
+#include <cstdio>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 
+#include "data/chunk.h"
 #include "data/chunk_list.h"
+#include "data/hash_queue.h"
+#include "manager.h"
+#include "thread_disk.h"
 #include "utils/instrumentation.h"
 
 #include "exceptions.h"
@@ -49,6 +55,44 @@
 
 namespace torrent {
 
+#ifdef __linux__
+
+// Single-value cgroup v2 files; a missing controller or a literal
+// "max" limit yields false.
+static bool
+chunk_manager_read_cgroup_value(const char* path, uint64_t* value) {
+  FILE* file = std::fopen(path, "r");
+
+  if (file == NULL)
+    return false;
+
+  bool result = std::fscanf(file, "%" SCNu64, value) == 1;
+  std::fclose(file);
+
+  return result;
+}
+
+static bool
+chunk_manager_read_psi_memory(double* some_avg10, double* full_avg10) {
+  FILE* file = std::fopen("/proc/pressure/memory", "r");
+
+  if (file == NULL)
+    return false;
+
+  char line[256];
+  bool result = false;
+
+  while (std::fgets(line, sizeof(line), file) != NULL)
+    if (std::sscanf(line, "some avg10=%lf", some_avg10) == 1 ||
+        std::sscanf(line, "full avg10=%lf", full_avg10) == 1)
+      result = true;
+
+  std::fclose(file);
+  return result;
+}
+
+#endif
+
 ChunkManager::ChunkManager() :
   m_memoryUsage(0),
   m_memoryBlockCount(0),
@@ -61,11 +105,30 @@ ChunkManager::ChunkManager() :
   m_preloadMinSize(256 << 10),
   m_preloadRequiredRate(5 << 10),
 
+  m_writeDropBehind(false),
+  m_adviseHugepage(false),
+
+  m_residentUsage(0),
+  m_timeResidencySampled(0),
+
+  m_memoryPressure(pressure_none),
+  m_timePressureSampled(0),
+
+  m_compressedCacheSize(0),
+  m_compressedCacheUsage(0),
+
   m_statsPreloaded(0),
   m_statsNotPreloaded(0),
+  m_statsCompressedHits(0),
 
   m_timerStarved(0),
-  m_lastFreed(0) {
+  m_lastFreed(0),
+
+  m_asyncFlushCount(0),
+
+  m_chunkPool(sizeof(Chunk)) {
+
+  pthread_mutex_init(&m_flushLock, NULL);
 
   // 1/5 of the available memory should be enough for the client. If
   // the client really requires alot more memory it should call this
@@ -74,6 +137,12 @@ ChunkManager::ChunkManager() :
 }
 
 ChunkManager::~ChunkManager() {
+  // Free any flushed chunks that were posted back but whose signal
+  // hasn't been processed yet.
+  work_flush_done();
+
+  pthread_mutex_destroy(&m_flushLock);
+
   if (m_memoryUsage != 0 || m_memoryBlockCount != 0)
     throw internal_error("ChunkManager::~ChunkManager() m_memoryUsage != 0 || m_memoryBlockCount != 0.");
 }
@@ -98,6 +167,17 @@ ChunkManager::sync_queue_size() const {
   return size;
 }
 
+void
+ChunkManager::set_max_memory_usage(uint64_t bytes) {
+  m_maxMemoryUsage = bytes;
+
+  // Scale the hash queue's congestion threshold with the memory
+  // limit, so request pipelines back off before allocations hit the
+  // ceiling.
+  if (manager != NULL && manager->hash_queue() != NULL)
+    manager->hash_queue()->set_congestion_bytes(bytes / 4);
+}
+
 uint64_t
 ChunkManager::estimate_max_memory_usage() {
   rlimit rlp;
@@ -142,10 +222,31 @@ ChunkManager::erase(ChunkList* chunkList) {
 
 bool
 ChunkManager::allocate(uint32_t size, int flags) {
-  if (m_memoryUsage + size > (3 * m_maxMemoryUsage) / 4)
-    try_free_memory((1 * m_maxMemoryUsage) / 4);
-
-  if (m_memoryUsage + size > m_maxMemoryUsage) {
+  // Allocation is where our footprint grows, so refresh the kernel's
+  // view here rather than waiting for the next periodic tick; the
+  // sampler rate-limits itself to once a second.
+  sample_memory_pressure();
+
+  // Under external memory pressure shrink the ceiling we're willing
+  // to grow to; the kernel's numbers outrank our rlimit-derived
+  // limit, which is blind to container limits.
+  uint64_t effective_max = m_maxMemoryUsage;
+
+  if (m_memoryPressure == pressure_moderate)
+    effective_max = (3 * m_maxMemoryUsage) / 4;
+  else if (m_memoryPressure == pressure_critical)
+    effective_max = m_maxMemoryUsage / 2;
+
+  // Only force syncs when the resident sample confirms the pressure
+  // is real; a recent sample showing mostly cold mappings means the
+  // kernel has already reclaimed the memory for us.
+  bool sample_is_current = m_timeResidencySampled + 60 >= cachedTime.seconds();
+
+  if (m_memoryUsage + size > (3 * effective_max) / 4 &&
+      (!sample_is_current || m_residentUsage + size > (2 * effective_max) / 4))
+    try_free_memory((1 * effective_max) / 4);
+
+  if (m_memoryUsage + size > effective_max) {
     if (!(flags & allocate_dont_log))
       instrumentation_update(INSTRUMENTATION_MINCORE_ALLOC_FAILED, 1);
 
@@ -202,11 +303,166 @@ ChunkManager::try_free_memory(uint64_t size) {
   m_timerStarved = cachedTime.seconds();
 }
 
+void
+ChunkManager::set_compressed_cache_size(uint64_t bytes) {
+  m_compressedCacheSize = bytes;
+
+  if (m_compressedCacheUsage > m_compressedCacheSize)
+    evict_compressed(m_compressedCacheSize);
+}
+
+bool
+ChunkManager::compressed_cache_allocate(uint32_t size) {
+  if (size > m_compressedCacheSize)
+    return false;
+
+  if (m_compressedCacheUsage + size > m_compressedCacheSize)
+    evict_compressed(m_compressedCacheSize - size);
+
+  if (m_compressedCacheUsage + size > m_compressedCacheSize)
+    return false;
+
+  m_compressedCacheUsage += size;
+  return true;
+}
+
+void
+ChunkManager::compressed_cache_deallocate(uint32_t size) {
+  if (size > m_compressedCacheUsage)
+    throw internal_error("ChunkManager::compressed_cache_deallocate(...) size > m_compressedCacheUsage.");
+
+  m_compressedCacheUsage -= size;
+}
+
+void
+ChunkManager::evict_compressed(uint64_t target) {
+  // Drop one entry per list per pass so no single download gets its
+  // retained chunks wiped while another hoards the budget.
+  bool evicted;
+
+  do {
+    evicted = false;
+
+    for (iterator itr = base_type::begin(), last = base_type::end(); itr != last && m_compressedCacheUsage > target; itr++)
+      evicted |= (*itr)->evict_compressed();
+
+  } while (evicted && m_compressedCacheUsage > target);
+}
+
+bool
+ChunkManager::flush_chunks_async(ChunkList* chunk_list) {
+  if (!manager->main_thread_disk()->is_active())
+    return false;
+
+  flush_list_type* flush_list = new flush_list_type;
+  chunk_list->detach_queue_chunks(flush_list);
+
+  if (flush_list->empty()) {
+    delete flush_list;
+    return true;
+  }
+
+  m_asyncFlushCount++;
+
+  manager->main_thread_disk()->push_job([this, flush_list]() {
+      for (flush_list_type::iterator itr = flush_list->begin(), last = flush_list->end(); itr != last; itr++)
+        (*itr)->sync(MemoryChunk::sync_sync);
+
+      pthread_mutex_lock(&m_flushLock);
+      m_flushedChunks.push_back(flush_list);
+      pthread_mutex_unlock(&m_flushLock);
+
+      m_slotFlushDone();
+    });
+  manager->main_thread_disk()->interrupt();
+
+  return true;
+}
+
+void
+ChunkManager::work_flush_done() {
+  std::vector<flush_list_type*> flushed;
+
+  pthread_mutex_lock(&m_flushLock);
+  flushed.swap(m_flushedChunks);
+  pthread_mutex_unlock(&m_flushLock);
+
+  for (std::vector<flush_list_type*>::iterator itr = flushed.begin(), last = flushed.end(); itr != last; itr++) {
+    for (flush_list_type::iterator chunk_itr = (*itr)->begin(), chunk_last = (*itr)->end(); chunk_itr != chunk_last; chunk_itr++)
+      delete *chunk_itr;
+
+    delete *itr;
+    m_asyncFlushCount--;
+  }
+}
+
 void
 ChunkManager::periodic_sync() {
+  sample_memory_pressure();
+  sample_residency();
   sync_all(ChunkList::sync_use_timeout, 0);
 }
 
+void
+ChunkManager::sample_memory_pressure() {
+  // Cheap, but not free; cap the procfs reads at one per second as
+  // this also runs on the allocation path.
+  if (m_timePressureSampled + 1 > cachedTime.seconds())
+    return;
+
+  m_timePressureSampled = cachedTime.seconds();
+
+  int level = pressure_none;
+
+#ifdef __linux__
+  // The cgroup v2 limit catches containers about to hit their hard
+  // cap even before the kernel starts stalling us.
+  uint64_t current;
+  uint64_t max;
+
+  if (chunk_manager_read_cgroup_value("/sys/fs/cgroup/memory.current", &current) &&
+      chunk_manager_read_cgroup_value("/sys/fs/cgroup/memory.max", &max) && max != 0) {
+    if (current >= max - max / 16)
+      level = pressure_critical;
+    else if (current >= max - max / 8)
+      level = pressure_moderate;
+  }
+
+  // PSI covers the host-wide case and kicks in once reclaim actually
+  // starts costing anyone wall-clock time.
+  double some_avg10 = 0.0;
+  double full_avg10 = 0.0;
+
+  if (chunk_manager_read_psi_memory(&some_avg10, &full_avg10)) {
+    if (full_avg10 >= 5.0 && level < pressure_critical)
+      level = pressure_critical;
+    else if (some_avg10 >= 10.0 && level < pressure_moderate)
+      level = pressure_moderate;
+  }
+#endif
+
+  // Escalation to critical reclaims immediately, ahead of the OOM
+  // killer; bypass the starvation timer try_free_memory uses to pace
+  // itself.
+  if (level == pressure_critical && m_memoryPressure != pressure_critical) {
+    sync_all(0, m_maxMemoryUsage / 2);
+    m_timerStarved = cachedTime.seconds();
+  }
+
+  m_memoryPressure = level;
+}
+
+void
+ChunkManager::sample_residency() {
+  uint64_t total = 0;
+
+  for (iterator itr = base_type::begin(), last = base_type::end(); itr != last; itr++)
+    total += (*itr)->sample_residency();
+
+  m_residentUsage = total;
+  m_timeResidencySampled = cachedTime.seconds();
+}
+
 void
 ChunkManager::sync_all(int flags, uint64_t target) {
   if (empty())
@@ -39,7 +39,10 @@
 #ifndef LIBTORRENT_CHUNK_MANAGER_H
 #define LIBTORRENT_CHUNK_MANAGER_H
 
+#include <functional>
 #include <vector>
+#include <pthread.h>
+#include <rak/allocators.h>
 #include <torrent/common.h>
 
 namespace torrent {
@@ -52,6 +55,9 @@ public:
   typedef std::vector<ChunkList*> base_type;
   typedef uint32_t                size_type;
 
+  typedef std::vector<Chunk*>     flush_list_type;
+  typedef std::function<void ()>  slot_void;
+
   using base_type::iterator;
   using base_type::reverse_iterator;
   using base_type::const_iterator;
@@ -65,6 +71,11 @@ public:
   ~ChunkManager();
   
   uint64_t            memory_usage() const                      { return m_memoryUsage; }
+
+  // Bytes of mapped chunk memory found resident by the last mincore
+  // sampling pass; mapped-but-cold pages don't represent real memory
+  // pressure.
+  uint64_t            resident_usage() const                    { return m_residentUsage; }
   uint64_t            sync_queue_memory_usage() const;
 
   uint32_t            memory_block_count() const                { return m_memoryBlockCount; }
@@ -74,7 +85,7 @@ public:
 
   // The client should set this automatically if ulimit is set.
   uint64_t            max_memory_usage() const                  { return m_maxMemoryUsage; }
-  void                set_max_memory_usage(uint64_t bytes)      { m_maxMemoryUsage = bytes; }
+  void                set_max_memory_usage(uint64_t bytes);
 
   // Estimate the max memory usage possible, capped at 1GB.
   static uint64_t     estimate_max_memory_usage();
@@ -109,6 +120,47 @@ public:
   uint32_t            preload_required_rate() const             { return m_preloadRequiredRate; }
   void                set_preload_required_rate(uint32_t bytes) { m_preloadRequiredRate = bytes; }
 
+  // Evict bulk-written chunk data from the page cache once writeback
+  // has been queued, for one-pass download workloads where the data
+  // won't be read again soon. Best effort; still-dirty pages are
+  // skipped and picked up on a later sync round.
+  bool                write_drop_behind() const                 { return m_writeDropBehind; }
+  void                set_write_drop_behind(bool state)         { m_writeDropBehind = state; }
+
+  // Request transparent hugepages for new chunk mappings to reduce
+  // TLB pressure when a large number of chunks are mapped. Best
+  // effort; the kernel may not honor the advice.
+  bool                advise_hugepage() const                   { return m_adviseHugepage; }
+  void                set_advise_hugepage(bool state)           { m_adviseHugepage = state; }
+
+  // External memory pressure as reported by the kernel, sampled from
+  // the cgroup memory limit and PSI when available. The rlimit-based
+  // max memory estimate is blind to container limits, so under
+  // pressure the chunk caching gets graduated responses: preloading
+  // stops and drop-behind kicks in at 'moderate', the allocation
+  // ceiling shrinks and a reclaiming sync runs at 'critical'.
+  static const int pressure_none     = 0;
+  static const int pressure_moderate = 1;
+  static const int pressure_critical = 2;
+
+  int                 memory_pressure() const                   { return m_memoryPressure; }
+  bool                is_memory_pressured() const               { return m_memoryPressure != pressure_none; }
+
+  // Budget for the compressed chunk retention tier. Evicted complete
+  // chunks keep a deflated copy of their data within this budget, so
+  // a re-request on compressible swarms inflates from RAM instead of
+  // seeking the disk. Set to 0 (the default) to disable the tier.
+  uint64_t            compressed_cache_size() const             { return m_compressedCacheSize; }
+  void                set_compressed_cache_size(uint64_t bytes);
+
+  uint64_t            compressed_cache_usage() const            { return m_compressedCacheUsage; }
+
+  // Used by ChunkList to account the deflated copies; reserving
+  // evicts the oldest entries round-robin across the chunk lists
+  // until the new entry fits.
+  bool                compressed_cache_allocate(uint32_t size);
+  void                compressed_cache_deallocate(uint32_t size);
+
 
   void                insert(ChunkList* chunkList);
   void                erase(ChunkList* chunkList);
@@ -131,8 +183,29 @@ public:
   void                deallocate(uint32_t size, int flags = 0);
 
   void                try_free_memory(uint64_t size);
+
+  // Pool for Chunk allocations; main thread only, like the rest of
+  // the chunk accounting.
+  rak::memory_pool*   chunk_pool()                              { return &m_chunkPool; }
+
+  // Detach the flushable dirty chunks of a closing download and sync
+  // them on the disk thread, instead of blocking the event loop on
+  // msync. The chunks are posted back through slot_flush_done and
+  // freed on the main thread, as the chunk pool is not thread
+  // safe. Returns false if the disk thread isn't running and the
+  // caller must sync in place.
+  bool                flush_chunks_async(ChunkList* chunk_list);
+
+  // Flushes still in flight on the disk thread; clients should let
+  // this drain to zero before calling cleanup().
+  uint32_t            async_flush_count() const                 { return m_asyncFlushCount; }
+
+  void                work_flush_done();
+  slot_void&          slot_flush_done()                         { return m_slotFlushDone; }
   
   void                periodic_sync();
+  void                sample_residency();
+  void                sample_memory_pressure();
 
   // Not sure if I wnt these here. Consider implementing a generic
   // statistics API.
@@ -142,11 +215,15 @@ public:
   uint32_t            stats_not_preloaded() const               { return m_statsNotPreloaded; }
   void                inc_stats_not_preloaded()                 { m_statsNotPreloaded++; }
 
+  uint32_t            stats_compressed_hits() const             { return m_statsCompressedHits; }
+  void                inc_stats_compressed_hits()               { m_statsCompressedHits++; }
+
 private:
   ChunkManager(const ChunkManager&);
   void operator = (const ChunkManager&);
 
   void                sync_all(int flags, uint64_t target) LIBTORRENT_NO_EXPORT;
+  void                evict_compressed(uint64_t target) LIBTORRENT_NO_EXPORT;
 
   uint64_t            m_memoryUsage;
   uint64_t            m_maxMemoryUsage;
@@ -161,11 +238,31 @@ private:
   uint32_t            m_preloadMinSize;
   uint32_t            m_preloadRequiredRate;
 
+  bool                m_writeDropBehind;
+  bool                m_adviseHugepage;
+
+  uint64_t            m_residentUsage;
+  int64_t             m_timeResidencySampled;
+
+  int                 m_memoryPressure;
+  int64_t             m_timePressureSampled;
+
+  uint64_t            m_compressedCacheSize;
+  uint64_t            m_compressedCacheUsage;
+
   uint32_t            m_statsPreloaded;
   uint32_t            m_statsNotPreloaded;
+  uint32_t            m_statsCompressedHits;
 
   int32_t             m_timerStarved;
   size_type           m_lastFreed;
+
+  uint32_t                      m_asyncFlushCount;
+  std::vector<flush_list_type*> m_flushedChunks;
+  pthread_mutex_t               m_flushLock;
+  slot_void                     m_slotFlushDone;
+
+  rak::memory_pool    m_chunkPool;
 };
 
 }
@@ -41,41 +41,32 @@
 #include <rak/address_info.h>
 #include <rak/socket_address.h>
 
+#include "net/async_resolver.h"
 #include "net/listen.h"
 
 #include "connection_manager.h"
 #include "error.h"
 #include "exceptions.h"
+#include "globals.h"
 #include "manager.h"
 
 namespace torrent {
 
-// Fix TrackerUdp, etc, if this is made async.
-static ConnectionManager::slot_resolver_result_type*
-resolve_host(const char* host, int family, int socktype, ConnectionManager::slot_resolver_result_type slot) {
-  if (manager->main_thread_main()->is_current())
-    thread_base::release_global_lock();
-
-  rak::address_info* ai;
-  int err;
-
-  if ((err = rak::address_info::get_address_info(host, family, socktype, &ai)) != 0) {
-    if (manager->main_thread_main()->is_current())
-      thread_base::acquire_global_lock();
-
-    slot(NULL, err);
-    return NULL;
-  }
-
-  rak::socket_address sa;
-  sa.copy(*ai->address(), ai->length());
-  rak::address_info::free_address_info(ai);
-  
-  if (manager->main_thread_main()->is_current())
-    thread_base::acquire_global_lock();
-  
-  slot(sa.c_sockaddr(), 0);
-  return NULL;
+// How long a pool entry is skipped by the rotation after a failed
+// bind or connect on that source address.
+static const uint64_t bind_failed_cooldown_usec = 30 * 1000000;
+
+// Compare the address part only; the local port of an established
+// socket is ephemeral while pool entries hold port zero.
+static bool
+bind_address_equal(const sockaddr* lhs, const sockaddr* rhs) {
+  const rak::socket_address* lsa = rak::socket_address::cast_from(lhs);
+  const rak::socket_address* rsa = rak::socket_address::cast_from(rhs);
+
+  return
+    lsa->family() == rak::socket_address::af_inet &&
+    rsa->family() == rak::socket_address::af_inet &&
+    lsa->sa_inet()->address_n() == rsa->sa_inet()->address_n();
 }
 
 ConnectionManager::ConnectionManager() :
@@ -86,10 +77,15 @@ ConnectionManager::ConnectionManager() :
   m_sendBufferSize(0),
   m_receiveBufferSize(0),
   m_encryptionOptions(encryption_none),
+  m_bufferAutotune(false),
+
+  m_bindPoolNext(0),
 
   m_listen(new Listen),
   m_listen_port(0),
-  m_listen_backlog(SOMAXCONN) {
+  m_listen_backlog(SOMAXCONN),
+
+  m_async_resolver(new AsyncResolver) {
 
   m_bindAddress = (new rak::socket_address())->c_sockaddr();
   m_localAddress = (new rak::socket_address())->c_sockaddr();
@@ -99,7 +95,8 @@ ConnectionManager::ConnectionManager() :
   rak::socket_address::cast_from(m_localAddress)->clear();
   rak::socket_address::cast_from(m_proxyAddress)->clear();
 
-  m_slot_resolver = std::bind(&resolve_host,
+  m_slot_resolver = std::bind(&AsyncResolver::enqueue,
+                              m_async_resolver,
                               std::placeholders::_1,
                               std::placeholders::_2,
                               std::placeholders::_3,
@@ -107,11 +104,15 @@ ConnectionManager::ConnectionManager() :
 }
 
 ConnectionManager::~ConnectionManager() {
+  delete m_async_resolver;
   delete m_listen;
 
   delete m_bindAddress;
   delete m_localAddress;
   delete m_proxyAddress;
+
+  for (bind_address_list::iterator itr = m_bindPool.begin(), last = m_bindPool.end(); itr != last; itr++)
+    delete itr->address;
 }
 
 bool
@@ -168,6 +169,77 @@ ConnectionManager::set_proxy_address(const sockaddr* sa) {
   rak::socket_address::cast_from(m_proxyAddress)->copy(*rsa, rsa->length());
 }
 
+void
+ConnectionManager::add_bind_address(const sockaddr* sa) {
+  const rak::socket_address* rsa = rak::socket_address::cast_from(sa);
+
+  if (rsa->family() != rak::socket_address::af_inet)
+    throw input_error("Tried to add a bind address that is not an af_inet address.");
+
+  bind_address_entry entry;
+  entry.address = (new rak::socket_address())->c_sockaddr();
+  entry.throttles = ThrottlePair(NULL, NULL);
+  entry.failed_until = 0;
+
+  rak::socket_address::cast_from(entry.address)->copy(*rsa, rsa->length());
+
+  m_bindPool.push_back(entry);
+}
+
+void
+ConnectionManager::clear_bind_addresses() {
+  for (bind_address_list::iterator itr = m_bindPool.begin(), last = m_bindPool.end(); itr != last; itr++)
+    delete itr->address;
+
+  m_bindPool.clear();
+  m_bindPoolNext = 0;
+}
+
+const sockaddr*
+ConnectionManager::rotate_bind_address() {
+  if (m_bindPool.empty())
+    return m_bindAddress;
+
+  for (uint32_t i = 0; i < m_bindPool.size(); i++) {
+    bind_address_entry& entry = m_bindPool[m_bindPoolNext];
+    m_bindPoolNext = (m_bindPoolNext + 1) % m_bindPool.size();
+
+    if (entry.failed_until <= (uint64_t)cachedTime.usec())
+      return entry.address;
+  }
+
+  // Every uplink is on cooldown; fall back to the plain bind address
+  // so we at least keep trying.
+  return m_bindAddress;
+}
+
+void
+ConnectionManager::bind_address_failed(const sockaddr* sa) {
+  for (bind_address_list::iterator itr = m_bindPool.begin(), last = m_bindPool.end(); itr != last; itr++)
+    if (bind_address_equal(itr->address, sa))
+      itr->failed_until = cachedTime.usec() + bind_failed_cooldown_usec;
+}
+
+void
+ConnectionManager::set_bind_address_throttle(const sockaddr* sa, ThrottlePair throttles) {
+  for (bind_address_list::iterator itr = m_bindPool.begin(), last = m_bindPool.end(); itr != last; itr++)
+    if (bind_address_equal(itr->address, sa)) {
+      itr->throttles = throttles;
+      return;
+    }
+
+  throw input_error("Tried to set a throttle for an address not in the bind address pool.");
+}
+
+ThrottlePair
+ConnectionManager::bind_address_throttle(const sockaddr* sa) const {
+  for (bind_address_list::const_iterator itr = m_bindPool.begin(), last = m_bindPool.end(); itr != last; itr++)
+    if (bind_address_equal(itr->address, sa))
+      return itr->throttles;
+
+  return ThrottlePair(NULL, NULL);
+}
+
 uint32_t
 ConnectionManager::filter(const sockaddr* sa) {
   if (!m_slot_filter)
@@ -41,6 +41,7 @@
 
 #include <functional>
 #include <list>
+#include <vector>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netinet/in_systm.h>
@@ -54,6 +55,8 @@ namespace torrent {
 // First element is upload throttle, second element is download throttle.
 typedef std::pair<Throttle*, Throttle*> ThrottlePair;
 
+class AsyncResolver;
+
 class LIBTORRENT_EXPORT ConnectionManager {
 public:
   typedef uint32_t size_type;
@@ -125,11 +128,21 @@ public:
   uint32_t            receive_buffer_size() const             { return m_receiveBufferSize; }
   uint32_t            encryption_options()                    { return m_encryptionOptions; }
 
+  // When enabled the socket buffers of established connections are
+  // periodically resized to match the measured bandwidth-delay
+  // product, within the bounds below; the static sizes above only
+  // apply at socket creation.
+  bool                is_buffer_autotune() const              { return m_bufferAutotune; }
+
   void                set_max_size(size_type s)               { m_maxSize = s; }
   void                set_priority(priority_type p)           { m_priority = p; }
   void                set_send_buffer_size(uint32_t s);
   void                set_receive_buffer_size(uint32_t s);
-  void                set_encryption_options(uint32_t options); 
+  void                set_encryption_options(uint32_t options);
+  void                set_buffer_autotune(bool state)         { m_bufferAutotune = state; }
+
+  static const uint32_t buffer_autotune_min_size = (16 << 10);
+  static const uint32_t buffer_autotune_max_size = (4 << 20);
 
   // Setting the addresses creates a copy of the address.
   const sockaddr*     bind_address() const                    { return m_bindAddress; }
@@ -140,6 +153,34 @@ public:
   void                set_local_address(const sockaddr* sa);
   void                set_proxy_address(const sockaddr* sa);
 
+  // Pool of source addresses for outgoing connections on multi-homed
+  // hosts. When entries have been added new peer connects rotate over
+  // the pool, skipping any entry that recently failed, so traffic is
+  // spread across all uplinks instead of just the bind address.
+  struct bind_address_entry {
+    sockaddr*    address;
+    ThrottlePair throttles;
+    uint64_t     failed_until;
+  };
+
+  typedef std::vector<bind_address_entry> bind_address_list;
+
+  const bind_address_list& bind_addresses() const         { return m_bindPool; }
+
+  void                add_bind_address(const sockaddr* sa);
+  void                clear_bind_addresses();
+
+  // The next source address to bind an outgoing connection to; falls
+  // back to the plain bind address when the pool is empty or every
+  // entry is on failover cooldown.
+  const sockaddr*     rotate_bind_address();
+  void                bind_address_failed(const sockaddr* sa);
+
+  // Per-interface throttles, NULLs meaning the global throttle. The
+  // address must already be in the pool.
+  void                set_bind_address_throttle(const sockaddr* sa, ThrottlePair throttles);
+  ThrottlePair        bind_address_throttle(const sockaddr* sa) const;
+
   uint32_t            filter(const sockaddr* sa);
   void                set_filter(const slot_filter_type& s)   { m_slot_filter = s; }
 
@@ -178,15 +219,21 @@ private:
   uint32_t            m_sendBufferSize;
   uint32_t            m_receiveBufferSize;
   int                 m_encryptionOptions;
+  bool                m_bufferAutotune;
 
   sockaddr*           m_bindAddress;
   sockaddr*           m_localAddress;
   sockaddr*           m_proxyAddress;
 
+  bind_address_list   m_bindPool;
+  uint32_t            m_bindPoolNext;
+
   Listen*             m_listen;
   port_type           m_listen_port;
   uint32_t            m_listen_backlog;
 
+  AsyncResolver*      m_async_resolver;
+
   slot_filter_type    m_slot_filter;
   slot_resolver_type  m_slot_resolver;
   slot_throttle_type  m_slot_address_throttle;
@@ -42,6 +42,7 @@
 
 #include "peer/peer_info.h"
 #include "protocol/peer_connection_base.h"
+#include "utils/instrumentation.h"
 
 #include "block.h"
 #include "block_failed.h"
@@ -84,6 +85,8 @@ Block::insert(PeerInfo* peerInfo) {
 
   m_notStalled++;
 
+  instrumentation_alloc(INSTRUMENTATION_ALLOC_PROTOCOL, sizeof(BlockTransfer));
+
   transfer_list_type::iterator itr = m_queued.insert(m_queued.end(), new BlockTransfer());
 
   (*itr)->set_peer_info(peerInfo);
@@ -165,6 +168,8 @@ Block::erase(BlockTransfer* transfer) {
 
   transfer->set_block(NULL);
   delete transfer;
+
+  instrumentation_free(INSTRUMENTATION_ALLOC_PROTOCOL, sizeof(BlockTransfer));
 }
 
 bool
@@ -246,6 +251,12 @@ Block::completed(BlockTransfer* transfer) {
 
   m_state = STATE_COMPLETED;
 
+  // The block takes no new transfers until the chunk's hash is
+  // checked, so release the list capacity built up while it was
+  // downloading. Only the leader is kept, for later reference.
+  transfer_list_type().swap(m_queued);
+  transfer_list_type(m_transfers).swap(m_transfers);
+
   return m_parent->is_all_finished();
 }
 
@@ -331,9 +342,10 @@ void
 Block::release(BlockTransfer* transfer) {
   transfer->set_peer_info(NULL);
 
-  if (!transfer->is_valid())
+  if (!transfer->is_valid()) {
     delete transfer;
-  else
+    instrumentation_free(INSTRUMENTATION_ALLOC_PROTOCOL, sizeof(BlockTransfer));
+  } else
     // TODO: Do we need to verify that the block is 'this'?
     transfer->block()->erase(transfer);
 }
@@ -353,6 +365,7 @@ Block::invalidate_transfer(BlockTransfer* transfer) {
 
   if (transfer->peer_info() == NULL) {
     delete transfer;
+    instrumentation_free(INSTRUMENTATION_ALLOC_PROTOCOL, sizeof(BlockTransfer));
     return; // Consider if this should be an exception.
   }
 
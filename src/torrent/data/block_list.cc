@@ -49,6 +49,7 @@ BlockList::BlockList(const Piece& piece, uint32_t blockLength) :
   m_piece(piece),
   m_priority(PRIORITY_OFF),
   m_finished(0),
+  m_unfinishedStart(0),
 
   m_failed(0),
   m_attempt(0),
@@ -119,8 +119,14 @@ public:
 
   size_type           finished() const              { return m_finished; }
   void                inc_finished()                { m_finished++; }
-  void                clear_finished()              { m_finished = 0; }
-  
+  void                clear_finished()              { m_finished = 0; m_unfinishedStart = 0; }
+
+  // First block that is not finished; the cursor lets repeated
+  // delegation scans skip the completed prefix instead of re-checking
+  // it every call. Only do_all_failed() moves finished blocks back to
+  // unfinished, and it resets the cursor via clear_finished().
+  iterator            first_unfinished();
+
   uint32_t            failed() const                { return m_failed; }
 
   // Temporary, just increment for now.
@@ -146,12 +152,22 @@ private:
   priority_t          m_priority;
 
   size_type           m_finished;
+  size_type           m_unfinishedStart;
+
   uint32_t            m_failed;
   uint32_t            m_attempt;
 
   bool                m_bySeeder;
 };
 
+inline BlockList::iterator
+BlockList::first_unfinished() {
+  while (m_unfinishedStart < size() && operator[](m_unfinishedStart).is_finished())
+    m_unfinishedStart++;
+
+  return begin() + m_unfinishedStart;
+}
+
 }
 
 #endif
@@ -2,6 +2,7 @@
 #define LIBTORRENT_DATA_DOWNLOAD_DATA_H
 
 #include <functional>
+#include <string>
 
 #include <torrent/common.h>
 #include <torrent/bitfield.h>
@@ -25,7 +26,15 @@ public:
 
   typedef void (function_chunk_list_node_p)(ChunkListNode *); 
   typedef std::function<function_chunk_list_node_p> slot_chunk_list_node_p;
-  download_data() : m_wanted_chunks(0) {}
+  download_data() :
+    m_wanted_chunks(0),
+    m_write_once(false),
+    m_synced_bytes(0),
+    m_synced_chunks(0),
+    m_sync_time_usec(0),
+    m_hashed_chunks(0),
+    m_hash_wait_usec(0),
+    m_hash_faulted_bytes(0) {}
 
   const HashString&      hash() const                  { return m_hash; }
 
@@ -40,6 +49,40 @@ public:
 
   uint32_t               wanted_chunks() const         { return m_wanted_chunks; }
 
+  // Downloaded data won't be read back soon, so drop verified and
+  // flushed chunks from the page cache.
+  bool                   is_write_once() const         { return m_write_once; }
+
+  // Disk I/O accounting for this download, updated by the chunk list
+  // and hash queue on the main thread. Lets clients see which
+  // download is saturating the disks.
+  uint64_t               synced_bytes() const          { return m_synced_bytes; }
+  uint32_t               synced_chunks() const         { return m_synced_chunks; }
+  uint64_t               sync_time_usec() const        { return m_sync_time_usec; }
+
+  // Optional CRC32C shadow of the verified chunk payloads, four
+  // big-endian bytes per chunk with zero meaning no checksum
+  // recorded. Updated as chunks pass SHA1 verification and persisted
+  // with the resume data, so an integrity sweep can run a cheap
+  // checksum pass at memory bandwidth and only escalate mismatching
+  // chunks to a full rehash.
+  bool                   has_chunk_crc32c() const      { return !m_chunk_crc32c.empty(); }
+  const std::string&     chunk_crc32c() const          { return m_chunk_crc32c; }
+
+  uint32_t               chunk_crc32c_value(uint32_t index) const;
+  void                   set_chunk_crc32c_value(uint32_t index, uint32_t crc);
+
+  void                   set_chunk_crc32c(const std::string& shadow) { m_chunk_crc32c = shadow; }
+  void                   enable_chunk_crc32c(uint32_t chunk_count) { m_chunk_crc32c.assign(4 * (size_t)chunk_count, '\0'); }
+  void                   disable_chunk_crc32c()        { m_chunk_crc32c.clear(); }
+
+  uint32_t               hashed_chunks() const         { return m_hashed_chunks; }
+  uint64_t               hash_wait_usec() const        { return m_hash_wait_usec; }
+  uint64_t               hash_faulted_bytes() const    { return m_hash_faulted_bytes; }
+
+  void                   add_synced(uint32_t bytes, uint64_t time_usec) { m_synced_bytes += bytes; m_synced_chunks++; m_sync_time_usec += time_usec; }
+  void                   add_hashed(uint64_t wait_usec, uint32_t faulted_bytes) { m_hashed_chunks++; m_hash_wait_usec += wait_usec; m_hash_faulted_bytes += faulted_bytes; }
+
   uint32_t               calc_wanted_chunks() const;
   void                   verify_wanted_chunks(const char* where) const;
 
@@ -64,6 +107,8 @@ protected:
   priority_ranges*       mutable_high_priority()       { return &m_high_priority; }
   priority_ranges*       mutable_normal_priority()     { return &m_normal_priority; }
 
+  void                   set_write_once(bool state)    { m_write_once = state; }
+
   void                   update_wanted_chunks()        { m_wanted_chunks = calc_wanted_chunks(); }
   void                   set_wanted_chunks(uint32_t n) { m_wanted_chunks = n; }
 
@@ -81,6 +126,17 @@ private:
   priority_ranges        m_normal_priority;
 
   uint32_t               m_wanted_chunks;
+  bool                   m_write_once;
+
+  uint64_t               m_synced_bytes;
+  uint32_t               m_synced_chunks;
+  uint64_t               m_sync_time_usec;
+
+  uint32_t               m_hashed_chunks;
+  uint64_t               m_hash_wait_usec;
+  uint64_t               m_hash_faulted_bytes;
+
+  std::string            m_chunk_crc32c;
 
   mutable slot_void      m_slot_initial_hash;
   mutable slot_void      m_slot_download_done;
@@ -89,6 +145,23 @@ private:
   mutable slot_chunk_list_node_p m_slot_chunk_done;
 };
 
+inline uint32_t
+download_data::chunk_crc32c_value(uint32_t index) const {
+  const unsigned char* src = (const unsigned char*)m_chunk_crc32c.data() + 4 * (size_t)index;
+
+  return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8) | (uint32_t)src[3];
+}
+
+inline void
+download_data::set_chunk_crc32c_value(uint32_t index, uint32_t crc) {
+  char* dest = &m_chunk_crc32c[4 * (size_t)index];
+
+  dest[0] = crc >> 24;
+  dest[1] = crc >> 16;
+  dest[2] = crc >> 8;
+  dest[3] = crc;
+}
+
 }
 
 #endif // LIBTORRENT_DATA_DOWNLOAD_DATA_H
@@ -36,6 +36,7 @@
 
 #include "config.h"
 
+#include <unistd.h>
 #include <rak/error_number.h>
 #include <rak/file_stat.h>
 
@@ -68,6 +69,9 @@ File::File() :
   m_size(0),
   m_lastTouched(cachedTime.usec()),
 
+  m_lruPrev(NULL),
+  m_lruNext(NULL),
+
   m_completed(0),
   m_priority(PRIORITY_NORMAL),
 
@@ -117,8 +121,10 @@ File::prepare(int prot, int flags) {
   // set. If so don't quit as we need to try re-sizing, instead call
   // resize_file.
 
-  if (is_open() && has_permissions(prot))
+  if (is_open() && has_permissions(prot)) {
+    manager->file_manager()->lru_touch(this);
     return true;
+  }
 
   // For now don't allow overridding this check in prepare.
   if (m_flags & flag_create_queued)
@@ -177,16 +183,32 @@ File::resize_file() {
   if (m_size == SocketFile(m_fd).size())
     return true;
 
-  int flags = 0;
-
-  // Set FS supported non-blocking allocation flag and potentially
-  // blocking allocation flag if fallocate flag is set.
   if (m_flags & flag_fallocate) {
-    flags |= SocketFile::flag_fallocate;
-    flags |= SocketFile::flag_fallocate_blocking;
+    // Make the file usable at full size right away, then hand the
+    // potentially slow block allocation to the disk thread so torrent
+    // start doesn't stall on large payloads.
+    if (!SocketFile(m_fd).set_size(m_size, 0))
+      return false;
+
+    int fd;
+
+    if (manager->main_thread_disk()->is_active() && (fd = dup(m_fd)) != -1) {
+      uint64_t size = m_size;
+
+      manager->main_thread_disk()->push_job([fd, size] () {
+          SocketFile file(fd);
+          file.set_size(size, SocketFile::flag_fallocate | SocketFile::flag_fallocate_blocking);
+          file.close();
+        });
+      manager->main_thread_disk()->interrupt();
+
+      return true;
+    }
+
+    return SocketFile(m_fd).set_size(m_size, SocketFile::flag_fallocate | SocketFile::flag_fallocate_blocking);
   }
 
-  return SocketFile(m_fd).set_size(m_size, flags);
+  return SocketFile(m_fd).set_size(m_size, 0);
 }
 
 }
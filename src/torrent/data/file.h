@@ -115,6 +115,13 @@ public:
   uint64_t            last_touched() const                     { return m_lastTouched; }
   void                set_last_touched(uint64_t t)             { m_lastTouched = t; }
 
+  // Intrusive links for the FileManager's LRU over open files. Only
+  // changed by libtorrent.
+  File*               lru_prev() const                         { return m_lruPrev; }
+  File*               lru_next() const                         { return m_lruNext; }
+  void                set_lru_prev(File* file)                 { m_lruPrev = file; }
+  void                set_lru_next(File* file)                 { m_lruNext = file; }
+
 protected:
   void                set_flags_protected(int flags)           { m_flags |= flags; }
   void                unset_flags_protected(int flags)         { m_flags &= ~flags; }
@@ -150,6 +157,9 @@ private:
   uint64_t            m_size;
   uint64_t            m_lastTouched;
 
+  File*               m_lruPrev;
+  File*               m_lruNext;
+
   range_type          m_range;
 
   uint32_t            m_completed;
@@ -37,8 +37,10 @@
 #include "config.h"
 
 #include <algorithm>
+#include <cerrno>
 #include <cstring>
 #include <functional>
+#include <unistd.h>
 #include <limits>
 #include <memory>
 #include <set>
@@ -51,6 +53,7 @@
 #include "data/memory_chunk.h"
 #include "data/socket_file.h"
 
+#include "torrent/chunk_manager.h"
 #include "torrent/exceptions.h"
 #include "torrent/path.h"
 #include "torrent/utils/log.h"
@@ -113,7 +116,7 @@ bool
 FileList::is_root_dir_created() const {
   rak::file_stat fs;
 
-  if (!fs.update(m_rootDir))
+  if (!fs.update(m_rootDir.str()))
 //     return rak::error_number::current() == rak::error_number::e_access;
     return false;
 
@@ -405,7 +408,7 @@ FileList::open(int flags) {
   if (m_rootDir.empty())
     throw internal_error("FileList::open() m_rootDir.empty().", data()->hash());
 
-  m_indirectLinks.push_back(m_rootDir);
+  m_indirectLinks.push_back(m_rootDir.str());
 
   Path lastPath;
   path_set pathSet;
@@ -414,7 +417,7 @@ FileList::open(int flags) {
 
   try {
     if (!(flags & open_no_create) && !make_root_path())
-      throw storage_error("Could not create directory '" + m_rootDir + "': " + std::strerror(errno));
+      throw storage_error("Could not create directory '" + m_rootDir.str() + "': " + std::strerror(errno));
   
     for (itr = begin(); itr != end(); ++itr) {
       File* entry = *itr;
@@ -433,7 +436,7 @@ FileList::open(int flags) {
       if (entry->path()->back().empty())
         entry->set_frozen_path(std::string());
       else
-        entry->set_frozen_path(m_rootDir + entry->path()->as_string());
+        entry->set_frozen_path(m_rootDir.str() + entry->path()->as_string());
 
       if (!pathSet.insert(entry->frozen_path().c_str()).second)
         throw storage_error("Duplicate filename found.");
@@ -499,6 +502,24 @@ FileList::open(int flags) {
   }
 }
 
+void
+FileList::prepare_active_files() {
+  // Re-open handles the file manager evicted while the download sat
+  // idle, in one batch, so the first chunk accesses after activation
+  // don't each fault an open() through the chunk mapping path. Leave
+  // a quarter of the global budget to the LRU so a single large
+  // torrent can't flush every other download's handles.
+  FileManager* fileManager = manager->file_manager();
+
+  for (iterator itr = begin(), last = end(); itr != last; ++itr) {
+    if (fileManager->open_files() >= fileManager->max_open_files() - fileManager->max_open_files() / 4)
+      break;
+
+    if (!(*itr)->is_open())
+      (*itr)->prepare(MemoryChunk::prot_read, 0);
+  }
+}
+
 void
 FileList::close() {
   if (!is_open())
@@ -519,7 +540,7 @@ FileList::close() {
 
 void
 FileList::make_directory(Path::const_iterator pathBegin, Path::const_iterator pathEnd, Path::const_iterator startItr) {
-  std::string path = m_rootDir;
+  std::string path = m_rootDir.str();
 
   while (pathBegin != pathEnd) {
     path += "/" + *pathBegin;
@@ -594,7 +615,12 @@ FileList::create_chunk_part(FileList::iterator itr, uint64_t offset, uint32_t le
   if (!(*itr)->prepare(prot))
     return MemoryChunk();
 
-  return SocketFile((*itr)->file_descriptor()).create_chunk(offset, length, prot, MemoryChunk::map_shared);
+  MemoryChunk mc = SocketFile((*itr)->file_descriptor()).create_chunk(offset, length, prot, MemoryChunk::map_shared);
+
+  if (mc.is_valid() && manager->chunk_manager()->advise_hugepage())
+    mc.advise(0, mc.size(), MemoryChunk::advice_hugepage);
+
+  return mc;
 }
 
 Chunk*
@@ -716,6 +742,69 @@ FileList::update_completed() {
   }
 }
 
+void
+FileList::cull_hole_chunks(ranges<uint32_t>* hash_ranges) {
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+  ranges<uint32_t> data_chunks;
+
+  for (iterator itr = begin(), last = end(); itr != last; itr++) {
+    File* file = *itr;
+
+    if (file->size_bytes() == 0)
+      continue;
+
+    // Files that can't be opened get skipped by the hash check
+    // through the normal missing file path.
+    if (!file->prepare(MemoryChunk::prot_read, 0))
+      continue;
+
+    int fd = file->file_descriptor();
+
+    uint64_t pos = 0;
+
+    while (pos < file->size_bytes()) {
+      off_t data_begin = lseek(fd, pos, SEEK_DATA);
+
+      if (data_begin == (off_t)-1) {
+        // ENXIO means no data beyond this point; any other error,
+        // e.g. a file system without hole reporting, conservatively
+        // treats the rest of the file as data.
+        if (errno != ENXIO)
+          data_chunks.insert((uint32_t)((file->offset() + pos) / chunk_size()),
+                             (uint32_t)((file->offset() + file->size_bytes() + chunk_size() - 1) / chunk_size()));
+
+        break;
+      }
+
+      off_t data_end = lseek(fd, data_begin, SEEK_HOLE);
+
+      if (data_end == (off_t)-1 || (uint64_t)data_end > file->size_bytes())
+        data_end = file->size_bytes();
+
+      data_chunks.insert((uint32_t)((file->offset() + data_begin) / chunk_size()),
+                         (uint32_t)((file->offset() + data_end + chunk_size() - 1) / chunk_size()));
+
+      pos = data_end;
+    }
+  }
+
+  // Erase the gaps between data-carrying chunk ranges; a valid chunk
+  // written as all zeroes may in rare cases be stored as a hole and
+  // will then be treated as missing, which is safe.
+  uint32_t pos = 0;
+
+  for (ranges<uint32_t>::iterator itr = data_chunks.begin(), last = data_chunks.end(); itr != last; itr++) {
+    if (pos < itr->first)
+      hash_ranges->erase(pos, itr->first);
+
+    pos = itr->second;
+  }
+
+  if (pos < size_chunks())
+    hash_ranges->erase(pos, size_chunks());
+#endif
+}
+
 void
 FileList::reset_filesize(int64_t size) {
   LT_LOG_FL(INFO, "Resetting torrent size: size:%" PRIi64 ".", size);
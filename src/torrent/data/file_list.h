@@ -44,6 +44,8 @@
 #include <torrent/path.h>
 #include <torrent/data/file.h>
 #include <torrent/data/download_data.h>
+#include <torrent/utils/intern_pool.h>
+#include <torrent/utils/ranges.h>
 
 namespace torrent {
 
@@ -121,8 +123,11 @@ public:
   const Bitfield*      bitfield() const                               { return m_data.completed_bitfield(); }
 
   // You may only call set_root_dir after all nodes have been added.
-  const std::string&  root_dir() const                                { return m_rootDir; }
-  const std::string&  frozen_root_dir() const                         { return m_frozenRootDir; }
+  //
+  // Most downloads share the same download directory, so the root dir
+  // is interned in the session-wide pool.
+  const std::string&  root_dir() const                                { return m_rootDir.str(); }
+  const std::string&  frozen_root_dir() const                         { return m_frozenRootDir.str(); }
   void                set_root_dir(const std::string& path);
 
   uint64_t            max_file_size() const                           { return m_maxFileSize; }
@@ -160,6 +165,8 @@ protected:
   void                open(int flags) LIBTORRENT_NO_EXPORT;
   void                close() LIBTORRENT_NO_EXPORT;
 
+  void                prepare_active_files() LIBTORRENT_NO_EXPORT;
+
   download_data*      mutable_data()                                   { return &m_data; }
 
   // Before calling this function, make sure you clear errno. If
@@ -171,6 +178,11 @@ protected:
   iterator            inc_completed(iterator firstItr, uint32_t index) LIBTORRENT_NO_EXPORT;
   void                update_completed() LIBTORRENT_NO_EXPORT;
 
+  // Erase chunk ranges that lie entirely within file system holes
+  // from 'hash_ranges'; such chunks were never written and cannot
+  // pass the hash check.
+  void                cull_hole_chunks(ranges<uint32_t>* hash_ranges) LIBTORRENT_NO_EXPORT;
+
   // Used for meta downloads; we only know the
   // size after the first extension handshake.
   void                reset_filesize(int64_t) LIBTORRENT_NO_EXPORT;
@@ -188,13 +200,13 @@ private:
   uint32_t            m_chunkSize;
   uint64_t            m_maxFileSize;
 
-  std::string         m_rootDir;
+  interned_string     m_rootDir;
 
   path_list           m_indirectLinks;
 
   // Reorder next minor version bump:
   bool                m_isMultiFile;
-  std::string         m_frozenRootDir;
+  interned_string     m_frozenRootDir;
 };
 
 inline FileList::iterator
@@ -49,6 +49,8 @@ namespace torrent {
 
 FileManager::FileManager() :
   m_maxOpenFiles(0),
+  m_lruFront(NULL),
+  m_lruBack(NULL),
   m_filesOpenedCounter(0),
   m_filesClosedCounter(0),
   m_filesFailedCounter(0) {}
@@ -90,6 +92,7 @@ FileManager::open(value_type file, int prot, int flags) {
   file->set_protection(prot);
   file->set_file_descriptor(fd.fd());
   base_type::push_back(file);
+  lru_insert(file);
 
   // Consider storing the position of the file here.
 
@@ -106,7 +109,8 @@ FileManager::close(value_type file) {
 
   file->set_protection(0);
   file->set_file_descriptor(-1);
-  
+  lru_remove(file);
+
   iterator itr = std::find(begin(), end(), file);
 
   if (itr == end())
@@ -118,23 +122,50 @@ FileManager::close(value_type file) {
   m_filesClosedCounter++;
 }
 
-struct FileManagerActivity {
-  FileManagerActivity() : m_last(rak::timer::max().usec()), m_file(NULL) {}
+void
+FileManager::close_least_active() {
+  if (m_lruFront == NULL)
+    throw internal_error("FileManager::close_least_active() called with no open files.");
 
-  void operator ()(File* f) {
-    if (f->is_open() && f->last_touched() <= m_last) {
-      m_last = f->last_touched();
-      m_file = f;
-    }
-  }
+  close(m_lruFront);
+}
 
-  uint64_t   m_last;
-  File*      m_file;
-};
+void
+FileManager::lru_touch(value_type file) {
+  if (m_lruBack == file)
+    return;
+
+  lru_remove(file);
+  lru_insert(file);
+}
 
 void
-FileManager::close_least_active() {
-  close(std::for_each(begin(), end(), FileManagerActivity()).m_file);
+FileManager::lru_insert(value_type file) {
+  file->set_lru_prev(m_lruBack);
+  file->set_lru_next(NULL);
+
+  if (m_lruBack != NULL)
+    m_lruBack->set_lru_next(file);
+  else
+    m_lruFront = file;
+
+  m_lruBack = file;
+}
+
+void
+FileManager::lru_remove(value_type file) {
+  if (file->lru_prev() != NULL)
+    file->lru_prev()->set_lru_next(file->lru_next());
+  else
+    m_lruFront = file->lru_next();
+
+  if (file->lru_next() != NULL)
+    file->lru_next()->set_lru_prev(file->lru_prev());
+  else
+    m_lruBack = file->lru_prev();
+
+  file->set_lru_prev(NULL);
+  file->set_lru_next(NULL);
 }
 
 }
@@ -71,6 +71,10 @@ public:
 
   void                close_least_active();
 
+  // Move the file to the most-recently-used end of the LRU; called
+  // when an already open file is touched through File::prepare().
+  void                lru_touch(value_type file);
+
   // Statistics:
   uint64_t            files_opened_counter() const { return m_filesOpenedCounter; }
   uint64_t            files_closed_counter() const { return m_filesClosedCounter; }
@@ -80,8 +84,16 @@ private:
   FileManager(const FileManager&) LIBTORRENT_NO_EXPORT;
   void operator = (const FileManager&) LIBTORRENT_NO_EXPORT;
 
+  void                lru_insert(value_type file) LIBTORRENT_NO_EXPORT;
+  void                lru_remove(value_type file) LIBTORRENT_NO_EXPORT;
+
   size_type           m_maxOpenFiles;
 
+  // Intrusive LRU over the open files, linked through File's lru
+  // pointers with the least recently used file at the front.
+  value_type          m_lruFront;
+  value_type          m_lruBack;
+
   uint64_t            m_filesOpenedCounter;
   uint64_t            m_filesClosedCounter;
   uint64_t            m_filesFailedCounter;
@@ -68,12 +68,16 @@ TransferList::~TransferList() {
 
 TransferList::iterator
 TransferList::find(uint32_t index) {
-  return std::find_if(begin(), end(), rak::equal(index, std::mem_fun(&BlockList::index)));
+  index_map_type::const_iterator itr = m_indexMap.find(index);
+
+  return itr != m_indexMap.end() ? begin() + itr->second : end();
 }
 
 TransferList::const_iterator
 TransferList::find(uint32_t index) const {
-  return std::find_if(begin(), end(), rak::equal(index, std::mem_fun(&BlockList::index)));
+  index_map_type::const_iterator itr = m_indexMap.find(index);
+
+  return itr != m_indexMap.end() ? begin() + itr->second : end();
 }
 
 void
@@ -82,6 +86,7 @@ TransferList::clear() {
   std::for_each(begin(), end(), rak::call_delete<BlockList>());
 
   base_type::clear();
+  m_indexMap.clear();
 }
 
 TransferList::iterator
@@ -90,9 +95,11 @@ TransferList::insert(const Piece& piece, uint32_t blockSize) {
     throw internal_error("Delegator::new_chunk(...) received an index that is already delegated.");
 
   BlockList* blockList = new BlockList(piece, blockSize);
-  
+
   m_slot_queued(piece.index());
 
+  m_indexMap[piece.index()] = base_type::size();
+
   return base_type::insert(end(), blockList);
 }
 
@@ -103,6 +110,14 @@ TransferList::erase(iterator itr) {
   if (itr == end())
     throw internal_error("TransferList::erase(...) itr == m_chunks.end().");
 
+  // The erase shifts the vector, so positions past the erased entry
+  // are adjusted along with it.
+  m_indexMap.erase((*itr)->index());
+
+  for (index_map_type::iterator mapItr = m_indexMap.begin(), mapLast = m_indexMap.end(); mapItr != mapLast; mapItr++)
+    if (mapItr->second > (base_type::size_type)std::distance(begin(), itr))
+      mapItr->second--;
+
   delete *itr;
 
   return base_type::erase(itr);
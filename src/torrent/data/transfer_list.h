@@ -38,6 +38,7 @@
 #define LIBTORRENT_TRANSFER_LIST_H
 
 #include <functional>
+#include <map>
 #include <vector>
 
 #include <torrent/common.h>
@@ -48,6 +49,7 @@ class TransferList : public std::vector<BlockList*> {
 public:
   typedef std::vector<BlockList*>                    base_type;
   typedef std::vector<std::pair<int64_t, uint32_t> > completed_list_type;
+  typedef std::map<uint32_t, base_type::size_type>   index_map_type;
 
   using base_type::value_type;
   using base_type::reference;
@@ -114,6 +116,11 @@ private:
 
   completed_list_type m_completedList;
 
+  // Maps chunk index to position in the vector so in-flight chunks
+  // can be resolved without scanning the whole list. Positions are
+  // adjusted on erase, which already shifts the vector.
+  index_map_type      m_indexMap;
+
   uint32_t            m_succeededCount;
   uint32_t            m_failedCount;
 };
@@ -86,6 +86,7 @@ const uint32_t DownloadInfo::unlimited;
 
 const DownloadInfo* Download::info() const { return m_ptr->info(); }
 const download_data* Download::data() const { return m_ptr->data(); }
+download_data*       Download::mutable_data() { return m_ptr->data(); }
 
 void
 Download::open(int flags) {
@@ -212,6 +213,10 @@ Download::hash_check(bool tryQuick) {
 
   m_ptr->main()->file_list()->update_completed();
 
+  // Chunk ranges that are provably file system holes were never
+  // written, so checking them would just hash zeroes.
+  m_ptr->main()->file_list()->cull_hole_chunks(&m_ptr->hash_checker()->hashing_ranges());
+
   return m_ptr->hash_checker()->start(tryQuick);
 }
 
@@ -247,6 +252,11 @@ Download::set_pex_enabled(bool enabled) {
     m_ptr->info()->unset_flags(DownloadInfo::flag_pex_enabled);
 }
 
+void
+Download::set_write_once(bool state) {
+  m_ptr->data()->set_write_once(state);
+}
+
 Object*
 Download::bencode() {
   return m_ptr->bencode();
@@ -594,6 +604,17 @@ Download::update_priorities() {
   m_ptr->receive_update_priorities();
 }
 
+bool
+Download::is_sequential_enabled() const {
+  return m_ptr->main()->chunk_selector()->is_sequential();
+}
+
+void
+Download::set_sequential_enabled(bool state) {
+  m_ptr->main()->chunk_selector()->set_sequential(state);
+  m_ptr->main()->delegator()->set_streaming(state);
+}
+
 void
 Download::add_peer(const sockaddr* sa, int port) {
   if (m_ptr->info()->is_private())
@@ -73,6 +73,7 @@ public:
 
   const DownloadInfo*  info() const;
   const download_data* data() const;
+  download_data*       mutable_data();
 
   // Not active atm. Opens and prepares/closes the files.
   void                open(int flags = 0);
@@ -99,6 +100,10 @@ public:
 
   void                set_pex_enabled(bool enabled);
 
+  // Mark the download as write-once; verified and flushed chunks are
+  // dropped from the page cache as they won't be read back soon.
+  void                set_write_once(bool state);
+
   Object*             bencode();
   const Object*       bencode() const;
 
@@ -197,6 +202,13 @@ public:
   // all the peer bitfields to see if we are still interested.
   void                update_priorities();
 
+  // Streaming mode: chunks are selected in rough file order within a
+  // window at the in-order edge, and window blocks lingering past a
+  // deadline are requested from additional peers. Rarest-first still
+  // applies to peers that don't have the window.
+  bool                is_sequential_enabled() const;
+  void                set_sequential_enabled(bool state);
+
   void                add_peer(const sockaddr* addr, int port);
 
   DownloadWrapper*    ptr() { return m_ptr; }
@@ -53,8 +53,16 @@ namespace torrent {
 choke_group::choke_group() :
   m_tracker_mode(TRACKER_MODE_NORMAL),
   m_down_queue(choke_queue::flag_unchoke_all_new),
+  m_up_deficit(0), m_down_deficit(0),
   m_first(NULL), m_last(NULL) { }
 
+uint32_t
+choke_group::weight() const {
+  return
+    std::for_each(m_first, m_last,
+                  rak::accumulate((uint32_t)0, std::mem_fun_ref(&resource_manager_entry::priority))).result;
+}
+
 uint64_t
 choke_group::up_rate() const {
   return
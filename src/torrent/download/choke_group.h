@@ -84,6 +84,20 @@ public:
   unsigned int        up_unchoked() const   { return m_up_queue.size_unchoked(); }
   unsigned int        down_unchoked() const { return m_down_queue.size_unchoked(); }
 
+  // Sum of the priorities of this group's entries; the resource
+  // manager hands out unchoke slots in proportion to it.
+  uint32_t            weight() const;
+
+  // Fractional quota left over from the previous balance cycle, in
+  // units of 1/total-weight of a slot. Carrying it forward lets
+  // low-weight groups accumulate credit until they earn a whole slot
+  // instead of rounding to zero every cycle.
+  uint32_t            up_deficit() const                 { return m_up_deficit; }
+  uint32_t            down_deficit() const               { return m_down_deficit; }
+
+  void                set_up_deficit(uint32_t deficit)   { m_up_deficit = deficit; }
+  void                set_down_deficit(uint32_t deficit) { m_down_deficit = deficit; }
+
   // Internal:
 
   resource_manager_entry* first() { return m_first; }
@@ -102,6 +116,9 @@ private:
   choke_queue             m_up_queue;
   choke_queue             m_down_queue;
 
+  uint32_t                m_up_deficit;
+  uint32_t                m_down_deficit;
+
   resource_manager_entry* m_first;
   resource_manager_entry* m_last;
 };
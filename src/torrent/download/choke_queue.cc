@@ -8,6 +8,7 @@
 
 #include "protocol/peer_connection_base.h"
 #include "torrent/download/group_entry.h"
+#include "utils/tracepoints.h"
 #include "torrent/peer/connection_list.h"
 #include "torrent/peer/choke_status.h"
 #include "torrent/utils/log.h"
@@ -24,6 +25,43 @@ struct choke_manager_less {
   bool operator () (choke_queue::value_type v1, choke_queue::value_type v2) const { return v1.weight < v2.weight; }
 };
 
+// The group containers keep their order from the previous cycle and
+// the rate-based weights only drift between cycles, so the input is
+// typically nearly sorted. Insertion sort handles that in linear time
+// where std::sort always pays the full n log n; a displacement budget
+// bails out to std::sort when the order has actually churned, e.g.
+// the randomized optimistic unchoke weights.
+static void
+choke_manager_sort_weights(choke_queue::iterator first, choke_queue::iterator last) {
+  if (std::distance(first, last) < 2)
+    return;
+
+  uint32_t budget = 2 * std::distance(first, last);
+
+  for (choke_queue::iterator itr = first + 1; itr != last && budget != 0; itr++) {
+    choke_queue::value_type value = *itr;
+    choke_queue::iterator   pos = itr;
+
+    while (pos != first && value.weight < (pos - 1)->weight && budget != 0) {
+      *pos = *(pos - 1);
+      pos--;
+      budget--;
+    }
+
+    *pos = value;
+  }
+
+  if (budget == 0)
+    std::sort(first, last, choke_manager_less());
+
+  // Every caller passes a whole group_entry container, so the offset
+  // from 'first' is the element's index; rebuild the indices stored
+  // in the choke_status objects now that the elements have stopped
+  // moving.
+  for (choke_queue::iterator itr = first; itr != last; itr++)
+    itr->status->set_entry_index(itr - first);
+}
+
 static inline bool
 should_connection_unchoke(choke_queue* cq, PeerConnectionBase* pcb) {
   return pcb->should_connection_unchoke(cq);
@@ -61,6 +99,34 @@ choke_queue::max_alternate() const {
     return (m_currently_unchoked + 9) / 10;
 }
 
+// Snapshot both throttle rates into the entries before weighing, so
+// the heuristics read them cache-linearly from the containers they
+// iterate anyway.
+static void
+choke_queue_snapshot_rates(choke_queue::iterator first, choke_queue::iterator last) {
+  while (first != last) {
+    first->down_rate    = first->connection->peer_chunks()->download_throttle()->rate()->rate_ewma();
+    first->up_rate      = first->connection->peer_chunks()->upload_throttle()->rate()->rate_ewma();
+    first->write_queued = first->connection->write_queue_size();
+
+    first++;
+  }
+}
+
+void
+choke_queue::weigh_connections() {
+  for (group_container_type::iterator itr = m_group_container.begin(), last = m_group_container.end(); itr != last; itr++) {
+    choke_queue_snapshot_rates((*itr)->mutable_unchoked()->begin(), (*itr)->mutable_unchoked()->end());
+    choke_queue_snapshot_rates((*itr)->mutable_queued()->begin(), (*itr)->mutable_queued()->end());
+
+    m_heuristics_list[m_heuristics].slot_choke_weight((*itr)->mutable_unchoked()->begin(), (*itr)->mutable_unchoked()->end());
+    choke_manager_sort_weights((*itr)->mutable_unchoked()->begin(), (*itr)->mutable_unchoked()->end());
+
+    m_heuristics_list[m_heuristics].slot_unchoke_weight((*itr)->mutable_queued()->begin(), (*itr)->mutable_queued()->end());
+    choke_manager_sort_weights((*itr)->mutable_queued()->begin(), (*itr)->mutable_queued()->end());
+  }
+}
+
 group_stats
 choke_queue::prepare_weights(group_stats gs) {
   // gs.sum_min_needed = 0;
@@ -70,12 +136,6 @@ choke_queue::prepare_weights(group_stats gs) {
   // also remember to clear the queue/unchoked thingies.
 
   for (group_container_type::iterator itr = m_group_container.begin(), last = m_group_container.end(); itr != last; itr++) {
-    m_heuristics_list[m_heuristics].slot_choke_weight((*itr)->mutable_unchoked()->begin(), (*itr)->mutable_unchoked()->end());
-    std::sort((*itr)->mutable_unchoked()->begin(), (*itr)->mutable_unchoked()->end(), choke_manager_less());
-
-    m_heuristics_list[m_heuristics].slot_unchoke_weight((*itr)->mutable_queued()->begin(), (*itr)->mutable_queued()->end());
-    std::sort((*itr)->mutable_queued()->begin(), (*itr)->mutable_queued()->end(), choke_manager_less());
-
     // Aggregate the statistics... Remember to update them after
     // optimistic/pessimistic unchokes.
     gs.sum_min_needed += std::min((*itr)->size_connections(), std::min((*itr)->min_slots(), (*itr)->max_slots()));
@@ -148,22 +208,13 @@ choke_queue::retrieve_connections(group_stats gs, container_type* queued, contai
   return gs;
 }
 
-void
-choke_queue::rebuild_containers(container_type* queued, container_type* unchoked) {
-  queued->clear();
-  unchoked->clear();
-
-  for (group_container_type::iterator itr = m_group_container.begin(), last = m_group_container.end(); itr != last; itr++) {
-    queued->insert(queued->end(), (*itr)->queued()->begin(), (*itr)->queued()->end());
-    unchoked->insert(unchoked->end(), (*itr)->unchoked()->begin(), (*itr)->unchoked()->end());
-  }
-}
-
 void
 choke_queue::balance() {
   LT_LOG_THIS("balancing queue: heuristics:%i currently_unchoked:%" PRIu32 " max_unchoked:%" PRIu32,
               m_heuristics, m_currently_unchoked, m_maxUnchoked)
 
+  LT_SDT2(choke_balance_begin, m_currently_unchoked, m_maxUnchoked);
+
   // Return if no balancing is needed. Don't return if is_unlimited()
   // as we might have just changed the value and have interested that
   // can be unchoked.
@@ -179,6 +230,8 @@ choke_queue::balance() {
   group_stats gs;
   std::memset(&gs, 0, sizeof(group_stats));
 
+  weigh_connections();
+
   gs = prepare_weights(gs);
   gs = retrieve_connections(gs, &queued, &unchoked);
 
@@ -214,17 +267,22 @@ choke_queue::balance() {
   if (result != 0)
     m_slotUnchoke(result);
 
+  LT_SDT2(choke_balance_end, adjust, result);
+
   LT_LOG_THIS("balanced queue: adjust:%i can_unchoke:%i queued:%" PRIu32 " unchoked:%" PRIu32 " result:%i",
                adjust, can_unchoke, queued.size(), unchoked.size(), result);
 }
 
 void
 choke_queue::balance_entry(group_entry* entry) {
+  choke_queue_snapshot_rates(entry->mutable_unchoked()->begin(), entry->mutable_unchoked()->end());
+  choke_queue_snapshot_rates(entry->mutable_queued()->begin(), entry->mutable_queued()->end());
+
   m_heuristics_list[m_heuristics].slot_choke_weight(entry->mutable_unchoked()->begin(), entry->mutable_unchoked()->end());
-  std::sort(entry->mutable_unchoked()->begin(), entry->mutable_unchoked()->end(), choke_manager_less());
+  choke_manager_sort_weights(entry->mutable_unchoked()->begin(), entry->mutable_unchoked()->end());
 
   m_heuristics_list[m_heuristics].slot_unchoke_weight(entry->mutable_queued()->begin(), entry->mutable_queued()->end());
-  std::sort(entry->mutable_queued()->begin(), entry->mutable_queued()->end(), choke_manager_less());
+  choke_manager_sort_weights(entry->mutable_queued()->begin(), entry->mutable_queued()->end());
 
   int count = 0;
   unsigned int min_slots = std::min(entry->min_slots(), entry->max_slots());
@@ -243,16 +301,18 @@ choke_queue::cycle(uint32_t quota) {
   // TODO: This should not use the old values, but rather the number
   // of unchoked this round.
   // HACKKKKKK
-  container_type queued;
-  container_type unchoked;
+  //
+  // Only the aggregate count is needed here, so sum the group sizes
+  // instead of rebuilding the full containers.
+  int oldSize = 0;
 
-  rebuild_containers(&queued, &unchoked);
+  for (group_container_type::iterator itr = m_group_container.begin(), last = m_group_container.end(); itr != last; itr++)
+    oldSize += (*itr)->unchoked()->size();
 
-  int oldSize = unchoked.size();
   uint32_t alternate = max_alternate();
 
-  queued.clear();
-  unchoked.clear();
+  container_type queued;
+  container_type unchoked;
 
   group_stats gs;
   std::memset(&gs, 0, sizeof(group_stats));
@@ -280,12 +340,20 @@ choke_queue::cycle(uint32_t quota) {
   if (unchoked.size() > quota)
     throw internal_error("choke_queue::cycle() unchoked.size() > quota.");
 
-  rebuild_containers(&queued, &unchoked); // Remove...
+  // Same here; the groups already hold the result, so sum their sizes
+  // rather than copying every connection back out.
+  uint32_t newQueued = 0;
+  uint32_t newUnchoked = 0;
+
+  for (group_container_type::iterator itr = m_group_container.begin(), last = m_group_container.end(); itr != last; itr++) {
+    newQueued += (*itr)->queued()->size();
+    newUnchoked += (*itr)->unchoked()->size();
+  }
 
   lt_log_print(LOG_PEER_DEBUG, "After cycle; queued:%u unchoked:%u unchoked_count:%i old_size:%i.",
-               (unsigned)queued.size(), (unsigned)unchoked.size(), unchoked_count, oldSize);
+               newQueued, newUnchoked, unchoked_count, oldSize);
 
-  return ((int)unchoked.size() - (int)oldSize); // + gs.changed_unchoke
+  return ((int)newUnchoked - (int)oldSize); // + gs.changed_unchoke
 }
 
 void
@@ -298,7 +366,7 @@ choke_queue::set_queued(PeerConnectionBase* pc, choke_status* base) {
   if (base->snubbed())
     return;
 
-  base->entry()->connection_queued(pc);
+  base->entry()->connection_queued(pc, base);
   modify_currently_queued(1);
 
   if (!is_full() && (m_flags & flag_unchoke_all_new || m_slotCanUnchoke() > 0) &&
@@ -324,7 +392,7 @@ choke_queue::set_not_queued(PeerConnectionBase* pc, choke_status* base) {
     m_slotUnchoke(-1);
   }
 
-  base->entry()->connection_unqueued(pc);
+  base->entry()->connection_unqueued(pc, base);
   modify_currently_queued(-1);
 }
 
@@ -343,7 +411,7 @@ choke_queue::set_snubbed(PeerConnectionBase* pc, choke_status* base) {
     return;
   }
 
-  base->entry()->connection_unqueued(pc);
+  base->entry()->connection_unqueued(pc, base);
   modify_currently_queued(-1);
 
   base->set_queued(false);
@@ -362,7 +430,7 @@ choke_queue::set_not_snubbed(PeerConnectionBase* pc, choke_status* base) {
   if (base->unchoked())
     throw internal_error("choke_queue::set_not_snubbed(...) base->unchoked().");
   
-  base->entry()->connection_queued(pc);
+  base->entry()->connection_queued(pc, base);
   modify_currently_queued(1);
 
   if (!is_full() && (m_flags & flag_unchoke_all_new || m_slotCanUnchoke() > 0) &&
@@ -383,11 +451,11 @@ choke_queue::disconnected(PeerConnectionBase* pc, choke_status* base) {
   } else if (base->unchoked()) {
     m_slotUnchoke(-1);
 
-    base->entry()->connection_choked(pc);
+    base->entry()->connection_choked(pc, base);
     modify_currently_unchoked(-1);
 
   } else if (base->queued()) {
-    base->entry()->connection_unqueued(pc);
+    base->entry()->connection_unqueued(pc, base);
     modify_currently_queued(-1);
   }
 
@@ -605,15 +673,26 @@ choke_queue::adjust_choke_range(iterator first, iterator last,
 
 // Note that these algorithms fail if the rate >= 2^30.
 
+// Send queues deeper than this count as congested when ranking peers
+// for choking; the peer's TCP is already backed up, so keeping it
+// unchoked only grows state ahead of a stalled socket.
+static const uint32_t congested_queue_bytes = (128 << 10);
+
 // Need to add the recently unchoked check here?
 
 void
 calculate_upload_choke(choke_queue::iterator first, choke_queue::iterator last) {
   while (first != last) {
+    if (first->write_queued >= congested_queue_bytes) {
+      first->weight = 0;
+      first++;
+      continue;
+    }
+
     // Very crude version for now.
     //
     // This needs to give more weight to peers that haven't had time to unchoke us.
-    uint32_t downloadRate = first->connection->peer_chunks()->download_throttle()->rate()->rate() / 16;
+    uint32_t downloadRate = first->down_rate / 16;
     first->weight = choke_queue::order_base - 1 - downloadRate;
 
     first++;
@@ -624,7 +703,7 @@ void
 calculate_upload_unchoke(choke_queue::iterator first, choke_queue::iterator last) {
   while (first != last) {
     if (first->connection->is_down_local_unchoked()) {
-      uint32_t downloadRate = first->connection->peer_chunks()->download_throttle()->rate()->rate() / 16;
+      uint32_t downloadRate = first->down_rate / 16;
 
       // If the peer transmits at less than 1KB, we should consider it
       // to be a rather stingy peer, and should look for new ones.
@@ -651,8 +730,14 @@ calculate_upload_unchoke(choke_queue::iterator first, choke_queue::iterator last
 void
 calculate_upload_choke_seed(choke_queue::iterator first, choke_queue::iterator last) {
   while (first != last) {
+    if (first->write_queued >= congested_queue_bytes) {
+      first->weight = 0;
+      first++;
+      continue;
+    }
+
     int order = 1; // + first->connection->peer_info()->is_preferred();
-    uint32_t upload_rate = first->connection->peer_chunks()->upload_throttle()->rate()->rate() / 16;
+    uint32_t upload_rate = first->up_rate / 16;
 
     first->weight = order * choke_queue::order_base - 1 - upload_rate;
     first++;
@@ -685,11 +770,19 @@ calculate_choke_upload_leech_experimental(choke_queue::iterator first, choke_que
       continue;
     }
 
+    // A congested send queue outweighs whatever rates the peer shows;
+    // the bytes behind the backlog were sent before it stalled.
+    if (first->write_queued >= congested_queue_bytes) {
+      first->weight = 0;
+      first++;
+      continue;
+    }
+
     // Preferred peers will get 4 times higher weight.
     int multiplier = 1 + 3 * first->connection->peer_info()->is_preferred();
 
-    uint32_t download_rate = first->connection->peer_chunks()->download_throttle()->rate()->rate() / 64;
-    uint32_t upload_rate   = first->connection->peer_chunks()->upload_throttle()->rate()->rate() / (64 * 4);
+    uint32_t download_rate = first->down_rate / 64;
+    uint32_t upload_rate   = first->up_rate / (64 * 4);
 
     first->weight = choke_queue::order_base - 1 - (download_rate + upload_rate) * multiplier;
     first++;
@@ -705,7 +798,7 @@ calculate_unchoke_upload_leech_experimental(choke_queue::iterator first, choke_q
     if (first->connection->is_down_local_unchoked()) {
       int multiplier = 1 + 3 * first->connection->peer_info()->is_preferred();
 
-      uint32_t download_rate = first->connection->peer_chunks()->download_throttle()->rate()->rate() / 64;
+      uint32_t download_rate = first->down_rate / 64;
 
       first->weight = choke_queue::order_base + download_rate * multiplier;
 
@@ -734,7 +827,7 @@ void
 calculate_download_choke(choke_queue::iterator first, choke_queue::iterator last) {
   while (first != last) {
     // Very crude version for now.
-    uint32_t downloadRate = first->connection->peer_chunks()->download_throttle()->rate()->rate() / 16;
+    uint32_t downloadRate = first->down_rate / 16;
     first->weight = choke_queue::order_base - 1 - downloadRate;
 
     first++;
@@ -745,7 +838,7 @@ void
 calculate_download_unchoke(choke_queue::iterator first, choke_queue::iterator last) {
   while (first != last) {
     // Very crude version for now.
-    uint32_t downloadRate = first->connection->peer_chunks()->download_throttle()->rate()->rate() / 16;
+    uint32_t downloadRate = first->down_rate / 16;
     first->weight = downloadRate;
 
     first++;
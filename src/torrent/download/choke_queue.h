@@ -125,8 +125,17 @@ public:
   int32_t             max_unchoked_signed() const             { return m_maxUnchoked; }
   void                set_max_unchoked(uint32_t v)            { m_maxUnchoked = v; }
 
+  // Recompute and sort the connection weights for all groups. This
+  // phase is independent of quota allocation and only reads connection
+  // state, so the resource manager may run it for several queues
+  // concurrently before the serial cycle pass.
+  void                weigh_connections();
+
   void                balance();
   void                balance_entry(group_entry* entry);
+
+  // Assumes weigh_connections() has been called since the last change
+  // to connection rates, i.e. earlier in the same tick.
   int                 cycle(uint32_t quota);
 
   // Assume interested state is already updated for the PCB and that
@@ -157,7 +166,6 @@ public:
 private:
   group_stats         prepare_weights(group_stats gs);
   group_stats         retrieve_connections(group_stats gs, container_type* queued, container_type* unchoked);
-  void                rebuild_containers(container_type* queued, container_type* unchoked);
 
   inline uint32_t     max_alternate() const;
 
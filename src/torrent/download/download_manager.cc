@@ -36,6 +36,7 @@
 
 #include "config.h"
 
+#include <cstring>
 #include <rak/functional.h>
 
 #include "torrent/exceptions.h"
@@ -45,11 +46,45 @@
 
 namespace torrent {
 
+static inline uint64_t
+hash_index_key(const HashString& hash) {
+  uint64_t key;
+  std::memcpy(&key, hash.data(), sizeof(key));
+
+  return key;
+}
+
+DownloadWrapper*
+DownloadManager::find_indexed(const hash_index_type& index, const HashString& hash, bool obfuscated) {
+  std::pair<hash_index_type::const_iterator, hash_index_type::const_iterator> range =
+    index.equal_range(hash_index_key(hash));
+
+  for (hash_index_type::const_iterator itr = range.first; itr != range.second; ++itr)
+    if ((obfuscated ? itr->second->info()->hash_obfuscated() : itr->second->info()->hash()) == hash)
+      return itr->second;
+
+  return NULL;
+}
+
+void
+DownloadManager::erase_indexed(hash_index_type* index, uint64_t key, DownloadWrapper* d) {
+  std::pair<hash_index_type::iterator, hash_index_type::iterator> range = index->equal_range(key);
+
+  for (hash_index_type::iterator itr = range.first; itr != range.second; ++itr)
+    if (itr->second == d) {
+      index->erase(itr);
+      return;
+    }
+}
+
 DownloadManager::iterator
 DownloadManager::insert(DownloadWrapper* d) {
   if (find(d->info()->hash()) != end())
     throw internal_error("Could not add torrent as it already exists.");
 
+  m_hashIndex.insert(hash_index_type::value_type(hash_index_key(d->info()->hash()), d));
+  m_obfuscatedIndex.insert(hash_index_type::value_type(hash_index_key(d->info()->hash_obfuscated()), d));
+
   return base_type::insert(end(), d);
 }
 
@@ -59,13 +94,19 @@ DownloadManager::erase(DownloadWrapper* d) {
 
   if (itr == end())
     throw internal_error("Tried to remove a torrent that doesn't exist");
-    
+
+  erase_indexed(&m_hashIndex, hash_index_key(d->info()->hash()), d);
+  erase_indexed(&m_obfuscatedIndex, hash_index_key(d->info()->hash_obfuscated()), d);
+
   delete *itr;
   return base_type::erase(itr);
 }
 
 void
 DownloadManager::clear() {
+  m_hashIndex.clear();
+  m_obfuscatedIndex.clear();
+
   while (!empty()) {
     delete base_type::back();
     base_type::pop_back();
@@ -74,13 +115,17 @@ DownloadManager::clear() {
 
 DownloadManager::iterator
 DownloadManager::find(const std::string& hash) {
-  return std::find_if(begin(), end(), rak::equal(*HashString::cast_from(hash),
-                                                 rak::on(std::mem_fun(&DownloadWrapper::info), std::mem_fun(&DownloadInfo::hash))));
+  return find(*HashString::cast_from(hash));
 }
 
 DownloadManager::iterator
 DownloadManager::find(const HashString& hash) {
-  return std::find_if(begin(), end(), rak::equal(hash, rak::on(std::mem_fun(&DownloadWrapper::info), std::mem_fun(&DownloadInfo::hash))));
+  DownloadWrapper* d = find_indexed(m_hashIndex, hash, false);
+
+  if (d == NULL)
+    return end();
+
+  return std::find(begin(), end(), d);
 }
 
 DownloadManager::iterator
@@ -95,24 +140,22 @@ DownloadManager::find_chunk_list(ChunkList* cl) {
 
 DownloadMain*
 DownloadManager::find_main(const char* hash) {
-  iterator itr = std::find_if(begin(), end(), rak::equal(*HashString::cast_from(hash),
-                                                         rak::on(std::mem_fun(&DownloadWrapper::info), std::mem_fun(&DownloadInfo::hash))));
+  DownloadWrapper* d = find_indexed(m_hashIndex, *HashString::cast_from(hash), false);
 
-  if (itr == end())
+  if (d == NULL)
     return NULL;
   else
-    return (*itr)->main();
+    return d->main();
 }
 
 DownloadMain*
 DownloadManager::find_main_obfuscated(const char* hash) {
-  iterator itr = std::find_if(begin(), end(), rak::equal(*HashString::cast_from(hash),
-                                                         rak::on(std::mem_fun(&DownloadWrapper::info), std::mem_fun(&DownloadInfo::hash_obfuscated))));
+  DownloadWrapper* d = find_indexed(m_obfuscatedIndex, *HashString::cast_from(hash), true);
 
-  if (itr == end())
+  if (d == NULL)
     return NULL;
   else
-    return (*itr)->main();
+    return d->main();
 }
 
 }
@@ -37,6 +37,7 @@
 #ifndef LIBTORRENT_DOWNLOAD_MANAGER_H
 #define LIBTORRENT_DOWNLOAD_MANAGER_H
 
+#include <unordered_map>
 #include <vector>
 #include <torrent/common.h>
 
@@ -90,6 +91,17 @@ public:
   iterator            erase(DownloadWrapper* d) LIBTORRENT_NO_EXPORT;
 
   void                clear() LIBTORRENT_NO_EXPORT;
+
+private:
+  // Index over the first 8 bytes of the info hash; entries with the
+  // same key are disambiguated with a full hash compare.
+  typedef std::unordered_multimap<uint64_t, DownloadWrapper*> hash_index_type;
+
+  DownloadWrapper*    find_indexed(const hash_index_type& index, const HashString& hash, bool obfuscated);
+  static void         erase_indexed(hash_index_type* index, uint64_t key, DownloadWrapper* d) LIBTORRENT_NO_EXPORT;
+
+  hash_index_type     m_hashIndex;
+  hash_index_type     m_obfuscatedIndex;
 };
 
 }
@@ -37,12 +37,11 @@
 #ifndef LIBTORRENT_DOWNLOAD_GROUP_ENTRY_H
 #define LIBTORRENT_DOWNLOAD_GROUP_ENTRY_H
 
-#include <algorithm>
-#include <functional>
 #include <vector>
 
 #include <torrent/common.h>
 #include <torrent/exceptions.h>
+#include <torrent/peer/choke_status.h>
 
 namespace torrent {
 
@@ -50,13 +49,27 @@ class choke_queue;
 class PeerConnectionBase;
 
 struct weighted_connection {
-  weighted_connection(PeerConnectionBase* pcb, uint32_t w) : connection(pcb), weight(w) {}
+  weighted_connection(PeerConnectionBase* pcb, uint32_t w, choke_status* s) : connection(pcb), weight(w), down_rate(0), up_rate(0), write_queued(0), status(s) {}
 
   bool operator == (const PeerConnectionBase* pcb) { return pcb == connection; }
   bool operator != (const PeerConnectionBase* pcb) { return pcb != connection; }
 
   PeerConnectionBase* connection;
   uint32_t            weight;
+
+  // Throttle rates snapshotted once per balance cycle, so the weight
+  // heuristics read the flat vector instead of chasing through every
+  // connection's throttle nodes.
+  uint32_t            down_rate;
+  uint32_t            up_rate;
+
+  // Kernel send queue depth sampled along with the rates; the upload
+  // heuristics use it as a congestion signal.
+  uint32_t            write_queued;
+
+  // The choke_status tracking this membership, so removals and sorts
+  // can update its stored index when the element moves.
+  choke_status*       status;
 };
 
 // TODO: Rename to choke_entry, create an new class called group entry?
@@ -86,11 +99,14 @@ protected:
   container_type*     mutable_queued()   { return &m_queued; }
   container_type*     mutable_unchoked() { return &m_unchoked; }
 
-  void                connection_unchoked(PeerConnectionBase* pcb);
-  void                connection_choked(PeerConnectionBase* pcb);
+  // Membership changes are O(1); the element's position is kept in
+  // the connection's choke_status and patched up whenever a swap with
+  // the back or a weight sort moves it.
+  void                connection_unchoked(PeerConnectionBase* pcb, choke_status* base);
+  void                connection_choked(PeerConnectionBase* pcb, choke_status* base);
 
-  void                connection_queued(PeerConnectionBase* pcb);
-  void                connection_unqueued(PeerConnectionBase* pcb);
+  void                connection_queued(PeerConnectionBase* pcb, choke_status* base);
+  void                connection_unqueued(PeerConnectionBase* pcb, choke_status* base);
 
 private:
   uint32_t            m_max_slots;
@@ -103,43 +119,43 @@ private:
   container_type      m_unchoked;
 };
 
-inline void group_entry::connection_unchoked(PeerConnectionBase* pcb) {
-  container_type::iterator itr = std::find_if(m_unchoked.begin(), m_unchoked.end(),
-                                              std::bind(&weighted_connection::operator==, std::placeholders::_1, pcb));
-
-  if (itr != m_unchoked.end()) throw internal_error("group_entry::connection_unchoked(pcb) failed.");
-
-  m_unchoked.push_back(weighted_connection(pcb, uint32_t()));
+inline void group_entry::connection_unchoked(PeerConnectionBase* pcb, choke_status* base) {
+  base->set_entry_index(m_unchoked.size());
+  m_unchoked.push_back(weighted_connection(pcb, uint32_t(), base));
 }
 
-inline void group_entry::connection_queued(PeerConnectionBase* pcb) {
-  container_type::iterator itr = std::find_if(m_queued.begin(), m_queued.end(),
-                                              std::bind(&weighted_connection::operator==, std::placeholders::_1, pcb));
-
-  if (itr != m_queued.end()) throw internal_error("group_entry::connection_queued(pcb) failed.");
-
-  m_queued.push_back(weighted_connection(pcb, uint32_t()));
+inline void group_entry::connection_queued(PeerConnectionBase* pcb, choke_status* base) {
+  base->set_entry_index(m_queued.size());
+  m_queued.push_back(weighted_connection(pcb, uint32_t(), base));
 }
 
 inline void
-group_entry::connection_choked(PeerConnectionBase* pcb) {
-  container_type::iterator itr = std::find_if(m_unchoked.begin(), m_unchoked.end(),
-                                              std::bind(&weighted_connection::operator==, std::placeholders::_1, pcb));
+group_entry::connection_choked(PeerConnectionBase* pcb, choke_status* base) {
+  uint32_t index = base->entry_index();
 
-  if (itr == m_unchoked.end()) throw internal_error("group_entry::connection_choked(pcb) failed.");
+  if (index >= m_unchoked.size() || m_unchoked[index].connection != pcb)
+    throw internal_error("group_entry::connection_choked(pcb, base) failed.");
+
+  if (index != m_unchoked.size() - 1) {
+    m_unchoked[index] = m_unchoked.back();
+    m_unchoked[index].status->set_entry_index(index);
+  }
 
-  std::swap(*itr, m_unchoked.back());
   m_unchoked.pop_back();
 }
 
 inline void
-group_entry::connection_unqueued(PeerConnectionBase* pcb) {
-  container_type::iterator itr = std::find_if(m_queued.begin(), m_queued.end(),
-                                              std::bind(&weighted_connection::operator==, std::placeholders::_1, pcb));
+group_entry::connection_unqueued(PeerConnectionBase* pcb, choke_status* base) {
+  uint32_t index = base->entry_index();
+
+  if (index >= m_queued.size() || m_queued[index].connection != pcb)
+    throw internal_error("group_entry::connection_unqueued(pcb, base) failed.");
 
-  if (itr == m_queued.end()) throw internal_error("group_entry::connection_unqueued(pcb) failed.");
+  if (index != m_queued.size() - 1) {
+    m_queued[index] = m_queued.back();
+    m_queued[index].status->set_entry_index(index);
+  }
 
-  std::swap(*itr, m_queued.back());
   m_queued.pop_back();
 }
 
@@ -7,10 +7,12 @@
 #include <rak/functional.h>
 
 #include "torrent/exceptions.h"
+#include "torrent/throttle.h"
 #include "torrent/download/choke_group.h"
 #include "torrent/utils/log.h"
 #include "download/download_main.h"
 #include "protocol/peer_connection_base.h"
+#include "manager.h"
 
 #include "choke_queue.h"
 #include "resource_manager.h"
@@ -25,12 +27,22 @@ namespace torrent {
 const Rate* resource_manager_entry::up_rate() const { return m_download->info()->up_rate(); }
 const Rate* resource_manager_entry::down_rate() const { return m_download->info()->down_rate(); }
 
+const unsigned int ResourceManager::auto_unchoked_min;
+const unsigned int ResourceManager::auto_unchoked_max;
+
 ResourceManager::ResourceManager() :
   m_currentlyUploadUnchoked(0),
   m_currentlyDownloadUnchoked(0),
   m_maxUploadUnchoked(0),
-  m_maxDownloadUnchoked(0)
+  m_maxDownloadUnchoked(0),
+  m_autoUploadUnchoked(0),
+  m_weigh_running(false),
+  m_weigh_shutdown(false),
+  m_weigh_active(0)
 {
+  pthread_mutex_init(&m_weigh_lock, NULL);
+  pthread_cond_init(&m_weigh_cond, NULL);
+  pthread_cond_init(&m_weigh_done_cond, NULL);
 }
 
 ResourceManager::~ResourceManager() {
@@ -41,6 +53,99 @@ ResourceManager::~ResourceManager() {
     throw internal_error("ResourceManager::~ResourceManager() called but m_currentlyDownloadUnchoked != 0.");
 
   std::for_each(choke_base_type::begin(), choke_base_type::end(), rak::call_delete<choke_group>());
+
+  stop_weigh_workers();
+
+  pthread_mutex_destroy(&m_weigh_lock);
+  pthread_cond_destroy(&m_weigh_cond);
+  pthread_cond_destroy(&m_weigh_done_cond);
+}
+
+void
+ResourceManager::start_weigh_workers() {
+  for (unsigned int i = 0; i < weigh_worker_count; i++)
+    if (pthread_create(&m_weigh_threads[i], NULL, &ResourceManager::weigh_thread_func, this) != 0)
+      throw internal_error("ResourceManager::start_weigh_workers() could not create thread.");
+
+  m_weigh_running = true;
+}
+
+void
+ResourceManager::stop_weigh_workers() {
+  if (!m_weigh_running)
+    return;
+
+  pthread_mutex_lock(&m_weigh_lock);
+  m_weigh_shutdown = true;
+  pthread_cond_broadcast(&m_weigh_cond);
+  pthread_mutex_unlock(&m_weigh_lock);
+
+  for (unsigned int i = 0; i < weigh_worker_count; i++)
+    pthread_join(m_weigh_threads[i], NULL);
+
+  m_weigh_running = false;
+}
+
+void*
+ResourceManager::weigh_thread_func(void* manager) {
+  static_cast<ResourceManager*>(manager)->weigh_run();
+  return NULL;
+}
+
+void
+ResourceManager::weigh_run() {
+  pthread_mutex_lock(&m_weigh_lock);
+
+  while (true) {
+    while (m_weigh_queue.empty() && !m_weigh_shutdown)
+      pthread_cond_wait(&m_weigh_cond, &m_weigh_lock);
+
+    if (m_weigh_shutdown)
+      break;
+
+    choke_queue* queue = m_weigh_queue.back();
+    m_weigh_queue.pop_back();
+    m_weigh_active++;
+
+    pthread_mutex_unlock(&m_weigh_lock);
+    queue->weigh_connections();
+    pthread_mutex_lock(&m_weigh_lock);
+
+    if (--m_weigh_active == 0 && m_weigh_queue.empty())
+      pthread_cond_signal(&m_weigh_done_cond);
+  }
+
+  pthread_mutex_unlock(&m_weigh_lock);
+}
+
+// Recompute the connection weights for every group's queue in the
+// given direction. The weigh slots only read connection state and
+// this thread owns all mutators, so blocking here until the workers
+// drain the queue makes the fork-join race free.
+void
+ResourceManager::weigh_queues(bool is_up) {
+  // A single group doesn't gain anything from the worker round trip.
+  if (group_size() < 2) {
+    for (choke_base_type::iterator itr = choke_base_type::begin(), last = choke_base_type::end(); itr != last; itr++)
+      (is_up ? (*itr)->up_queue() : (*itr)->down_queue())->weigh_connections();
+
+    return;
+  }
+
+  if (!m_weigh_running)
+    start_weigh_workers();
+
+  pthread_mutex_lock(&m_weigh_lock);
+
+  for (choke_base_type::iterator itr = choke_base_type::begin(), last = choke_base_type::end(); itr != last; itr++)
+    m_weigh_queue.push_back(is_up ? (*itr)->up_queue() : (*itr)->down_queue());
+
+  pthread_cond_broadcast(&m_weigh_cond);
+
+  while (!m_weigh_queue.empty() || m_weigh_active != 0)
+    pthread_cond_wait(&m_weigh_done_cond, &m_weigh_lock);
+
+  pthread_mutex_unlock(&m_weigh_lock);
 }
 
 // If called directly ensure a valid group has been selected.
@@ -250,6 +355,60 @@ ResourceManager::set_max_download_unchoked(unsigned int m) {
   m_maxDownloadUnchoked = m;
 }
 
+void
+ResourceManager::set_auto_upload_unchoked(bool state) {
+  if (!state) {
+    m_autoUploadUnchoked = 0;
+    return;
+  }
+
+  // Seed the controller from the current unchoke count so enabling it
+  // doesn't trigger a choke burst on the next tick.
+  m_autoUploadUnchoked = std::max(m_currentlyUploadUnchoked, auto_unchoked_min);
+}
+
+// Adjust the upload unchoke limit from measured link saturation:
+// while the throttle's configured capacity is underfilled and choked
+// peers are waiting for a slot, grow the limit; once the link
+// saturates, shed slots so the remaining ones get fatter shares.
+// Without a configured capacity saturation can't be judged, so the
+// limit holds steady.
+unsigned int
+ResourceManager::update_auto_upload_unchoked() {
+  uint64_t capacity = manager->upload_throttle()->max_rate();
+
+  if (capacity == 0)
+    return m_autoUploadUnchoked;
+
+  uint64_t rate = 0;
+  uint32_t requested = 0;
+
+  for (choke_base_type::const_iterator itr = choke_base_type::begin(), last = choke_base_type::end(); itr != last; itr++) {
+    rate += (*itr)->up_rate();
+    requested += (*itr)->up_queue()->size_total();
+  }
+
+  if (rate >= capacity - capacity / 8) {
+    // Saturated; back off one slot at a time so transfer rates decay
+    // gently.
+    if (m_autoUploadUnchoked > auto_unchoked_min)
+      m_autoUploadUnchoked--;
+
+  } else if (rate < capacity - capacity / 4 && requested > m_autoUploadUnchoked) {
+    m_autoUploadUnchoked = std::min(m_autoUploadUnchoked + 1 + m_autoUploadUnchoked / 16, auto_unchoked_max);
+  }
+
+  if (m_maxUploadUnchoked != 0)
+    m_autoUploadUnchoked = std::min(m_autoUploadUnchoked, m_maxUploadUnchoked);
+
+  m_autoUploadUnchoked = std::max(m_autoUploadUnchoked, auto_unchoked_min);
+
+  LT_LOG_THIS("auto-scaled upload unchoked slots; limit:%u rate:%" PRIu64 " capacity:%" PRIu64,
+              m_autoUploadUnchoked, rate, capacity);
+
+  return m_autoUploadUnchoked;
+}
+
 // The choking choke manager won't updated it's count until after
 // possibly multiple calls of this function.
 void
@@ -274,6 +433,9 @@ ResourceManager::receive_download_unchoke(int num) {
 
 int
 ResourceManager::retrieve_upload_can_unchoke() {
+  if (m_autoUploadUnchoked != 0)
+    return (int)m_autoUploadUnchoked - (int)m_currentlyUploadUnchoked;
+
   if (m_maxUploadUnchoked == 0)
     return std::numeric_limits<int>::max();
 
@@ -292,8 +454,9 @@ void
 ResourceManager::receive_tick() {
   validate_group_iterators();
 
-  m_currentlyUploadUnchoked   += balance_unchoked(choke_base_type::size(), m_maxUploadUnchoked, true);
-  m_currentlyDownloadUnchoked += balance_unchoked(choke_base_type::size(), m_maxDownloadUnchoked, false);
+  m_currentlyUploadUnchoked   += balance_unchoked(m_autoUploadUnchoked != 0 ? update_auto_upload_unchoked() : m_maxUploadUnchoked,
+                                                  true);
+  m_currentlyDownloadUnchoked += balance_unchoked(m_maxDownloadUnchoked, false);
 
   unsigned int up_unchoked = std::accumulate(choke_base_type::begin(), choke_base_type::end(), 0,
                                              std::bind(std::plus<unsigned int>(), std::placeholders::_1,
@@ -317,9 +480,13 @@ ResourceManager::total_weight() const {
 }
 
 int
-ResourceManager::balance_unchoked(unsigned int weight, unsigned int max_unchoked, bool is_up) {
+ResourceManager::balance_unchoked(unsigned int max_unchoked, bool is_up) {
   int change = 0;
 
+  // Weighing is independent of the quota allocation below, so it runs
+  // for all groups here, in parallel when there are several.
+  weigh_queues(is_up);
+
   if (max_unchoked == 0) {
     choke_base_type::iterator group_itr = choke_base_type::begin();
 
@@ -337,7 +504,7 @@ ResourceManager::balance_unchoked(unsigned int weight, unsigned int max_unchoked
 
   // We put the downloads with fewest interested first so that those
   // with more interested will gain any unused slots from the
-  // preceding downloads. Consider multiplying with priority.
+  // preceding downloads.
   //
   // Consider skipping the leading zero interested downloads. Though
   // that won't work as they need to choke peers once their priority
@@ -368,15 +535,33 @@ ResourceManager::balance_unchoked(unsigned int weight, unsigned int max_unchoked
     LT_LOG_THIS("balancing download unchoked slots; current_unchoked:%u change:%i max_unchoked:%u", m_currentlyDownloadUnchoked, change, max_unchoked);
   }
 
+  // Deficit round-robin over group weights. Each group's share of the
+  // remaining quota is proportional to the summed priority of its
+  // entries, and the division remainder is carried in the group's
+  // deficit counter to the next tick, so a low-weight group converges
+  // on its exact configured share instead of rounding to zero every
+  // cycle. Groups whose entries sum to zero priority weigh one,
+  // matching the old equal split and keeping empty groups cycling.
+  unsigned int weight = 0;
+
+  for (choke_group** itr = group_first; itr != group_last; itr++)
+    weight += std::max<uint32_t>((*itr)->weight(), 1);
+
   while (group_first != group_last) {
     choke_queue* cm = is_up ? (*group_first)->up_queue() : (*group_first)->down_queue();
 
-    // change += cm->cycle(weight != 0 ? (quota * itr->priority()) / weight : 0);
-    change += cm->cycle(weight != 0 ? quota / weight : 0);
+    uint32_t group_weight = std::max<uint32_t>((*group_first)->weight(), 1);
+    uint64_t credit = (uint64_t)quota * group_weight + (is_up ? (*group_first)->up_deficit() : (*group_first)->down_deficit());
+
+    change += cm->cycle(weight != 0 ? credit / weight : 0);
+
+    if (is_up)
+      (*group_first)->set_up_deficit(weight != 0 ? credit % weight : 0);
+    else
+      (*group_first)->set_down_deficit(weight != 0 ? credit % weight : 0);
 
     quota -= cm->size_unchoked();
-    // weight -= itr->priority();
-    weight--;
+    weight -= group_weight;
     group_first++;
   }
 
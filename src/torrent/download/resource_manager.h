@@ -37,6 +37,7 @@
 #ifndef LIBTORRENT_PEER_RESOURCE_MANAGER_H
 #define LIBTORRENT_PEER_RESOURCE_MANAGER_H
 
+#include <pthread.h>
 #include <string>
 #include <vector>
 #include <cinttypes>
@@ -54,6 +55,7 @@ namespace torrent {
 // Add unlimited handling later.
 
 class choke_group;
+class choke_queue;
 class DownloadMain;
 class Rate;
 class ResourceManager;
@@ -141,6 +143,14 @@ public:
   void                set_max_upload_unchoked(unsigned int m);
   void                set_max_download_unchoked(unsigned int m);
 
+  // When enabled the upload unchoke limit is adjusted every tick from
+  // the measured aggregate upload rate against the upload throttle's
+  // configured capacity, rather than using the static limit. A
+  // non-zero static limit still acts as a ceiling.
+  bool                is_auto_upload_unchoked() const           { return m_autoUploadUnchoked != 0; }
+  unsigned int        auto_upload_unchoked() const              { return m_autoUploadUnchoked; }
+  void                set_auto_upload_unchoked(bool state);
+
   void                receive_upload_unchoke(int num);
   void                receive_download_unchoke(int num);
 
@@ -150,6 +160,14 @@ public:
   void                receive_tick();
 
 private:
+  // Number of worker threads weighing choke queues during the
+  // periodic cycle; the queues are independent until the quota loop.
+  static const unsigned int weigh_worker_count = 2;
+
+  // Bounds for the auto-scaled upload unchoke limit.
+  static const unsigned int auto_unchoked_min = 4;
+  static const unsigned int auto_unchoked_max = 1 << 10;
+
   iterator            insert(const resource_manager_entry& entry);
 
   void                update_group_iterators();
@@ -157,13 +175,35 @@ private:
 
   unsigned int        total_weight() const;
 
-  int                 balance_unchoked(unsigned int weight, unsigned int max_unchoked, bool is_up);
+  int                 balance_unchoked(unsigned int max_unchoked, bool is_up);
+
+  unsigned int        update_auto_upload_unchoked();
+
+  void                weigh_queues(bool is_up);
+
+  void                start_weigh_workers();
+  void                stop_weigh_workers();
+  static void*        weigh_thread_func(void* manager);
+  void                weigh_run();
 
   unsigned int        m_currentlyUploadUnchoked;
   unsigned int        m_currentlyDownloadUnchoked;
 
   unsigned int        m_maxUploadUnchoked;
   unsigned int        m_maxDownloadUnchoked;
+
+  // Controller-owned upload unchoke limit; zero when auto-scaling is
+  // disabled.
+  unsigned int        m_autoUploadUnchoked;
+
+  bool                m_weigh_running;
+  bool                m_weigh_shutdown;
+  pthread_t           m_weigh_threads[weigh_worker_count];
+  std::vector<choke_queue*> m_weigh_queue;
+  unsigned int        m_weigh_active;
+  pthread_mutex_t     m_weigh_lock;
+  pthread_cond_t      m_weigh_cond;
+  pthread_cond_t      m_weigh_done_cond;
 };
 
 }
@@ -22,6 +22,17 @@ public:
   // TODO: Require all to define their ownh typename.
   virtual const char* type_name() const { return "default"; }
 
+  // Dispatch class used by the poll implementations to order event
+  // delivery within one batch; lower values run first. Payload
+  // transfers go ahead of control traffic, which goes ahead of
+  // floodable sources like accept and DHT, so a control-plane storm
+  // doesn't add latency to transfers.
+  static const int POLL_PRIORITY_TRANSFER = 0;
+  static const int POLL_PRIORITY_CONTROL  = 1;
+  static const int POLL_PRIORITY_LOW      = 2;
+
+  virtual int poll_priority() const { return POLL_PRIORITY_CONTROL; }
+
 protected:
   void close_file_descriptor();
   void set_file_descriptor(int fd);
@@ -36,39 +36,77 @@
 
 #include "config.h"
 
-#include <cctype>
 #include <rak/string_manip.h>
 
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
 #include "hash_string.h"
 
 namespace torrent {
 
+// Branchier than a table but avoids locale-aware isxdigit and a
+// second classification pass per character.
+static inline int
+hexdigit_value(unsigned char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+
+  c |= 0x20;
+
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+
+  return -1;
+}
+
 const char*
 hash_string_from_hex_c_str(const char* first, HashString& hash) {
   const char* hash_first = first;
 
   torrent::HashString::iterator itr = hash.begin();
-  
+
   while (itr != hash.end()) {
-    if (!std::isxdigit(*first) || !std::isxdigit(*(first + 1)))
+    int high = hexdigit_value(*first);
+    int low  = hexdigit_value(*(first + 1));
+
+    if (high < 0 || low < 0)
       return hash_first;
 
-    *itr++ = (rak::hexchar_to_value(*first) << 4) + rak::hexchar_to_value(*(first + 1));
+    *itr++ = (high << 4) + low;
     first += 2;
   }
 
   return first;
 }
-  
+
 char*
 hash_string_to_hex(const HashString& hash, char* first) {
+#ifdef __SSSE3__
+  // Convert the first 16 bytes in one go: split each byte into its
+  // nibbles and use those to index a hex-digit table with pshufb.
+  __m128i table = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+                                '8', '9', 'A', 'B', 'C', 'D', 'E', 'F');
+  __m128i mask  = _mm_set1_epi8(0x0f);
+
+  __m128i src = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hash.data()));
+  __m128i lo  = _mm_shuffle_epi8(table, _mm_and_si128(src, mask));
+  __m128i hi  = _mm_shuffle_epi8(table, _mm_and_si128(_mm_srli_epi16(src, 4), mask));
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(first),      _mm_unpacklo_epi8(hi, lo));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(first + 16), _mm_unpackhi_epi8(hi, lo));
+
+  return rak::transform_hex(hash.begin() + 16, hash.end(), first + 32);
+#else
   return rak::transform_hex(hash.begin(), hash.end(), first);
+#endif
 }
 
 std::string
 hash_string_to_hex_str(const HashString& hash) {
   std::string str(HashString::size_data * 2, '\0');
-  rak::transform_hex(hash.begin(), hash.end(), str.begin());
+  hash_string_to_hex(hash, &str[0]);
 
   return str;
 }
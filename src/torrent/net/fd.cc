@@ -4,7 +4,9 @@
 
 #include <cerrno>
 #include <fcntl.h>
+#include <mutex>
 #include <unistd.h>
+#include <vector>
 #include <netinet/in.h>
 #include <netinet/in_systm.h>
 #include <netinet/ip.h>
@@ -53,6 +55,47 @@ int fd__listen(int socket, int backlog) { return ::listen(socket, backlog); }
 int fd__setsockopt_int(int socket, int level, int option_name, int option_value) { return ::setsockopt(socket, level, option_name, &option_value, sizeof(int)); }
 int fd__socket(int domain, int type, int protocol) { return ::socket(domain, type, protocol); }
 
+// Process-wide table of the flags applied to each fd opened through
+// fd_open, so state checks don't need getsockopt/fcntl round trips.
+static std::mutex fd_table_mutex;
+static std::vector<fd_flags> fd_table;
+
+static void
+fd_table_insert(int fd, fd_flags flags) {
+  std::lock_guard<std::mutex> guard(fd_table_mutex);
+
+  if (static_cast<size_t>(fd) >= fd_table.size())
+    fd_table.resize(fd + 256, fd_flags());
+
+  fd_table[fd] = flags;
+}
+
+static void
+fd_table_set(int fd, fd_flags flags) {
+  std::lock_guard<std::mutex> guard(fd_table_mutex);
+
+  if (static_cast<size_t>(fd) < fd_table.size() && fd_table[fd] != fd_flags())
+    fd_table[fd] |= flags;
+}
+
+static void
+fd_table_erase(int fd) {
+  std::lock_guard<std::mutex> guard(fd_table_mutex);
+
+  if (static_cast<size_t>(fd) < fd_table.size())
+    fd_table[fd] = fd_flags();
+}
+
+fd_flags
+fd_get_flags(int fd) {
+  std::lock_guard<std::mutex> guard(fd_table_mutex);
+
+  if (fd < 0 || static_cast<size_t>(fd) >= fd_table.size())
+    return fd_flags();
+
+  return fd_table[fd];
+}
+
 int
 fd_open(fd_flags flags) {
   int domain;
@@ -70,6 +113,13 @@ fd_open(fd_flags flags) {
     return -1;
   }
 
+#ifdef SOCK_NONBLOCK
+  // Fold non-blocking mode into the socket call itself, saving the
+  // fcntl per socket during connection storms.
+  if ((flags & fd_flag_nonblock))
+    domain |= SOCK_NONBLOCK;
+#endif
+
   int fd = -1;
 
   if (fd == -1 && !(flags & fd_flag_v4only)) {
@@ -93,11 +143,13 @@ fd_open(fd_flags flags) {
     return -1;
   }
 
+#ifndef SOCK_NONBLOCK
   if ((flags & fd_flag_nonblock) && !fd_set_nonblock(fd)) {
     LT_LOG_FD_FLAG_ERROR("fd_open failed to set nonblock");
     fd_close(fd);
     return -1;
   }
+#endif
 
   if ((flags & fd_flag_reuse_address) && !fd_set_reuse_address(fd, true)) {
     LT_LOG_FD_FLAG_ERROR("fd_open failed to set reuse_address");
@@ -105,10 +157,17 @@ fd_open(fd_flags flags) {
     return -1;
   }
 
+  fd_table_insert(fd, flags);
+
   LT_LOG_FD_FLAG("fd_open succeeded");
   return fd;
 }
 
+int
+fd_open_stream(fd_flags flags) {
+  return fd_open(flags | fd_flag_stream);
+}
+
 void
 fd_close(int fd) {
   if (fd == STDIN_FILENO || fd == STDOUT_FILENO || fd == STDERR_FILENO)
@@ -117,6 +176,8 @@ fd_close(int fd) {
   if (fd__close(fd) == -1)
     throw internal_error("torrent::fd_close: " + std::string(strerror(errno)));
 
+  fd_table_erase(fd);
+
   LT_LOG_FD("fd_close succeeded");
 }
 
@@ -180,6 +241,8 @@ fd_set_nonblock(int fd) {
     return false;
   }
 
+  fd_table_set(fd, fd_flag_nonblock);
+
   LT_LOG_FD("fd_set_nonblock succeeded");
   return true;
 }
@@ -191,6 +254,9 @@ fd_set_reuse_address(int fd, bool state) {
     return false;
   }
 
+  if (state)
+    fd_table_set(fd, fd_flag_reuse_address);
+
   LT_LOG_FD_VALUE("fd_set_reuse_address succeeded", state);
   return true;
 }
@@ -202,6 +268,9 @@ fd_set_v6only(int fd, bool state) {
     return false;
   }
 
+  if (state)
+    fd_table_set(fd, fd_flag_v6only);
+
   LT_LOG_FD_VALUE("fd_set_v6only succeeded", state);
   return true;
 }
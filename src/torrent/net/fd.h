@@ -19,8 +19,14 @@ enum fd_flags : int {
 constexpr bool fd_valid_flags(fd_flags flags);
 
 int  fd_open(fd_flags flags) LIBTORRENT_EXPORT;
+int  fd_open_stream(fd_flags flags) LIBTORRENT_EXPORT;
 void fd_close(int fd) LIBTORRENT_EXPORT;
 
+// Flags recorded for an open fd in the process-wide metadata table,
+// or an empty set if the fd was not opened through fd_open. Lets
+// callers check socket state without getsockopt/fcntl round trips.
+fd_flags fd_get_flags(int fd) LIBTORRENT_EXPORT;
+
 fd_sap_tuple fd_accept(int fd) LIBTORRENT_EXPORT;
 
 bool fd_bind(int fd, const sockaddr* sa) LIBTORRENT_EXPORT;
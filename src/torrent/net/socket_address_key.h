@@ -31,6 +31,10 @@ public:
   static socket_address_key from_sin_addr(const sockaddr_in& sa);
   static socket_address_key from_sin6_addr(const sockaddr_in6& sa);
 
+  // FNV-1a over the packed representation; the factory functions zero
+  // any padding so equal keys hash equal.
+  uint32_t hash() const;
+
   bool operator < (const socket_address_key& sa) const;
   bool operator > (const socket_address_key& sa) const;
   bool operator == (const socket_address_key& sa) const;
@@ -106,6 +110,16 @@ socket_address_key::from_sin6_addr(const sockaddr_in6& sa) {
   return result;
 }
 
+inline uint32_t
+socket_address_key::hash() const {
+  uint32_t result = 2166136261u;
+
+  for (const uint8_t* itr = reinterpret_cast<const uint8_t*>(this), *last = itr + sizeof(socket_address_key); itr != last; itr++)
+    result = (result ^ *itr) * 16777619u;
+
+  return result;
+}
+
 inline bool
 socket_address_key::operator < (const socket_address_key& sa) const {
   return std::memcmp(this, &sa, sizeof(socket_address_key)) < 0;
@@ -45,6 +45,61 @@
 
 namespace torrent {
 
+// The pool carves fixed-size blocks out of 4KiB slabs and keeps freed
+// blocks on per-size free lists. Slabs are never returned to the heap;
+// tearing down a parsed tree just threads its blocks back onto the
+// lists, so the next parse reuses them without touching the allocator.
+//
+// The free lists are per-thread so worker threads may parse and
+// discard trees without locking; blocks freed on another thread than
+// they were allocated on simply migrate to that thread's list.
+static const size_t object_pool_granularity = 8;
+static const size_t object_pool_max_size    = 256;
+static const size_t object_pool_slab_size   = 4096;
+
+static thread_local void* object_pool_free_list[object_pool_max_size / object_pool_granularity];
+
+void*
+object_pool_allocate(size_t size) {
+  if (size == 0 || size > object_pool_max_size)
+    return ::operator new(size);
+
+  size_t bucket = (size - 1) / object_pool_granularity;
+  void* result = object_pool_free_list[bucket];
+
+  if (result != NULL) {
+    object_pool_free_list[bucket] = *reinterpret_cast<void**>(result);
+    return result;
+  }
+
+  // Carve a fresh slab into blocks of this size class, chaining all
+  // but the returned one onto the free list.
+  size_t block_size = (bucket + 1) * object_pool_granularity;
+
+  char* slab = static_cast<char*>(::operator new(object_pool_slab_size));
+  char* end  = slab + (object_pool_slab_size / block_size) * block_size;
+
+  for (char* itr = slab + block_size; itr != end; itr += block_size) {
+    *reinterpret_cast<void**>(itr) = object_pool_free_list[bucket];
+    object_pool_free_list[bucket] = itr;
+  }
+
+  return slab;
+}
+
+void
+object_pool_deallocate(void* p, size_t size) {
+  if (size == 0 || size > object_pool_max_size) {
+    ::operator delete(p);
+    return;
+  }
+
+  size_t bucket = (size - 1) / object_pool_granularity;
+
+  *reinterpret_cast<void**>(p) = object_pool_free_list[bucket];
+  object_pool_free_list[bucket] = p;
+}
+
 Object&
 Object::get_key(const std::string& k) {
   check_throw(TYPE_MAP);
@@ -201,8 +256,8 @@ Object::operator = (const Object& src) {
   switch (type()) {
   case TYPE_STRING:   new (&_string()) string_type(src._string()); break;
   case TYPE_LIST:     new (&_list()) list_type(src._list()); break;
-  case TYPE_MAP:      _map_ptr() = new map_type(src._map()); break;
-  case TYPE_DICT_KEY: new (&_dict_key()) dict_key_type(src._dict_key()); _dict_key().second = new Object(*src._dict_key().second); break;
+  case TYPE_MAP:      _map_ptr() = new_map_data(src._map()); break;
+  case TYPE_DICT_KEY: new (&_dict_key()) dict_key_type(src._dict_key()); _dict_key().second = new_object_data(*src._dict_key().second); break;
   default: t_pod = src.t_pod; break;
   }
 
@@ -40,6 +40,7 @@
 #include <limits>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 #include <torrent/common.h>
 #include <torrent/exceptions.h>
@@ -47,12 +48,49 @@
 
 namespace torrent {
 
+// Pooled backing store for Object's containers. Small blocks are
+// carved out of larger slabs and recycled on per-size free lists, so
+// parsing a bencoded tree does not pay one allocator round-trip per
+// dictionary entry or small list.
+void* object_pool_allocate(size_t size) LIBTORRENT_EXPORT;
+void  object_pool_deallocate(void* p, size_t size) LIBTORRENT_EXPORT;
+
+template <typename T>
+class object_pool_allocator {
+public:
+  typedef T               value_type;
+  typedef T*              pointer;
+  typedef const T*        const_pointer;
+  typedef T&              reference;
+  typedef const T&        const_reference;
+  typedef std::size_t     size_type;
+  typedef std::ptrdiff_t  difference_type;
+
+  template <typename U> struct rebind { typedef object_pool_allocator<U> other; };
+
+  object_pool_allocator() throw() {}
+  object_pool_allocator(const object_pool_allocator&) throw() {}
+  template <typename U> object_pool_allocator(const object_pool_allocator<U>&) throw() {}
+
+  pointer             allocate(size_type n, const void* = NULL) { return static_cast<pointer>(object_pool_allocate(n * sizeof(T))); }
+  void                deallocate(pointer p, size_type n)        { object_pool_deallocate(p, n * sizeof(T)); }
+
+  size_type           max_size() const throw()                  { return std::numeric_limits<size_type>::max() / sizeof(T); }
+};
+
+template <typename T, typename U>
+inline bool operator == (const object_pool_allocator<T>&, const object_pool_allocator<U>&) { return true; }
+
+template <typename T, typename U>
+inline bool operator != (const object_pool_allocator<T>&, const object_pool_allocator<U>&) { return false; }
+
 class LIBTORRENT_EXPORT Object {
 public:
   typedef int64_t                           value_type;
   typedef std::string                       string_type;
-  typedef std::vector<Object>               list_type;
-  typedef std::map<std::string, Object>     map_type;
+  typedef std::vector<Object, object_pool_allocator<Object> > list_type;
+  typedef std::map<std::string, Object, std::less<std::string>,
+                   object_pool_allocator<std::pair<const std::string, Object> > > map_type;
   typedef map_type*                         map_ptr_type;
   typedef map_type::key_type                key_type;
   typedef std::pair<std::string, Object*>   dict_key_type;
@@ -102,12 +140,17 @@ public:
   Object(const value_type v)   : m_flags(TYPE_VALUE) { new (&_value()) value_type(v); }
   Object(const char* s)        : m_flags(TYPE_STRING) { new (&_string()) string_type(s); }
   Object(const string_type& s) : m_flags(TYPE_STRING) { new (&_string()) string_type(s); }
+  Object(string_type&& s)      : m_flags(TYPE_STRING) { new (&_string()) string_type(std::move(s)); }
   Object(const raw_bencode& r) : m_flags(TYPE_RAW_BENCODE) { new (&_raw_bencode()) raw_bencode(r); }
   Object(const raw_string& r)  : m_flags(TYPE_RAW_STRING) { new (&_raw_string()) raw_string(r); }
   Object(const raw_list& r)    : m_flags(TYPE_RAW_LIST) { new (&_raw_list()) raw_list(r); }
   Object(const raw_map& r)     : m_flags(TYPE_RAW_MAP) { new (&_raw_map()) raw_map(r); }
   Object(const Object& b);
 
+  // Stealing a tree is constant time; the source is left empty. Must
+  // not throw so list reallocation moves instead of deep-copying.
+  Object(Object&& b) noexcept;
+
   ~Object() { clear(); }
 
   // TODO: Move this out of the class namespace, call them
@@ -116,7 +159,7 @@ public:
   static Object       create_value()  { return Object(value_type()); }
   static Object       create_string() { return Object(string_type()); }
   static Object       create_list()   { Object tmp; tmp.m_flags = TYPE_LIST; new (&tmp._list()) list_type(); return tmp; }
-  static Object       create_map()    { Object tmp; tmp.m_flags = TYPE_MAP; tmp._map_ptr() = new map_type(); return tmp; }
+  static Object       create_map()    { Object tmp; tmp.m_flags = TYPE_MAP; tmp._map_ptr() = new_map_data(); return tmp; }
   static Object       create_dict_key();
 
   static Object       create_raw_bencode(raw_bencode obj = raw_bencode());
@@ -213,6 +256,7 @@ public:
   template <typename T> const map_type&    get_key_map(const T& k) const    { return get_key(k).as_map(); }
 
   Object&             insert_key(const key_type& k, const Object& b) { check_throw(TYPE_MAP); return _map()[k] = b; }
+  Object&             insert_key(const key_type& k, Object&& b)      { check_throw(TYPE_MAP); return _map()[k] = std::move(b); }
   Object&             insert_key_move(const key_type& k, Object& b)  { check_throw(TYPE_MAP); return _map()[k].move(b); }
 
   // 'insert_preserve_*' inserts the object 'b' if the key 'k' does
@@ -228,7 +272,9 @@ public:
   void                erase_key(const key_type& k)                   { check_throw(TYPE_MAP); _map().erase(k); }
 
   Object&             insert_front(const Object& b)                  { check_throw(TYPE_LIST); return *_list().insert(_list().begin(), b); }
+  Object&             insert_front(Object&& b)                       { check_throw(TYPE_LIST); return *_list().insert(_list().begin(), std::move(b)); }
   Object&             insert_back(const Object& b)                   { check_throw(TYPE_LIST); return *_list().insert(_list().end(), b); }
+  Object&             insert_back(Object&& b)                        { check_throw(TYPE_LIST); return *_list().insert(_list().end(), std::move(b)); }
 
   // Copy and merge operations:
   Object&             move(Object& b);
@@ -242,6 +288,7 @@ public:
                                  uint32_t maxDepth = ~uint32_t());
 
   Object&             operator = (const Object& b);
+  Object&             operator = (Object&& b);
 
   // Internal:
   void                swap_same_type(Object& left, Object& right);
@@ -250,6 +297,18 @@ public:
   inline bool         check(map_type::const_iterator itr, type_type t) const { return itr != _map().end() && itr->second.type() == t; }
   inline void         check_throw(type_type t) const                         { if (t != type()) throw bencode_error("Wrong object type."); }
 
+  // The map head and the dict-key target object go through the object
+  // pool like the container nodes, so building a typical bencode tree
+  // performs no global allocator round-trips; scalars and the string
+  // and list heads already live inline in the union.
+  static map_type*    new_map_data()                     { return new (object_pool_allocate(sizeof(map_type))) map_type(); }
+  static map_type*    new_map_data(const map_type& src)  { return new (object_pool_allocate(sizeof(map_type))) map_type(src); }
+  static void         delete_map_data(map_type* p)       { p->~map_type(); object_pool_deallocate(p, sizeof(map_type)); }
+
+  static Object*      new_object_data()                  { return new (object_pool_allocate(sizeof(Object))) Object(); }
+  static Object*      new_object_data(const Object& src) { return new (object_pool_allocate(sizeof(Object))) Object(src); }
+  static void         delete_object_data(Object* p)      { p->~Object(); object_pool_deallocate(p, sizeof(Object)); }
+
   template <typename T> void check_value_throw(const char* err_msg) const;
 
   uint32_t            m_flags;
@@ -356,13 +415,50 @@ Object::Object(const Object& b) {
   case TYPE_VALUE:       t_pod = b.t_pod; break;
   case TYPE_STRING:      new (&_string()) string_type(b._string()); break;
   case TYPE_LIST:        new (&_list()) list_type(b._list()); break;
-  case TYPE_MAP:         _map_ptr() = new map_type(b._map()); break;
+  case TYPE_MAP:         _map_ptr() = new_map_data(b._map()); break;
   case TYPE_DICT_KEY:
     new (&_dict_key().first) string_type(b._dict_key().first);
-    _dict_key().second = new Object(*b._dict_key().second); break;
+    _dict_key().second = new_object_data(*b._dict_key().second); break;
   }
 }
 
+inline
+Object::Object(Object&& b) noexcept {
+  m_flags = b.m_flags & (mask_type | mask_public);
+
+  // Heap-backed types are stolen outright and the source husk
+  // destroyed here, so the source is left TYPE_NONE with nothing left
+  // for its destructor to do.
+  switch (type()) {
+  case TYPE_NONE:
+  case TYPE_RAW_BENCODE:
+  case TYPE_RAW_STRING:
+  case TYPE_RAW_LIST:
+  case TYPE_RAW_MAP:
+  case TYPE_VALUE:       t_pod = b.t_pod; break;
+  case TYPE_STRING:      new (&_string()) string_type(std::move(b._string())); b._string().~string_type(); break;
+  case TYPE_LIST:        new (&_list()) list_type(std::move(b._list())); b._list().~list_type(); break;
+  case TYPE_MAP:         _map_ptr() = b._map_ptr(); break;
+  case TYPE_DICT_KEY:
+    new (&_dict_key().first) string_type(std::move(b._dict_key().first));
+    b._dict_key().first.~string_type();
+    _dict_key().second = b._dict_key().second; break;
+  }
+
+  b.m_flags = TYPE_NONE;
+}
+
+inline Object&
+Object::operator = (Object&& b) {
+  if (&b == this)
+    return *this;
+
+  clear();
+  new (this) Object(std::move(b));
+
+  return *this;
+}
+
 inline Object
 Object::create_empty(type_type t) {
   switch (t) {
@@ -397,7 +493,7 @@ Object::create_dict_key() {
   Object tmp;
   tmp.m_flags = TYPE_DICT_KEY;
   new (&tmp._dict_key()) dict_key_type();
-  tmp._dict_key().second = new Object();
+  tmp._dict_key().second = new_object_data();
   return tmp;
 }
 
@@ -452,8 +548,8 @@ Object::clear() {
   switch (type()) {
   case TYPE_STRING:   _string().~string_type(); break;
   case TYPE_LIST:     _list().~list_type(); break;
-  case TYPE_MAP:      delete _map_ptr(); break;
-  case TYPE_DICT_KEY: delete _dict_key().second; _dict_key().~dict_key_type(); break;
+  case TYPE_MAP:      delete_map_data(_map_ptr()); break;
+  case TYPE_DICT_KEY: delete_object_data(_dict_key().second); _dict_key().~dict_key_type(); break;
   default: break;
   }
 
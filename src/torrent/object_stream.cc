@@ -36,6 +36,7 @@
 
 #include "config.h"
 
+#include <cstring>
 #include <iterator>
 #include <iostream>
 #include <cmath>
@@ -73,6 +74,36 @@ object_read_string(std::istream* input, std::string& str) {
   return !input->fail();
 }
 
+// Locate the end of a digit run a word at a time. Classification is
+// SWAR: each lane is biased so only bytes outside '0'..'9' end up
+// with the high bit set, and the first such lane bounds the run. The
+// scalar tail also settles which byte within the last word stopped
+// the scan, keeping the helper endian-agnostic.
+static inline const char*
+object_scan_digits(const char* first, const char* last) {
+  static const uint64_t swar_xor  = UINT64_C(0x3030303030303030);
+  static const uint64_t swar_add  = UINT64_C(0x7676767676767676);
+  static const uint64_t swar_low  = UINT64_C(0x7f7f7f7f7f7f7f7f);
+  static const uint64_t swar_high = UINT64_C(0x8080808080808080);
+
+  while (last - first >= (ptrdiff_t)sizeof(uint64_t)) {
+    uint64_t w;
+    std::memcpy(&w, first, sizeof(w));
+
+    w ^= swar_xor;
+
+    if (((((w & swar_low) + swar_add) | w) & swar_high) != 0)
+      break;
+
+    first += sizeof(uint64_t);
+  }
+
+  while (first != last && *first >= '0' && *first <= '9')
+    first++;
+
+  return first;
+}
+
 const char*
 object_read_bencode_c_value(const char* first, const char* last, int64_t& value) {
   if (first == last)
@@ -91,7 +122,9 @@ object_read_bencode_c_value(const char* first, const char* last, int64_t& value)
 
   value = 0;
 
-  while (first != last && *first >= '0' && *first <= '9')
+  const char* digits_end = object_scan_digits(first, last);
+
+  while (first != digits_end)
     value = value * 10 + (*first++ - '0');
 
   if (neg)
@@ -107,7 +140,9 @@ object_read_bencode_c_string(const char* first, const char* last) {
   // bit out.
   unsigned int length = 0x1 << (std::numeric_limits<unsigned int>::digits - 1);
 
-  while (first != last && *first >= '0' && *first <= '9')
+  const char* digits_end = object_scan_digits(first, last);
+
+  while (first != digits_end)
     length = length * 10 + (*first++ - '0');
 
   if (length + 1 > (unsigned int)std::distance(first, last) || length + 1 == 0
@@ -186,7 +221,17 @@ object_read_bencode(std::istream* input, Object* object, uint32_t depth) {
       if (str <= last && !object->as_map().empty())
         object->set_internal_flags(Object::flag_unordered);
 
-      Object* value = &object->as_map()[str];
+      // Keys in a well-formed dictionary arrive in sorted order, so
+      // append with an end hint in amortized constant time instead of
+      // paying a full tree descent per key; unordered or duplicate
+      // keys just make the hint a no-op.
+      Object* value;
+
+      if (object->as_map().empty() || last < str)
+        value = &object->as_map().insert(object->as_map().end(), Object::map_type::value_type(str, Object()))->second;
+      else
+        value = &object->as_map()[str];
+
       object_read_bencode(input, value, depth);
 
       if (value->flags() & Object::flag_unordered)
@@ -213,8 +258,8 @@ object_read_bencode(std::istream* input, Object* object, uint32_t depth) {
   object->clear();
 }
 
-const char*
-object_read_bencode_c(const char* first, const char* last, Object* object, uint32_t depth) {
+static const char*
+object_read_bencode_c_impl(const char* first, const char* last, Object* object, uint32_t depth, bool borrow) {
   if (first == last)
     throw torrent::bencode_error("Invalid bencode data.");
 
@@ -240,7 +285,7 @@ object_read_bencode_c(const char* first, const char* last, Object* object, uint3
 	return first + 1;
 
       Object::list_iterator itr = object->as_list().insert(object->as_list().end(), Object());
-      first = object_read_bencode_c(first, last, &*itr, depth);
+      first = object_read_bencode_c_impl(first, last, &*itr, depth, borrow);
 
       // The unordered flag is inherited also from list elements who
       // have been marked as unordered, though e.g. unordered strings
@@ -275,8 +320,16 @@ object_read_bencode_c(const char* first, const char* last, Object* object, uint3
       if (str <= prev && !object->as_map().empty())
         object->set_internal_flags(Object::flag_unordered);
 
-      Object* value = &object->as_map()[str];
-      first = object_read_bencode_c(first, last, value, depth);
+      // As above: sorted keys append with an end hint in amortized
+      // constant time, anything else falls back to a plain insert.
+      Object* value;
+
+      if (object->as_map().empty() || prev < str)
+        value = &object->as_map().insert(object->as_map().end(), Object::map_type::value_type(str, Object()))->second;
+      else
+        value = &object->as_map()[str];
+
+      first = object_read_bencode_c_impl(first, last, value, depth, borrow);
 
       if (value->flags() & Object::flag_unordered)
         object->set_internal_flags(Object::flag_unordered);
@@ -292,7 +345,11 @@ object_read_bencode_c(const char* first, const char* last, Object* object, uint3
       throw torrent::bencode_error("Invalid bencode data.");
 
     raw_string raw_str = object_read_bencode_c_string(first, last);
-    *object = raw_str.as_string();
+
+    if (borrow)
+      *object = Object(raw_str);
+    else
+      *object = raw_str.as_string();
 
     return raw_str.end();
   }
@@ -301,6 +358,16 @@ object_read_bencode_c(const char* first, const char* last, Object* object, uint3
   throw torrent::bencode_error("Invalid bencode data.");
 }
 
+const char*
+object_read_bencode_c(const char* first, const char* last, Object* object, uint32_t depth) {
+  return object_read_bencode_c_impl(first, last, object, depth, false);
+}
+
+const char*
+object_read_bencode_borrow_c(const char* first, const char* last, Object* object, uint32_t depth) {
+  return object_read_bencode_c_impl(first, last, object, depth, true);
+}
+
 inline bool object_is_not_digit(char c) { return c < '0' || c > '9'; }
 
 const char*
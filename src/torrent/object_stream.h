@@ -54,6 +54,15 @@ raw_string  object_read_bencode_c_string(const char* first, const char* last) LI
 // the client.
 void        object_read_bencode(std::istream* input, Object* object, uint32_t depth = 0) LIBTORRENT_EXPORT;
 const char* object_read_bencode_c(const char* first, const char* last, Object* object, uint32_t depth = 0) LIBTORRENT_EXPORT;
+
+// Same as object_read_bencode_c, except string values are stored as
+// TYPE_RAW_STRING views into the input buffer instead of being copied.
+// The caller must keep the buffer alive for as long as the tree is
+// used. Dictionary keys are still copied as the map requires owned
+// keys, but those are short; this avoids copying multi-megabyte
+// strings like piece hashes during a parse-then-discard pass.
+const char* object_read_bencode_borrow_c(const char* first, const char* last, Object* object, uint32_t depth = 0) LIBTORRENT_EXPORT;
+
 const char* object_read_bencode_skip_c(const char* first, const char* last) LIBTORRENT_EXPORT;
 
 std::istream& operator >> (std::istream& input, Object& object) LIBTORRENT_EXPORT;
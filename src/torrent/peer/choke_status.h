@@ -48,6 +48,8 @@ public:
   choke_status() :
     m_group_entry(NULL),
 
+    m_entry_index(0),
+
     m_queued(false),
     m_unchoked(false),
     m_snubbed(false),
@@ -56,6 +58,12 @@ public:
   group_entry*        entry() const                           { return m_group_entry; }
   void                set_entry(group_entry* grp_ent)         { m_group_entry = grp_ent; }
 
+  // Position within the entry's queued or unchoked container,
+  // maintained by group_entry so membership changes don't need a
+  // linear scan. Only valid while queued or unchoked.
+  uint32_t            entry_index() const                     { return m_entry_index; }
+  void                set_entry_index(uint32_t idx)           { m_entry_index = idx; }
+
   bool                queued() const                          { return m_queued; }
   void                set_queued(bool s)                      { m_queued = s; }
 
@@ -72,6 +80,7 @@ public:
 private:
   // TODO: Use flags.
   group_entry*        m_group_entry;
+  uint32_t            m_entry_index;
 
   bool                m_queued;
   bool                m_unchoked;
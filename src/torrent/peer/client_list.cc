@@ -143,7 +143,29 @@ ClientList::insert(ClientInfo::id_type type, const char* key, const char* versio
   else
     std::memset(clientInfo.mutable_upper_version(), -1, ClientInfo::max_version_size);
 
-  return base_type::insert(end(), clientInfo);
+  iterator itr = base_type::insert(end(), clientInfo);
+  rebuild_dispatch();
+
+  return itr;
+}
+
+// Insertion only happens at configuration time, so the dispatch index
+// is rebuilt wholesale rather than updated in place.
+void
+ClientList::rebuild_dispatch() {
+  std::memset(m_dispatch, 0, sizeof(m_dispatch));
+  m_dispatch_next.assign(size(), 0);
+
+  // Walk backwards so each chain head ends up on the earliest entry,
+  // preserving the first-match semantics of the old linear scan.
+  for (size_type idx = size() - 1; idx >= 1; idx--) {
+    const ClientInfo& info = *(begin() + idx);
+
+    uint32_t& head = m_dispatch[info.type()][static_cast<uint8_t>(info.key()[0]) & (dispatch_width - 1)];
+
+    m_dispatch_next[idx] = head;
+    head = idx;
+  }
 }
 
 ClientList::iterator
@@ -229,7 +251,18 @@ ClientList::retrieve_id(ClientInfo* dest, const HashString& id) const {
     return false;
   }
 
-  const_iterator itr = std::find_if(begin() + 1, end(), std::bind(&ClientInfo::intersects, *dest, std::placeholders::_1));
+  // Two table loads narrow the candidates to the entries sharing the
+  // parsed type and leading key character; the chain is empty or a
+  // couple of entries long for every known prefix.
+  const_iterator itr = end();
+
+  for (uint32_t idx = m_dispatch[dest->type()][static_cast<uint8_t>(dest->key()[0]) & (dispatch_width - 1)];
+       idx != 0; idx = m_dispatch_next[idx]) {
+    if (ClientInfo::intersects(*dest, *(begin() + idx))) {
+      itr = begin() + idx;
+      break;
+    }
+  }
 
   if (itr == end())
     dest->set_info(begin()->info());
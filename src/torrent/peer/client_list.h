@@ -76,6 +76,18 @@ public:
 
   bool                retrieve_id(ClientInfo* dest, const HashString& id) const;
   void                retrieve_unknown(ClientInfo* dest) const;
+
+private:
+  // Two-level dispatch over the parsed client id: the first level
+  // maps (type, leading key character) to a chain of entries sharing
+  // that prefix, chained through m_dispatch_next in insertion order.
+  // Index 0 is the unknown entry and doubles as the chain terminator.
+  static const uint32_t dispatch_width = 128;
+
+  void                rebuild_dispatch() LIBTORRENT_NO_EXPORT;
+
+  uint32_t            m_dispatch[ClientInfo::TYPE_MAX_SIZE][dispatch_width];
+  std::vector<uint32_t> m_dispatch_next;
 };
 
 }
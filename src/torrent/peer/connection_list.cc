@@ -167,6 +167,19 @@ ConnectionList::erase(PeerInfo* peerInfo, int flags) {
 
 void
 ConnectionList::erase_remaining(iterator pos, int flags) {
+  // With disconnect_delayed the range is queued for the bounded
+  // per-tick sweep below instead of paying every socket teardown and
+  // PeerInfo release in one pass.
+  if (flags & disconnect_delayed) {
+    for (iterator itr = pos; itr != end(); itr++)
+      m_disconnectQueue.push_back((*itr)->id());
+
+    if (!m_disconnectQueue.empty() && !m_download->delay_disconnect_peers().is_queued())
+      priority_queue_insert(&taskScheduler, &m_download->delay_disconnect_peers(), cachedTime);
+
+    return;
+  }
+
   flags |= disconnect_quick;
 
   // Need to do it one connection at the time to ensure that when the
@@ -180,19 +193,30 @@ ConnectionList::erase_remaining(iterator pos, int flags) {
 void
 ConnectionList::erase_seeders() {
   erase_remaining(std::partition(begin(), end(), rak::on(std::mem_fun(&Peer::c_ptr), std::mem_fun(&PeerConnectionBase::is_not_seeder))),
-                  disconnect_unwanted);
+                  disconnect_unwanted | disconnect_delayed);
 }
 
+// Bound the teardown work done per invocation; the remainder is
+// rescheduled so a mass disconnect is spread across loop iterations.
+static const ConnectionList::queue_type::size_type max_queued_disconnects = 64;
+
 void
 ConnectionList::disconnect_queued() {
-  for (queue_type::const_iterator itr = m_disconnectQueue.begin(), last = m_disconnectQueue.end(); itr != last; itr++) {
-    ConnectionList::iterator conn_itr = find(m_disconnectQueue.back().c_str());
+  queue_type::size_type count = std::min(m_disconnectQueue.size(), max_queued_disconnects);
+
+  for (queue_type::size_type i = 0; i < count; i++) {
+    ConnectionList::iterator conn_itr = find(m_disconnectQueue[i].c_str());
 
     if (conn_itr != end())
       erase(conn_itr, 0);
   }
 
-  m_disconnectQueue = queue_type();
+  m_disconnectQueue.erase(m_disconnectQueue.begin(), m_disconnectQueue.begin() + count);
+
+  if (m_disconnectQueue.empty())
+    queue_type().swap(m_disconnectQueue);
+  else if (!m_download->delay_disconnect_peers().is_queued())
+    priority_queue_insert(&taskScheduler, &m_download->delay_disconnect_peers(), cachedTime);
 }
 
 struct connection_list_less {
@@ -81,6 +81,8 @@ public:
   const Rate*          up_rate() const;
   const Rate*          peer_rate() const;
 
+  // May be compacted (empty()) while the peer is idle; the size and
+  // set counters remain valid.
   const Bitfield*      bitfield() const;
 
   const BlockTransfer* transfer() const;
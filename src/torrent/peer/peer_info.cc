@@ -62,10 +62,21 @@ PeerInfo::PeerInfo(const sockaddr* address) :
 
   m_connection(NULL)
 {
-  rak::socket_address* sa = new rak::socket_address();
-  *sa = *rak::socket_address::cast_from(address);
+  std::memset(&m_addressInet6, 0, sizeof(m_addressInet6));
 
-  m_address = sa->c_sockaddr();
+  switch (address->sa_family) {
+  case AF_INET:
+    m_addressInet = *reinterpret_cast<const sockaddr_in*>(address);
+    break;
+  case AF_INET6:
+    m_addressInet6 = *reinterpret_cast<const sockaddr_in6*>(address);
+    break;
+  default:
+    m_address.sa_family = AF_UNSPEC;
+    break;
+  }
+
+  instrumentation_alloc(INSTRUMENTATION_ALLOC_DOWNLOAD, sizeof(PeerInfo));
 }
 
 PeerInfo::~PeerInfo() {
@@ -77,12 +88,12 @@ PeerInfo::~PeerInfo() {
   if (is_blocked())
     throw internal_error("PeerInfo::~PeerInfo() peer is blocked.");
 
-  delete rak::socket_address::cast_from(m_address);
+  instrumentation_free(INSTRUMENTATION_ALLOC_DOWNLOAD, sizeof(PeerInfo));
 }
 
 void
 PeerInfo::set_port(uint16_t port) {
-  rak::socket_address::cast_from(m_address)->set_port(port);
+  rak::socket_address::cast_from(&m_address)->set_port(port);
 }
 
 }
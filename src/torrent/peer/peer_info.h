@@ -37,6 +37,7 @@
 #ifndef LIBTORRENT_PEER_INFO_H
 #define LIBTORRENT_PEER_INFO_H
 
+#include <netinet/in.h>
 #include <torrent/exceptions.h>
 #include <torrent/hash_string.h>
 #include <torrent/peer/client_info.h>
@@ -60,7 +61,14 @@ public:
   static const int flag_unwanted  = (1 << 5);
   static const int flag_preferred = (1 << 6);
 
+  // Encryption mode negotiated by the last completed handshake, so
+  // reconnects can start out in the mode this address is known to
+  // accept instead of failing and retrying in the other one.
+  static const int flag_crypto_rc4   = (1 << 7);
+  static const int flag_crypto_plain = (1 << 8);
+
   static const int mask_ip_table = flag_unwanted | flag_preferred;
+  static const int mask_crypto   = flag_crypto_rc4 | flag_crypto_plain;
 
   PeerInfo(const sockaddr* address);
   ~PeerInfo();
@@ -73,6 +81,9 @@ public:
   bool                is_unwanted() const                   { return m_flags & flag_unwanted; }
   bool                is_preferred() const                  { return m_flags & flag_preferred; }
 
+  bool                is_crypto_rc4() const                 { return m_flags & flag_crypto_rc4; }
+  bool                is_crypto_plain() const               { return m_flags & flag_crypto_plain; }
+
   int                 flags() const                         { return m_flags; }
 
   const HashString&   id() const                            { return m_id; }
@@ -81,7 +92,7 @@ public:
   const ClientInfo&   client_info() const                   { return m_clientInfo; }
 
   const char*         options() const                       { return m_options; }
-  const sockaddr*     socket_address() const                { return m_address; }
+  const sockaddr*     socket_address() const                { return &m_address; }
 
   uint16_t            listen_port() const                   { return m_listenPort; }
 
@@ -98,6 +109,7 @@ public:
 
   bool                supports_dht() const                  { return m_options[7] & 0x01; }
   bool                supports_extensions() const           { return m_options[5] & 0x10; }
+  bool                supports_fast_extension() const       { return m_options[7] & 0x04; }
 
   //
   // Internal to libTorrent:
@@ -142,9 +154,15 @@ private:
 
   uint16_t            m_listenPort;
 
-  // Replace this with a union. Since the user never copies PeerInfo
-  // it should be safe to not require sockaddr_in6 to be part of it.
-  sockaddr*           m_address;
+  // Inline storage sized for the families PeerList accepts; with
+  // every peer ever seen kept around this is both smaller and one
+  // less pointer chase than the heap-allocated rak::socket_address
+  // it used to point at.
+  union {
+    sockaddr            m_address;
+    sockaddr_in         m_addressInet;
+    sockaddr_in6        m_addressInet6;
+  };
 
   PeerConnectionBase* m_connection;
 };
@@ -1,6 +1,7 @@
 #include "config.h"
 
 #include <algorithm>
+#include <cstring>
 #include <functional>
 #include <rak/functional.h>
 #include <rak/socket_address.h>
@@ -62,16 +63,138 @@ struct peer_list_equal_port : public std::binary_function<PeerList::reference, u
 //
 
 PeerList::PeerList() :
-  m_available_list(new AvailableList) {
+  m_available_list(new AvailableList),
+  m_key_index_fill(0) {
+}
+
+// Returns the first tree entry for 'key', or end() if the key is not
+// present.
+PeerList::iterator
+PeerList::key_index_find(const socket_address_key& key) {
+  if (m_key_index.empty())
+    return base_type::end();
+
+  uint32_t mask = m_key_index.size() - 1;
+  uint32_t slot = key.hash() & mask;
+
+  while (true) {
+    const key_index_slot& entry = m_key_index[slot];
+
+    if (entry.state == slot_empty)
+      return base_type::end();
+
+    if (entry.state == slot_used && entry.key == key)
+      return entry.first;
+
+    slot = (slot + 1) & mask;
+  }
+}
+
+// Insert an index entry for a key not already present, growing the
+// table to keep the fill factor, tombstones included, below three
+// quarters.
+void
+PeerList::key_index_insert(const socket_address_key& key, iterator itr) {
+  if (4 * (m_key_index_fill + 1) >= 3 * m_key_index.size())
+    key_index_rebuild();
+
+  uint32_t mask = m_key_index.size() - 1;
+  uint32_t slot = key.hash() & mask;
+  uint32_t insertSlot = m_key_index.size();
+
+  while (m_key_index[slot].state != slot_empty) {
+    // The rebuild indexes the whole tree, including the entry this
+    // call was about to add.
+    if (m_key_index[slot].state == slot_used && m_key_index[slot].key == key)
+      return;
+
+    if (m_key_index[slot].state == slot_erased && insertSlot == m_key_index.size())
+      insertSlot = slot;
+
+    slot = (slot + 1) & mask;
+  }
+
+  if (insertSlot == m_key_index.size()) {
+    insertSlot = slot;
+    m_key_index_fill++;
+  }
+
+  m_key_index[insertSlot].state = slot_used;
+  m_key_index[insertSlot].key = key;
+  m_key_index[insertSlot].first = itr;
+}
+
+// Called before erasing 'itr' from the tree; moves the index to the
+// next entry with the same key or drops the key entirely.
+void
+PeerList::key_index_erase(iterator itr) {
+  uint32_t mask = m_key_index.size() - 1;
+  uint32_t slot = itr->first.hash() & mask;
+
+  while (!(m_key_index[slot].state == slot_used && m_key_index[slot].key == itr->first))
+    slot = (slot + 1) & mask;
+
+  // A duplicate entry that isn't the indexed first leaves the index
+  // untouched.
+  if (m_key_index[slot].first != itr)
+    return;
+
+  iterator next = itr;
+  next++;
+
+  if (next != base_type::end() && next->first == itr->first)
+    m_key_index[slot].first = next;
+  else
+    m_key_index[slot].state = slot_erased;
+}
+
+void
+PeerList::key_index_rebuild() {
+  uint32_t tableSize = 64;
+
+  while (tableSize < 2 * (size() + 1))
+    tableSize <<= 1;
+
+  key_index_slot empty_slot;
+  empty_slot.state = slot_empty;
+  std::memset(&empty_slot.key, 0, sizeof(empty_slot.key));
+  empty_slot.first = base_type::end();
+
+  m_key_index.assign(tableSize, empty_slot);
+  m_key_index_fill = 0;
+
+  uint32_t mask = tableSize - 1;
+
+  // Iteration is in key order, so indexing only the first entry of
+  // each equal-key run needs no lookups.
+  for (iterator itr = base_type::begin(), last = base_type::end(); itr != last; itr++) {
+    if (itr != base_type::begin() && std::prev(itr)->first == itr->first)
+      continue;
+
+    uint32_t slot = itr->first.hash() & mask;
+
+    while (m_key_index[slot].state == slot_used)
+      slot = (slot + 1) & mask;
+
+    m_key_index[slot].state = slot_used;
+    m_key_index[slot].key = itr->first;
+    m_key_index[slot].first = itr;
+    m_key_index_fill++;
+  }
 }
 
 PeerList::~PeerList() {
   LT_LOG_EVENTS("deleting list total:%" PRIuPTR " available:%" PRIuPTR,
                 size(), m_available_list->size());
 
+  flush_deferred_peers();
+
   std::for_each(begin(), end(), rak::on(rak::mem_ref(&value_type::second), rak::call_delete<PeerInfo>()));
   base_type::clear();
 
+  m_key_index.clear();
+  m_key_index_fill = 0;
+
   m_info = NULL;
   delete m_available_list;
 }
@@ -95,14 +218,12 @@ PeerList::insert_address(const sockaddr* sa, int flags) {
 
   const rak::socket_address* address = rak::socket_address::cast_from(sa);
 
-  range_type range = base_type::equal_range(sock_key);
-
   // Do some special handling if we got a new port number but the
   // address was present.
   //
   // What we do depends on the flags, but for now just allow one
   // PeerInfo per address key and do nothing.
-  if (range.first != range.second) {
+  if (key_index_find(sock_key) != base_type::end()) {
     LT_LOG_EVENTS("address already exists " LT_LOG_SA_FMT,
                   address->address_str().c_str(), address->port());
     return NULL;
@@ -118,7 +239,7 @@ PeerList::insert_address(const sockaddr* sa, int flags) {
   
   manager->client_list()->retrieve_unknown(&peerInfo->mutable_client_info());
 
-  base_type::insert(range.second, value_type(sock_key, peerInfo));
+  key_index_insert(sock_key, base_type::insert(value_type(sock_key, peerInfo)));
 
   if ((flags & address_available) && peerInfo->listen_port() != 0) {
     m_available_list->push_back(address);
@@ -132,6 +253,18 @@ PeerList::insert_address(const sockaddr* sa, int flags) {
   return peerInfo;
 }
 
+const PeerInfo*
+PeerList::find_address(const sockaddr* sa) {
+  socket_address_key sock_key = socket_address_key::from_sockaddr(sa);
+
+  if (!sock_key.is_valid() ||
+      !socket_address_key::is_comparable_sockaddr(sa))
+    return NULL;
+
+  iterator itr = key_index_find(sock_key);
+  return itr != base_type::end() ? itr->second : NULL;
+}
+
 inline bool
 socket_address_less_rak(const rak::socket_address& s1, const rak::socket_address& s2) {
   return socket_address_less(s1.c_sockaddr(), s2.c_sockaddr());
@@ -149,13 +282,17 @@ PeerList::insert_available(const void* al) {
   if (m_available_list->size() + addressList->size() > m_available_list->capacity())
     m_available_list->reserve(m_available_list->size() + addressList->size() + 128);
 
-  // Optimize this so that we don't traverse the tree for every
-  // insert, since we know 'al' is sorted.
+  // The response is sorted by the caller, but the available list is
+  // not kept sorted, so merge-join against a sorted snapshot of it;
+  // one pass over each replaces the old resumed scan, whose reversed
+  // predicate never actually caught a duplicate.
+  std::vector<rak::socket_address> avail_sorted(m_available_list->begin(), m_available_list->end());
+  std::sort(avail_sorted.begin(), avail_sorted.end(), socket_address_less_rak);
 
   AddressList::const_iterator itr   = addressList->begin();
   AddressList::const_iterator last  = addressList->end();
-  AvailableList::const_iterator availItr  = m_available_list->begin();
-  AvailableList::const_iterator availLast = m_available_list->end();
+  std::vector<rak::socket_address>::const_iterator availItr  = avail_sorted.begin();
+  std::vector<rak::socket_address>::const_iterator availLast = avail_sorted.end();
 
   for (; itr != last; itr++) {
     if (!socket_address_key::is_comparable_sockaddr(itr->c_sockaddr()) || itr->port() == 0) {
@@ -164,7 +301,8 @@ PeerList::insert_available(const void* al) {
       continue;
     }
 
-    availItr = std::find_if(availItr, availLast, rak::bind2nd(std::ptr_fun(&socket_address_less_rak), *itr));
+    while (availItr != availLast && socket_address_less_rak(*availItr, *itr))
+      availItr++;
 
     if (availItr != availLast && !socket_address_less(availItr->c_sockaddr(), itr->c_sockaddr())) {
       // The address is already in m_available_list, so don't bother
@@ -179,12 +317,12 @@ PeerList::insert_available(const void* al) {
     // ever want to connect. Just update the timer for the last
     // availability notice if the peer isn't really ideal, but might
     // be used in an emergency.
-    range_type range = base_type::equal_range(sock_key);
+    iterator key_itr = key_index_find(sock_key);
 
-    if (range.first != range.second) {
+    if (key_itr != base_type::end()) {
       // Add some logic here to select the best PeerInfo, but for now
       // just assume the first one is the only one that exists.
-      PeerInfo* peerInfo = range.first->second;
+      PeerInfo* peerInfo = key_itr->second;
 
       if (peerInfo->listen_port() == 0)
         peerInfo->set_port(itr->port());
@@ -253,18 +391,18 @@ PeerList::connected(const sockaddr* sa, int flags) {
   }
 
   PeerInfo* peerInfo;
-  range_type range = base_type::equal_range(sock_key);
+  iterator key_itr = key_index_find(sock_key);
 
-  if (range.first == range.second) {
+  if (key_itr == base_type::end()) {
     // Create a new entry.
     peerInfo = new PeerInfo(sa);
     peerInfo->set_flags(filter_value & PeerInfo::mask_ip_table);
 
-    base_type::insert(range.second, value_type(sock_key, peerInfo));
+    key_index_insert(sock_key, base_type::insert(value_type(sock_key, peerInfo)));
 
-  } else if (!range.first->second->is_connected()) {
+  } else if (!key_itr->second->is_connected()) {
     // Use an old entry.
-    peerInfo = range.first->second;
+    peerInfo = key_itr->second;
     peerInfo->set_port(address->port());
 
   } else {
@@ -290,7 +428,9 @@ PeerList::connected(const sockaddr* sa, int flags) {
     peerInfo = new PeerInfo(sa);
     peerInfo->set_flags(filter_value & PeerInfo::mask_ip_table);
 
-    base_type::insert(range.second, value_type(sock_key, peerInfo));
+    // Inserted at the end of the equal-key run, so the indexed first
+    // entry stays valid.
+    base_type::insert(value_type(sock_key, peerInfo));
   }
 
   if (flags & connect_filter_recent &&
@@ -317,11 +457,12 @@ void
 PeerList::disconnected(PeerInfo* p, int flags) {
   socket_address_key sock_key = socket_address_key::from_sockaddr(p->socket_address());
 
-  range_type range = base_type::equal_range(sock_key);
-  
-  iterator itr = std::find_if(range.first, range.second, rak::equal(p, rak::mem_ref(&value_type::second)));
+  iterator itr = key_index_find(sock_key);
 
-  if (itr == range.second) {
+  while (itr != base_type::end() && itr->first == sock_key && itr->second != p)
+    itr++;
+
+  if (itr == base_type::end() || !(itr->first == sock_key)) {
     if (std::find_if(base_type::begin(), base_type::end(), rak::equal(p, rak::mem_ref(&value_type::second))) == base_type::end())
       throw internal_error("PeerList::disconnected(...) itr == range.second, doesn't exist.");
     else
@@ -392,8 +533,13 @@ PeerList::cull_peers(int flags) {
     iterator tmp = itr++;
     PeerInfo* peerInfo = tmp->second;
 
+    key_index_erase(tmp);
     base_type::erase(tmp);
-    delete peerInfo;
+
+    // Only unlink here; the free happens in flush_deferred_peers()
+    // once the loop has gone quiescent, so anything holding the
+    // pointer further up the current call stack stays valid.
+    m_deferred_peers.push_back(peerInfo);
 
     counter++;
   }
@@ -401,4 +547,10 @@ PeerList::cull_peers(int flags) {
   return counter;
 }
 
+void
+PeerList::flush_deferred_peers() {
+  std::for_each(m_deferred_peers.begin(), m_deferred_peers.end(), rak::call_delete<PeerInfo>());
+  m_deferred_peers.clear();
+}
+
 }
@@ -2,6 +2,7 @@
 #define LIBTORRENT_PEER_LIST_H
 
 #include <map>
+#include <vector>
 #include <torrent/common.h>
 #include <torrent/net/socket_address_key.h>
 #include <torrent/utils/extents.h>
@@ -54,6 +55,11 @@ public:
 
   PeerInfo*           insert_address(const sockaddr* address, int flags);
 
+  // Find an existing entry for 'sa', or NULL. Used by the connection
+  // admission scoring to look up peer history without mutating the
+  // list.
+  const PeerInfo*     find_address(const sockaddr* sa) LIBTORRENT_NO_EXPORT;
+
   // This will be used internally only for the moment.
   uint32_t            insert_available(const void* al) LIBTORRENT_NO_EXPORT;
 
@@ -64,6 +70,12 @@ public:
 
   uint32_t            cull_peers(int flags);
 
+  // Culling only unlinks the PeerInfo's; the actual frees are
+  // deferred to the next quiescent pass over this download, so no
+  // caller higher up the stack can be left with a dangling pointer
+  // from the same event.
+  void                flush_deferred_peers();
+
   const_iterator         begin() const  { return base_type::begin(); }
   const_iterator         end() const    { return base_type::end(); }
   const_reverse_iterator rbegin() const { return base_type::rbegin(); }
@@ -83,10 +95,37 @@ private:
   PeerList(const PeerList&);
   void operator = (const PeerList&);
 
+  // Flat open-addressing index caching the first tree entry for each
+  // packed address key, so lookups on the incoming connection and
+  // merge paths cost a probe over a contiguous table instead of a
+  // walk down the tree.
+  static const uint8_t slot_empty  = 0;
+  static const uint8_t slot_used   = 1;
+  static const uint8_t slot_erased = 2;
+
+  struct key_index_slot {
+    uint8_t             state;
+    socket_address_key  key;
+    base_type::iterator first;
+  };
+
+  typedef std::vector<key_index_slot> key_index_type;
+
+  iterator            key_index_find(const socket_address_key& key) LIBTORRENT_NO_EXPORT;
+  void                key_index_insert(const socket_address_key& key, iterator itr) LIBTORRENT_NO_EXPORT;
+  void                key_index_erase(iterator itr) LIBTORRENT_NO_EXPORT;
+  void                key_index_rebuild() LIBTORRENT_NO_EXPORT;
+
   static ipv4_table   m_ipv4_table;
 
   DownloadInfo*       m_info;
   AvailableList*      m_available_list;
+
+  key_index_type      m_key_index;
+  uint32_t            m_key_index_fill;
+
+  // Unlinked but not yet freed PeerInfo's.
+  std::vector<PeerInfo*> m_deferred_peers;
 };
 
 }
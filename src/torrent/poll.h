@@ -51,6 +51,10 @@ public:
   static const int      poll_worker_thread     = 0x1;
   static const uint32_t flag_waive_global_lock = 0x1;
 
+  // Spin with a zero poll timeout instead of sleeping in the kernel,
+  // trading a dedicated core for wakeup latency.
+  static const uint32_t flag_busy_poll         = 0x2;
+
   Poll() : m_flags(0) {}
   virtual ~Poll() {}
 
@@ -93,6 +97,13 @@ public:
 
   static slot_poll&   slot_create_poll() { return m_slot_create_poll; }
 
+  // Probe the available backends at runtime and return the best
+  // usable one; epoll or kqueue when the compiled-in support also
+  // works on the running kernel, otherwise the select() fallback.
+  // Thread initialization uses this when the client has not installed
+  // its own create slot.
+  static Poll*        create(int maxOpenSockets);
+
 private:
   static slot_poll    m_slot_create_poll;
 
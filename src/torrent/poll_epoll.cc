@@ -48,7 +48,9 @@
 #include "torrent.h"
 #include "poll_epoll.h"
 #include "utils/log.h"
+#include "utils/instrumentation.h"
 #include "utils/thread_base.h"
+#include "utils/tracepoints.h"
 #include "rak/error_number.h"
 #include "rak/timer.h"
 
@@ -86,6 +88,11 @@ PollEPoll::modify(Event* event, int op, uint32_t mask) {
   e.data.fd = event->file_descriptor();
   e.events = mask;
 
+  // The table keeps the logical mask; EPOLLET is a property of the
+  // registration, not of what the event listens to.
+  if (m_edgeTriggered && mask != 0)
+    e.events |= EPOLLET;
+
   set_event_mask(event, mask);
 
   if (epoll_ctl(m_fd, op, event->file_descriptor(), &e)) {
@@ -129,11 +136,26 @@ PollEPoll::PollEPoll(int fd, int maxEvents, int maxOpenSockets) :
   m_fd(fd),
   m_maxEvents(maxEvents),
   m_waitingEvents(0),
+  m_edgeTriggered(false),
   m_events(new epoll_event[m_maxEvents]) {
 
   m_table.resize(maxOpenSockets);
 }
 
+void
+PollEPoll::set_edge_triggered(bool state) {
+  if (state == m_edgeTriggered)
+    return;
+
+  // Already registered descriptors keep their trigger mode in the
+  // kernel, so flipping it mid-flight would leave the set split.
+  for (Table::const_iterator itr = m_table.begin(), last = m_table.end(); itr != last; ++itr)
+    if (itr->second != NULL)
+      throw internal_error("PollEPoll::set_edge_triggered(...) called with active file descriptors.");
+
+  m_edgeTriggered = state;
+}
+
 PollEPoll::~PollEPoll() {
   m_table.clear();
   delete [] m_events;
@@ -160,34 +182,47 @@ unsigned int
 PollEPoll::perform() {
   unsigned int count = 0;
 
-  for (epoll_event *itr = m_events, *last = m_events + m_waitingEvents; itr != last; ++itr) {
-    if (itr->data.fd < 0 || (size_t)itr->data.fd >= m_table.size())
-      continue;
+  LT_SDT1(poll_perform, m_waitingEvents);
 
-    if ((flags() & flag_waive_global_lock) && thread_base::global_queue_size() != 0)
-      thread_base::waive_global_lock();
+  // Dispatch in event class order instead of kernel return order, so
+  // an accept or DHT flood in the same batch doesn't run ahead of
+  // payload transfers. The table entry is re-read each pass, as
+  // sockets may remove themselves during dispatch.
+  for (int priority = Event::POLL_PRIORITY_TRANSFER; priority <= Event::POLL_PRIORITY_LOW; priority++) {
+    for (epoll_event *itr = m_events, *last = m_events + m_waitingEvents; itr != last; ++itr) {
+      if (itr->data.fd < 0 || (size_t)itr->data.fd >= m_table.size())
+        continue;
 
-    Table::iterator evItr = m_table.begin() + itr->data.fd;
+      Table::iterator evItr = m_table.begin() + itr->data.fd;
 
-    // Each branch must check for data.ptr != NULL to allow the socket
-    // to remove itself between the calls.
-    //
-    // TODO: Make it so that it checks that read/write is wanted, that
-    // it wasn't removed from one of them but not closed.
+      if (evItr->second == NULL || evItr->second->poll_priority() != priority)
+        continue;
 
-    if (itr->events & EPOLLERR && evItr->second != NULL && evItr->first & EPOLLERR) {
-      count++;
-      evItr->second->event_error();
-    }
+      LT_SDT2(poll_event, itr->data.fd, itr->events);
 
-    if (itr->events & EPOLLIN && evItr->second != NULL && evItr->first & EPOLLIN) {
-      count++;
-      evItr->second->event_read();
-    }
+      if ((flags() & flag_waive_global_lock) && thread_base::global_queue_size() != 0)
+        thread_base::waive_global_lock();
+
+      // Each branch must check for data.ptr != NULL to allow the socket
+      // to remove itself between the calls.
+      //
+      // TODO: Make it so that it checks that read/write is wanted, that
+      // it wasn't removed from one of them but not closed.
+
+      if (itr->events & EPOLLERR && evItr->second != NULL && evItr->first & EPOLLERR) {
+        count++;
+        evItr->second->event_error();
+      }
 
-    if (itr->events & EPOLLOUT && evItr->second != NULL && evItr->first & EPOLLOUT) {
-      count++;
-      evItr->second->event_write();
+      if (itr->events & EPOLLIN && evItr->second != NULL && evItr->first & EPOLLIN) {
+        count++;
+        evItr->second->event_read();
+      }
+
+      if (itr->events & EPOLLOUT && evItr->second != NULL && evItr->first & EPOLLOUT) {
+        count++;
+        evItr->second->event_write();
+      }
     }
   }
 
@@ -201,6 +236,11 @@ PollEPoll::do_poll(int64_t timeout_usec, int flags) {
 
   timeout += 10;
 
+  // Busy-poll mode spins on the kernel's ready list instead of
+  // sleeping, for setups that trade a core for wakeup latency.
+  if (Poll::flags() & flag_busy_poll)
+    timeout = rak::timer();
+
   if (!(flags & poll_worker_thread)) {
     thread_base::release_global_lock();
     thread_base::entering_main_polling();
@@ -221,7 +261,26 @@ PollEPoll::do_poll(int64_t timeout_usec, int flags) {
     return 0;
   }
 
-  return perform();
+  rak::timer perform_start = rak::timer::current();
+
+  unsigned int count = perform();
+
+  // A full event table means more sockets are ready than fit in one
+  // batch. Drain the backlog now instead of waking up once per slice,
+  // which also keeps edge-triggered notifications from sitting in the
+  // kernel's ready list until the next poll.
+  while (status == m_maxEvents) {
+    status = poll(0);
+
+    if (status <= 0)
+      break;
+
+    count += perform();
+  }
+
+  instrumentation_update(INSTRUMENTATION_POLLING_TIME_SOCKET_EVENTS, (rak::timer::current() - perform_start).usec());
+
+  return count;
 }
 
 uint32_t
@@ -345,6 +404,7 @@ int PollEPoll::poll(int msec) { throw internal_error("An PollEPoll function was
 unsigned int PollEPoll::perform() { throw internal_error("An PollEPoll function was called, but it is disabled."); }
 unsigned int PollEPoll::do_poll(int64_t timeout_usec, int flags) { throw internal_error("An PollEPoll function was called, but it is disabled."); }
 uint32_t PollEPoll::open_max() const { throw internal_error("An PollEPoll function was called, but it is disabled."); }
+void PollEPoll::set_edge_triggered(bool state) { throw internal_error("An PollEPoll function was called, but it is disabled."); }
 
 void PollEPoll::open(torrent::Event* event) {}
 void PollEPoll::close(torrent::Event* event) {}
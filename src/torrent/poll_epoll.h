@@ -58,6 +58,15 @@ public:
 
   int                 file_descriptor() { return m_fd; }
 
+  // Edge-triggered mode registers all file descriptors with EPOLLET,
+  // so the kernel only reports a socket when new activity arrives
+  // rather than on every epoll_wait while it stays ready. This
+  // requires every event handler to consume until EAGAIN, which the
+  // Event implementations in this library do. Must be set before any
+  // file descriptors are inserted.
+  bool                is_edge_triggered() const { return m_edgeTriggered; }
+  void                set_edge_triggered(bool state);
+
   virtual uint32_t    open_max() const;
 
   // torrent::Event::get_fd() is guaranteed to be valid and remain constant
@@ -96,6 +105,8 @@ private:
   int                 m_maxEvents;
   int                 m_waitingEvents;
 
+  bool                m_edgeTriggered;
+
   Table               m_table;
   epoll_event*        m_events;
 };
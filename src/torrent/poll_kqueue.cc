@@ -51,6 +51,7 @@
 #include "rak/timer.h"
 #include "rak/error_number.h"
 #include "utils/log.h"
+#include "utils/instrumentation.h"
 #include "utils/thread_base.h"
 
 #ifdef USE_KQUEUE
@@ -100,6 +101,23 @@ void
 PollKQueue::modify(Event* event, unsigned short op, short mask) {
   LT_LOG_EVENT(event, DEBUG, "Modify event: op:%hx mask:%hx changed:%u.", op, mask, m_changedEvents);
 
+  // Socket state that flips within one poll cycle leaves an add and a
+  // delete for the same filter in the buffer. Ops on a filter
+  // strictly alternate, so a buffered entry is always the opposite of
+  // the incoming one and the pair nets out to no kernel change; drop
+  // both instead of submitting them.
+  for (struct kevent *itr = m_changes + m_changedEvents; itr != m_changes; ) {
+    itr--;
+
+    if (itr->ident != (uintptr_t)event->file_descriptor() || itr->filter != mask)
+      continue;
+
+    // Entries for different sockets are order-independent, so the
+    // last entry can just take the cancelled slot.
+    *itr = m_changes[--m_changedEvents];
+    return;
+  }
+
   // Flush the changed filters to the kernel if the buffer is full.
   if (m_changedEvents == m_maxEvents) {
     if (kevent(m_fd, m_changes, m_changedEvents, NULL, 0, NULL) == -1)
@@ -260,6 +278,11 @@ PollKQueue::do_poll(int64_t timeout_usec, int flags) {
   rak::timer timeout = rak::timer(timeout_usec);
   timeout += 10;
 
+  // Busy-poll mode spins on the kernel's ready list instead of
+  // sleeping, for setups that trade a core for wakeup latency.
+  if (Poll::flags() & flag_busy_poll)
+    timeout = rak::timer();
+
   if (!(flags & poll_worker_thread)) {
     thread_base::release_global_lock();
     thread_base::entering_main_polling();
@@ -280,7 +303,12 @@ PollKQueue::do_poll(int64_t timeout_usec, int flags) {
     return 0;
   }
 
-  return perform();
+  rak::timer perform_start = rak::timer::current();
+  unsigned int count = perform();
+
+  instrumentation_update(INSTRUMENTATION_POLLING_TIME_SOCKET_EVENTS, (rak::timer::current() - perform_start).usec());
+
+  return count;
 }
 
 uint32_t
@@ -47,11 +47,14 @@
 
 #include "event.h"
 #include "exceptions.h"
+#include "poll_epoll.h"
+#include "poll_kqueue.h"
 #include "poll_select.h"
 #include "torrent.h"
 #include "rak/timer.h"
 #include "rak/error_number.h"
 #include "utils/log.h"
+#include "utils/instrumentation.h"
 #include "utils/thread_base.h"
 
 #define LT_LOG_EVENT(event, log_level, log_fmt, ...)                    \
@@ -61,65 +64,75 @@ namespace torrent {
 
 Poll::slot_poll Poll::m_slot_create_poll;
 
-template <typename _Operation>
-struct poll_check_t {
-  poll_check_t(Poll* p, fd_set* s, _Operation op) : m_poll(p), m_set(s), m_op(op) {}
+// The backends' create functions return NULL both when support was
+// compiled out and when the running kernel rejects them, so this
+// doubles as a capability probe.
+Poll*
+Poll::create(int maxOpenSockets) {
+  Poll* poll;
 
-  bool operator () (Event* s) {
-    // This check is nessesary as other events may remove a socket
-    // from the set.
-    if (s == NULL)
-      return false;
+  if ((poll = PollEPoll::create(maxOpenSockets)) != NULL)
+    return poll;
 
-    // This check is not nessesary, just for debugging.
-    if (s->file_descriptor() < 0)
-      throw internal_error("poll_check: s->fd < 0");
+  if ((poll = PollKQueue::create(maxOpenSockets)) != NULL)
+    return poll;
 
-    if (FD_ISSET(s->file_descriptor(), m_set)) {
-      m_op(s);
+  if ((poll = PollSelect::create(maxOpenSockets)) != NULL)
+    return poll;
 
-      // We waive the global lock after an event has been processed in
-      // order to ensure that 's' doesn't get removed before the op is
-      // called.
-      if ((m_poll->flags() & Poll::flag_waive_global_lock) && thread_base::global_queue_size() != 0)
-        thread_base::waive_global_lock();
+  throw internal_error("Poll::create(...) found no usable poll backend.");
+}
 
-      return true;
-    } else {
-      return false;
-    }
-  }
+// Mark all active slots in the fd set, stamping the slot generations
+// so perform can validate the readiness it gathers here. Returns the
+// largest fd marked.
+static unsigned int
+poll_mark(SocketSet* set, fd_set* fds) {
+  if (set->empty())
+    return 0;
+
+  SocketSet::size_type last = set->max_fd();
+
+  for (SocketSet::size_type fd = 0; fd <= last; fd++) {
+    if (set->event_at(fd) == NULL)
+      continue;
 
-  Poll*      m_poll;
-  fd_set*    m_set;
-  _Operation m_op;
-};
+    FD_SET(fd, fds);
+    set->mark(fd);
+  }
 
-template <typename _Operation>
-inline poll_check_t<_Operation>
-poll_check(Poll* p, fd_set* s, _Operation op) {
-  return poll_check_t<_Operation>(p, s, op);
+  return last;
 }
 
-struct poll_mark {
-  poll_mark(fd_set* s, unsigned int* m) : m_max(m), m_set(s) {}
+static unsigned int
+poll_check(Poll* poll, SocketSet* set, fd_set* fds, void (Event::*op)()) {
+  unsigned int count = 0;
+
+  if (set->empty())
+    return 0;
 
-  void operator () (Event* s) {
-    // Neither of these checks are nessesary, just for debugging.
-    if (s == NULL)
-      throw internal_error("poll_mark: s == NULL");
+  // Use a fixed bound; events inserted by the ops below bump their
+  // slot's generation and thus fail the check anyway.
+  SocketSet::size_type last = set->max_fd();
 
-    if (s->file_descriptor() < 0)
-      throw internal_error("poll_mark: s->fd < 0");
+  for (SocketSet::size_type fd = 0; fd <= last; fd++) {
+    // The generation check is nessesary as other events may remove or
+    // replace a socket in the set after the readiness was gathered.
+    if (!FD_ISSET(fd, fds) || !set->is_current(fd))
+      continue;
 
-    *m_max = std::max(*m_max, (unsigned int)s->file_descriptor());
+    (set->event_at(fd)->*op)();
+    count++;
 
-    FD_SET(s->file_descriptor(), m_set);
+    // We waive the global lock after an event has been processed in
+    // order to ensure that the event doesn't get removed before the
+    // op is called.
+    if ((poll->flags() & Poll::flag_waive_global_lock) && thread_base::global_queue_size() != 0)
+      thread_base::waive_global_lock();
   }
 
-  unsigned int*       m_max;
-  fd_set*             m_set;
-};
+  return count;
+}
 
 PollSelect*
 PollSelect::create(int maxOpenSockets) {
@@ -154,24 +167,10 @@ PollSelect::create(int maxOpenSockets) {
 }
 
 PollSelect::~PollSelect() {
-  m_readSet->prepare();
-  m_writeSet->prepare();
-  m_exceptSet->prepare();
-
   // Re-add this check when you've cleaned up the client shutdown procedure.
-  if (!m_readSet->empty() || !m_writeSet->empty() || !m_exceptSet->empty()) {
+  if (!m_readSet->empty() || !m_writeSet->empty() || !m_exceptSet->empty())
     throw internal_error("PollSelect::~PollSelect() called but the sets are not empty");
 
-    // for (SocketSet::const_iterator itr = m_readSet->begin(); itr != m_readSet->end(); itr++)
-    //   std::cout << "R" << (*itr)->file_descriptor() << std::endl;
-
-    // for (SocketSet::const_iterator itr = m_writeSet->begin(); itr != m_writeSet->end(); itr++)
-    //   std::cout << "W" << (*itr)->file_descriptor() << std::endl;
-
-    // for (SocketSet::const_iterator itr = m_exceptSet->begin(); itr != m_exceptSet->end(); itr++)
-    //   std::cout << "E" << (*itr)->file_descriptor() << std::endl;
-  }
-
 //   delete m_readSet;
 //   delete m_writeSet;
 //   delete m_exceptSet;
@@ -188,14 +187,9 @@ unsigned int
 PollSelect::fdset(fd_set* readSet, fd_set* writeSet, fd_set* exceptSet) {
   unsigned int maxFd = 0;
 
-  m_readSet->prepare();
-  std::for_each(m_readSet->begin(), m_readSet->end(), poll_mark(readSet, &maxFd));
-
-  m_writeSet->prepare();
-  std::for_each(m_writeSet->begin(), m_writeSet->end(), poll_mark(writeSet, &maxFd));
-  
-  m_exceptSet->prepare();
-  std::for_each(m_exceptSet->begin(), m_exceptSet->end(), poll_mark(exceptSet, &maxFd));
+  maxFd = std::max(maxFd, poll_mark(m_readSet, readSet));
+  maxFd = std::max(maxFd, poll_mark(m_writeSet, writeSet));
+  maxFd = std::max(maxFd, poll_mark(m_exceptSet, exceptSet));
 
   return maxFd;
 }
@@ -206,17 +200,9 @@ PollSelect::perform(fd_set* readSet, fd_set* writeSet, fd_set* exceptSet) {
 
   // Make sure we don't do read/write on fd's that are in except. This should
   // not be a problem as any except call should remove it from the m_*Set's.
-  m_exceptSet->prepare();
-  count += std::count_if(m_exceptSet->begin(), m_exceptSet->end(),
-                         poll_check(this, exceptSet, std::mem_fun(&Event::event_error)));
-
-  m_readSet->prepare();
-  count += std::count_if(m_readSet->begin(), m_readSet->end(),
-                         poll_check(this, readSet, std::mem_fun(&Event::event_read)));
-
-  m_writeSet->prepare();
-  count += std::count_if(m_writeSet->begin(), m_writeSet->end(),
-                         poll_check(this, writeSet, std::mem_fun(&Event::event_write)));
+  count += poll_check(this, m_exceptSet, exceptSet, &Event::event_error);
+  count += poll_check(this, m_readSet, readSet, &Event::event_read);
+  count += poll_check(this, m_writeSet, writeSet, &Event::event_write);
 
   return count;
 }
@@ -227,6 +213,11 @@ PollSelect::do_poll(int64_t timeout_usec, int flags) {
 
   timeout += 10;
 
+  // Busy-poll mode spins on the kernel's ready list instead of
+  // sleeping, for setups that trade a core for wakeup latency.
+  if (Poll::flags() & flag_busy_poll)
+    timeout = rak::timer();
+
   uint32_t set_size = open_max();
 
   char read_set_buffer[set_size];
@@ -262,7 +253,12 @@ PollSelect::do_poll(int64_t timeout_usec, int flags) {
     return 0;
   }
 
-  return perform(read_set, write_set, error_set);
+  rak::timer perform_start = rak::timer::current();
+  unsigned int count = perform(read_set, write_set, error_set);
+
+  instrumentation_update(INSTRUMENTATION_POLLING_TIME_SOCKET_EVENTS, (rak::timer::current() - perform_start).usec());
+
+  return count;
 }
 
 #ifdef LT_LOG_POLL_OPEN
@@ -318,17 +314,17 @@ PollSelect::closed(Event* event) {
 
 bool
 PollSelect::in_read(Event* event) {
-  return m_readSet->find(event) != m_readSet->end();
+  return m_readSet->has(event);
 }
 
 bool
 PollSelect::in_write(Event* event) {
-  return m_writeSet->find(event) != m_writeSet->end();
+  return m_writeSet->has(event);
 }
 
 bool
 PollSelect::in_error(Event* event) {
-  return m_exceptSet->find(event) != m_exceptSet->end();
+  return m_exceptSet->has(event);
 }
 
 void
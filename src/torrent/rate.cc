@@ -36,12 +36,16 @@
 
 #include "config.h"
 
+#include <cmath>
+
 #include "globals.h"
 #include "rate.h"
 #include "exceptions.h"
 
 namespace torrent {
 
+const Rate::timer_type Rate::ewma_tau;
+
 inline void
 Rate::discard_old() const {
   while (!m_container.empty() && m_container.back().first < cachedTime.seconds() - m_span) {
@@ -50,15 +54,86 @@ Rate::discard_old() const {
   }
 }
 
+// Move the pending batch into the bucket list and EWMA. The batch is
+// stamped with the current second; a fold triggered by the second
+// advancing places it at most one bucket late, which is within the
+// resolution the bucket list already has.
+void
+Rate::fold_pending() const {
+  m_pendingTime = cachedTime.seconds();
+
+  if (m_pending == 0)
+    return;
+
+  rate_type bytes = m_pending;
+  m_pending = 0;
+
+  discard_old();
+
+  if (m_container.empty() || m_container.front().first != cachedTime.seconds())
+    m_container.push_front(value_type(cachedTime.seconds(), bytes));
+  else
+    m_container.front().second += bytes;
+
+  m_current += bytes;
+
+  m_ewmaBytes += bytes;
+  ewma_fold();
+}
+
+void
+Rate::insert_batched(rate_type bytes) {
+  if (m_pendingTime != cachedTime.seconds())
+    fold_pending();
+
+  m_pending += bytes;
+  m_total += bytes;
+}
+
 Rate::rate_type
 Rate::rate() const {
+  fold_pending();
   discard_old();
 
   return m_current / m_span;
 }
 
+// Fold the bytes accumulated since the last fold into the EWMA.
+// Samples landing within the same poll cycle carry identical
+// cachedTime stamps, so they are accumulated and folded as one batch
+// once the clock advances.
+inline void
+Rate::ewma_fold() const {
+  int64_t now = cachedTime.usec();
+
+  if (m_ewmaTime == 0) {
+    m_ewmaTime = now;
+    return;
+  }
+
+  int64_t elapsed = now - m_ewmaTime;
+
+  if (elapsed <= 0)
+    return;
+
+  double alpha = 1.0 - std::exp(-(double)elapsed / ewma_tau);
+
+  m_ewmaRate += alpha * ((double)m_ewmaBytes / elapsed - m_ewmaRate);
+  m_ewmaBytes = 0;
+  m_ewmaTime = now;
+}
+
+Rate::rate_type
+Rate::rate_ewma() const {
+  fold_pending();
+  ewma_fold();
+
+  return (rate_type)(m_ewmaRate * 1000000.0);
+}
+
 void
 Rate::insert(rate_type bytes) {
+  fold_pending();
   discard_old();
 
   if (m_current > ((rate_type)1 << 40) || bytes > ((rate_type)1 << 28))
@@ -71,6 +146,9 @@ Rate::insert(rate_type bytes) {
 
   m_total += bytes;
   m_current += bytes;
+
+  m_ewmaBytes += bytes;
+  ewma_fold();
 }
 
 }
@@ -55,11 +55,23 @@ public:
   typedef std::pair<timer_type, rate_type> value_type;
   typedef std::deque<value_type>           queue_type;
 
-  Rate(timer_type span) : m_current(0), m_total(0), m_span(span) {}
+  // Decay time constant for the smoothed rate, in microseconds.
+  static const timer_type ewma_tau = 500000;
+
+  Rate(timer_type span) :
+    m_current(0), m_total(0), m_span(span),
+    m_pending(0), m_pendingTime(0),
+    m_ewmaRate(0.0), m_ewmaTime(0), m_ewmaBytes(0) {}
 
   // Bytes per second.
   rate_type           rate() const;
 
+  // Bytes per second as a fixed-decay EWMA over the microsecond
+  // timestamps captured at poll return. Unlike rate() this does not
+  // jitter at sub-second scale, making it suitable for choke and
+  // throttle decisions; no extra clock reads are involved.
+  rate_type           rate_ewma() const;
+
   // Total bytes transfered.
   total_type          total() const                           { return m_total; }
   void                set_total(total_type bytes)             { m_total = bytes; }
@@ -70,7 +82,15 @@ public:
 
   void                insert(rate_type bytes);
 
-  void                reset_rate()                            { m_current = 0; m_container.clear(); }
+  // Hot-path variant for per-packet accounting: the bytes land in a
+  // pending counter and the bucket list and EWMA maintenance is
+  // deferred until the second advances or a reader folds, so a
+  // network event costs two additions instead of a deque walk.
+  // total() stays exact; the folded bytes are stamped with the
+  // second they are folded in, at the bucket list's own resolution.
+  void                insert_batched(rate_type bytes);
+
+  void                reset_rate()                            { m_current = 0; m_container.clear(); m_pending = 0; m_pendingTime = 0; m_ewmaRate = 0.0; m_ewmaTime = 0; m_ewmaBytes = 0; }
   
   bool                operator <  (Rate& r) const             { return rate() < r.rate(); }
   bool                operator >  (Rate& r) const             { return rate() > r.rate(); }
@@ -84,12 +104,23 @@ public:
 
 private:
   inline void         discard_old() const;
+  inline void         ewma_fold() const;
+  void                fold_pending() const;
 
   mutable queue_type  m_container;
 
   mutable rate_type   m_current;
   total_type          m_total;
   timer_type          m_span;
+
+  // Bytes accumulated by insert_batched since the last fold, and the
+  // second they started accruing in.
+  mutable rate_type   m_pending;
+  mutable timer_type  m_pendingTime;
+
+  mutable double      m_ewmaRate;   // Bytes per microsecond.
+  mutable int64_t     m_ewmaTime;   // Timestamp of the last fold.
+  mutable rate_type   m_ewmaBytes;  // Bytes accumulated since the last fold.
 };
 
 }
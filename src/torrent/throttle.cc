@@ -59,6 +59,7 @@ Throttle::create_throttle() {
   ThrottleInternal* throttle = new ThrottleInternal(ThrottleInternal::flag_root);
 
   throttle->m_maxRate = 0;
+  throttle->m_adaptiveTick = false;
   throttle->m_throttleList = new ThrottleList();
 
   return throttle;
@@ -147,6 +148,15 @@ Throttle::calculate_interval() const {
   if (rate < 1024)
     return 10 * 100000;
 
+  // At high configured rates a 100ms tick releases a large burst in
+  // one go; scale the tick down so each one covers roughly two max
+  // chunks, bounded below at 25ms.
+  if (m_adaptiveTick && m_maxRate >= adaptive_tick_rate) {
+    uint64_t interval = ((uint64_t)2 * m_throttleList->max_chunk_size() * 1000000) / m_maxRate;
+
+    return std::max<uint64_t>(std::min<uint64_t>(interval, 100000), 25000);
+  }
+
   // At least two max chunks per tick.
   uint32_t interval = (5 * m_throttleList->max_chunk_size()) / rate;
 
@@ -57,6 +57,15 @@ public:
   uint32_t            max_rate() const { return m_maxRate; }
   void                set_max_rate(uint32_t v);
 
+  // Adaptive tick shortens the throttle tick below the default 100ms
+  // once the configured rate crosses adaptive_tick_rate, so the burst
+  // released per tick stays around two max chunks instead of growing
+  // with the rate.
+  static const uint32_t adaptive_tick_rate = (1 << 20);
+
+  bool                is_adaptive_tick() const   { return m_adaptiveTick; }
+  void                set_adaptive_tick(bool state) { m_adaptiveTick = state; }
+
   const Rate*         rate() const;
 
   ThrottleList*       throttle_list()  { return m_throttleList; }
@@ -73,6 +82,7 @@ protected:
   uint32_t            calculate_interval() const LIBTORRENT_NO_EXPORT;
 
   uint32_t            m_maxRate;
+  bool                m_adaptiveTick;
 
   ThrottleList*       m_throttleList;
 };
@@ -55,6 +55,20 @@ calculate_reserved(uint32_t openMax) {
     return 16;
 }    
 
+// Extra disk threads created on initialize(); zero keeps the old
+// single-threaded disk setup.
+uint32_t disk_workers = 0;
+
+uint32_t disk_worker_count() { return disk_workers; }
+void set_disk_worker_count(uint32_t count) { disk_workers = count; }
+
+// Network worker threads created on initialize(); zero keeps all
+// sockets on the main thread.
+uint32_t net_workers = 0;
+
+uint32_t net_worker_count() { return net_workers; }
+void set_net_worker_count(uint32_t count) { net_workers = count; }
+
 void
 initialize() {
   if (manager != NULL)
@@ -74,6 +88,20 @@ initialize() {
 
   manager->main_thread_disk()->init_thread();
   manager->main_thread_disk()->start_thread();
+
+  manager->create_disk_workers(disk_workers);
+
+  for (Manager::disk_worker_list_type::iterator itr = manager->disk_workers()->begin(), last = manager->disk_workers()->end(); itr != last; itr++) {
+    (*itr)->init_thread();
+    (*itr)->start_thread();
+  }
+
+  manager->create_net_workers(net_workers);
+
+  for (Manager::net_worker_list_type::iterator itr = manager->net_workers()->begin(), last = manager->net_workers()->end(); itr != last; itr++) {
+    (*itr)->init_thread();
+    (*itr)->start_thread();
+  }
 }
 
 // Clean up and close stuff. Stopping all torrents and waiting for
@@ -85,6 +113,12 @@ cleanup() {
 
   manager->main_thread_disk()->stop_thread_wait();
 
+  for (Manager::disk_worker_list_type::iterator itr = manager->disk_workers()->begin(), last = manager->disk_workers()->end(); itr != last; itr++)
+    (*itr)->stop_thread_wait();
+
+  for (Manager::net_worker_list_type::iterator itr = manager->net_workers()->begin(), last = manager->net_workers()->end(); itr != last; itr++)
+    (*itr)->stop_thread_wait();
+
   delete manager;
   manager = NULL;
 }
@@ -129,6 +163,11 @@ encoding_list() {
 
 Download
 download_add(Object* object) {
+  return download_add_prepared(download_prepare(object), object);
+}
+
+DownloadWrapper*
+download_prepare(Object* object) {
   std::auto_ptr<DownloadWrapper> download(new DownloadWrapper);
 
   DownloadConstructor ctor;
@@ -139,12 +178,13 @@ download_add(Object* object) {
 
   std::string infoHash;
   if (download->info()->is_meta_download())
-    infoHash = object->get_key("info").get_key("pieces").as_string();
+    infoHash = object_create_string(object->get_key("info").get_key("pieces"));
   else
     infoHash = object_sha1(&object->get_key("info"));
 
-  if (manager->download_manager()->find(infoHash) != manager->download_manager()->end())
-    throw input_error("Info hash already used by another torrent.");
+  // Stash the hash so registration doesn't need to recompute it; the
+  // obfuscated hash and slots get set up in initialize(...) later.
+  download->info()->mutable_hash().assign(infoHash.c_str());
 
   if (!download->info()->is_meta_download()) {
     char buffer[1024];
@@ -153,6 +193,18 @@ download_add(Object* object) {
     download->main()->set_metadata_size(metadata_size);
   }
 
+  return download.release();
+}
+
+Download
+download_add_prepared(DownloadWrapper* prepared, Object* object) {
+  std::auto_ptr<DownloadWrapper> download(prepared);
+
+  std::string infoHash = download->info()->hash().str();
+
+  if (manager->download_manager()->find(infoHash) != manager->download_manager()->end())
+    throw input_error("Info hash already used by another torrent.");
+
   std::string local_id = PEER_NAME + rak::generate_random<std::string>(20 - std::string(PEER_NAME).size());
 
   download->set_hash_queue(manager->hash_queue());
@@ -160,6 +212,10 @@ download_add(Object* object) {
 
   // Add trackers, etc, after setting the info hash so that log
   // entries look sane.
+  DownloadConstructor ctor;
+  ctor.set_download(download.get());
+  ctor.set_encoding_list(manager->encoding_list());
+
   ctor.parse_tracker(*object);
 
   // Default PeerConnection factory functions.
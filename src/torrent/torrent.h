@@ -80,6 +80,17 @@ const char*         version() LIBTORRENT_EXPORT;
 // Disk access tuning.
 uint32_t            hash_queue_size() LIBTORRENT_EXPORT;
 
+// Number of disk threads beyond the main one to spawn; must be set
+// before initialize() to take effect.
+uint32_t            disk_worker_count() LIBTORRENT_EXPORT;
+void                set_disk_worker_count(uint32_t count) LIBTORRENT_EXPORT;
+
+// Number of network worker threads to spawn; sockets are sharded
+// onto them by file descriptor. Must be set before initialize() to
+// take effect.
+uint32_t            net_worker_count() LIBTORRENT_EXPORT;
+void                set_net_worker_count(uint32_t count) LIBTORRENT_EXPORT;
+
 typedef std::list<Download> DList;
 typedef std::list<std::string> EncodingList;
 
@@ -97,6 +108,16 @@ EncodingList*       encoding_list() LIBTORRENT_EXPORT;
 Download            download_add(Object* s) LIBTORRENT_EXPORT;
 void                download_remove(Download d) LIBTORRENT_EXPORT;
 
+// The two halves of 'download_add', for clients loading large
+// sessions. 'download_prepare' only reads the object and computes the
+// info hash, without touching any shared session state, so it may be
+// run for many torrents concurrently on worker threads.
+// 'download_add_prepared' registers the result and must be serialized
+// onto the main thread; it takes ownership of 'prepared' and deletes
+// it if registration throws.
+DownloadWrapper*    download_prepare(Object* s) LIBTORRENT_EXPORT;
+Download            download_add_prepared(DownloadWrapper* prepared, Object* s) LIBTORRENT_EXPORT;
+
 // Add all downloads to dlist. The client is responsible for clearing
 // it before the call.
 void                download_list(DList& dlist) LIBTORRENT_EXPORT;
@@ -4,6 +4,7 @@
 #include <string>
 #include <cinttypes>
 #include <torrent/common.h>
+#include <torrent/utils/intern_pool.h>
 
 namespace torrent {
 
@@ -60,7 +61,9 @@ public:
   uint32_t            group() const                         { return m_group; }
   virtual Type        type() const = 0;
 
-  const std::string&  url() const                           { return m_url; }
+  // The same tracker URLs recur across most open downloads, so they
+  // are interned in the session-wide pool.
+  const std::string&  url() const                           { return m_url.str(); }
   void                set_url(const std::string& url)       { m_url = url; }
 
   const std::string&  tracker_id() const                    { return m_tracker_id; }
@@ -120,7 +123,7 @@ protected:
   TrackerList*        m_parent;
   uint32_t            m_group;
 
-  std::string         m_url;
+  interned_string     m_url;
   std::string         m_tracker_id;
 
   uint32_t            m_normal_interval;
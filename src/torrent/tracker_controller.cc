@@ -57,6 +57,10 @@ struct tracker_controller_private {
   rak::priority_item task_scrape;
 };
 
+// Number of enabled controllers; announce times only need to be
+// spread out when several torrents compete for the tracker sockets.
+static unsigned int tracker_controller_active = 0;
+
 // End temp hacks...
 
 void
@@ -66,8 +70,22 @@ TrackerController::update_timeout(uint32_t seconds_to_next) {
 
   rak::timer next_timeout = cachedTime;
 
-  if (seconds_to_next != 0)
+  if (seconds_to_next != 0) {
+    // With many torrents active, jitter long waits so announces stay
+    // de-synchronized after a restart instead of hitting the resolver
+    // and tracker sockets in bursts. Seeding torrents take up to
+    // twice the jitter, letting leechers announce first.
+    if (seconds_to_next >= 30 && tracker_controller_active > 1) {
+      uint32_t jitter = seconds_to_next / 8;
+
+      if (m_tracker_list->info()->slot_left()() == 0)
+        jitter *= 2;
+
+      seconds_to_next += random() % jitter;
+    }
+
     next_timeout = (cachedTime + rak::timer::from_seconds(seconds_to_next)).round_seconds();
+  }
 
   priority_queue_erase(&taskScheduler, &m_private->task_timeout);
   priority_queue_insert(&taskScheduler, &m_private->task_timeout, next_timeout);
@@ -94,6 +112,9 @@ TrackerController::TrackerController(TrackerList* trackers) :
 }
 
 TrackerController::~TrackerController() {
+  if (m_flags & flag_active)
+    tracker_controller_active--;
+
   priority_queue_erase(&taskScheduler, &m_private->task_timeout);
   priority_queue_erase(&taskScheduler, &m_private->task_scrape);
   delete m_private;
@@ -298,6 +319,7 @@ TrackerController::enable(int enable_flags) {
   // fast. In the future do this based on flags passed.
   m_flags |= flag_active;
   m_flags &= ~flag_send_stop;
+  tracker_controller_active++;
 
   m_tracker_list->close_all_excluding((1 << Tracker::EVENT_COMPLETED));
   
@@ -318,6 +340,7 @@ TrackerController::disable() {
 
   // Disable other flags?...
   m_flags &= ~(flag_active | flag_requesting | flag_promiscuous_mode);
+  tracker_controller_active--;
 
   m_tracker_list->close_all_excluding((1 << Tracker::EVENT_STOPPED) | (1 << Tracker::EVENT_COMPLETED));
   priority_queue_erase(&taskScheduler, &m_private->task_timeout);
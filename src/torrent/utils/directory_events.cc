@@ -91,7 +91,7 @@ directory_events::close() {
 
   ::close(m_fileDesc);
   m_fileDesc = -1;
-  m_wd_list.clear();
+  m_wd_map.clear();
 }
 
 void
@@ -124,10 +124,12 @@ directory_events::notify_on(const std::string& path, int flags, const slot_strin
   if (result == -1)
     throw input_error("Call to inotify_add_watch(...) failed: " + std::string(rak::error_number::current().c_str()));
 
-  wd_list::iterator itr = m_wd_list.insert(m_wd_list.end(), watch_descriptor());
-  itr->descriptor = result;
-  itr->path = path + (*path.rbegin() != '/' ? "/" : "");
-  itr->slot = slot;
+  // Re-watching a directory returns the same descriptor, so the entry
+  // is replaced rather than duplicated.
+  watch_descriptor& wd = m_wd_map[result];
+  wd.descriptor = result;
+  wd.path = path + (*path.rbegin() != '/' ? "/" : "");
+  wd.slot = slot;
 
 #else
   throw input_error("No support for inotify.");
@@ -137,30 +139,32 @@ directory_events::notify_on(const std::string& path, int flags, const slot_strin
 void
 directory_events::event_read() {
 #ifdef HAVE_INOTIFY
-  char buffer[2048];
-  int result = ::read(m_fileDesc, buffer, 2048);
+  // Drain the whole queue in one wakeup; with hundreds of watched
+  // directories a busy tree posts far more than one buffer's worth of
+  // events between polls.
+  char buffer[16 << 10] __attribute__((aligned(__alignof__(struct inotify_event))));
+  int  result;
 
-  if (result < sizeof(struct inotify_event))
-    return;
+  while ((result = ::read(m_fileDesc, buffer, sizeof(buffer))) >= (int)sizeof(struct inotify_event)) {
+    struct inotify_event* event = (struct inotify_event*)buffer;
 
-  struct inotify_event* event = (struct inotify_event*)buffer;
-  
-  while (event + 1 <= (struct inotify_event*)(buffer + result)) {
-    char* next_event = (char*)event + sizeof(struct inotify_event) + event->len;
+    while ((char*)(event + 1) <= buffer + result) {
+      char* next_event = (char*)event + sizeof(struct inotify_event) + event->len;
 
-    if (event->len == 0 || next_event > buffer + 2048)
-      return;
+      if (event->len == 0 || next_event > buffer + result)
+        break;
 
-    wd_list::const_iterator itr = std::find_if(m_wd_list.begin(), m_wd_list.end(),
-                                               std::bind(&watch_descriptor::compare_desc, std::placeholders::_1, event->wd));
+      wd_map::const_iterator itr = m_wd_map.find(event->wd);
 
-    if (itr != m_wd_list.end()) {
-      std::string sname(event->name);
-      if((sname.substr(sname.find_last_of(".") ) == ".torrent"))
-        itr->slot(itr->path + event->name);
-    }
+      if (itr != m_wd_map.end()) {
+        std::string sname(event->name);
 
-    event = (struct inotify_event*)(next_event);
+        if (sname.size() >= 8 && sname.compare(sname.size() - 8, 8, ".torrent") == 0)
+          itr->second.slot(itr->second.path + sname);
+      }
+
+      event = (struct inotify_event*)(next_event);
+    }
   }
 #endif
 }
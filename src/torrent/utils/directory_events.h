@@ -39,7 +39,7 @@
 
 #include <functional>
 #include <string>
-#include <vector>
+#include <unordered_map>
 
 #include <torrent/event.h>
 
@@ -48,8 +48,6 @@ namespace torrent {
 struct watch_descriptor {
   typedef std::function<void (const std::string&)> slot_string;
 
-  bool compare_desc(int desc) const { return desc == descriptor; }
-
   int         descriptor;
   std::string path;
   slot_string slot;
@@ -57,8 +55,10 @@ struct watch_descriptor {
 
 class LIBTORRENT_EXPORT directory_events : public Event {
 public:
-  typedef std::vector<watch_descriptor> wd_list;
-  typedef watch_descriptor::slot_string slot_string;
+  // Watches are resolved by descriptor on every inotify event, so
+  // they are kept in a hash map rather than scanned linearly.
+  typedef std::unordered_map<int, watch_descriptor> wd_map;
+  typedef watch_descriptor::slot_string             slot_string;
 
   static const int flag_on_added   = 0x1;
   static const int flag_on_removed = 0x2;
@@ -79,7 +79,7 @@ public:
   virtual const char* type_name() const { return "directory_events"; }
 
 private:
-  wd_list             m_wd_list;
+  wd_map              m_wd_map;
 };
 
 }
@@ -0,0 +1,92 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2011, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include "torrent/exceptions.h"
+
+#include "intern_pool.h"
+
+namespace torrent {
+
+intern_pool::pool_type intern_pool::m_pool;
+
+const std::string*
+intern_pool::acquire(const std::string& value) {
+  pool_type::iterator itr = m_pool.insert(pool_type::value_type(value, 0)).first;
+
+  itr->second++;
+
+  // Map nodes are stable, so the key outlives any rebalancing.
+  return &itr->first;
+}
+
+const std::string*
+intern_pool::copy(const std::string* value) {
+  if (value == NULL)
+    return NULL;
+
+  pool_type::iterator itr = m_pool.find(*value);
+
+  if (itr == m_pool.end() || &itr->first != value)
+    throw internal_error("intern_pool::copy(...) value not in pool.");
+
+  itr->second++;
+  return value;
+}
+
+void
+intern_pool::release(const std::string* value) {
+  if (value == NULL)
+    return;
+
+  pool_type::iterator itr = m_pool.find(*value);
+
+  if (itr == m_pool.end() || &itr->first != value)
+    throw internal_error("intern_pool::release(...) value not in pool.");
+
+  if (--itr->second == 0)
+    m_pool.erase(itr);
+}
+
+const std::string&
+interned_string::str() const {
+  static const std::string empty_string;
+
+  return m_value != NULL ? *m_value : empty_string;
+}
+
+}
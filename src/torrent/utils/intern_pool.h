@@ -0,0 +1,107 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2011, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_UTILS_INTERN_POOL_H
+#define LIBTORRENT_UTILS_INTERN_POOL_H
+
+#include <map>
+#include <string>
+#include <torrent/common.h>
+
+namespace torrent {
+
+// Session-wide pool of reference-counted unique strings. With
+// thousands of open downloads the same tracker URLs and directory
+// prefixes are stored over and over; holders keep an interned_string
+// handle instead of their own copy, so each distinct value exists
+// once.
+//
+// Main thread only, like the rest of the download metadata.
+
+class LIBTORRENT_EXPORT intern_pool {
+public:
+  typedef std::map<std::string, uint32_t> pool_type;
+
+  static const std::string* acquire(const std::string& value);
+  static const std::string* copy(const std::string* value);
+  static void               release(const std::string* value);
+
+  static uint32_t           unique_count() { return m_pool.size(); }
+
+private:
+  static pool_type    m_pool;
+};
+
+class LIBTORRENT_EXPORT interned_string {
+public:
+  interned_string() : m_value(NULL) {}
+  interned_string(const std::string& value) : m_value(intern_pool::acquire(value)) {}
+  interned_string(const interned_string& src) : m_value(intern_pool::copy(src.m_value)) {}
+
+  ~interned_string() { intern_pool::release(m_value); }
+
+  interned_string& operator = (const interned_string& src) {
+    const std::string* value = intern_pool::copy(src.m_value);
+    intern_pool::release(m_value);
+    m_value = value;
+    return *this;
+  }
+
+  interned_string& operator = (const std::string& value) {
+    const std::string* interned = intern_pool::acquire(value);
+    intern_pool::release(m_value);
+    m_value = interned;
+    return *this;
+  }
+
+  bool                empty() const { return m_value == NULL || m_value->empty(); }
+
+  const std::string&  str() const;
+  const char*         c_str() const { return str().c_str(); }
+
+  operator const std::string& () const { return str(); }
+
+  // Interned values are unique, so equality is pointer equality.
+  bool operator == (const interned_string& rhs) const { return m_value == rhs.m_value; }
+  bool operator != (const interned_string& rhs) const { return m_value != rhs.m_value; }
+
+private:
+  const std::string*  m_value;
+};
+
+}
+
+#endif
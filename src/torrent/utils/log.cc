@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include <zlib.h>
 
 #include <algorithm>
@@ -58,6 +59,102 @@ pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 const char log_level_char[] = { 'C', 'E', 'W', 'N', 'I', 'D' };
 
+// Formatted log lines staged by a thread that enabled its ring;
+// records are '[int32 group][uint32 size][payload]' with the dump
+// flag or'ed into the group. The ring is only ever touched by its
+// owning thread, so staging needs no synchronization; the mutex is
+// taken once per flushed batch instead of once per line.
+struct log_thread_ring {
+  static const size_t max_size = 1 << 16;
+
+  size_t position;
+  char   data[max_size];
+};
+
+static const int32_t log_ring_flag_dump   = 1 << 30;
+static const size_t  log_ring_header_size = 8;
+
+static thread_local log_thread_ring* log_ring = NULL;
+
+void
+log_thread_ring_enable() {
+  if (log_ring == NULL)
+    log_ring = new log_thread_ring();
+}
+
+void
+log_thread_ring_disable() {
+  log_thread_ring_flush();
+
+  delete log_ring;
+  log_ring = NULL;
+}
+
+void
+log_thread_ring_flush() {
+  if (log_ring == NULL || log_ring->position == 0)
+    return;
+
+  pthread_mutex_lock(&log_mutex);
+
+  const char* itr  = log_ring->data;
+  const char* last = log_ring->data + log_ring->position;
+
+  while (itr != last) {
+    int32_t  group;
+    uint32_t size;
+
+    memcpy(&group, itr, sizeof(group));
+    memcpy(&size, itr + sizeof(group), sizeof(size));
+    itr += log_ring_header_size;
+
+    // The group's outputs may have been closed between staging and
+    // flushing; dispatch to whatever is cached now.
+    log_group& grp = log_groups[group & ~log_ring_flag_dump];
+
+    if (!grp.empty())
+      std::for_each(grp.cached_first(), grp.cached_last(),
+                    std::bind(&log_slot::operator(),
+                              std::placeholders::_1,
+                              itr,
+                              size,
+                              (group & log_ring_flag_dump) ? -1 : group));
+    itr += size;
+  }
+
+  log_ring->position = 0;
+  pthread_mutex_unlock(&log_mutex);
+}
+
+static void
+log_ring_append(int32_t group, const char* data, uint32_t size) {
+  if (log_ring_header_size + size > log_thread_ring::max_size - log_ring->position)
+    log_thread_ring_flush();
+
+  if (log_ring_header_size + size > log_thread_ring::max_size) {
+    // Oversized dumps skip the ring and dispatch directly.
+    log_group& grp = log_groups[group & ~log_ring_flag_dump];
+
+    pthread_mutex_lock(&log_mutex);
+    std::for_each(grp.cached_first(), grp.cached_last(),
+                  std::bind(&log_slot::operator(),
+                            std::placeholders::_1,
+                            data,
+                            size,
+                            (group & log_ring_flag_dump) ? -1 : group));
+    pthread_mutex_unlock(&log_mutex);
+    return;
+  }
+
+  char* itr = log_ring->data + log_ring->position;
+
+  memcpy(itr, &group, sizeof(group));
+  memcpy(itr + sizeof(group), &size, sizeof(size));
+  memcpy(itr + log_ring_header_size, data, size);
+
+  log_ring->position += log_ring_header_size + size;
+}
+
 // Removing logs always triggers a check if we got any un-used
 // log_output objects.
 
@@ -151,6 +248,17 @@ log_group::internal_print(const HashString* hash, const char* subsystem, const v
   if (count <= 0)
     return;
 
+  if (log_ring != NULL) {
+    int32_t group = std::distance(log_groups.begin(), log_group_list::iterator(this));
+
+    log_ring_append(group, buffer, std::distance(buffer, first));
+
+    if (dump_data != NULL)
+      log_ring_append(group | log_ring_flag_dump, (const char*)dump_data, dump_size);
+
+    return;
+  }
+
   pthread_mutex_lock(&log_mutex);
 
   std::for_each(m_first, m_last, std::bind(&log_slot::operator(),
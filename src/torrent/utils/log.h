@@ -181,6 +181,9 @@ public:
 
   void                set_cached(log_slot* f, log_slot* l)        { m_first = f; m_last = l; }
 
+  log_slot*           cached_first() const                        { return m_first; }
+  log_slot*           cached_last() const                         { return m_last; }
+
 private:
   outputs_type        m_outputs;
   outputs_type        m_cached_outputs;
@@ -196,6 +199,15 @@ extern log_group_list log_groups LIBTORRENT_EXPORT;
 void log_initialize() LIBTORRENT_EXPORT;
 void log_cleanup() LIBTORRENT_EXPORT;
 
+// Threads that run an event loop may enable a per-thread ring that
+// stages formatted log lines, so the hot path never touches the
+// global log mutex. Only the owning thread accesses its ring; the
+// loop flushes it once per iteration, taking the mutex once per
+// batch of lines. Threads without a ring dispatch synchronously.
+void log_thread_ring_enable() LIBTORRENT_EXPORT;
+void log_thread_ring_disable() LIBTORRENT_EXPORT;
+void log_thread_ring_flush() LIBTORRENT_EXPORT;
+
 void log_open_output(const char* name, log_slot slot) LIBTORRENT_EXPORT;
 void log_close_output(const char* name) LIBTORRENT_EXPORT;
 void log_close_output_str(const std::string name) LIBTORRENT_EXPORT;
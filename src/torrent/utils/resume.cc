@@ -43,6 +43,7 @@
 #include "peer/peer_list.h"
 #include "torrent/utils/log.h"
 
+#include "data/download_data.h"
 #include "data/file.h"
 #include "data/file_list.h"
 #include "data/transfer_list.h"
@@ -75,8 +76,160 @@
 
 namespace torrent {
 
+// Packed per-file progress, stored as one string under 'files.packed'
+// so loading doesn't walk a bencoded map per file. The header holds
+// the format version and file count, then one record per file with
+// its mtime and completed chunk count, all big-endian.
+static const uint32_t resume_packed_version     = 1;
+static const size_t   resume_packed_header_size = 8;
+static const size_t   resume_packed_record_size = 12;
+
+static inline char*
+resume_pack_32(char* buffer, uint32_t value) {
+  for (int shift = 24; shift >= 0; shift -= 8)
+    *buffer++ = value >> shift;
+
+  return buffer;
+}
+
+static inline char*
+resume_pack_64(char* buffer, uint64_t value) {
+  for (int shift = 56; shift >= 0; shift -= 8)
+    *buffer++ = value >> shift;
+
+  return buffer;
+}
+
+static inline uint32_t
+resume_unpack_32(const char* buffer) {
+  uint32_t value = 0;
+
+  for (int shift = 24; shift >= 0; shift -= 8)
+    value |= (uint32_t)(uint8_t)*buffer++ << shift;
+
+  return value;
+}
+
+static inline uint64_t
+resume_unpack_64(const char* buffer) {
+  uint64_t value = 0;
+
+  for (int shift = 56; shift >= 0; shift -= 8)
+    value |= (uint64_t)(uint8_t)*buffer++ << shift;
+
+  return value;
+}
+
+static void
+resume_load_file_progress(Download download, FileList* fileList, FileList::iterator listItr, unsigned int file_index, int64_t mtimeValue) {
+  rak::file_stat fs;
+  bool fileExists = fs.update(fileList->root_dir() + (*listItr)->path()->as_string());
+
+  // The default action when we have 'mtime' is not to create nor
+  // resize the file.
+  (*listItr)->unset_flags(File::flag_create_queued | File::flag_resize_queued);
+
+  if (mtimeValue == ~int64_t(0) || mtimeValue == ~int64_t(1)) {
+    // If 'mtime' is ~0 it means we haven't gotten around to
+    // creating the file.
+    //
+    // Else if it is ~1 it means the file doesn't exist nor do we
+    // want to create it.
+    //
+    // When 'mtime' is ~2 we need to recheck the hash without
+    // creating the file. It will just fail on the mtime check
+    // later, so we don't need to handle it explicitly.
+
+    if (mtimeValue == ~int64_t(0)) {
+      LT_LOG_LOAD_FILE("file not created by client, file:create|resize range:clear|(recheck)", 0);
+      (*listItr)->set_flags(File::flag_create_queued | File::flag_resize_queued);
+    } else {
+      LT_LOG_LOAD_FILE("do not create file, file:- range:clear|(recheck)", 0);
+    }
+
+    // Ensure the bitfield range is cleared so that stray resume
+    // data doesn't get counted.
+    download.update_range(Download::update_range_clear | (fileExists ? Download::update_range_recheck : 0),
+                          (*listItr)->range().first, (*listItr)->range().second);
+    return;
+  }
+
+  // If the file is the wrong size, queue resize and clear resume
+  // data for that file.
+  if ((uint64_t)fs.size() != (*listItr)->size_bytes()) {
+    if (fs.size() == 0) {
+      LT_LOG_LOAD_FILE("zero-length file found, file:resize range:clear|recheck", 0);
+    } else {
+      LT_LOG_LOAD_FILE("file has the wrong size, file:resize range:clear|recheck", 0);
+    }
+
+    (*listItr)->set_flags(File::flag_resize_queued);
+    download.update_range(Download::update_range_clear | Download::update_range_recheck,
+                          (*listItr)->range().first, (*listItr)->range().second);
+    return;
+  }
+
+  // An 'mtime' of ~3 means the resume data was written while the
+  // torrent was actively downloading, and thus we need to recheck
+  // chunks that might not have been completely written to disk.
+  //
+  // This gets handled by the uncertain pieces, so just skip the file.
+  if (mtimeValue == ~int64_t(3)) {
+    LT_LOG_LOAD_FILE("file was downloading", 0);
+    return;
+  }
+
+  // An 'mtime' of ~2 indicates that the resume data was made by an
+  // old rtorrent version which does not include 'uncertain_pieces'
+  // field, and thus can't be relied upon.
+  //
+  // If the 'mtime' is an actual mtime we check to see if it matches
+  // the file, else clear the range. This should be set only for
+  // files that have completed and got no indices in
+  // TransferList::completed_list().
+  if (mtimeValue == ~int64_t(2) || mtimeValue != fs.modified_time()) {
+    LT_LOG_LOAD_FILE("resume data doesn't include uncertain pieces, range:clear|recheck", 0);
+    download.update_range(Download::update_range_clear | Download::update_range_recheck,
+                          (*listItr)->range().first, (*listItr)->range().second);
+    return;
+  }
+
+  LT_LOG_LOAD_FILE("no recheck needed", 0);
+}
+
 void
 resume_load_progress(Download download, const Object& object) {
+  FileList* fileList = download.file_list();
+
+  // Prefer the packed progress record; one string holds all per-file
+  // state so the load is a single linear pass.
+  if (object.has_key_string("files.packed")) {
+    const Object::string_type& packed = object.get_key_string("files.packed");
+
+    if (packed.size() != resume_packed_header_size + fileList->size_files() * resume_packed_record_size ||
+        resume_unpack_32(packed.c_str()) != resume_packed_version ||
+        resume_unpack_32(packed.c_str() + 4) != fileList->size_files()) {
+      LT_LOG_LOAD_INVALID("packed file progress has wrong version or size", 0);
+      return;
+    }
+
+    if (!resume_load_bitfield(download, object))
+      return;
+
+    const char* record = packed.c_str() + resume_packed_header_size;
+
+    for (FileList::iterator listItr = fileList->begin(), listLast = fileList->end(); listItr != listLast; ++listItr, record += resume_packed_record_size) {
+      unsigned int file_index = std::distance(fileList->begin(), listItr);
+
+      (*listItr)->set_completed_chunks(resume_unpack_32(record + 8));
+      resume_load_file_progress(download, fileList, listItr, file_index, (int64_t)resume_unpack_64(record));
+    }
+
+    resume_load_uncertain_pieces(download, object);
+    resume_load_chunk_crc32c(download, object);
+    return;
+  }
+
   if (!object.has_key_list("files")) {
     LT_LOG_LOAD("could not find 'files' key", 0);
     return;
@@ -94,14 +247,9 @@ resume_load_progress(Download download, const Object& object) {
 
   Object::list_const_iterator filesItr  = files.begin();
 
-  FileList* fileList = download.file_list();
-
   for (FileList::iterator listItr = fileList->begin(), listLast = fileList->end(); listItr != listLast; ++listItr, ++filesItr) {
-    std::string file_path = (*listItr)->path()->as_string();
     unsigned int file_index = std::distance(fileList->begin(), listItr);
 
-    rak::file_stat fs;
-
     if (!filesItr->has_key_value("mtime")) {
       LT_LOG_LOAD_FILE("no mtime found, file:create|resize range:clear|recheck", 0);
 
@@ -114,82 +262,11 @@ resume_load_progress(Download download, const Object& object) {
       continue;
     }
 
-    int64_t mtimeValue = filesItr->get_key_value("mtime");
-    bool    fileExists = fs.update(fileList->root_dir() + (*listItr)->path()->as_string());
-
-    // The default action when we have 'mtime' is not to create nor
-    // resize the file.
-    (*listItr)->unset_flags(File::flag_create_queued | File::flag_resize_queued);
-
-    if (mtimeValue == ~int64_t(0) || mtimeValue == ~int64_t(1)) {
-      // If 'mtime' is ~0 it means we haven't gotten around to
-      // creating the file.
-      //
-      // Else if it is ~1 it means the file doesn't exist nor do we
-      // want to create it.
-      //
-      // When 'mtime' is ~2 we need to recheck the hash without
-      // creating the file. It will just fail on the mtime check
-      // later, so we don't need to handle it explicitly.
-
-      if (mtimeValue == ~int64_t(0)) {
-        LT_LOG_LOAD_FILE("file not created by client, file:create|resize range:clear|(recheck)", 0);
-        (*listItr)->set_flags(File::flag_create_queued | File::flag_resize_queued);
-      } else {
-        LT_LOG_LOAD_FILE("do not create file, file:- range:clear|(recheck)", 0);
-      }
-
-      // Ensure the bitfield range is cleared so that stray resume
-      // data doesn't get counted.
-      download.update_range(Download::update_range_clear | (fileExists ? Download::update_range_recheck : 0),
-                            (*listItr)->range().first, (*listItr)->range().second);
-      continue;
-    }
-
-    // If the file is the wrong size, queue resize and clear resume
-    // data for that file.
-    if ((uint64_t)fs.size() != (*listItr)->size_bytes()) {
-      if (fs.size() == 0) {
-        LT_LOG_LOAD_FILE("zero-length file found, file:resize range:clear|recheck", 0);
-      } else {
-        LT_LOG_LOAD_FILE("file has the wrong size, file:resize range:clear|recheck", 0);
-      }
-
-      (*listItr)->set_flags(File::flag_resize_queued);
-      download.update_range(Download::update_range_clear | Download::update_range_recheck,
-                            (*listItr)->range().first, (*listItr)->range().second);
-      continue;
-    }
-
-    // An 'mtime' of ~3 means the resume data was written while the
-    // torrent was actively downloading, and thus we need to recheck
-    // chunks that might not have been completely written to disk.
-    //
-    // This gets handled below, so just skip to the next file.
-    if (mtimeValue == ~int64_t(3)) {
-      LT_LOG_LOAD_FILE("file was downloading", 0);
-      continue;
-    }
-
-    // An 'mtime' of ~2 indicates that the resume data was made by an
-    // old rtorrent version which does not include 'uncertain_pieces'
-    // field, and thus can't be relied upon.
-    //
-    // If the 'mtime' is an actual mtime we check to see if it matches
-    // the file, else clear the range. This should be set only for
-    // files that have completed and got no indices in
-    // TransferList::completed_list().
-    if (mtimeValue == ~int64_t(2) || mtimeValue != fs.modified_time()) {
-      LT_LOG_LOAD_FILE("resume data doesn't include uncertain pieces, range:clear|recheck", 0);
-      download.update_range(Download::update_range_clear | Download::update_range_recheck,
-                            (*listItr)->range().first, (*listItr)->range().second);
-      continue;
-    }
-
-    LT_LOG_LOAD_FILE("no recheck needed", 0);
+    resume_load_file_progress(download, fileList, listItr, file_index, filesItr->get_key_value("mtime"));
   }
 
   resume_load_uncertain_pieces(download, object);
+  resume_load_chunk_crc32c(download, object);
 }
 
 void
@@ -207,6 +284,8 @@ resume_save_progress(Download download, Object& object) {
   if (!download.is_hash_checked()) {
     LT_LOG_SAVE("sync failed, invalidating resume data", 0);
 
+    object.erase_key("files.packed");
+
     if (!object.has_key_list("files"))
       return;
 
@@ -219,34 +298,34 @@ resume_save_progress(Download download, Object& object) {
   }
 
   resume_save_bitfield(download, object);
-  
-  Object::list_type&    files    = object.insert_preserve_copy("files", Object::create_list()).first->second.as_list();
-  Object::list_iterator filesItr = files.begin();
 
   FileList* fileList = download.file_list();
 
-  for (FileList::iterator listItr = fileList->begin(), listLast = fileList->end(); listItr != listLast; ++listItr, ++filesItr) {
-    unsigned int file_index = std::distance(fileList->begin(), listItr);
+  std::string packed;
+  packed.reserve(resume_packed_header_size + fileList->size_files() * resume_packed_record_size);
 
-    if (filesItr == files.end())
-      filesItr = files.insert(filesItr, Object::create_map());
-    else if (!filesItr->is_map())
-      *filesItr = Object::create_map();
+  char buffer[resume_packed_record_size];
+
+  resume_pack_32(buffer, resume_packed_version);
+  resume_pack_32(buffer + 4, fileList->size_files());
+  packed.append(buffer, resume_packed_header_size);
 
-    filesItr->insert_key("completed", (int64_t)(*listItr)->completed_chunks());
+  for (FileList::iterator listItr = fileList->begin(), listLast = fileList->end(); listItr != listLast; ++listItr) {
+    unsigned int file_index = std::distance(fileList->begin(), listItr);
+    int64_t mtimeValue;
 
     rak::file_stat fs;
     bool fileExists = fs.update(fileList->root_dir() + (*listItr)->path()->as_string());
 
     if (!fileExists) {
-      
+
       if ((*listItr)->is_create_queued()) {
         // ~0 means the file still needs to be created.
-        filesItr->insert_key("mtime", ~int64_t(0));
+        mtimeValue = ~int64_t(0);
         LT_LOG_SAVE_FILE("file not created, create queued", 0);
       } else {
         // ~1 means the file shouldn't be created.
-        filesItr->insert_key("mtime", ~int64_t(1));
+        mtimeValue = ~int64_t(1);
         LT_LOG_SAVE_FILE("file not created, create not queued", 0);
       }
 
@@ -258,28 +337,50 @@ resume_save_progress(Download download, Object& object) {
 
       // This assumes the syncs are properly called before
       // resume_save_progress gets called after finishing a torrent.
-      filesItr->insert_key("mtime", (int64_t)fs.modified_time());
-      LT_LOG_SAVE_FILE("file completed, mtime:%" PRIi64, (int64_t)fs.modified_time());
+      mtimeValue = (int64_t)fs.modified_time();
+      LT_LOG_SAVE_FILE("file completed, mtime:%" PRIi64, mtimeValue);
 
     } else if (!download.info()->is_active()) {
       // When stopped, all chunks should have received sync, thus the
       // file's mtime will be correct. (We hope)
-      filesItr->insert_key("mtime", (int64_t)fs.modified_time());
-      LT_LOG_SAVE_FILE("file inactive and assumed sync'ed, mtime:%" PRIi64, (int64_t)fs.modified_time());
+      mtimeValue = (int64_t)fs.modified_time();
+      LT_LOG_SAVE_FILE("file inactive and assumed sync'ed, mtime:%" PRIi64, mtimeValue);
 
     } else {
       // If the torrent isn't done and we've not shut down, then set
       // 'mtime' to ~3 so as to indicate that the 'mtime' is not to be
       // trusted, yet we have a partial bitfield for the file.
-      filesItr->insert_key("mtime", ~int64_t(3));
+      mtimeValue = ~int64_t(3);
       LT_LOG_SAVE_FILE("file actively downloading", 0);
     }
+
+    resume_pack_64(buffer, (uint64_t)mtimeValue);
+    resume_pack_32(buffer + 8, (*listItr)->completed_chunks());
+    packed.append(buffer, resume_packed_record_size);
   }
+
+  object.insert_key("files.packed", packed);
+
+  // Drop the per-file progress keys from the legacy list so stale
+  // values don't linger alongside the packed record.
+  if (object.has_key_list("files")) {
+    Object::list_type& files = object.get_key_list("files");
+
+    for (Object::list_iterator itr = files.begin(), last = files.end(); itr != last; itr++) {
+      if (itr->is_map()) {
+        itr->erase_key("mtime");
+        itr->erase_key("completed");
+      }
+    }
+  }
+
+  resume_save_chunk_crc32c(download, object);
 }
 
 void
 resume_clear_progress(Download download, Object& object) {
   object.erase_key("bitfield");
+  object.erase_key("files.packed");
 }
 
 bool
@@ -388,6 +489,35 @@ resume_save_uncertain_pieces(Download download, Object& object) {
   completed.append((const char*)&buffer.front(), buffer.size() * sizeof(uint32_t));
 }
 
+void
+resume_load_chunk_crc32c(Download download, const Object& object) {
+  if (!object.has_key_string("chunk_crc32c")) {
+    LT_LOG_LOAD("no chunk checksum shadow found", 0);
+    return;
+  }
+
+  const Object::string_type& shadow = object.get_key_string("chunk_crc32c");
+
+  if (shadow.size() != 4 * (size_t)download.file_list()->size_chunks()) {
+    LT_LOG_LOAD_INVALID("chunk checksum shadow does not match the chunk count", 0);
+    return;
+  }
+
+  LT_LOG_LOAD("loaded chunk checksum shadow for %u chunks", download.file_list()->size_chunks());
+
+  download.mutable_data()->set_chunk_crc32c(shadow);
+}
+
+void
+resume_save_chunk_crc32c(Download download, Object& object) {
+  object.erase_key("chunk_crc32c");
+
+  if (!download.data()->has_chunk_crc32c())
+    return;
+
+  object.insert_key("chunk_crc32c", download.data()->chunk_crc32c());
+}
+
 bool
 resume_check_target_files(Download download, __UNUSED const Object& object) {
   FileList* fileList = download.file_list();
@@ -64,6 +64,13 @@ void resume_save_bitfield(Download download, Object& object) LIBTORRENT_EXPORT;
 void resume_load_uncertain_pieces(Download download, const Object& object) LIBTORRENT_EXPORT;
 void resume_save_uncertain_pieces(Download download, Object& object) LIBTORRENT_EXPORT;
 
+// Optional CRC32C shadow of the verified chunks, maintained by the
+// download once enabled through 'download_data'. Loading and saving
+// is handled by the progress functions; these are exported for
+// clients that store the shadow separately.
+void resume_load_chunk_crc32c(Download download, const Object& object) LIBTORRENT_EXPORT;
+void resume_save_chunk_crc32c(Download download, Object& object) LIBTORRENT_EXPORT;
+
 bool resume_check_target_files(Download download, const Object& object) LIBTORRENT_EXPORT;
 
 void resume_load_file_priorities(Download download, const Object& object) LIBTORRENT_EXPORT;
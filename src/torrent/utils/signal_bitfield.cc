@@ -34,9 +34,14 @@ signal_bitfield::work() {
   unsigned int i = 0;
 
   while (bitfield) {
-    if ((bitfield & (1 << i))) {
+    if ((bitfield & (bitfield_type(1) << i))) {
+      // Clear the pending counter before dispatching so a signal
+      // raised during the slot call re-raises the bit; everything
+      // counted up to this point is covered by this dispatch.
+      __sync_lock_test_and_set(&m_pending[i], 0);
+
       m_slots[i]();
-      bitfield = bitfield & ~(1 << i);
+      bitfield = bitfield & ~(bitfield_type(1) << i);
     }
 
     i++;
@@ -37,6 +37,7 @@
 #ifndef LIBTORRENT_UTILS_SIGNAL_BITFIELD_H
 #define LIBTORRENT_UTILS_SIGNAL_BITFIELD_H
 
+#include <algorithm>
 #include <functional>
 
 #include <torrent/common.h>
@@ -45,17 +46,27 @@ namespace torrent {
 
 class LIBTORRENT_EXPORT lt_cacheline_aligned signal_bitfield {
 public:
-  typedef uint32_t               bitfield_type;
+  typedef uint64_t               bitfield_type;
   typedef std::function<void ()> slot_type;
-  
-  static const unsigned int max_size = 32;
 
-  signal_bitfield() : m_bitfield(0), m_size(0) {}
-  
-  bool          has_signal(unsigned int index) const { return m_bitfield & (1 << index); }
+  static const unsigned int max_size = 64;
+
+  signal_bitfield() : m_bitfield(0), m_size(0) { std::fill(m_pending, m_pending + max_size, 0); }
+
+  bool          has_signal(unsigned int index) const { return m_bitfield & (bitfield_type(1) << index); }
+
+  // Returns true when the signal was raised from idle; repeat raises
+  // before the owning thread dispatches only bump the pending
+  // counter, letting the caller skip the cross-thread interrupt. The
+  // whole batch is handled by a single dispatch.
+  bool          signal(unsigned int index) {
+    if (__sync_fetch_and_add(&m_pending[index], 1) != 0)
+      return false;
+
+    __sync_or_and_fetch(&m_bitfield, bitfield_type(1) << index);
+    return true;
+  }
 
-  // Do the interrupt from the thread?
-  void          signal(unsigned int index) { __sync_or_and_fetch(&m_bitfield, 1 << index); }
   void          work();
 
   unsigned int  add_signal(slot_type slot);
@@ -65,6 +76,7 @@ private:
   bitfield_type m_bitfield;
   unsigned int  m_size;
   slot_type     m_slots[max_size] lt_cacheline_aligned;
+  uint32_t      m_pending[max_size] lt_cacheline_aligned;
 };
 
 }
@@ -1,8 +1,10 @@
 #include "config.h"
 
 #include <cstring>
+#include <sched.h>
 #include <signal.h>
 #include <unistd.h>
+#include <rak/timer.h>
 
 #include "exceptions.h"
 #include "poll.h"
@@ -22,7 +24,9 @@ thread_base::thread_base() :
 
   m_poll(NULL),
   m_interrupt_sender(NULL),
-  m_interrupt_receiver(NULL)
+  m_interrupt_receiver(NULL),
+  m_stall_threshold(1000000),
+  m_idle_next(0)
 {
   std::memset(&m_thread, 0, sizeof(pthread_t));
 
@@ -52,6 +56,48 @@ thread_base::start_thread() {
 
   if (pthread_create(&m_thread, NULL, (pthread_func)&thread_base::event_loop, this))
     throw internal_error("Failed to create thread.");
+
+  if (!m_affinity_cpus.empty())
+    apply_affinity();
+}
+
+void
+thread_base::set_affinity_cpus(const std::vector<int>& cpus) {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+  m_affinity_cpus = cpus;
+
+  // Before start_thread the pthread does not exist yet; start_thread
+  // applies the stored set right after creating it.
+  if (is_active())
+    apply_affinity();
+#else
+  throw internal_error("thread_base::set_affinity_cpus(...) not supported on this platform.");
+#endif
+}
+
+void
+thread_base::apply_affinity() {
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+
+  if (m_affinity_cpus.empty()) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      CPU_SET(cpu, &cpu_set);
+  } else {
+    for (std::vector<int>::const_iterator itr = m_affinity_cpus.begin(), last = m_affinity_cpus.end(); itr != last; itr++) {
+      if (*itr < 0 || *itr >= CPU_SETSIZE)
+        throw internal_error("thread_base::apply_affinity() cpu index out of range.");
+
+      CPU_SET(*itr, &cpu_set);
+    }
+  }
+
+  if (pthread_setaffinity_np(m_thread, sizeof(cpu_set_t), &cpu_set) != 0)
+    throw internal_error("thread_base::apply_affinity() pthread_setaffinity_np failed.");
+
+  lt_log_print(torrent::LOG_THREAD_NOTICE, "%s: Pinned thread to %zu cpus.", name(), m_affinity_cpus.size());
+#endif
 }
 
 void
@@ -73,6 +119,19 @@ thread_base::stop_thread_wait() {
   acquire_global_lock();
 }
 
+void
+thread_base::add_idle_slice(const slot_void& slot) {
+  m_idle_slices.push_back(slot);
+}
+
+void
+thread_base::call_idle_slice() {
+  if (m_idle_next >= m_idle_slices.size())
+    m_idle_next = 0;
+
+  m_idle_slices[m_idle_next++]();
+}
+
 // Fix interrupting when shutting down thread.
 void
 thread_base::interrupt() {
@@ -103,7 +162,11 @@ thread_base::event_loop(thread_base* thread) {
 #endif
 
   lt_log_print(torrent::LOG_THREAD_NOTICE, "%s: Starting thread.", thread->name());
-  
+
+  // Stage this thread's log lines in a per-thread ring, flushed at
+  // the bottom of each loop iteration.
+  log_thread_ring_enable();
+
   try {
 
 // #ifdef USE_INTERRUPT_SOCKET
@@ -111,11 +174,54 @@ thread_base::event_loop(thread_base* thread) {
 // #endif
 
     while (true) {
+#ifdef LT_INSTRUMENTATION
+      rak::timer work_start = rak::timer::current();
+#endif
+
+      // Stall watchdog: time each work phase so an iteration that
+      // blows past the threshold can name its culprit below.
+      int64_t     stall_threshold = thread->m_stall_threshold;
+      int64_t     stall_total = 0;
+      int64_t     stall_slowest = 0;
+      const char* stall_phase = "";
+      rak::timer  phase_start;
+
+      if (stall_threshold != 0)
+        phase_start = rak::timer::current();
+
+      auto end_phase = [&](const char* name) {
+          if (stall_threshold == 0)
+            return;
+
+          rak::timer now = rak::timer::current();
+          int64_t usec = (now - phase_start).usec();
+
+          if (usec > stall_slowest) {
+            stall_slowest = usec;
+            stall_phase = name;
+          }
+
+          stall_total += usec;
+          phase_start = now;
+        };
+
       if (thread->m_slot_do_work)
         thread->m_slot_do_work();
 
+      end_phase("do_work");
+
+      // Occupancy accounting: scheduled tasks and signal work are
+      // timed as one bucket, socket event dispatch is timed by the
+      // poll implementations.
+      rak::timer tasks_start = rak::timer::current();
+
       thread->call_events();
+      end_phase("call_events");
+
       thread->signal_bitfield()->work();
+      end_phase("signal_work");
+
+      instrumentation_update(INSTRUMENTATION_POLLING_TIME_SCHEDULED_TASKS, (rak::timer::current() - tasks_start).usec());
 
       __sync_fetch_and_or(&thread->m_flags, flag_polling);
 
@@ -124,8 +230,17 @@ thread_base::event_loop(thread_base* thread) {
       if (thread->m_slot_do_work)
         thread->m_slot_do_work();
 
+      end_phase("do_work");
+
+      tasks_start = rak::timer::current();
+
       thread->call_events();
+      end_phase("call_events");
+
       thread->signal_bitfield()->work();
+      end_phase("signal_work");
+
+      instrumentation_update(INSTRUMENTATION_POLLING_TIME_SCHEDULED_TASKS, (rak::timer::current() - tasks_start).usec());
 
       uint64_t next_timeout = 0;
 
@@ -136,6 +251,30 @@ thread_base::event_loop(thread_base* thread) {
           next_timeout = std::min(next_timeout, thread->m_slot_next_timeout());
       }
 
+      end_phase("next_timeout");
+
+      // Spend large poll timeouts on deferred maintenance instead of
+      // sleeping through them: one bounded slice per iteration,
+      // round-robin over the registered jobs. Iterations with
+      // imminent work skip this entirely, keeping event dispatch
+      // latency flat.
+      if (!thread->m_idle_slices.empty() && !thread->has_no_timeout() && next_timeout >= (uint64_t)idle_slack_usec) {
+        thread->call_idle_slice();
+
+        // The slice may have scheduled tasks of its own.
+        next_timeout = thread->next_timeout_usec();
+
+        if (thread->m_slot_next_timeout)
+          next_timeout = std::min(next_timeout, thread->m_slot_next_timeout());
+
+        end_phase("idle_slice");
+      }
+
+      if (stall_threshold != 0 && stall_total >= stall_threshold)
+        lt_log_print(torrent::LOG_THREAD_WARN,
+                     "%s: Event loop stalled for %" PRIi64 " usec, slowest phase '%s' at %" PRIi64 " usec.",
+                     thread->name(), stall_total, stall_phase, stall_slowest);
+
       // Add the sleep call when testing interrupts, etc.
       // usleep(50);
 
@@ -147,6 +286,12 @@ thread_base::event_loop(thread_base* thread) {
       instrumentation_update(INSTRUMENTATION_POLLING_DO_POLL, 1);
       instrumentation_update(instrumentation_enum(INSTRUMENTATION_POLLING_DO_POLL + thread->m_instrumentation_index), 1);
 
+#ifdef LT_INSTRUMENTATION
+      instrumentation_record(INSTRUMENTATION_HISTOGRAM_POLL_LATENCY, (rak::timer::current() - work_start).usec());
+#endif
+
+      log_thread_ring_flush();
+
       int event_count = thread->m_poll->do_poll(next_timeout, poll_flags);
 
       instrumentation_update(INSTRUMENTATION_POLLING_EVENTS, event_count);
@@ -163,6 +308,8 @@ thread_base::event_loop(thread_base* thread) {
     lt_log_print(torrent::LOG_THREAD_NOTICE, "%s: Shutting down thread.", thread->name());
   }
 
+  log_thread_ring_disable();
+
   __sync_lock_test_and_set(&thread->m_state, STATE_INACTIVE);
   return NULL;
 }
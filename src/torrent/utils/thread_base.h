@@ -4,6 +4,7 @@
 #import <functional>
 #import <pthread.h>
 #import <sys/types.h>
+#import <vector>
 
 #import <torrent/common.h>
 #import <torrent/utils/signal_bitfield.h>
@@ -63,6 +64,29 @@ public:
   virtual void        stop_thread();
   void                stop_thread_wait();
 
+  // Pin the thread to the given set of cpus, e.g. those of one NUMA
+  // node so that memory the thread faults in is allocated node-local
+  // under the kernel's first-touch policy. May be called before or
+  // after start_thread; an empty set clears the restriction. Throws
+  // if the platform has no pthread_setaffinity_np.
+  const std::vector<int>& affinity_cpus() const { return m_affinity_cpus; }
+  void                set_affinity_cpus(const std::vector<int>& cpus);
+
+  // Stall watchdog: when the work phases of one event loop iteration
+  // exceed the threshold, a warning naming the slowest phase and its
+  // duration is logged. Zero disables the clock reads entirely.
+  int64_t             stall_threshold_usec() const      { return m_stall_threshold; }
+  void                set_stall_threshold_usec(int64_t usec) { m_stall_threshold = usec; }
+
+  // Idle maintenance: registered jobs run one at a time, round-robin,
+  // and only when the computed poll timeout shows at least
+  // idle_slack_usec of slack ahead. Each job must be a bounded slice,
+  // and completion must not depend on idle time alone; keep a timer
+  // backstop for work with a deadline.
+  static const int64_t idle_slack_usec = 50000;
+
+  void                add_idle_slice(const slot_void& slot);
+
   void                interrupt();
   void                send_event_signal(unsigned int index, bool interrupt = true);
 
@@ -110,6 +134,16 @@ protected:
 
   thread_interrupt*   m_interrupt_sender;
   thread_interrupt*   m_interrupt_receiver;
+
+private:
+  void                apply_affinity() LIBTORRENT_NO_EXPORT;
+  void                call_idle_slice() LIBTORRENT_NO_EXPORT;
+
+  std::vector<int>    m_affinity_cpus;
+  int64_t             m_stall_threshold;
+
+  std::vector<slot_void> m_idle_slices;
+  unsigned int        m_idle_next;
 };
 
 inline bool
@@ -136,9 +170,9 @@ thread_base::state() const {
 
 inline void
 thread_base::send_event_signal(unsigned int index, bool do_interrupt) {
-  m_signal_bitfield.signal(index);
-
-  if (do_interrupt)
+  // Only the raise from idle needs to wake the thread; coalesced
+  // raises are covered by the dispatch the first one triggered.
+  if (m_signal_bitfield.signal(index) && do_interrupt)
     interrupt();
 }
 
@@ -38,7 +38,12 @@
 
 #include "thread_interrupt.h"
 
+#include <cstdint>
+#include <unistd.h>
 #include <sys/socket.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 
 #include "net/socket_fd.h"
 #include "rak/error_number.h"
@@ -48,6 +53,7 @@
 namespace torrent {
 
 thread_interrupt::thread_interrupt(int fd) :
+  m_isEventfd(false),
   m_poking(false) {
   m_fileDesc = fd;
   get_fd().set_nonblock();
@@ -66,6 +72,21 @@ thread_interrupt::poke() {
   if (!__sync_bool_compare_and_swap(&m_other->m_poking, false, true))
     return true;
 
+#ifdef EFD_NONBLOCK
+  if (m_isEventfd) {
+    uint64_t counter = 1;
+    int result = ::write(m_fileDesc, &counter, sizeof(counter));
+
+    if (result != sizeof(counter) &&
+        (result != -1 || !rak::error_number::current().is_blocked_momentary()))
+      throw internal_error("Invalid result writing to thread_interrupt eventfd.");
+
+    instrumentation_update(INSTRUMENTATION_POLLING_INTERRUPT_POKE, 1);
+
+    return true;
+  }
+#endif
+
   int result = ::send(m_fileDesc, "a", 1, 0);
 
   if (result == 0 ||
@@ -79,6 +100,31 @@ thread_interrupt::poke() {
 
 thread_interrupt::pair_type
 thread_interrupt::create_pair() {
+#ifdef EFD_NONBLOCK
+  // A single eventfd replaces the socketpair where available; a write
+  // bumps an in-kernel counter instead of copying a byte through
+  // socket buffers, and a read drains any number of pokes at once.
+  // The sender holds a dup so both halves keep owning their fd.
+  int efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (efd != -1) {
+    int efd_dup = ::dup(efd);
+
+    if (efd_dup == -1) {
+      ::close(efd);
+    } else {
+      thread_interrupt* t1 = new thread_interrupt(efd_dup);
+      thread_interrupt* t2 = new thread_interrupt(efd);
+
+      t1->m_isEventfd = t2->m_isEventfd = true;
+      t1->m_other = t2;
+      t2->m_other = t1;
+
+      return pair_type(t1, t2);
+    }
+  }
+#endif
+
   int fd1, fd2;
 
   if (!SocketFd::open_socket_pair(fd1, fd2))
@@ -95,6 +141,22 @@ thread_interrupt::create_pair() {
 
 void
 thread_interrupt::event_read() {
+#ifdef EFD_NONBLOCK
+  if (m_isEventfd) {
+    uint64_t counter;
+    int result = ::read(m_fileDesc, &counter, sizeof(counter));
+
+    if (result != sizeof(counter) &&
+        (result != -1 || !rak::error_number::current().is_blocked_momentary()))
+      throw internal_error("Invalid result reading from thread_interrupt eventfd.");
+
+    instrumentation_update(INSTRUMENTATION_POLLING_INTERRUPT_READ_EVENT, 1);
+
+    __sync_bool_compare_and_swap(&m_poking, true, false);
+    return;
+  }
+#endif
+
   char buffer[256];
   int result = ::recv(m_fileDesc, buffer, 256, 0);
 
@@ -66,6 +66,7 @@ private:
   SocketFd&           get_fd() { return *reinterpret_cast<SocketFd*>(&m_fileDesc); }
 
   thread_interrupt*   m_other;
+  bool                m_isEventfd;
   bool                m_poking lt_cacheline_aligned;
 };
 
@@ -38,8 +38,10 @@
 
 #define __STDC_FORMAT_MACROS
 
+#include <deque>
 #include <iomanip>
 #include <sstream>
+#include <pthread.h>
 #include <rak/functional.h>
 #include <rak/string_manip.h>
 
@@ -49,6 +51,7 @@
 #include "torrent/download_info.h"
 #include "torrent/exceptions.h"
 #include "torrent/http.h"
+#include "torrent/object_static_map.h"
 #include "torrent/object_stream.h"
 #include "torrent/tracker_list.h"
 #include "torrent/utils/log.h"
@@ -58,6 +61,7 @@
 
 #include "globals.h"
 #include "manager.h"
+#include "utils/instrumentation.h"
 
 #define LT_LOG_TRACKER(log_level, log_fmt, ...)                         \
   lt_log_print_info(LOG_TRACKER_##log_level, m_parent->info(), "tracker", "[%u] " log_fmt, group(), __VA_ARGS__);
@@ -67,11 +71,220 @@
 
 namespace torrent {
 
+// Possible bencode keys in an announce reply. The reply is parsed
+// with static key dispatch so the hot announce path extracts its
+// fields without building an Object tree; peer lists are kept as raw
+// views into the reply buffer.
+enum tracker_http_keys {
+  key_complete,
+  key_downloaded,
+  key_failure_reason,
+  key_incomplete,
+  key_interval,
+  key_min_interval,
+  key_peers,
+  key_peers6,
+  key_tracker_id,
+
+  key_tracker_LAST,
+};
+
+class TrackerHttpResponse : public static_map_type<tracker_http_keys, key_tracker_LAST> {
+public:
+  typedef static_map_type<tracker_http_keys, key_tracker_LAST> base_type;
+};
+
+template <>
+const TrackerHttpResponse::key_list_type TrackerHttpResponse::base_type::keys = {
+  { key_complete,       "complete" },
+  { key_downloaded,     "downloaded" },
+  { key_failure_reason, "failure reason" },
+  { key_incomplete,     "incomplete" },
+  { key_interval,       "interval" },
+  { key_min_interval,   "min interval" },
+
+  // Kept raw as some trackers send a string of compact addresses and
+  // others a list of peer dictionaries.
+  { key_peers,          "peers*" },
+  { key_peers6,         "peers6*S" },
+  { key_tracker_id,     "tracker id*S" },
+};
+
+// Scrapes are not sent immediately; they wait a moment in a shared
+// list so scrapes of the same tracker from other torrents can be
+// coalesced into a single multi-hash request.
+static const unsigned int scrape_batch_delay    = 2;   // Seconds to wait for more scrapes.
+static const unsigned int scrape_batch_max_size = 64;  // Info-hashes per scrape request.
+
+static std::vector<TrackerHttp*> http_scrape_pending;
+static rak::priority_item        http_scrape_task;
+
+// A reply handed off to the parse worker. The worker only touches
+// the content and the output fields; 'tracker' is the delivery
+// handle and is cleared under the queue lock when the request is
+// cancelled before delivery.
+struct TrackerHttpParseJob {
+  TrackerHttp*        tracker;
+  bool                scrape;
+  std::string         content;
+
+  bool                failed;
+  bool                peers_failed;
+  std::string         failure_msg;
+
+  Object              scrape_object;  // Scrape replies keep the full tree.
+  TrackerHttpResponse response;       // Points into 'content'.
+  AddressList         address_list;   // Sorted and deduplicated.
+};
+
+// Parse worker shared by all http trackers, started on first use.
+// Announce bursts for thousands of torrents used to parse their
+// replies inline on the main loop; here only the cheap delivery of
+// the finished results serializes through loop time.
+static pthread_t                        http_parse_thread;
+static pthread_mutex_t                  http_parse_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t                   http_parse_cond = PTHREAD_COND_INITIALIZER;
+static bool                             http_parse_running = false;
+static bool                             http_parse_shutdown = false;
+static std::deque<TrackerHttpParseJob*> http_parse_queue;
+static std::deque<TrackerHttpParseJob*> http_parse_done_queue;
+static std::deque<TrackerHttpParseJob*> http_parse_retire_queue;
+static TrackerHttpParseJob*             http_parse_active = NULL;
+static std::function<void ()>           http_parse_slot_done;
+
+// Parse directly from the contiguous buffer instead of pulling the
+// stream apart character by character through the streambuf
+// interface.
+static void
+http_parse_perform(TrackerHttpParseJob* job) {
+  if (job->scrape) {
+    // Scrape replies are keyed by info-hash, so those still need a
+    // full Object tree.
+    try {
+      object_read_bencode_c(job->content.c_str(), job->content.c_str() + job->content.size(), &job->scrape_object);
+
+    } catch (bencode_error& e) {
+      job->failed = true;
+      job->failure_msg = "Could not parse bencoded data: " + rak::sanitize(rak::striptags(job->content)).substr(0, 99);
+      return;
+    }
+
+    if (!job->scrape_object.is_map()) {
+      job->failed = true;
+      job->failure_msg = "Root not a bencoded map";
+      return;
+    }
+
+    if (job->scrape_object.has_key("failure reason")) {
+      job->failed = true;
+      job->failure_msg = "Failure reason \"" +
+        (job->scrape_object.get_key("failure reason").is_string() ?
+         job->scrape_object.get_key_string("failure reason") :
+         std::string("failure reason not a string"))
+        + "\"";
+    }
+
+    return;
+  }
+
+  try {
+    static_map_read_bencode(job->content.c_str(), job->content.c_str() + job->content.size(), job->response);
+
+  } catch (bencode_error& e) {
+    job->failed = true;
+    job->failure_msg = "Could not parse bencoded data: " + rak::sanitize(rak::striptags(job->content)).substr(0, 99);
+    return;
+  }
+
+  if (job->response[key_peers].is_raw_bencode()) {
+    raw_bencode peers = job->response[key_peers].as_raw_bencode();
+
+    // Due to some trackers sending the wrong type when no peers are
+    // available, don't bork on it.
+    if (peers.is_raw_string()) {
+      job->address_list.parse_address_compact(peers.as_raw_string());
+
+    } else if (peers.is_raw_list()) {
+      // A few trackers still reply with a list of peer dictionaries;
+      // build the small temporary tree for just those.
+      try {
+        Object tmp;
+        object_read_bencode_c(peers.begin(), peers.end(), &tmp);
+
+        if (tmp.is_list())
+          job->address_list.parse_address_normal(tmp.as_list());
+
+      } catch (bencode_error& e) {
+        job->peers_failed = true;
+        job->failure_msg = e.what();
+        return;
+      }
+    }
+  }
+
+  if (job->response[key_peers6].is_raw_string())
+    job->address_list.parse_address_compact_ipv6(job->response[key_peers6].as_raw_string().as_string());
+
+  // Normalize here so the merge on the main thread starts from a
+  // sorted, deduplicated block.
+  job->address_list.sort();
+  job->address_list.erase(std::unique(job->address_list.begin(), job->address_list.end()), job->address_list.end());
+}
+
+static void*
+http_parse_thread_func(__UNUSED void* arg) {
+  pthread_mutex_lock(&http_parse_lock);
+
+  while (!http_parse_shutdown) {
+    // Consumed jobs come back here for destruction so their Object
+    // trees land on this thread's pool free lists, where the next
+    // parse reuses them. Freeing them on the main thread would
+    // migrate the blocks there one way and leave this thread carving
+    // a fresh slab for every reply.
+    while (!http_parse_retire_queue.empty()) {
+      TrackerHttpParseJob* job = http_parse_retire_queue.front();
+      http_parse_retire_queue.pop_front();
+
+      pthread_mutex_unlock(&http_parse_lock);
+      delete job;
+      pthread_mutex_lock(&http_parse_lock);
+    }
+
+    if (http_parse_queue.empty()) {
+      pthread_cond_wait(&http_parse_cond, &http_parse_lock);
+      continue;
+    }
+
+    TrackerHttpParseJob* job = http_parse_queue.front();
+    http_parse_queue.pop_front();
+    http_parse_active = job;
+
+    pthread_mutex_unlock(&http_parse_lock);
+
+    http_parse_perform(job);
+
+    pthread_mutex_lock(&http_parse_lock);
+    http_parse_active = NULL;
+    http_parse_done_queue.push_back(job);
+    pthread_mutex_unlock(&http_parse_lock);
+
+    http_parse_slot_done();
+
+    pthread_mutex_lock(&http_parse_lock);
+  }
+
+  pthread_mutex_unlock(&http_parse_lock);
+  return NULL;
+}
+
 TrackerHttp::TrackerHttp(TrackerList* parent, const std::string& url, int flags) :
   Tracker(parent, url, flags),
 
   m_get(Http::slot_factory()()),
-  m_data(NULL) {
+  m_data(NULL),
+  m_spareData(NULL),
+  m_scrapeQueued(false),
+  m_scrapeLeader(NULL) {
 
   m_get->signal_done().push_back(std::bind(&TrackerHttp::receive_done, this));
   m_get->signal_failed().push_back(std::bind(&TrackerHttp::receive_failed, this, std::placeholders::_1));
@@ -92,8 +305,25 @@ TrackerHttp::TrackerHttp(TrackerList* parent, const std::string& url, int flags)
 }
 
 TrackerHttp::~TrackerHttp() {
+  offload_parse_cancel();
+  leave_scrape_group();
+
   delete m_get;
   delete m_data;
+  delete m_spareData;
+}
+
+std::stringstream*
+TrackerHttp::open_data() {
+  if (m_spareData != NULL) {
+    m_data = m_spareData;
+    m_spareData = NULL;
+
+  } else {
+    m_data = new std::stringstream();
+  }
+
+  return m_data;
 }
 
 bool
@@ -114,6 +344,7 @@ TrackerHttp::request_prefix(std::stringstream* stream, const std::string& url) {
 
 void
 TrackerHttp::send_state(int state) {
+  leave_scrape_group();
   close_directly();
 
   if (m_parent == NULL)
@@ -188,7 +419,7 @@ TrackerHttp::send_state(int state) {
     break;
   }
 
-  m_data = new std::stringstream();
+  open_data();
 
   std::string request_url = s.str();
 
@@ -201,36 +432,113 @@ TrackerHttp::send_state(int state) {
   m_get->set_stream(m_data);
   m_get->set_timeout(2 * 60);
 
+  m_requestTime = rak::timer::current();
   m_get->start();
 }
 
 void
 TrackerHttp::send_scrape() {
-  if (m_data != NULL)
+  if (m_data != NULL || m_scrapeQueued || m_scrapeLeader != NULL)
     return;
 
   m_latest_event = EVENT_SCRAPE;
 
+  m_scrapeQueued = true;
+  http_scrape_pending.push_back(this);
+
+  if (!http_scrape_task.is_queued()) {
+    http_scrape_task.slot() = std::bind(&TrackerHttp::flush_scrapes);
+    priority_queue_insert(&taskScheduler, &http_scrape_task, (cachedTime + rak::timer::from_seconds(scrape_batch_delay)).round_seconds());
+  }
+}
+
+void
+TrackerHttp::flush_scrapes() {
+  while (!http_scrape_pending.empty()) {
+    TrackerHttp* leader = http_scrape_pending.front();
+
+    http_scrape_pending.erase(http_scrape_pending.begin());
+    leader->m_scrapeQueued = false;
+    leader->m_scrapeLeader = leader;
+    leader->m_scrapeGroup.clear();
+
+    // Pull every pending scrape of the same tracker onto the
+    // leader's request.
+    for (std::vector<TrackerHttp*>::iterator itr = http_scrape_pending.begin();
+         itr != http_scrape_pending.end() && leader->m_scrapeGroup.size() + 1 < scrape_batch_max_size; ) {
+      if ((*itr)->m_url == leader->m_url) {
+        (*itr)->m_scrapeQueued = false;
+        (*itr)->m_scrapeLeader = leader;
+        leader->m_scrapeGroup.push_back(*itr);
+        itr = http_scrape_pending.erase(itr);
+
+      } else {
+        ++itr;
+      }
+    }
+
+    leader->start_scrape();
+  }
+}
+
+void
+TrackerHttp::start_scrape() {
   std::stringstream s;
   s.imbue(std::locale::classic());
 
   request_prefix(&s, scrape_url_from(m_url));
 
-  m_data = new std::stringstream();
+  for (std::vector<TrackerHttp*>::iterator itr = m_scrapeGroup.begin(); itr != m_scrapeGroup.end(); ++itr) {
+    char hash[61];
+
+    *rak::copy_escape_html((*itr)->m_parent->info()->hash().begin(),
+                           (*itr)->m_parent->info()->hash().end(), hash) = '\0';
+    s << "&info_hash=" << hash;
+  }
+
+  open_data();
 
   std::string request_url = s.str();
 
-  LT_LOG_TRACKER_DUMP(DEBUG, request_url.c_str(), request_url.size(), "Tracker HTTP scrape.", 0);
-  
+  LT_LOG_TRACKER_DUMP(DEBUG, request_url.c_str(), request_url.size(), "Tracker HTTP scrape (hashes:%zu).", m_scrapeGroup.size() + 1);
+
   m_get->set_url(request_url);
   m_get->set_stream(m_data);
   m_get->set_timeout(2 * 60);
 
+  m_requestTime = rak::timer::current();
   m_get->start();
 }
 
+void
+TrackerHttp::leave_scrape_group() {
+  if (m_scrapeQueued) {
+    m_scrapeQueued = false;
+    http_scrape_pending.erase(std::remove(http_scrape_pending.begin(), http_scrape_pending.end(), this), http_scrape_pending.end());
+
+    if (http_scrape_pending.empty() && http_scrape_task.is_queued())
+      priority_queue_erase(&taskScheduler, &http_scrape_task);
+  }
+
+  if (m_scrapeLeader == this) {
+    // Orphan the members; their controllers will scrape again later.
+    while (!m_scrapeGroup.empty()) {
+      m_scrapeGroup.back()->m_scrapeLeader = NULL;
+      m_scrapeGroup.pop_back();
+    }
+
+  } else if (m_scrapeLeader != NULL) {
+    std::vector<TrackerHttp*>& group = m_scrapeLeader->m_scrapeGroup;
+    group.erase(std::remove(group.begin(), group.end(), this), group.end());
+  }
+
+  m_scrapeLeader = NULL;
+}
+
 void
 TrackerHttp::close() {
+  leave_scrape_group();
+
   if (m_data == NULL)
     return;
 
@@ -242,12 +550,16 @@ TrackerHttp::close() {
 
 void
 TrackerHttp::disown() {
+  leave_scrape_group();
+
   if (m_data == NULL)
     return;
 
   LT_LOG_TRACKER(DEBUG, "Tracker HTTP request disowned: state:%s url:%s.",
                  option_as_string(OPTION_TRACKER_EVENT, m_latest_event), m_url.c_str());
-  
+
+  offload_parse_cancel();
+
   m_get->set_delete_self();
   m_get->set_delete_stream();
   m_get->signal_done().clear();
@@ -268,10 +580,22 @@ TrackerHttp::close_directly() {
   if (m_data == NULL)
     return;
 
+  offload_parse_cancel();
+
   m_get->close();
   m_get->set_stream(NULL);
 
-  delete m_data;
+  // Keep one stream object around for the next request; only the
+  // disown path hands the stream off for deletion.
+  if (m_spareData == NULL) {
+    m_data->clear();
+    m_data->str(std::string());
+    m_spareData = m_data;
+
+  } else {
+    delete m_data;
+  }
+
   m_data = NULL;
 }
 
@@ -280,33 +604,139 @@ TrackerHttp::receive_done() {
   if (m_data == NULL)
     throw internal_error("TrackerHttp::receive_done() called on an invalid object");
 
-  if (lt_log_is_valid(LOG_TRACKER_DEBUG)) {
-    std::string dump = m_data->str();
-    LT_LOG_TRACKER_DUMP(DEBUG, dump.c_str(), dump.size(), "Tracker HTTP reply.", 0);
+  instrumentation_record(INSTRUMENTATION_HISTOGRAM_TRACKER_RTT, (rak::timer::current() - m_requestTime).usec());
+
+  TrackerHttpParseJob* job = new TrackerHttpParseJob;
+
+  job->tracker = this;
+  job->scrape = m_latest_event == EVENT_SCRAPE;
+  job->content = m_data->str();
+  job->failed = false;
+  job->peers_failed = false;
+
+  LT_LOG_TRACKER_DUMP(DEBUG, job->content.c_str(), job->content.size(), "Tracker HTTP reply.", 0);
+
+  // The request stays busy while the reply is parsed off-thread;
+  // receive_parse_done picks up when the worker is done with it.
+  offload_parse(job);
+}
+
+void
+TrackerHttp::offload_parse(TrackerHttpParseJob* job) {
+  if (!http_parse_running) {
+    if (pthread_create(&http_parse_thread, NULL, &http_parse_thread_func, NULL) != 0)
+      throw internal_error("TrackerHttp::offload_parse() could not create thread.");
+
+    http_parse_running = true;
   }
 
-  Object b;
-  *m_data >> b;
+  pthread_mutex_lock(&http_parse_lock);
+  http_parse_queue.push_back(job);
+  pthread_cond_signal(&http_parse_cond);
+  pthread_mutex_unlock(&http_parse_lock);
+}
 
-  if (m_data->fail()) {
-    std::string dump = m_data->str();
-    return receive_failed("Could not parse bencoded data: " + rak::sanitize(rak::striptags(dump)).substr(0,99));
+// Called when the request is torn down before delivery; the worker
+// never touches the tracker object, so clearing the delivery handle
+// is all cancellation takes.
+void
+TrackerHttp::offload_parse_cancel() {
+  if (!http_parse_running)
+    return;
+
+  pthread_mutex_lock(&http_parse_lock);
+
+  for (std::deque<TrackerHttpParseJob*>::iterator itr = http_parse_queue.begin(), last = http_parse_queue.end(); itr != last; itr++)
+    if ((*itr)->tracker == this)
+      (*itr)->tracker = NULL;
+
+  for (std::deque<TrackerHttpParseJob*>::iterator itr = http_parse_done_queue.begin(), last = http_parse_done_queue.end(); itr != last; itr++)
+    if ((*itr)->tracker == this)
+      (*itr)->tracker = NULL;
+
+  if (http_parse_active != NULL && http_parse_active->tracker == this)
+    http_parse_active->tracker = NULL;
+
+  pthread_mutex_unlock(&http_parse_lock);
+}
+
+void
+TrackerHttp::work_parse_done() {
+  pthread_mutex_lock(&http_parse_lock);
+
+  while (!http_parse_done_queue.empty()) {
+    TrackerHttpParseJob* job = http_parse_done_queue.front();
+    http_parse_done_queue.pop_front();
+
+    pthread_mutex_unlock(&http_parse_lock);
+
+    // Cancellation happens on this thread, so the handle can't be
+    // cleared under us here.
+    if (job->tracker != NULL)
+      job->tracker->receive_parse_done(job);
+
+    pthread_mutex_lock(&http_parse_lock);
+
+    // Hand the job back to the worker for destruction; the Object
+    // trees were allocated there and their pool blocks belong on that
+    // thread's free lists.
+    http_parse_retire_queue.push_back(job);
   }
 
-  if (!b.is_map())
-    return receive_failed("Root not a bencoded map");
+  pthread_cond_signal(&http_parse_cond);
+  pthread_mutex_unlock(&http_parse_lock);
+}
 
-  if (b.has_key("failure reason"))
-    return receive_failed("Failure reason \"" +
-			 (b.get_key("failure reason").is_string() ?
-			  b.get_key_string("failure reason") :
-			  std::string("failure reason not a string"))
-			 + "\"");
+void
+TrackerHttp::stop_parse_worker() {
+  if (!http_parse_running)
+    return;
+
+  pthread_mutex_lock(&http_parse_lock);
+  http_parse_shutdown = true;
+  pthread_cond_broadcast(&http_parse_cond);
+  pthread_mutex_unlock(&http_parse_lock);
+
+  pthread_join(http_parse_thread, NULL);
+
+  while (!http_parse_queue.empty()) {
+    delete http_parse_queue.front();
+    http_parse_queue.pop_front();
+  }
+
+  while (!http_parse_done_queue.empty()) {
+    delete http_parse_done_queue.front();
+    http_parse_done_queue.pop_front();
+  }
+
+  // With the worker joined, freeing the retired trees here is a
+  // one-time migration to this thread's pool lists, not a leak.
+  while (!http_parse_retire_queue.empty()) {
+    delete http_parse_retire_queue.front();
+    http_parse_retire_queue.pop_front();
+  }
+
+  http_parse_running = false;
+  http_parse_shutdown = false;
+}
+
+std::function<void ()>&
+TrackerHttp::slot_parse_done() {
+  return http_parse_slot_done;
+}
+
+void
+TrackerHttp::receive_parse_done(TrackerHttpParseJob* job) {
+  if (m_data == NULL)
+    throw internal_error("TrackerHttp::receive_parse_done() called on an invalid object");
 
-  if (m_latest_event == EVENT_SCRAPE)
-    process_scrape(b);
+  if (job->failed)
+    return receive_failed(job->failure_msg);
+
+  if (job->scrape)
+    process_scrape(job->scrape_object);
   else
-    process_success(b);
+    process_success(job);
 }
 
 void
@@ -318,57 +748,64 @@ TrackerHttp::receive_failed(std::string msg) {
 
   close_directly();
 
-  if (m_latest_event == EVENT_SCRAPE)
+  if (m_latest_event == EVENT_SCRAPE) {
+    // Propagate the failure to the trackers multiplexed onto this
+    // request.
+    while (!m_scrapeGroup.empty()) {
+      TrackerHttp* member = m_scrapeGroup.back();
+
+      m_scrapeGroup.pop_back();
+      member->m_scrapeLeader = NULL;
+      member->m_parent->receive_scrape_failed(member, msg);
+    }
+
+    m_scrapeLeader = NULL;
     m_parent->receive_scrape_failed(this, msg);
-  else
+
+  } else {
     m_parent->receive_failed(this, msg);
+  }
 }
 
 void
-TrackerHttp::process_success(const Object& object) {
-  if (object.has_key_value("interval"))
-    set_normal_interval(object.get_key_value("interval"));
-  
-  if (object.has_key_value("min interval"))
-    set_min_interval(object.get_key_value("min interval"));
-
-  if (object.has_key_string("tracker id"))
-    m_tracker_id = object.get_key_string("tracker id");
+TrackerHttp::process_success(TrackerHttpParseJob* job) {
+  const TrackerHttpResponse& response = job->response;
 
-  if (object.has_key_value("complete") && object.has_key_value("incomplete")) {
-    m_scrape_complete = std::max<int64_t>(object.get_key_value("complete"), 0);
-    m_scrape_incomplete = std::max<int64_t>(object.get_key_value("incomplete"), 0);
-    m_scrape_time_last = cachedTime.seconds();
-  }
+  if (response[key_failure_reason].is_not_empty())
+    return receive_failed("Failure reason \"" +
+                          (response[key_failure_reason].is_string() ?
+                           response[key_failure_reason].as_string() :
+                           std::string("failure reason not a string"))
+                          + "\"");
 
-  if (object.has_key_value("downloaded"))
-    m_scrape_downloaded = std::max<int64_t>(object.get_key_value("downloaded"), 0);
+  if (response[key_interval].is_value())
+    set_normal_interval(response[key_interval].as_value());
 
-  AddressList l;
+  if (response[key_min_interval].is_value())
+    set_min_interval(response[key_min_interval].as_value());
 
-  if (!object.has_key("peers") && !object.has_key("peers6"))
-    return receive_failed("No peers returned");
+  if (response[key_tracker_id].is_raw_string())
+    m_tracker_id = response[key_tracker_id].as_raw_string().as_string();
 
-  if (object.has_key("peers")) {
-    try {
-      // Due to some trackers sending the wrong type when no peers are
-      // available, don't bork on it.
-      if (object.get_key("peers").is_string())
-        l.parse_address_compact(object.get_key_string("peers"));
+  if (response[key_complete].is_value() && response[key_incomplete].is_value()) {
+    m_scrape_complete = std::max<int64_t>(response[key_complete].as_value(), 0);
+    m_scrape_incomplete = std::max<int64_t>(response[key_incomplete].as_value(), 0);
+    m_scrape_time_last = cachedTime.seconds();
+  }
 
-      else if (object.get_key("peers").is_list())
-        l.parse_address_normal(object.get_key_list("peers"));
+  if (response[key_downloaded].is_value())
+    m_scrape_downloaded = std::max<int64_t>(response[key_downloaded].as_value(), 0);
 
-    } catch (bencode_error& e) {
-      return receive_failed(e.what());
-    }
-  }
+  // The peer list check comes after the failure reason check above,
+  // so a reply carrying both still reports the tracker's own message.
+  if (job->peers_failed)
+    return receive_failed(job->failure_msg);
 
-  if (object.has_key_string("peers6"))
-    l.parse_address_compact_ipv6(object.get_key_string("peers6"));
+  if (!response[key_peers].is_raw_bencode() && !response[key_peers6].is_raw_string())
+    return receive_failed("No peers returned");
 
   close_directly();
-  m_parent->receive_success(this, &l);
+  m_parent->receive_success(this, &job->address_list);
 }
 
 void
@@ -379,11 +816,39 @@ TrackerHttp::process_scrape(const Object& object) {
   // Add better validation here...
   const Object& files = object.get_key("files");
 
+  // Hand out results to the trackers multiplexed onto this request
+  // before completing our own scrape.
+  while (!m_scrapeGroup.empty()) {
+    TrackerHttp* member = m_scrapeGroup.back();
+
+    m_scrapeGroup.pop_back();
+    member->m_scrapeLeader = NULL;
+
+    if (files.has_key_map(member->m_parent->info()->hash().str())) {
+      member->process_scrape_stats(files.get_key(member->m_parent->info()->hash().str()));
+      member->m_parent->receive_scrape_success(member);
+
+    } else {
+      member->m_parent->receive_scrape_failed(member, "Tracker scrape replay did not contain infohash.");
+    }
+  }
+
+  m_scrapeLeader = NULL;
+
   if (!files.has_key_map(m_parent->info()->hash().str()))
     return receive_failed("Tracker scrape replay did not contain infohash.");
 
-  const Object& stats = files.get_key(m_parent->info()->hash().str());
+  process_scrape_stats(files.get_key(m_parent->info()->hash().str()));
+
+  LT_LOG_TRACKER(INFO, "Tracker scrape for %u torrents: complete:%u incomplete:%u downloaded:%u.",
+                 files.as_map().size(), m_scrape_complete, m_scrape_incomplete, m_scrape_downloaded);
+
+  close_directly();
+  m_parent->receive_scrape_success(this);
+}
 
+void
+TrackerHttp::process_scrape_stats(const Object& stats) {
   if (stats.has_key_value("complete"))
     m_scrape_complete = std::max<int64_t>(stats.get_key_value("complete"), 0);
 
@@ -392,12 +857,6 @@ TrackerHttp::process_scrape(const Object& object) {
 
   if (stats.has_key_value("downloaded"))
     m_scrape_downloaded = std::max<int64_t>(stats.get_key_value("downloaded"), 0);
-
-  LT_LOG_TRACKER(INFO, "Tracker scrape for %u torrents: complete:%u incomplete:%u downloaded:%u.",
-                 files.as_map().size(), m_scrape_complete, m_scrape_incomplete, m_scrape_downloaded);
-
-  close_directly();
-  m_parent->receive_scrape_success(this);
 }
 
 }
@@ -37,7 +37,10 @@
 #ifndef LIBTORRENT_TRACKER_TRACKER_HTTP_H
 #define LIBTORRENT_TRACKER_TRACKER_HTTP_H
 
+#include <functional>
 #include <iosfwd>
+#include <vector>
+#include <rak/timer.h>
 
 #include "torrent/object.h"
 #include "torrent/tracker.h"
@@ -45,12 +48,14 @@
 namespace torrent {
 
 class Http;
+class TrackerHttpResponse;
+struct TrackerHttpParseJob;
 
 class TrackerHttp : public Tracker {
 public:
   TrackerHttp(TrackerList* parent, const std::string& url, int flags);
   ~TrackerHttp();
-  
+
   virtual bool        is_busy() const;
 
   virtual void        send_state(int state);
@@ -60,6 +65,15 @@ public:
 
   virtual Type        type() const;
 
+  // Replies are parsed and normalized off the main thread on a worker
+  // shared by all http trackers; results are delivered back on the
+  // main thread through work_parse_done, wired to the signal bitfield
+  // via slot_parse_done.
+  static void         work_parse_done();
+  static void         stop_parse_worker();
+
+  static std::function<void ()>& slot_parse_done();
+
 private:
   void                close_directly();
 
@@ -68,13 +82,36 @@ private:
   void                receive_done();
   void                receive_failed(std::string msg);
 
-  void                process_success(const Object& object);
+  void                offload_parse(TrackerHttpParseJob* job);
+  void                offload_parse_cancel();
+  void                receive_parse_done(TrackerHttpParseJob* job);
+
+  void                process_success(TrackerHttpParseJob* job);
   void                process_scrape(const Object& object);
+  void                process_scrape_stats(const Object& stats);
+
+  // Pending scrapes are coalesced per tracker url into one multi-hash
+  // request, conducted by the first tracker of each group.
+  static void         flush_scrapes();
+
+  void                start_scrape();
+  void                leave_scrape_group();
+
+  std::stringstream*  open_data();
 
   Http*               m_get;
-  std::stringstream*  m_data;
+  std::stringstream*  m_data;       // Response buffer, non-NULL while a request is busy.
+  std::stringstream*  m_spareData;  // Kept between requests for reuse.
 
   bool                m_dropDeliminator;
+
+  // When the current request was started, for round-trip
+  // instrumentation.
+  rak::timer          m_requestTime;
+
+  bool                m_scrapeQueued;  // Waiting to be grouped with other scrapes.
+  TrackerHttp*        m_scrapeLeader;  // Tracker conducting the scrape we're part of, or this.
+  std::vector<TrackerHttp*> m_scrapeGroup;  // As leader, the other trackers on our request.
 };
 
 }
@@ -41,6 +41,7 @@
 #include <sys/types.h>
 
 #include <cstdio>
+#include <map>
 
 #include "rak/error_number.h"
 
@@ -56,6 +57,7 @@
 
 #include "tracker_udp.h"
 #include "manager.h"
+#include "utils/instrumentation.h"
 
 #define LT_LOG_TRACKER(log_level, log_fmt, ...)                         \
   lt_log_print_info(LOG_TRACKER_##log_level, m_parent->info(), "tracker_udp", "[%u] " log_fmt, group(), __VA_ARGS__);
@@ -65,6 +67,124 @@
 
 namespace torrent {
 
+// The connect round-trip hands out a connection ID that stays valid
+// for 60 seconds; cache the IDs per tracker endpoint, shared across
+// all tracker instances, so announcing many torrents to the same
+// tracker performs the round-trip only once per validity period.
+static const int32_t udp_connection_id_timeout = 60;
+
+struct udp_connection_id {
+  uint64_t id;
+  int32_t  expires;
+};
+
+typedef std::map<std::pair<uint32_t, uint16_t>, udp_connection_id> udp_connection_id_map;
+
+static udp_connection_id_map udp_connection_cache;
+
+static inline std::pair<uint32_t, uint16_t>
+udp_connection_key(const rak::socket_address* sa) {
+  return std::make_pair(sa->sa_inet()->address_n(), sa->sa_inet()->port_n());
+}
+
+static bool
+udp_connection_cache_find(const rak::socket_address* sa, uint64_t* id) {
+  if (sa->family() != rak::socket_address::af_inet)
+    return false;
+
+  udp_connection_id_map::iterator itr = udp_connection_cache.find(udp_connection_key(sa));
+
+  if (itr == udp_connection_cache.end())
+    return false;
+
+  if (cachedTime.seconds() >= itr->second.expires) {
+    udp_connection_cache.erase(itr);
+    return false;
+  }
+
+  *id = itr->second.id;
+  return true;
+}
+
+static void
+udp_connection_cache_insert(const rak::socket_address* sa, uint64_t id) {
+  if (sa->family() != rak::socket_address::af_inet)
+    return;
+
+  // Drop expired entries once in a while so the cache doesn't
+  // accumulate dead endpoints indefinitely.
+  if (udp_connection_cache.size() >= 64) {
+    for (udp_connection_id_map::iterator itr = udp_connection_cache.begin(); itr != udp_connection_cache.end(); ) {
+      if (cachedTime.seconds() >= itr->second.expires)
+        udp_connection_cache.erase(itr++);
+      else
+        ++itr;
+    }
+  }
+
+  udp_connection_id entry = { id, (int32_t)cachedTime.seconds() + udp_connection_id_timeout };
+  udp_connection_cache[udp_connection_key(sa)] = entry;
+}
+
+static void
+udp_connection_cache_erase(const rak::socket_address* sa) {
+  if (sa->family() == rak::socket_address::af_inet)
+    udp_connection_cache.erase(udp_connection_key(sa));
+}
+
+// Shared endpoint health: when all retries against a tracker endpoint
+// time out, fast-fail subsequent announces to the same endpoint for a
+// backoff period instead of letting every torrent burn through its own
+// timeout cycles. The backoff doubles on repeated outages and is
+// cleared by the first successful reply.
+static const int32_t udp_endpoint_down_initial = 30;
+static const int32_t udp_endpoint_down_max     = 300;
+
+struct udp_endpoint_health {
+  int32_t backoff;
+  int32_t retry_time;
+};
+
+typedef std::map<std::pair<uint32_t, uint16_t>, udp_endpoint_health> udp_endpoint_health_map;
+
+static udp_endpoint_health_map udp_endpoint_health_cache;
+
+static bool
+udp_endpoint_is_down(const rak::socket_address* sa) {
+  if (sa->family() != rak::socket_address::af_inet)
+    return false;
+
+  udp_endpoint_health_map::iterator itr = udp_endpoint_health_cache.find(udp_connection_key(sa));
+
+  return itr != udp_endpoint_health_cache.end() && cachedTime.seconds() < itr->second.retry_time;
+}
+
+static void
+udp_endpoint_mark_down(const rak::socket_address* sa) {
+  if (sa->family() != rak::socket_address::af_inet)
+    return;
+
+  if (udp_endpoint_health_cache.size() >= 64) {
+    for (udp_endpoint_health_map::iterator itr = udp_endpoint_health_cache.begin(); itr != udp_endpoint_health_cache.end(); ) {
+      if (cachedTime.seconds() >= itr->second.retry_time + udp_endpoint_down_max)
+        udp_endpoint_health_cache.erase(itr++);
+      else
+        ++itr;
+    }
+  }
+
+  udp_endpoint_health& entry = udp_endpoint_health_cache[udp_connection_key(sa)];
+
+  entry.backoff = entry.backoff == 0 ? udp_endpoint_down_initial : std::min(entry.backoff * 2, udp_endpoint_down_max);
+  entry.retry_time = cachedTime.seconds() + entry.backoff;
+}
+
+static void
+udp_endpoint_mark_up(const rak::socket_address* sa) {
+  if (sa->family() == rak::socket_address::af_inet)
+    udp_endpoint_health_cache.erase(udp_connection_key(sa));
+}
+
 TrackerUdp::TrackerUdp(TrackerList* parent, const std::string& url, int flags) :
   Tracker(parent, url, flags),
 
@@ -155,6 +275,11 @@ TrackerUdp::start_announce(const sockaddr* sa, int err) {
   if (!m_connectAddress.is_valid())
     return receive_failed("invalid tracker address");
 
+  // Fail immediately if this endpoint recently timed out for another
+  // tracker instance; one detected outage covers them all.
+  if (udp_endpoint_is_down(&m_connectAddress))
+    return receive_failed("tracker endpoint recently unreachable, backing off");
+
   // TODO: Make each of these a separate error... at the very least separate open and bind.
   if (!get_fd().open_datagram() || !get_fd().set_nonblock())
     return receive_failed("could not open UDP socket");
@@ -167,7 +292,12 @@ TrackerUdp::start_announce(const sockaddr* sa, int err) {
   m_readBuffer = new ReadBuffer;
   m_writeBuffer = new WriteBuffer;
 
-  prepare_connect_input();
+  // Skip the connect round-trip when we hold a valid connection ID
+  // for this endpoint.
+  if (udp_connection_cache_find(&m_connectAddress, &m_connectionId))
+    prepare_announce_input();
+  else
+    prepare_connect_input();
 
   manager->poll()->open(this);
   manager->poll()->insert_read(this);
@@ -229,6 +359,11 @@ TrackerUdp::type() const {
 
 void
 TrackerUdp::receive_failed(const std::string& msg) {
+  // The failure may stem from announcing with a connection ID the
+  // tracker no longer accepts; make sure the next attempt starts
+  // with a fresh connect round-trip.
+  udp_connection_cache_erase(&m_connectAddress);
+
   close_directly();
   m_parent->receive_failed(this, msg);
 }
@@ -239,6 +374,7 @@ TrackerUdp::receive_timeout() {
     throw internal_error("TrackerUdp::receive_timeout() called but m_taskTimeout is still scheduled.");
 
   if (--m_tries == 0) {
+    udp_endpoint_mark_down(&m_connectAddress);
     receive_failed("unable to connect to UDP tracker");
   } else {
     priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(m_parent->info()->udp_timeout())).round_seconds());
@@ -328,6 +464,7 @@ TrackerUdp::prepare_announce_input() {
   DownloadInfo* info = m_parent->info();
 
   m_writeBuffer->reset();
+  m_requestTime = rak::timer::current();
 
   m_writeBuffer->write_64(m_connectionId);
   m_writeBuffer->write_32(m_action = 1);
@@ -373,6 +510,8 @@ TrackerUdp::process_connect_output() {
     return false;
 
   m_connectionId = m_readBuffer->read_64();
+  udp_connection_cache_insert(&m_connectAddress, m_connectionId);
+  udp_endpoint_mark_up(&m_connectAddress);
 
   return true;
 }
@@ -383,6 +522,9 @@ TrackerUdp::process_announce_output() {
       m_readBuffer->read_32() != m_transactionId)
     return false;
 
+  udp_endpoint_mark_up(&m_connectAddress);
+  instrumentation_record(INSTRUMENTATION_HISTOGRAM_TRACKER_RTT, (rak::timer::current() - m_requestTime).usec());
+
   set_normal_interval(m_readBuffer->read_32());
 
   m_scrape_incomplete = m_readBuffer->read_32(); // leechers
@@ -112,6 +112,10 @@ private:
 
   uint32_t            m_tries;
 
+  // When the current announce request was sent, for round-trip
+  // instrumentation.
+  rak::timer          m_requestTime;
+
   rak::priority_item  m_taskTimeout;
 };
 
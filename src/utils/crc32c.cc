@@ -0,0 +1,199 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2011, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include "crc32c.h"
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define LT_CRC32C_SSE42
+#include <cpuid.h>
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__)
+#define LT_CRC32C_ARMV8
+#include <sys/auxv.h>
+#include <arm_acle.h>
+#ifdef HWCAP_CRC32
+#define LT_CRC32C_ARMV8_HWCAP HWCAP_CRC32
+#endif
+#endif
+
+namespace torrent {
+
+// The kernels work on the inverted running state; crc32c() applies
+// the pre and post inversion around them.
+typedef uint32_t (*crc32c_update_type)(uint32_t state, const unsigned char* data, uint32_t length);
+
+static uint32_t
+crc32c_update_scalar(uint32_t state, const unsigned char* data, uint32_t length) {
+  static const uint32_t polynomial = 0x82f63b78;
+
+  static uint32_t table[256];
+  static bool     table_filled = false;
+
+  if (!table_filled) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t entry = i;
+
+      for (unsigned int bit = 0; bit < 8; bit++)
+        entry = (entry >> 1) ^ ((entry & 1) ? polynomial : 0);
+
+      table[i] = entry;
+    }
+
+    table_filled = true;
+  }
+
+  while (length-- != 0)
+    state = (state >> 8) ^ table[(state ^ *data++) & 0xff];
+
+  return state;
+}
+
+#ifdef LT_CRC32C_SSE42
+
+__attribute__((target("sse4.2")))
+static uint32_t
+crc32c_update_sse42(uint32_t state, const unsigned char* data, uint32_t length) {
+#ifdef __x86_64__
+  uint64_t state64 = state;
+
+  while (length >= sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+
+    state64 = __builtin_ia32_crc32di(state64, word);
+    data += sizeof(uint64_t);
+    length -= sizeof(uint64_t);
+  }
+
+  state = (uint32_t)state64;
+#else
+  while (length >= sizeof(uint32_t)) {
+    uint32_t word;
+    std::memcpy(&word, data, sizeof(word));
+
+    state = __builtin_ia32_crc32si(state, word);
+    data += sizeof(uint32_t);
+    length -= sizeof(uint32_t);
+  }
+#endif
+
+  while (length-- != 0)
+    state = __builtin_ia32_crc32qi(state, *data++);
+
+  return state;
+}
+
+static bool
+crc32c_supports_sse42() {
+  unsigned int eax, ebx, ecx, edx;
+
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0)
+    return false;
+
+  return (ecx & (1 << 20)) != 0;
+}
+
+#endif
+
+#ifdef LT_CRC32C_ARMV8
+
+__attribute__((target("+crc")))
+static uint32_t
+crc32c_update_armv8(uint32_t state, const unsigned char* data, uint32_t length) {
+  while (length >= sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, data, sizeof(word));
+
+    state = __crc32cd(state, word);
+    data += sizeof(uint64_t);
+    length -= sizeof(uint64_t);
+  }
+
+  while (length-- != 0)
+    state = __crc32cb(state, *data++);
+
+  return state;
+}
+
+static bool
+crc32c_supports_armv8() {
+#ifdef LT_CRC32C_ARMV8_HWCAP
+  return (getauxval(AT_HWCAP) & LT_CRC32C_ARMV8_HWCAP) != 0;
+#else
+  return false;
+#endif
+}
+
+#endif
+
+// Verify a candidate kernel against the scalar implementation on a
+// known buffer, so a broken cpu feature probe degrades to the scalar
+// path instead of producing checksums that never match.
+static bool
+crc32c_verify_kernel(crc32c_update_type kernel) {
+  static const unsigned char buffer[11] = { 'l', 'i', 'b', 't', 'o', 'r', 'r', 'e', 'n', 't', '!' };
+
+  return kernel(~(uint32_t)0, buffer, sizeof(buffer)) == crc32c_update_scalar(~(uint32_t)0, buffer, sizeof(buffer));
+}
+
+static crc32c_update_type
+crc32c_update_select() {
+#ifdef LT_CRC32C_SSE42
+  if (crc32c_supports_sse42() && crc32c_verify_kernel(&crc32c_update_sse42))
+    return &crc32c_update_sse42;
+#endif
+
+#ifdef LT_CRC32C_ARMV8
+  if (crc32c_supports_armv8() && crc32c_verify_kernel(&crc32c_update_armv8))
+    return &crc32c_update_armv8;
+#endif
+
+  return &crc32c_update_scalar;
+}
+
+uint32_t
+crc32c(uint32_t crc, const void* data, uint32_t length) {
+  static crc32c_update_type update = crc32c_update_select();
+
+  return ~update(~crc, (const unsigned char*)data, length);
+}
+
+}
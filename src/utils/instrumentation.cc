@@ -36,12 +36,121 @@
 
 #include "config.h"
 
+#include <string.h>
+#include <pthread.h>
+#include <vector>
+
 #include "instrumentation.h"
 
 namespace torrent {
 
 std::array<int64_t, INSTRUMENTATION_MAX_SIZE> instrumentation_values lt_cacheline_aligned;
 
+typedef std::array<instrumentation_histogram, INSTRUMENTATION_HISTOGRAM_MAX_SIZE> histogram_block_type;
+
+// Threads register their block on the first sample they record; the
+// mutex only guards the registration list, never the hot path.
+static std::vector<histogram_block_type*> histogram_blocks;
+static pthread_mutex_t                    histogram_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static thread_local histogram_block_type* histogram_thread_block = NULL;
+
+int64_t
+instrumentation_histogram::quantile_usec(int percent) const {
+  if (total_count == 0)
+    return 0;
+
+  int64_t rank = (total_count * percent + 99) / 100;
+  int64_t seen = 0;
+
+  for (size_t itr = 0; itr < bucket_count; itr++) {
+    seen += buckets[itr];
+
+    if (seen >= rank)
+      return int64_t(1) << (itr + 1);
+  }
+
+  return int64_t(1) << bucket_count;
+}
+
+void
+instrumentation_record(instrumentation_histogram_enum type, int64_t usec) {
+#ifdef LT_INSTRUMENTATION
+  if (histogram_thread_block == NULL) {
+    histogram_thread_block = new histogram_block_type();
+
+    pthread_mutex_lock(&histogram_mutex);
+    histogram_blocks.push_back(histogram_thread_block);
+    pthread_mutex_unlock(&histogram_mutex);
+  }
+
+  instrumentation_histogram& histogram = (*histogram_thread_block)[type];
+
+  size_t bucket = 0;
+
+  while (usec >> (bucket + 1) != 0 && bucket + 1 < instrumentation_histogram::bucket_count)
+    bucket++;
+
+  histogram.buckets[bucket]++;
+  histogram.total_count++;
+  histogram.total_sum += usec;
+#endif
+}
+
+instrumentation_histogram
+instrumentation_histogram_snapshot(instrumentation_histogram_enum type) {
+  instrumentation_histogram result = instrumentation_histogram();
+
+  pthread_mutex_lock(&histogram_mutex);
+
+  for (std::vector<histogram_block_type*>::const_iterator itr = histogram_blocks.begin(), last = histogram_blocks.end(); itr != last; itr++) {
+    const instrumentation_histogram& histogram = (**itr)[type];
+
+    for (size_t bucket = 0; bucket < instrumentation_histogram::bucket_count; bucket++)
+      result.buckets[bucket] += histogram.buckets[bucket];
+
+    result.total_count += histogram.total_count;
+    result.total_sum   += histogram.total_sum;
+  }
+
+  pthread_mutex_unlock(&histogram_mutex);
+
+  return result;
+}
+
+// The per-thread buckets grow monotonically, so the interval since
+// the previous tick is just the difference of two snapshots.
+static instrumentation_histogram
+histogram_interval(instrumentation_histogram_enum type, instrumentation_histogram* previous) {
+  instrumentation_histogram current = instrumentation_histogram_snapshot(type);
+  instrumentation_histogram result = current;
+
+  for (size_t bucket = 0; bucket < instrumentation_histogram::bucket_count; bucket++)
+    result.buckets[bucket] -= previous->buckets[bucket];
+
+  result.total_count -= previous->total_count;
+  result.total_sum   -= previous->total_sum;
+
+  *previous = current;
+  return result;
+}
+
+static histogram_block_type histogram_previous_tick;
+
+static void
+histogram_tick_print(int log_group_type, const char* name, instrumentation_histogram_enum type) {
+  instrumentation_histogram interval = histogram_interval(type, &histogram_previous_tick[type]);
+
+  lt_log_print(log_group_type,
+               "%s n %" PRIi64 " sum_us %" PRIi64 " p50_us %" PRIi64 " p90_us %" PRIi64 " p99_us %" PRIi64,
+               name,
+               interval.total_count,
+               interval.total_sum,
+               interval.quantile_usec(50),
+               interval.quantile_usec(90),
+               interval.quantile_usec(99));
+}
+
 inline int64_t
 instrumentation_fetch_and_clear(instrumentation_enum type) {
 #ifdef LT_INSTRUMENTATION
@@ -85,7 +194,8 @@ instrumentation_tick() {
   lt_log_print(LOG_INSTRUMENTATION_POLLING,
                "%"  PRIi64 " %" PRIi64
                " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
-               " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64,
+               " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
+               " %"  PRIi64 " %" PRIi64 " %" PRIi64,
                instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_INTERRUPT_POKE),
                instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_INTERRUPT_READ_EVENT),
 
@@ -97,7 +207,11 @@ instrumentation_tick() {
                instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS),
                instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_MAIN),
                instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_DISK),
-               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_OTHERS));
+               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_OTHERS),
+
+               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_TIME_SOCKET_EVENTS),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_TIME_SCHEDULED_TASKS),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_TIME_THROTTLE_TICKS));
 
   lt_log_print(LOG_INSTRUMENTATION_TRANSFERS,
                "%"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
@@ -105,7 +219,8 @@ instrumentation_tick() {
                " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
                " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
                " %"  PRIi64 " %" PRIi64 " %" PRIi64 " %" PRIi64
-               " %" PRIi64,
+               " %" PRIi64
+               " %" PRIi64 " %" PRIi64,
 
                instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_DELEGATED),
                instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_DOWNLOADING),
@@ -134,7 +249,43 @@ instrumentation_tick() {
                instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_REMOVED),
                instrumentation_values[INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_TOTAL],
 
-               instrumentation_values[INSTRUMENTATION_TRANSFER_PEER_INFO_UNACCOUNTED]);
+               instrumentation_values[INSTRUMENTATION_TRANSFER_PEER_INFO_UNACCOUNTED],
+
+               instrumentation_values[INSTRUMENTATION_HASH_QUEUE_QUEUED_BYTES],
+               instrumentation_fetch_and_clear(INSTRUMENTATION_HASH_QUEUE_CONGESTED));
+
+  lt_log_print(LOG_INSTRUMENTATION_MEMORY,
+               "alloc"
+               " data %"     PRIi64 " %" PRIi64 " %" PRIi64
+               " net %"      PRIi64 " %" PRIi64 " %" PRIi64
+               " protocol %" PRIi64 " %" PRIi64 " %" PRIi64
+               " download %" PRIi64 " %" PRIi64 " %" PRIi64
+               " dht %"      PRIi64 " %" PRIi64 " %" PRIi64,
+
+               instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_DATA),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_DATA_FREED),
+               instrumentation_values[INSTRUMENTATION_ALLOC_DATA_BYTES],
+
+               instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_NET),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_NET_FREED),
+               instrumentation_values[INSTRUMENTATION_ALLOC_NET_BYTES],
+
+               instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_PROTOCOL),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_PROTOCOL_FREED),
+               instrumentation_values[INSTRUMENTATION_ALLOC_PROTOCOL_BYTES],
+
+               instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_DOWNLOAD),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_DOWNLOAD_FREED),
+               instrumentation_values[INSTRUMENTATION_ALLOC_DOWNLOAD_BYTES],
+
+               instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_DHT),
+               instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_DHT_FREED),
+               instrumentation_values[INSTRUMENTATION_ALLOC_DHT_BYTES]);
+
+  histogram_tick_print(LOG_INSTRUMENTATION_POLLING,   "poll_latency",         INSTRUMENTATION_HISTOGRAM_POLL_LATENCY);
+  histogram_tick_print(LOG_INSTRUMENTATION_MINCORE,   "sync_latency",         INSTRUMENTATION_HISTOGRAM_SYNC_LATENCY);
+  histogram_tick_print(LOG_INSTRUMENTATION_MEMORY,    "hash_queue_residence", INSTRUMENTATION_HISTOGRAM_HASH_QUEUE_RESIDENCE);
+  histogram_tick_print(LOG_INSTRUMENTATION_TRANSFERS, "tracker_rtt",          INSTRUMENTATION_HISTOGRAM_TRACKER_RTT);
 }
 
 void
@@ -167,6 +318,10 @@ instrumentation_reset() {
   instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_DISK);
   instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_EVENTS_OTHERS);
 
+  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_TIME_SOCKET_EVENTS);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_TIME_SCHEDULED_TASKS);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_POLLING_TIME_THROTTLE_TICKS);
+
   instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_DELEGATED);
   instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_DOWNLOADING);
   instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_FINISHED);
@@ -186,6 +341,29 @@ instrumentation_reset() {
   instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_ADDED);
   instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_MOVED);
   instrumentation_fetch_and_clear(INSTRUMENTATION_TRANSFER_REQUESTS_CHOKED_REMOVED);
+
+  // The live-byte counters are left alone like the other totals.
+  instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_DATA);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_DATA_FREED);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_NET);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_NET_FREED);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_PROTOCOL);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_PROTOCOL_FREED);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_DOWNLOAD);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_DOWNLOAD_FREED);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_DHT);
+  instrumentation_fetch_and_clear(INSTRUMENTATION_ALLOC_DHT_FREED);
+
+  // Racy against threads recording new samples, which is tolerated
+  // the same way as the counter reads above.
+  pthread_mutex_lock(&histogram_mutex);
+
+  for (std::vector<histogram_block_type*>::const_iterator itr = histogram_blocks.begin(), last = histogram_blocks.end(); itr != last; itr++)
+    memset(*itr, 0, sizeof(histogram_block_type));
+
+  memset(&histogram_previous_tick, 0, sizeof(histogram_block_type));
+
+  pthread_mutex_unlock(&histogram_mutex);
 }
 
 }
@@ -78,6 +78,14 @@ enum instrumentation_enum {
   INSTRUMENTATION_POLLING_EVENTS_DISK,
   INSTRUMENTATION_POLLING_EVENTS_OTHERS,
 
+  // Microseconds of loop time spent per event class, cleared at each
+  // dump so the log line reads as occupancy over the dump
+  // interval. Throttle ticks run off the scheduler and are counted in
+  // both the task bucket and their own.
+  INSTRUMENTATION_POLLING_TIME_SOCKET_EVENTS,
+  INSTRUMENTATION_POLLING_TIME_SCHEDULED_TASKS,
+  INSTRUMENTATION_POLLING_TIME_THROTTLE_TICKS,
+
   INSTRUMENTATION_TRANSFER_REQUESTS_DELEGATED,
   INSTRUMENTATION_TRANSFER_REQUESTS_DOWNLOADING,
   INSTRUMENTATION_TRANSFER_REQUESTS_FINISHED,
@@ -103,13 +111,68 @@ enum instrumentation_enum {
 
   INSTRUMENTATION_TRANSFER_PEER_INFO_UNACCOUNTED,
 
+  // Bytes queued for piece-hash verification, and how often the
+  // backlog told request pipelines to slow down.
+  INSTRUMENTATION_HASH_QUEUE_QUEUED_BYTES,
+  INSTRUMENTATION_HASH_QUEUE_CONGESTED,
+
+  // Allocation churn per subsystem: each tag is an allocation counter
+  // immediately followed by its deallocation and live-byte counters,
+  // which instrumentation_alloc/instrumentation_free rely on.
+  INSTRUMENTATION_ALLOC_DATA,
+  INSTRUMENTATION_ALLOC_DATA_FREED,
+  INSTRUMENTATION_ALLOC_DATA_BYTES,
+  INSTRUMENTATION_ALLOC_NET,
+  INSTRUMENTATION_ALLOC_NET_FREED,
+  INSTRUMENTATION_ALLOC_NET_BYTES,
+  INSTRUMENTATION_ALLOC_PROTOCOL,
+  INSTRUMENTATION_ALLOC_PROTOCOL_FREED,
+  INSTRUMENTATION_ALLOC_PROTOCOL_BYTES,
+  INSTRUMENTATION_ALLOC_DOWNLOAD,
+  INSTRUMENTATION_ALLOC_DOWNLOAD_FREED,
+  INSTRUMENTATION_ALLOC_DOWNLOAD_BYTES,
+  INSTRUMENTATION_ALLOC_DHT,
+  INSTRUMENTATION_ALLOC_DHT_FREED,
+  INSTRUMENTATION_ALLOC_DHT_BYTES,
+
   INSTRUMENTATION_MAX_SIZE
 };
 
+enum instrumentation_histogram_enum {
+  INSTRUMENTATION_HISTOGRAM_POLL_LATENCY,
+  INSTRUMENTATION_HISTOGRAM_SYNC_LATENCY,
+  INSTRUMENTATION_HISTOGRAM_HASH_QUEUE_RESIDENCE,
+  INSTRUMENTATION_HISTOGRAM_TRACKER_RTT,
+
+  INSTRUMENTATION_HISTOGRAM_MAX_SIZE
+};
+
+// Power-of-two bucketed histogram over microsecond samples; bucket n
+// counts samples in [2^n, 2^(n+1)). Each thread accumulates into its
+// own block without synchronization and blocks are merged when a
+// snapshot is taken, so recording a sample is a few plain increments.
+//
+// Like the counters above, merged reads are made without barriers;
+// the buckets only grow so a torn read just yields a slightly stale
+// snapshot.
+struct instrumentation_histogram {
+  static const size_t bucket_count = 24;
+
+  // Upper bound in microseconds of the bucket holding the sample at
+  // the given percentile, or zero for an empty histogram.
+  int64_t             quantile_usec(int percent) const;
+
+  int64_t buckets[bucket_count];
+  int64_t total_count;
+  int64_t total_sum;
+};
+
 extern std::array<int64_t, INSTRUMENTATION_MAX_SIZE> instrumentation_values lt_cacheline_aligned;
 
 void instrumentation_initialize();
 void instrumentation_update(instrumentation_enum type, int64_t change);
+void instrumentation_record(instrumentation_histogram_enum type, int64_t usec);
+instrumentation_histogram instrumentation_histogram_snapshot(instrumentation_histogram_enum type);
 void instrumentation_tick();
 void instrumentation_reset();
 
@@ -129,6 +192,21 @@ instrumentation_update(instrumentation_enum type, int64_t change) {
 #endif
 }
 
+// Attribute an allocation or deallocation to a subsystem; 'type' must
+// be one of the INSTRUMENTATION_ALLOC_* tags. The byte counter tracks
+// live bytes, the alloc/free counters are per-interval flows.
+inline void
+instrumentation_alloc(instrumentation_enum type, int64_t bytes) {
+  instrumentation_update(type, 1);
+  instrumentation_update(static_cast<instrumentation_enum>(type + 2), bytes);
+}
+
+inline void
+instrumentation_free(instrumentation_enum type, int64_t bytes) {
+  instrumentation_update(static_cast<instrumentation_enum>(type + 1), 1);
+  instrumentation_update(static_cast<instrumentation_enum>(type + 2), -bytes);
+}
+
 }
 
 #endif
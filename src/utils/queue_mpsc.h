@@ -0,0 +1,136 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2011, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_QUEUE_MPSC_H
+#define LIBTORRENT_QUEUE_MPSC_H
+
+#include <atomic>
+
+namespace torrent {
+
+// Unbounded multi-producer single-consumer queue. Producers push with
+// a single atomic exchange and never block each other or the
+// consumer; the consumer pops without any atomic read-modify-write.
+// Intended for cross-thread completion queues where the old code
+// would take a mutex per element on the hot path.
+
+template <typename Type>
+class queue_mpsc {
+public:
+  typedef Type value_type;
+
+  queue_mpsc();
+  ~queue_mpsc();
+
+  // Only meaningful from the consumer thread; a false result may be
+  // stale the moment it is returned.
+  bool                empty() const;
+
+  void                push_back(const value_type& value);
+  bool                pop_front(value_type* value);
+
+private:
+  queue_mpsc(const queue_mpsc&);
+  void operator = (const queue_mpsc&);
+
+  struct node_type {
+    node_type() : next(NULL) {}
+    node_type(const value_type& v) : next(NULL), value(v) {}
+
+    std::atomic<node_type*> next;
+    value_type              value;
+  };
+
+  node_type*              m_head;
+  std::atomic<node_type*> m_tail lt_cacheline_aligned;
+};
+
+template <typename Type>
+queue_mpsc<Type>::queue_mpsc() {
+  node_type* stub = new node_type();
+
+  m_head = stub;
+  m_tail.store(stub, std::memory_order_relaxed);
+}
+
+template <typename Type>
+queue_mpsc<Type>::~queue_mpsc() {
+  while (m_head != NULL) {
+    node_type* next = m_head->next.load(std::memory_order_relaxed);
+    delete m_head;
+    m_head = next;
+  }
+}
+
+template <typename Type>
+bool
+queue_mpsc<Type>::empty() const {
+  return m_head->next.load(std::memory_order_acquire) == NULL;
+}
+
+template <typename Type>
+void
+queue_mpsc<Type>::push_back(const value_type& value) {
+  node_type* node = new node_type(value);
+
+  // The exchange serializes concurrent producers; linking the
+  // predecessor afterwards is what makes the element visible to the
+  // consumer.
+  node_type* prev = m_tail.exchange(node, std::memory_order_acq_rel);
+  prev->next.store(node, std::memory_order_release);
+}
+
+template <typename Type>
+bool
+queue_mpsc<Type>::pop_front(value_type* value) {
+  node_type* next = m_head->next.load(std::memory_order_acquire);
+
+  if (next == NULL)
+    return false;
+
+  *value = next->value;
+
+  // The popped node becomes the new stub, so the value it carried is
+  // only cleared once the next element passes through.
+  delete m_head;
+  m_head = next;
+
+  return true;
+}
+
+}
+
+#endif
@@ -45,15 +45,30 @@ extern "C" {
 }
 #else
 #ifdef USE_OPENSSL
+#include <openssl/opensslv.h>
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+#include <openssl/evp.h>
+#ifndef OPENSSL_NO_RC4
 #include <openssl/rc4.h>
 #endif
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/provider.h>
+#endif
+#else
+#include <openssl/rc4.h>
+#endif
+#endif
 #endif
 
 namespace torrent {
 
 class RC4 {
 public:
+#if !defined(USE_CYRUS_RC4) && defined(USE_OPENSSL) && OPENSSL_VERSION_NUMBER >= 0x10100000L
+  RC4() : m_ctx(NULL)                                                 { }
+#else
   RC4()                                                               { }
+#endif
 
 #ifdef USE_CYRUS_RC4
   RC4(const unsigned char key[], int len)                             { rc4_init(&m_key, key, len); }
@@ -64,6 +79,130 @@ public:
 private:
   rc4_context_t m_key;
 
+#else
+#if defined(USE_OPENSSL) && OPENSSL_VERSION_NUMBER >= 0x10100000L
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+  // Going through EVP rather than the low-level RC4 entry point lets
+  // OpenSSL dispatch to its fastest machine-specific implementation
+  // at runtime. The context is heap-allocated, so the copy semantics
+  // EncryptionInfo relies on are implemented explicitly.
+  //
+  // Under OpenSSL 3 the rc4 cipher sits in the legacy provider, which
+  // is not loaded by default; if the cipher is unavailable we load
+  // the provider and retry, and failing that fall back to the
+  // low-level implementation. Every EVP call is checked, as a failed
+  // init leaves the context unusable and must never be crypted
+  // through.
+  RC4(const unsigned char key[], int len) : m_ctx(NULL) {
+    if (init_evp(key, len))
+      return;
+
+#ifndef OPENSSL_NO_RC4
+    RC4_set_key(&m_key, len, key);
+#endif
+  }
+
+  RC4(const RC4& rc4) : m_ctx(NULL) {
+    if (rc4.m_ctx != NULL) {
+      if ((m_ctx = EVP_CIPHER_CTX_new()) != NULL && !EVP_CIPHER_CTX_copy(m_ctx, rc4.m_ctx)) {
+        EVP_CIPHER_CTX_free(m_ctx);
+        m_ctx = NULL;
+      }
+
+    } else {
+#ifndef OPENSSL_NO_RC4
+      m_key = rc4.m_key;
+#endif
+    }
+  }
+
+  RC4& operator = (const RC4& rc4) {
+    if (this == &rc4)
+      return *this;
+
+    if (m_ctx != NULL) {
+      EVP_CIPHER_CTX_free(m_ctx);
+      m_ctx = NULL;
+    }
+
+    if (rc4.m_ctx != NULL) {
+      if ((m_ctx = EVP_CIPHER_CTX_new()) != NULL && !EVP_CIPHER_CTX_copy(m_ctx, rc4.m_ctx)) {
+        EVP_CIPHER_CTX_free(m_ctx);
+        m_ctx = NULL;
+      }
+
+    } else {
+#ifndef OPENSSL_NO_RC4
+      m_key = rc4.m_key;
+#endif
+    }
+
+    return *this;
+  }
+
+  ~RC4() {
+    if (m_ctx != NULL)
+      EVP_CIPHER_CTX_free(m_ctx);
+  }
+
+  void crypt(const void* indata, void* outdata, unsigned int length) {
+    if (m_ctx != NULL) {
+      int outl;
+
+      EVP_EncryptUpdate(m_ctx, (unsigned char*)outdata, &outl, (const unsigned char*)indata, length);
+      return;
+    }
+
+#ifndef OPENSSL_NO_RC4
+    ::RC4(&m_key, length, (const unsigned char*)indata, (unsigned char*)outdata);
+#endif
+    // With neither path available the stream is left unencrypted; the
+    // negotiation's VC match then fails and the handshake is dropped
+    // like any other bad crypto, instead of crashing the client.
+  }
+  void crypt(void* data, unsigned int length)                         { crypt(data, data, length); }
+
+private:
+  bool init_evp(const unsigned char key[], int len) {
+    if ((m_ctx = EVP_CIPHER_CTX_new()) == NULL)
+      return false;
+
+    if (!EVP_EncryptInit_ex(m_ctx, EVP_rc4(), NULL, NULL, NULL)) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+      // Thread-safe one-time load; a NULL result just means the
+      // provider isn't present and the retry below settles it.
+      static OSSL_PROVIDER* legacyProvider = OSSL_PROVIDER_load(NULL, "legacy");
+      (void)legacyProvider;
+
+      if (!EVP_EncryptInit_ex(m_ctx, EVP_rc4(), NULL, NULL, NULL)) {
+        EVP_CIPHER_CTX_free(m_ctx);
+        m_ctx = NULL;
+        return false;
+      }
+#else
+      EVP_CIPHER_CTX_free(m_ctx);
+      m_ctx = NULL;
+      return false;
+#endif
+    }
+
+    if (!EVP_CIPHER_CTX_set_key_length(m_ctx, len) ||
+        !EVP_EncryptInit_ex(m_ctx, NULL, NULL, key, NULL)) {
+      EVP_CIPHER_CTX_free(m_ctx);
+      m_ctx = NULL;
+      return false;
+    }
+
+    return true;
+  }
+
+  EVP_CIPHER_CTX* m_ctx;
+
+#ifndef OPENSSL_NO_RC4
+  // Fallback key schedule for when the EVP cipher is unavailable.
+  RC4_KEY m_key;
+#endif
+
 #else
 #ifdef USE_OPENSSL
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
@@ -82,6 +221,7 @@ private:
   void crypt(void* data, unsigned int length) {}
 #endif
 #endif
+#endif
 };
 
 };
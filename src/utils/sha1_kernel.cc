@@ -0,0 +1,494 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2011, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include "sha1_kernel.h"
+
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define LT_SHA1_KERNEL_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__)
+#define LT_SHA1_KERNEL_NEON
+#include <sys/auxv.h>
+#include <arm_neon.h>
+#ifdef HWCAP_SHA1
+#define LT_SHA1_KERNEL_NEON_HWCAP HWCAP_SHA1
+#endif
+#endif
+
+namespace torrent {
+
+inline uint32_t sha1_rotl(uint32_t x, unsigned int n) { return (x << n) | (x >> (32 - n)); }
+
+void
+sha1_compress_scalar(uint32_t* state, const unsigned char* data, unsigned int blocks) {
+  uint32_t w[80];
+
+  while (blocks-- != 0) {
+    for (unsigned int t = 0; t < 16; t++, data += 4)
+      w[t] = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | (uint32_t)data[3];
+
+    for (unsigned int t = 16; t < 80; t++)
+      w[t] = sha1_rotl(w[t-3] ^ w[t-8] ^ w[t-14] ^ w[t-16], 1);
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+    for (unsigned int t = 0; t < 80; t++) {
+      uint32_t f, k;
+
+      if (t < 20) {
+        f = (b & c) | (~b & d);        k = 0x5a827999;
+      } else if (t < 40) {
+        f = b ^ c ^ d;                 k = 0x6ed9eba1;
+      } else if (t < 60) {
+        f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc;
+      } else {
+        f = b ^ c ^ d;                 k = 0xca62c1d6;
+      }
+
+      uint32_t tmp = sha1_rotl(a, 5) + f + e + k + w[t];
+      e = d; d = c; c = sha1_rotl(b, 30); b = a; a = tmp;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+  }
+}
+
+#ifdef LT_SHA1_KERNEL_SHANI
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void
+sha1_compress_shani(uint32_t* state, const unsigned char* data, unsigned int blocks) {
+  const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+  __m128i abcd = _mm_loadu_si128((const __m128i*)state);
+  __m128i e0 = _mm_set_epi32(state[4], 0, 0, 0);
+  __m128i e1;
+
+  abcd = _mm_shuffle_epi32(abcd, 0x1b);
+
+  while (blocks-- != 0) {
+    __m128i abcd_save = abcd;
+    __m128i e0_save = e0;
+
+    __m128i msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data +  0)), mask);
+    __m128i msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), mask);
+    __m128i msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), mask);
+    __m128i msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), mask);
+
+    // Rounds 0-3.
+    e0 = _mm_add_epi32(e0, msg0);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+    // Rounds 4-7.
+    e1 = _mm_sha1nexte_epu32(e1, msg1);
+    e0 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+    msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+    // Rounds 8-11.
+    e0 = _mm_sha1nexte_epu32(e0, msg2);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+    msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+    msg0 = _mm_xor_si128(msg0, msg2);
+
+    // Rounds 12-15.
+    e1 = _mm_sha1nexte_epu32(e1, msg3);
+    e0 = abcd;
+    msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+    msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+    msg1 = _mm_xor_si128(msg1, msg3);
+
+    // Rounds 16-19.
+    e0 = _mm_sha1nexte_epu32(e0, msg0);
+    e1 = abcd;
+    msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+    msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+    msg2 = _mm_xor_si128(msg2, msg0);
+
+    // Rounds 20-23.
+    e1 = _mm_sha1nexte_epu32(e1, msg1);
+    e0 = abcd;
+    msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+    msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+    msg3 = _mm_xor_si128(msg3, msg1);
+
+    // Rounds 24-27.
+    e0 = _mm_sha1nexte_epu32(e0, msg2);
+    e1 = abcd;
+    msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+    msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+    msg0 = _mm_xor_si128(msg0, msg2);
+
+    // Rounds 28-31.
+    e1 = _mm_sha1nexte_epu32(e1, msg3);
+    e0 = abcd;
+    msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+    msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+    msg1 = _mm_xor_si128(msg1, msg3);
+
+    // Rounds 32-35.
+    e0 = _mm_sha1nexte_epu32(e0, msg0);
+    e1 = abcd;
+    msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+    msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+    msg2 = _mm_xor_si128(msg2, msg0);
+
+    // Rounds 36-39.
+    e1 = _mm_sha1nexte_epu32(e1, msg1);
+    e0 = abcd;
+    msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+    msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+    msg3 = _mm_xor_si128(msg3, msg1);
+
+    // Rounds 40-43.
+    e0 = _mm_sha1nexte_epu32(e0, msg2);
+    e1 = abcd;
+    msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+    msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+    msg0 = _mm_xor_si128(msg0, msg2);
+
+    // Rounds 44-47.
+    e1 = _mm_sha1nexte_epu32(e1, msg3);
+    e0 = abcd;
+    msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+    msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+    msg1 = _mm_xor_si128(msg1, msg3);
+
+    // Rounds 48-51.
+    e0 = _mm_sha1nexte_epu32(e0, msg0);
+    e1 = abcd;
+    msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+    msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+    msg2 = _mm_xor_si128(msg2, msg0);
+
+    // Rounds 52-55.
+    e1 = _mm_sha1nexte_epu32(e1, msg1);
+    e0 = abcd;
+    msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+    msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+    msg3 = _mm_xor_si128(msg3, msg1);
+
+    // Rounds 56-59.
+    e0 = _mm_sha1nexte_epu32(e0, msg2);
+    e1 = abcd;
+    msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+    msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+    msg0 = _mm_xor_si128(msg0, msg2);
+
+    // Rounds 60-63.
+    e1 = _mm_sha1nexte_epu32(e1, msg3);
+    e0 = abcd;
+    msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+    msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+    msg1 = _mm_xor_si128(msg1, msg3);
+
+    // Rounds 64-67.
+    e0 = _mm_sha1nexte_epu32(e0, msg0);
+    e1 = abcd;
+    msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+    msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+    msg2 = _mm_xor_si128(msg2, msg0);
+
+    // Rounds 68-71.
+    e1 = _mm_sha1nexte_epu32(e1, msg1);
+    e0 = abcd;
+    msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+    msg3 = _mm_xor_si128(msg3, msg1);
+
+    // Rounds 72-75.
+    e0 = _mm_sha1nexte_epu32(e0, msg2);
+    e1 = abcd;
+    msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+    // Rounds 76-79.
+    e1 = _mm_sha1nexte_epu32(e1, msg3);
+    e0 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+    e0 = _mm_sha1nexte_epu32(e0, e0_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+
+    data += 64;
+  }
+
+  abcd = _mm_shuffle_epi32(abcd, 0x1b);
+  _mm_storeu_si128((__m128i*)state, abcd);
+  state[4] = _mm_extract_epi32(e0, 3);
+}
+
+static bool
+sha1_supports_shani() {
+  unsigned int eax, ebx, ecx, edx;
+
+  if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) == 0)
+    return false;
+
+  return (ebx & (1 << 29)) != 0;
+}
+
+#endif
+
+#ifdef LT_SHA1_KERNEL_NEON
+
+__attribute__((target("+crypto")))
+static void
+sha1_compress_neon(uint32_t* state, const unsigned char* data, unsigned int blocks) {
+  static const uint32_t k[4] = { 0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6 };
+
+  uint32x4_t abcd = vld1q_u32(state);
+  uint32_t e0 = state[4];
+
+  while (blocks-- != 0) {
+    uint32x4_t abcd_save = abcd;
+    uint32_t e0_save = e0, e1;
+    uint32x4_t tmp0, tmp1;
+
+    uint32x4_t msg0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data +  0)));
+    uint32x4_t msg1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+    uint32x4_t msg2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+    uint32x4_t msg3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+    tmp0 = vaddq_u32(msg0, vdupq_n_u32(k[0]));
+    tmp1 = vaddq_u32(msg1, vdupq_n_u32(k[0]));
+
+    // Rounds 0-3.
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1cq_u32(abcd, e0, tmp0);
+    tmp0 = vaddq_u32(msg2, vdupq_n_u32(k[0]));
+    msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+    // Rounds 4-7.
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1cq_u32(abcd, e1, tmp1);
+    tmp1 = vaddq_u32(msg3, vdupq_n_u32(k[0]));
+    msg0 = vsha1su1q_u32(msg0, msg3);
+    msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+
+    // Rounds 8-11.
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1cq_u32(abcd, e0, tmp0);
+    tmp0 = vaddq_u32(msg0, vdupq_n_u32(k[0]));
+    msg1 = vsha1su1q_u32(msg1, msg0);
+    msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+
+    // Rounds 12-15.
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1cq_u32(abcd, e1, tmp1);
+    tmp1 = vaddq_u32(msg1, vdupq_n_u32(k[1]));
+    msg2 = vsha1su1q_u32(msg2, msg1);
+    msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+
+    // Rounds 16-19.
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1cq_u32(abcd, e0, tmp0);
+    tmp0 = vaddq_u32(msg2, vdupq_n_u32(k[1]));
+    msg3 = vsha1su1q_u32(msg3, msg2);
+    msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+    // Rounds 20-23.
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e1, tmp1);
+    tmp1 = vaddq_u32(msg3, vdupq_n_u32(k[1]));
+    msg0 = vsha1su1q_u32(msg0, msg3);
+    msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+
+    // Rounds 24-27.
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e0, tmp0);
+    tmp0 = vaddq_u32(msg0, vdupq_n_u32(k[1]));
+    msg1 = vsha1su1q_u32(msg1, msg0);
+    msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+
+    // Rounds 28-31.
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e1, tmp1);
+    tmp1 = vaddq_u32(msg1, vdupq_n_u32(k[1]));
+    msg2 = vsha1su1q_u32(msg2, msg1);
+    msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+
+    // Rounds 32-35.
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e0, tmp0);
+    tmp0 = vaddq_u32(msg2, vdupq_n_u32(k[2]));
+    msg3 = vsha1su1q_u32(msg3, msg2);
+    msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+    // Rounds 36-39.
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e1, tmp1);
+    tmp1 = vaddq_u32(msg3, vdupq_n_u32(k[2]));
+    msg0 = vsha1su1q_u32(msg0, msg3);
+    msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+
+    // Rounds 40-43.
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1mq_u32(abcd, e0, tmp0);
+    tmp0 = vaddq_u32(msg0, vdupq_n_u32(k[2]));
+    msg1 = vsha1su1q_u32(msg1, msg0);
+    msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+
+    // Rounds 44-47.
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1mq_u32(abcd, e1, tmp1);
+    tmp1 = vaddq_u32(msg1, vdupq_n_u32(k[2]));
+    msg2 = vsha1su1q_u32(msg2, msg1);
+    msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+
+    // Rounds 48-51.
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1mq_u32(abcd, e0, tmp0);
+    tmp0 = vaddq_u32(msg2, vdupq_n_u32(k[2]));
+    msg3 = vsha1su1q_u32(msg3, msg2);
+    msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+    // Rounds 52-55.
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1mq_u32(abcd, e1, tmp1);
+    tmp1 = vaddq_u32(msg3, vdupq_n_u32(k[3]));
+    msg0 = vsha1su1q_u32(msg0, msg3);
+    msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+
+    // Rounds 56-59.
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1mq_u32(abcd, e0, tmp0);
+    tmp0 = vaddq_u32(msg0, vdupq_n_u32(k[3]));
+    msg1 = vsha1su1q_u32(msg1, msg0);
+    msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+
+    // Rounds 60-63.
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e1, tmp1);
+    tmp1 = vaddq_u32(msg1, vdupq_n_u32(k[3]));
+    msg2 = vsha1su1q_u32(msg2, msg1);
+    msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+
+    // Rounds 64-67.
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e0, tmp0);
+    tmp0 = vaddq_u32(msg2, vdupq_n_u32(k[3]));
+    msg3 = vsha1su1q_u32(msg3, msg2);
+
+    // Rounds 68-71.
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e1, tmp1);
+    tmp1 = vaddq_u32(msg3, vdupq_n_u32(k[3]));
+
+    // Rounds 72-75.
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e0, tmp0);
+
+    // Rounds 76-79.
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e1, tmp1);
+
+    e0 += e0_save;
+    abcd = vaddq_u32(abcd, abcd_save);
+
+    data += 64;
+  }
+
+  vst1q_u32(state, abcd);
+  state[4] = e0;
+}
+
+static bool
+sha1_supports_neon() {
+#ifdef LT_SHA1_KERNEL_NEON_HWCAP
+  return (getauxval(AT_HWCAP) & LT_SHA1_KERNEL_NEON_HWCAP) != 0;
+#else
+  return false;
+#endif
+}
+
+#endif
+
+// Verify a candidate kernel against the scalar implementation on a
+// single known block, so a broken cpu feature probe degrades to the
+// scalar path instead of corrupting hashes.
+static bool
+sha1_verify_kernel(sha1_compress_type kernel) {
+  static const unsigned char block[64] = { 'l', 'i', 'b', 't', 'o', 'r', 'r', 'e', 'n', 't' };
+
+  uint32_t expected[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+  uint32_t result[5]   = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+
+  sha1_compress_scalar(expected, block, 1);
+  kernel(result, block, 1);
+
+  return std::memcmp(expected, result, sizeof(expected)) == 0;
+}
+
+sha1_compress_type
+sha1_compress_select() {
+#ifdef LT_SHA1_KERNEL_SHANI
+  if (sha1_supports_shani() && sha1_verify_kernel(&sha1_compress_shani))
+    return &sha1_compress_shani;
+#endif
+
+#ifdef LT_SHA1_KERNEL_NEON
+  if (sha1_supports_neon() && sha1_verify_kernel(&sha1_compress_neon))
+    return &sha1_compress_neon;
+#endif
+
+  return &sha1_compress_scalar;
+}
+
+}
@@ -42,9 +42,14 @@
 
 #include <string.h>
 #include "sha_fast.h"
+#include "sha1_kernel.h"
 
 namespace torrent {
 
+// Bulk block kernel with runtime cpu dispatch (SHA-NI, ARMv8 crypto
+// or scalar); resolved once on first use.
+static sha1_compress_type sha_bulk_compress = NULL;
+
 #define SHA1_INPUT_LEN 64
 #define SHA1_LENGTH 20
 
@@ -83,6 +88,9 @@ static void shaCompress(SHA1Context *ctx);
 void 
 SHA1_Begin(SHA1Context *ctx)
 {
+  if (sha_bulk_compress == NULL)
+    sha_bulk_compress = sha1_compress_select();
+
   memset(ctx, 0, sizeof(SHA1Context));
 
   /*
@@ -127,11 +135,14 @@ SHA1_Update(SHA1Context *ctx, const unsigned char *dataIn, unsigned int len)
       shaCompress(ctx);
     }
   }
-  while (len >= 64) {
-    memcpy(ctx->B, dataIn, 64);
-    dataIn += 64;
-    len    -= 64;
-    shaCompress(ctx);
+  /* Whole blocks are hashed straight from the input buffer, skipping
+   * the bounce through ctx->B. */
+  if (len >= 64) {
+    unsigned int blocks = len >> 6;
+
+    sha_bulk_compress(ctx->H, dataIn, blocks);
+    dataIn += blocks << 6;
+    len    &= 63;
   }
   if (len) {
     memcpy(ctx->B, dataIn, len);
@@ -0,0 +1,63 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2011, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_UTILS_TRACEPOINTS_H
+#define LIBTORRENT_UTILS_TRACEPOINTS_H
+
+// Stable SystemTap/DTrace static probe points under the 'libtorrent'
+// provider, for profiling production builds with bpftrace and
+// friends. An unattached probe costs a single nop; when sys/sdt.h is
+// unavailable the macros expand to nothing. Include after config.h.
+
+#ifdef HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define LT_SDT(name)              DTRACE_PROBE(libtorrent, name)
+#define LT_SDT1(name, a1)         DTRACE_PROBE1(libtorrent, name, a1)
+#define LT_SDT2(name, a1, a2)     DTRACE_PROBE2(libtorrent, name, a1, a2)
+#define LT_SDT3(name, a1, a2, a3) DTRACE_PROBE3(libtorrent, name, a1, a2, a3)
+
+#else
+
+#define LT_SDT(name)
+#define LT_SDT1(name, a1)
+#define LT_SDT2(name, a1, a2)
+#define LT_SDT3(name, a1, a2, a3)
+
+#endif
+
+#endif
@@ -89,7 +89,7 @@ test_hash_check_queue::test_single() {
   
   torrent::ChunkHandle handle_0 = chunk_list->get(0, torrent::ChunkList::get_blocking);
 
-  hash_queue.push_back(new torrent::HashChunk(handle_0));
+  hash_queue.push_back(new torrent::HashChunk(handle_0), false);
   
   CPPUNIT_ASSERT(hash_queue.size() == 1);
   CPPUNIT_ASSERT(hash_queue.front()->handle().is_blocking());
@@ -119,7 +119,7 @@ test_hash_check_queue::test_multiple() {
   for (unsigned int i = 0; i < 20; i++) {
     handles.push_back(chunk_list->get(i, torrent::ChunkList::get_blocking));
 
-    hash_queue.push_back(new torrent::HashChunk(handles.back()));
+    hash_queue.push_back(new torrent::HashChunk(handles.back()), false);
 
     CPPUNIT_ASSERT(hash_queue.size() == i + 1);
     CPPUNIT_ASSERT(hash_queue.back()->handle().is_blocking());
@@ -190,7 +190,7 @@ test_hash_check_queue::test_thread() {
 
     torrent::ChunkHandle handle_0 = chunk_list->get(0, torrent::ChunkList::get_blocking);
 
-    hash_queue->push_back(new torrent::HashChunk(handle_0));
+    hash_queue->push_back(new torrent::HashChunk(handle_0), false);
     thread_disk->interrupt();
 
     CPPUNIT_ASSERT(wait_for_true(std::bind(&verify_hash, &done_chunks, 0, hash_for_index(0))));
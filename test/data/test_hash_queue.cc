@@ -73,7 +73,7 @@ test_hash_queue::test_single() {
   hash_queue->slot_has_work() = std::bind(&fill_queue);
 
   torrent::ChunkHandle handle_0 = chunk_list->get(0, torrent::ChunkList::get_blocking);
-  hash_queue->push_back(handle_0, NULL, std::bind(&chunk_done, chunk_list, &done_chunks, std::placeholders::_1, std::placeholders::_2));
+  hash_queue->push_back(handle_0, NULL, std::bind(&chunk_done, chunk_list, &done_chunks, std::placeholders::_1, std::placeholders::_2), false);
   
   CPPUNIT_ASSERT(hash_queue->size() == 1);
   CPPUNIT_ASSERT(hash_queue->front().handle().is_blocking());
@@ -106,7 +106,7 @@ test_hash_queue::test_multiple() {
 
   for (unsigned int i = 0; i < 20; i++) {
     hash_queue->push_back(chunk_list->get(i, torrent::ChunkList::get_blocking),
-                          NULL, std::bind(&chunk_done, chunk_list, &done_chunks, std::placeholders::_1, std::placeholders::_2));
+                          NULL, std::bind(&chunk_done, chunk_list, &done_chunks, std::placeholders::_1, std::placeholders::_2), false);
 
     CPPUNIT_ASSERT(hash_queue->size() == i + 1);
     CPPUNIT_ASSERT(hash_queue->back().handle().is_blocking());
@@ -138,7 +138,7 @@ test_hash_queue::test_erase() {
 
   for (unsigned int i = 0; i < 20; i++) {
     hash_queue->push_back(chunk_list->get(i, torrent::ChunkList::get_blocking),
-                          NULL, std::bind(&chunk_done, chunk_list, &done_chunks, std::placeholders::_1, std::placeholders::_2));
+                          NULL, std::bind(&chunk_done, chunk_list, &done_chunks, std::placeholders::_1, std::placeholders::_2), false);
 
     CPPUNIT_ASSERT(hash_queue->size() == i + 1);
   }
@@ -167,7 +167,7 @@ test_hash_queue::test_erase_stress() {
   for (unsigned int i = 0; i < 1000; i++) {
     for (unsigned int i = 0; i < 20; i++) {
       hash_queue->push_back(chunk_list->get(i, torrent::ChunkList::get_blocking),
-                            NULL, std::bind(&chunk_done, chunk_list, &done_chunks, std::placeholders::_1, std::placeholders::_2));
+                            NULL, std::bind(&chunk_done, chunk_list, &done_chunks, std::placeholders::_1, std::placeholders::_2), false);
 
       CPPUNIT_ASSERT(hash_queue->size() == i + 1);
     }
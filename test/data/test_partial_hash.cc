@@ -0,0 +1,233 @@
+#import "config.h"
+
+#import "test_partial_hash.h"
+
+#import "data/chunk_list.h"
+#import "data/hash_chunk.h"
+#import "rak/socket_address.h"
+#import "torrent/chunk_manager.h"
+#import "torrent/exceptions.h"
+#import "torrent/data/block.h"
+#import "torrent/data/block_list.h"
+#import "torrent/data/piece.h"
+#import "torrent/peer/peer_info.h"
+#import "utils/sha1.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_partial_hash, "data");
+
+static const uint32_t partial_chunk_size = 1 << 10;
+static const uint32_t partial_block_size = partial_chunk_size / 4;
+
+static char
+partial_hash_byte_at(uint32_t index, uint32_t pos) {
+  return (char)(index + pos * 7);
+}
+
+// Two mapped parts so advancing crosses a part boundary mid-block.
+static torrent::Chunk*
+partial_hash_create_chunk(uint32_t index, int prot_flags) {
+  torrent::Chunk* chunk = new torrent::Chunk();
+
+  for (uint32_t part = 0; part < 2; part++) {
+    uint32_t part_size = partial_chunk_size / 2;
+
+    char* memory = (char*)mmap(NULL, part_size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+
+    if (memory == MAP_FAILED)
+      throw torrent::internal_error("partial_hash_create_chunk() failed: " + std::string(strerror(errno)));
+
+    for (uint32_t i = 0; i < part_size; i++)
+      memory[i] = partial_hash_byte_at(index, part * part_size + i);
+
+    chunk->push_back(torrent::ChunkPart::MAPPED_MMAP,
+                     torrent::MemoryChunk(memory, memory, memory + part_size,
+                                          torrent::MemoryChunk::prot_read | torrent::MemoryChunk::prot_write, 0));
+  }
+
+  return chunk;
+}
+
+static uint64_t
+partial_hash_free_diskspace() {
+  return 0;
+}
+
+static void
+partial_hash_storage_error(const std::string& message) {
+}
+
+#define SETUP_PARTIAL_HASH()                                            \
+  torrent::ChunkManager* chunk_manager = new torrent::ChunkManager;     \
+  torrent::ChunkList* chunk_list = new torrent::ChunkList;              \
+  chunk_list->set_manager(chunk_manager);                               \
+  chunk_list->slot_create_chunk() = std::bind(&partial_hash_create_chunk, std::placeholders::_1, std::placeholders::_2); \
+  chunk_list->slot_free_diskspace() = std::bind(&partial_hash_free_diskspace); \
+  chunk_list->slot_storage_error() = std::bind(&partial_hash_storage_error, std::placeholders::_1); \
+  chunk_list->set_chunk_size(partial_chunk_size);                       \
+  chunk_list->resize(8);
+
+#define CLEANUP_PARTIAL_HASH()                  \
+  delete chunk_list;                            \
+  delete chunk_manager;
+
+// Walk a block through queued->transfering->completed as the protocol
+// code would after its last byte arrives.
+static void
+finish_block(torrent::Block* block, torrent::PeerInfo* peer_info) {
+  torrent::BlockTransfer* transfer = block->insert(peer_info);
+
+  block->transfering(transfer);
+  transfer->adjust_position(transfer->piece().length());
+  block->completed(transfer);
+}
+
+static void
+reference_digest(uint32_t index, char* digest) {
+  char buffer[partial_chunk_size];
+
+  for (uint32_t i = 0; i < partial_chunk_size; i++)
+    buffer[i] = partial_hash_byte_at(index, i);
+
+  torrent::Sha1 sha1;
+  sha1.init();
+  sha1.update(buffer, partial_chunk_size);
+  sha1.final_c(digest);
+}
+
+void
+test_partial_hash::test_lifecycle() {
+  SETUP_PARTIAL_HASH();
+
+  // Read-only chunks are never fed by the download path, so no state
+  // is kept for them.
+  torrent::ChunkHandle handle_ro = chunk_list->get(0);
+
+  CPPUNIT_ASSERT(handle_ro.object()->hashed_position() == torrent::ChunkListNode::invalid_position);
+
+  chunk_list->release(&handle_ro);
+
+  torrent::ChunkHandle handle_rw = chunk_list->get(1, torrent::ChunkList::get_writable);
+
+  CPPUNIT_ASSERT(handle_rw.object()->hashed_position() == 0);
+
+  // Pretend some data was hashed, then drop the mapping; the state
+  // must not survive into the next incarnation of the chunk.
+  handle_rw.object()->set_hashed_position(512);
+
+  chunk_list->release(&handle_rw);
+  chunk_list->clear();
+  chunk_list->resize(8);
+
+  handle_rw = chunk_list->get(1, torrent::ChunkList::get_writable);
+
+  CPPUNIT_ASSERT(handle_rw.object()->hashed_position() == 0);
+
+  chunk_list->release(&handle_rw);
+
+  CLEANUP_PARTIAL_HASH();
+}
+
+void
+test_partial_hash::test_advance() {
+  SETUP_PARTIAL_HASH();
+
+  rak::socket_address peer_address;
+  torrent::PeerInfo* peer_info = new torrent::PeerInfo(peer_address.c_sockaddr());
+
+  torrent::ChunkHandle handle = chunk_list->get(0, torrent::ChunkList::get_writable);
+  torrent::BlockList* block_list = new torrent::BlockList(torrent::Piece(0, 0, partial_chunk_size), partial_block_size);
+
+  // Nothing finished, nothing advances.
+  chunk_list->hash_advance(handle.object(), block_list);
+  CPPUNIT_ASSERT(handle.object()->hashed_position() == 0);
+
+  // An out-of-order block must not advance past the hole before it.
+  finish_block(&(*block_list)[2], peer_info);
+
+  chunk_list->hash_advance(handle.object(), block_list);
+  CPPUNIT_ASSERT(handle.object()->hashed_position() == 0);
+
+  // The first block advances over itself only; block 1 crosses the
+  // mapped part boundary and joins up with the already finished
+  // block 2.
+  finish_block(&(*block_list)[0], peer_info);
+
+  chunk_list->hash_advance(handle.object(), block_list);
+  CPPUNIT_ASSERT(handle.object()->hashed_position() == 1 * partial_block_size);
+
+  finish_block(&(*block_list)[1], peer_info);
+
+  chunk_list->hash_advance(handle.object(), block_list);
+  CPPUNIT_ASSERT(handle.object()->hashed_position() == 3 * partial_block_size);
+
+  finish_block(&(*block_list)[3], peer_info);
+
+  chunk_list->hash_advance(handle.object(), block_list);
+  CPPUNIT_ASSERT(handle.object()->hashed_position() == partial_chunk_size);
+
+  // Cleared state means a cleared mapping or consumed hash; advancing
+  // must be a no-op, not a crash.
+  handle.object()->clear_partial_hash();
+  chunk_list->hash_advance(handle.object(), block_list);
+  CPPUNIT_ASSERT(handle.object()->hashed_position() == torrent::ChunkListNode::invalid_position);
+
+  delete block_list;
+  delete peer_info;
+
+  chunk_list->release(&handle);
+
+  CLEANUP_PARTIAL_HASH();
+}
+
+void
+test_partial_hash::test_resume() {
+  SETUP_PARTIAL_HASH();
+
+  rak::socket_address peer_address;
+  torrent::PeerInfo* peer_info = new torrent::PeerInfo(peer_address.c_sockaddr());
+
+  torrent::ChunkHandle handle = chunk_list->get(0, torrent::ChunkList::get_writable);
+  torrent::BlockList* block_list = new torrent::BlockList(torrent::Piece(0, 0, partial_chunk_size), partial_block_size);
+
+  // Advance over the first half, leaving the tail for the final pass.
+  finish_block(&(*block_list)[0], peer_info);
+  finish_block(&(*block_list)[1], peer_info);
+
+  chunk_list->hash_advance(handle.object(), block_list);
+  CPPUNIT_ASSERT(handle.object()->hashed_position() == 2 * partial_block_size);
+
+  // The hash chunk consumes the partial state and resumes mid-chunk.
+  torrent::HashChunk hash_chunk(handle);
+
+  CPPUNIT_ASSERT(handle.object()->hashed_position() == torrent::ChunkListNode::invalid_position);
+  CPPUNIT_ASSERT(hash_chunk.remaining() == partial_chunk_size - 2 * partial_block_size);
+
+  CPPUNIT_ASSERT(hash_chunk.perform(hash_chunk.remaining(), true));
+
+  char digest[20];
+  char expected[20];
+
+  hash_chunk.hash_c(digest);
+  reference_digest(0, expected);
+
+  CPPUNIT_ASSERT(std::memcmp(digest, expected, 20) == 0);
+
+  // A chunk without partial state still hashes from position zero.
+  torrent::ChunkHandle handle_full = chunk_list->get(0);
+  torrent::HashChunk hash_chunk_full(handle_full);
+
+  CPPUNIT_ASSERT(hash_chunk_full.remaining() == partial_chunk_size);
+  CPPUNIT_ASSERT(hash_chunk_full.perform(hash_chunk_full.remaining(), true));
+
+  hash_chunk_full.hash_c(digest);
+
+  CPPUNIT_ASSERT(std::memcmp(digest, expected, 20) == 0);
+
+  delete block_list;
+  delete peer_info;
+
+  chunk_list->release(&handle);
+  chunk_list->release(&handle_full);
+
+  CLEANUP_PARTIAL_HASH();
+}
@@ -0,0 +1,16 @@
+#import "helpers/test_fixture.h"
+
+class test_partial_hash : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_partial_hash);
+
+  CPPUNIT_TEST(test_lifecycle);
+  CPPUNIT_TEST(test_advance);
+  CPPUNIT_TEST(test_resume);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_lifecycle();
+  void test_advance();
+  void test_resume();
+};
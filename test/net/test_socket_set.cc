@@ -0,0 +1,138 @@
+#include "config.h"
+
+#include "test_socket_set.h"
+
+#include "net/socket_set.h"
+#include "torrent/event.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_socket_set, "net");
+
+namespace {
+
+class set_event : public torrent::Event {
+public:
+  set_event(int fd) { m_fileDesc = fd; }
+  ~set_event() { m_fileDesc = -1; }
+
+  void event_read() {}
+  void event_write() {}
+  void event_error() {}
+};
+
+}
+
+void
+test_socket_set::test_basic() {
+  torrent::SocketSet socket_set;
+  socket_set.reserve(32);
+
+  set_event event_1(4);
+  set_event event_2(9);
+
+  CPPUNIT_ASSERT(socket_set.empty());
+  CPPUNIT_ASSERT(!socket_set.has(&event_1));
+
+  socket_set.insert(&event_1);
+
+  CPPUNIT_ASSERT(socket_set.size() == 1);
+  CPPUNIT_ASSERT(socket_set.has(&event_1));
+  CPPUNIT_ASSERT(!socket_set.has(&event_2));
+  CPPUNIT_ASSERT(socket_set.event_at(4) == &event_1);
+
+  // Duplicate inserts and erasing foreign events are no-ops.
+  socket_set.insert(&event_1);
+  CPPUNIT_ASSERT(socket_set.size() == 1);
+
+  socket_set.erase(&event_2);
+  CPPUNIT_ASSERT(socket_set.size() == 1);
+
+  socket_set.erase(&event_1);
+
+  CPPUNIT_ASSERT(socket_set.empty());
+  CPPUNIT_ASSERT(!socket_set.has(&event_1));
+}
+
+void
+test_socket_set::test_max_fd() {
+  torrent::SocketSet socket_set;
+  socket_set.reserve(32);
+
+  CPPUNIT_ASSERT(socket_set.max_fd() == torrent::SocketSet::npos);
+
+  set_event event_1(3);
+  set_event event_2(17);
+  set_event event_3(0);
+
+  socket_set.insert(&event_1);
+  CPPUNIT_ASSERT(socket_set.max_fd() == 3);
+
+  socket_set.insert(&event_2);
+  CPPUNIT_ASSERT(socket_set.max_fd() == 17);
+
+  socket_set.insert(&event_3);
+  CPPUNIT_ASSERT(socket_set.max_fd() == 17);
+
+  socket_set.erase(&event_2);
+  CPPUNIT_ASSERT(socket_set.max_fd() == 3);
+
+  socket_set.erase(&event_1);
+  CPPUNIT_ASSERT(socket_set.max_fd() == 0);
+
+  socket_set.erase(&event_3);
+  CPPUNIT_ASSERT(socket_set.max_fd() == torrent::SocketSet::npos);
+}
+
+// The generation stamp is what lets readiness gathered before the
+// callbacks ran be discarded once the slot changes under it.
+void
+test_socket_set::test_generation() {
+  torrent::SocketSet socket_set;
+  socket_set.reserve(32);
+
+  set_event event_1(5);
+
+  socket_set.insert(&event_1);
+  socket_set.mark(5);
+
+  CPPUNIT_ASSERT(socket_set.is_current(5));
+
+  // An unmarked or out-of-bounds fd is never current.
+  CPPUNIT_ASSERT(!socket_set.is_current(6));
+  CPPUNIT_ASSERT(!socket_set.is_current(1 << 20));
+
+  // Erasing after the mark invalidates the gathered readiness, even
+  // though the mark itself is untouched.
+  socket_set.erase(&event_1);
+
+  CPPUNIT_ASSERT(!socket_set.is_current(5));
+}
+
+void
+test_socket_set::test_fd_reuse() {
+  torrent::SocketSet socket_set;
+  socket_set.reserve(32);
+
+  set_event event_1(7);
+  set_event event_2(7);
+
+  socket_set.insert(&event_1);
+  socket_set.mark(7);
+
+  CPPUNIT_ASSERT(socket_set.is_current(7));
+
+  // A close/accept pair can hand the same fd to a new connection
+  // within one poll cycle; the stale mark must not leak the old
+  // event's readiness into the new one.
+  socket_set.erase(&event_1);
+  socket_set.insert(&event_2);
+
+  CPPUNIT_ASSERT(socket_set.has(&event_2));
+  CPPUNIT_ASSERT(!socket_set.is_current(7));
+
+  // Only a fresh mark makes the slot current again.
+  socket_set.mark(7);
+
+  CPPUNIT_ASSERT(socket_set.is_current(7));
+
+  socket_set.erase(&event_2);
+}
@@ -0,0 +1,18 @@
+#include "helpers/test_fixture.h"
+
+class test_socket_set : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_socket_set);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_max_fd);
+  CPPUNIT_TEST(test_generation);
+  CPPUNIT_TEST(test_fd_reuse);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_max_fd();
+  void test_generation();
+  void test_fd_reuse();
+};
@@ -0,0 +1,195 @@
+#include "config.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "priority_queue_test.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(PriorityQueueTest);
+
+static std::vector<int>* fired_items = NULL;
+
+static void
+record_fired(int index) {
+  fired_items->push_back(index);
+}
+
+// Deterministic generator so failures reproduce; spans enough bits to
+// exercise every level of the wheel.
+static uint64_t prq_random_state = 0x853c49e6748fea9bULL;
+
+static uint64_t
+prq_random() {
+  prq_random_state = prq_random_state * 6364136223846793005ULL + 1442695040888963407ULL;
+  return prq_random_state >> 16;
+}
+
+void
+PriorityQueueTest::test_basic() {
+  rak::timer_wheel queue;
+
+  CPPUNIT_ASSERT(queue.empty());
+  CPPUNIT_ASSERT(queue.top() == NULL);
+
+  std::vector<int> fired;
+  fired_items = &fired;
+
+  rak::priority_item items[3];
+
+  for (int i = 0; i < 3; i++)
+    items[i].slot() = std::bind(&record_fired, i);
+
+  // Deltas chosen to land in different wheel levels.
+  rak::priority_queue_insert(&queue, &items[0], rak::timer((int64_t)1 << 30));
+  rak::priority_queue_insert(&queue, &items[1], rak::timer((int64_t)1 << 12));
+  rak::priority_queue_insert(&queue, &items[2], rak::timer((int64_t)1 << 21));
+
+  CPPUNIT_ASSERT(queue.size() == 3);
+  CPPUNIT_ASSERT(queue.top() == &items[1]);
+
+  rak::priority_queue_perform(&queue, rak::timer((int64_t)1 << 30));
+
+  CPPUNIT_ASSERT(queue.empty());
+  CPPUNIT_ASSERT(fired.size() == 3);
+  CPPUNIT_ASSERT(fired[0] == 1 && fired[1] == 2 && fired[2] == 0);
+}
+
+void
+PriorityQueueTest::test_erase() {
+  rak::timer_wheel queue;
+
+  rak::priority_item item;
+  item.slot() = std::bind(&record_fired, 0);
+
+  rak::priority_queue_insert(&queue, &item, rak::timer((int64_t)1 << 20));
+
+  CPPUNIT_ASSERT(queue.contains(&item));
+
+  rak::priority_queue_erase(&queue, &item);
+
+  CPPUNIT_ASSERT(!queue.contains(&item));
+  CPPUNIT_ASSERT(queue.empty());
+
+  // Erased items must be cleanly reinsertable.
+  rak::priority_queue_insert(&queue, &item, rak::timer((int64_t)1 << 10));
+
+  CPPUNIT_ASSERT(queue.top() == &item);
+
+  rak::priority_queue_erase(&queue, &item);
+}
+
+void
+PriorityQueueTest::test_clear() {
+  rak::timer_wheel queue;
+
+  rak::priority_item items[8];
+
+  for (int i = 0; i < 8; i++) {
+    items[i].slot() = std::bind(&record_fired, i);
+    rak::priority_queue_insert(&queue, &items[i], rak::timer((int64_t)1 << (10 + 2 * i)));
+  }
+
+  queue.clear();
+
+  CPPUNIT_ASSERT(queue.empty());
+  CPPUNIT_ASSERT(queue.top() == NULL);
+
+  for (int i = 0; i < 8; i++) {
+    CPPUNIT_ASSERT(!queue.contains(&items[i]));
+
+    // clear() drops the wheel's hooks but not the item's own time.
+    items[i].clear_time();
+    rak::priority_queue_insert(&queue, &items[i], rak::timer((int64_t)(i + 1) << 12));
+  }
+
+  CPPUNIT_ASSERT(queue.size() == 8);
+
+  queue.clear();
+
+  for (int i = 0; i < 8; i++)
+    items[i].clear_time();
+}
+
+// Random inserts, erases and dispatches checked against a brute-force
+// model of which items are pending and when they are due.
+void
+PriorityQueueTest::test_randomized() {
+  static const int item_count = 64;
+  static const int rounds = 2000;
+
+  rak::timer_wheel queue;
+
+  rak::priority_item items[item_count];
+  int64_t            due[item_count];
+
+  std::vector<int> fired;
+  fired_items = &fired;
+
+  for (int i = 0; i < item_count; i++) {
+    items[i].slot() = std::bind(&record_fired, i);
+    due[i] = -1;
+  }
+
+  int64_t now = 1;
+
+  for (int round = 0; round < rounds; round++) {
+    int index = prq_random() % item_count;
+
+    switch (prq_random() % 4) {
+    case 0:
+    case 1:
+      if (due[index] == -1) {
+        due[index] = now + 1 + (int64_t)(prq_random() & ((((int64_t)1 << 36) - 1)));
+        rak::priority_queue_insert(&queue, &items[index], rak::timer(due[index]));
+      }
+      break;
+
+    case 2:
+      rak::priority_queue_erase(&queue, &items[index]);
+      due[index] = -1;
+      break;
+
+    case 3: {
+      now += prq_random() & (((int64_t)1 << 34) - 1);
+
+      fired.clear();
+      rak::priority_queue_perform(&queue, rak::timer(now));
+
+      // Everything due must have fired, in non-decreasing time order,
+      // and nothing else.
+      std::vector<int> expected;
+
+      for (int i = 0; i < item_count; i++)
+        if (due[i] != -1 && due[i] <= now)
+          expected.push_back(i);
+
+      CPPUNIT_ASSERT(fired.size() == expected.size());
+
+      for (size_t i = 1; i < fired.size(); i++)
+        CPPUNIT_ASSERT(due[fired[i - 1]] <= due[fired[i]]);
+
+      std::vector<int> sorted_fired(fired);
+      std::sort(sorted_fired.begin(), sorted_fired.end());
+
+      CPPUNIT_ASSERT(std::equal(expected.begin(), expected.end(), sorted_fired.begin()));
+
+      for (size_t i = 0; i < fired.size(); i++)
+        due[fired[i]] = -1;
+
+      break;
+    }
+    }
+
+    size_t pending = 0;
+
+    for (int i = 0; i < item_count; i++)
+      pending += due[i] != -1;
+
+    CPPUNIT_ASSERT(queue.size() == pending);
+  }
+
+  for (int i = 0; i < item_count; i++)
+    rak::priority_queue_erase(&queue, &items[i]);
+
+  CPPUNIT_ASSERT(queue.empty());
+}
@@ -0,0 +1,21 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "rak/priority_queue_default.h"
+
+class PriorityQueueTest : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(PriorityQueueTest);
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_erase);
+  CPPUNIT_TEST(test_clear);
+  CPPUNIT_TEST(test_randomized);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp() {}
+  void tearDown() {}
+
+  void test_basic();
+  void test_erase();
+  void test_clear();
+  void test_randomized();
+};
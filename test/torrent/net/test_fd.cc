@@ -22,3 +22,28 @@ test_fd::test_valid_flags() {
   CPPUNIT_ASSERT(!torrent::fd_valid_flags(torrent::fd_flags(torrent::fd_flag_stream | ~torrent::fd_flag_all)));
   CPPUNIT_ASSERT(!torrent::fd_valid_flags(torrent::fd_flags(0x3245132)));
 }
+
+void
+test_fd::test_open_stream() {
+  int fd = torrent::fd_open_stream(torrent::fd_flag_nonblock);
+
+  CPPUNIT_ASSERT(fd != -1);
+  CPPUNIT_ASSERT(torrent::fd_get_flags(fd) & torrent::fd_flag_stream);
+  CPPUNIT_ASSERT(torrent::fd_get_flags(fd) & torrent::fd_flag_nonblock);
+
+  torrent::fd_close(fd);
+}
+
+void
+test_fd::test_get_flags() {
+  CPPUNIT_ASSERT(torrent::fd_get_flags(-1) == torrent::fd_flags());
+
+  int fd = torrent::fd_open(torrent::fd_flag_stream | torrent::fd_flag_reuse_address);
+
+  CPPUNIT_ASSERT(fd != -1);
+  CPPUNIT_ASSERT(torrent::fd_get_flags(fd) == (torrent::fd_flag_stream | torrent::fd_flag_reuse_address));
+
+  torrent::fd_close(fd);
+
+  CPPUNIT_ASSERT(torrent::fd_get_flags(fd) == torrent::fd_flags());
+}
@@ -4,9 +4,13 @@ class test_fd : public test_fixture {
   CPPUNIT_TEST_SUITE(test_fd);
 
   CPPUNIT_TEST(test_valid_flags);
+  CPPUNIT_TEST(test_open_stream);
+  CPPUNIT_TEST(test_get_flags);
 
   CPPUNIT_TEST_SUITE_END();
 
 public:
   void test_valid_flags();
+  void test_open_stream();
+  void test_get_flags();
 };
@@ -0,0 +1,75 @@
+#include "config.h"
+
+#include "test_bitfield.h"
+
+#include "torrent/bitfield.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_bitfield, "torrent");
+
+// A size that is neither byte- nor word-aligned, so every range ends
+// up exercising the masked head/tail bytes and the whole-byte middle.
+static const uint32_t test_size_bits = 67;
+
+static void
+setup_pattern(torrent::Bitfield* bitfield, bool* reference) {
+  bitfield->clear();
+  bitfield->set_size_bits(test_size_bits);
+  bitfield->allocate();
+  bitfield->unset_all();
+
+  for (uint32_t i = 0; i < test_size_bits; i++) {
+    reference[i] = (i % 3) == 0;
+
+    if (reference[i])
+      bitfield->set(i);
+  }
+}
+
+static void
+verify_against_reference(torrent::Bitfield* bitfield, const bool* reference) {
+  uint32_t set_count = 0;
+
+  for (uint32_t i = 0; i < test_size_bits; i++) {
+    CPPUNIT_ASSERT(bitfield->get(i) == reference[i]);
+    set_count += reference[i];
+  }
+
+  CPPUNIT_ASSERT(bitfield->size_set() == set_count);
+  CPPUNIT_ASSERT(bitfield->is_tail_cleared());
+}
+
+void
+test_bitfield::test_set_range_exhaustive() {
+  torrent::Bitfield bitfield;
+  bool reference[test_size_bits];
+
+  for (uint32_t first = 0; first <= test_size_bits; first++)
+    for (uint32_t last = first; last <= test_size_bits; last++) {
+      setup_pattern(&bitfield, reference);
+
+      bitfield.set_range(first, last);
+
+      for (uint32_t i = first; i < last; i++)
+        reference[i] = true;
+
+      verify_against_reference(&bitfield, reference);
+    }
+}
+
+void
+test_bitfield::test_unset_range_exhaustive() {
+  torrent::Bitfield bitfield;
+  bool reference[test_size_bits];
+
+  for (uint32_t first = 0; first <= test_size_bits; first++)
+    for (uint32_t last = first; last <= test_size_bits; last++) {
+      setup_pattern(&bitfield, reference);
+
+      bitfield.unset_range(first, last);
+
+      for (uint32_t i = first; i < last; i++)
+        reference[i] = false;
+
+      verify_against_reference(&bitfield, reference);
+    }
+}
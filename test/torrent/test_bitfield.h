@@ -0,0 +1,14 @@
+#include "helpers/test_fixture.h"
+
+class test_bitfield : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_bitfield);
+
+  CPPUNIT_TEST(test_set_range_exhaustive);
+  CPPUNIT_TEST(test_unset_range_exhaustive);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_set_range_exhaustive();
+  void test_unset_range_exhaustive();
+};
@@ -11,14 +11,16 @@
 
 CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_signal_bitfield, "torrent/utils");
 
+typedef torrent::signal_bitfield::bitfield_type mark_bitfield_type;
+
 static void
-mark_index(uint32_t* bitfield, unsigned int index) {
-  __sync_fetch_and_or(bitfield, 1 << index);
+mark_index(mark_bitfield_type* bitfield, unsigned int index) {
+  __sync_fetch_and_or(bitfield, mark_bitfield_type(1) << index);
 }
 
 static bool
-check_index(uint32_t* bitfield, unsigned int index) {
-  return *bitfield & (1 << index);
+check_index(mark_bitfield_type* bitfield, unsigned int index) {
+  return *bitfield & (mark_bitfield_type(1) << index);
 }
 
 void
@@ -42,7 +44,7 @@ verify_did_internal_error(std::function<unsigned int ()> func, bool should_throw
 }
 
 #define SETUP_SIGNAL_BITFIELD()                 \
-  uint32_t marked_bitfield = 0;                 \
+  mark_bitfield_type marked_bitfield = 0;       \
   torrent::signal_bitfield signal_bitfield;
 
 
@@ -93,10 +95,13 @@ test_signal_bitfield::test_multiple() {
 
   signal_bitfield.signal(2);
   signal_bitfield.signal(31);
+  signal_bitfield.signal(torrent::signal_bitfield::max_size - 1);
   CPPUNIT_ASSERT(marked_bitfield == 0x0);
   
   signal_bitfield.work();
-  CPPUNIT_ASSERT(marked_bitfield == (((unsigned int)1 << 2) | ((unsigned int)1 << 31)));
+  CPPUNIT_ASSERT(marked_bitfield == ((mark_bitfield_type(1) << 2) |
+                                     (mark_bitfield_type(1) << 31) |
+                                     (mark_bitfield_type(1) << (torrent::signal_bitfield::max_size - 1))));
 
   marked_bitfield = 0;
 
@@ -106,7 +111,7 @@ test_signal_bitfield::test_multiple() {
 
 void
 test_signal_bitfield::test_threaded() {
-  uint32_t marked_bitfield = 0;
+  mark_bitfield_type marked_bitfield = 0;
   test_thread* thread = new test_thread;
   // thread->set_test_flag(test_thread::test_flag_long_timeout);
 
@@ -122,11 +127,11 @@ test_signal_bitfield::test_threaded() {
     // thread->interrupt();
     // usleep(0);
 
-    thread->signal_bitfield()->signal(i % 20);
+    thread->signal_bitfield()->signal(i % torrent::signal_bitfield::max_size);
     // thread->interrupt();
 
-    CPPUNIT_ASSERT(wait_for_true(std::bind(&check_index, &marked_bitfield, i % 20)));
-    __sync_fetch_and_and(&marked_bitfield, ~uint32_t());
+    CPPUNIT_ASSERT(wait_for_true(std::bind(&check_index, &marked_bitfield, i % torrent::signal_bitfield::max_size)));
+    __sync_fetch_and_and(&marked_bitfield, mark_bitfield_type(0));
   }
 
   thread->stop_thread();
@@ -0,0 +1,114 @@
+#include "config.h"
+
+#include "test_queue_mpsc.h"
+
+#include <pthread.h>
+
+#include "utils/queue_mpsc.h"
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(test_queue_mpsc, "utils");
+
+typedef torrent::queue_mpsc<int> int_queue_type;
+
+void
+test_queue_mpsc::test_basic() {
+  int_queue_type queue;
+  int value = 0;
+
+  CPPUNIT_ASSERT(queue.empty());
+  CPPUNIT_ASSERT(!queue.pop_front(&value));
+
+  queue.push_back(42);
+
+  CPPUNIT_ASSERT(!queue.empty());
+  CPPUNIT_ASSERT(queue.pop_front(&value));
+  CPPUNIT_ASSERT(value == 42);
+
+  CPPUNIT_ASSERT(queue.empty());
+  CPPUNIT_ASSERT(!queue.pop_front(&value));
+
+  // A queue destroyed with elements still pending must free them.
+  queue.push_back(1);
+  queue.push_back(2);
+}
+
+void
+test_queue_mpsc::test_fifo() {
+  int_queue_type queue;
+  int value = 0;
+
+  for (int i = 0; i < 1000; i++)
+    queue.push_back(i);
+
+  for (int i = 0; i < 1000; i++) {
+    CPPUNIT_ASSERT(queue.pop_front(&value));
+    CPPUNIT_ASSERT(value == i);
+  }
+
+  CPPUNIT_ASSERT(queue.empty());
+}
+
+//
+// Threaded producers: each pushes a tagged sequence while the main
+// thread consumes, verifying per-producer FIFO order and that no
+// element is lost or duplicated.
+//
+
+static const int producer_count = 4;
+static const int producer_items = 10000;
+
+struct producer_args {
+  int_queue_type* queue;
+  int             id;
+};
+
+static void*
+queue_mpsc_producer(void* raw_args) {
+  producer_args* args = (producer_args*)raw_args;
+
+  for (int i = 0; i < producer_items; i++)
+    args->queue->push_back(args->id * producer_items + i);
+
+  return NULL;
+}
+
+void
+test_queue_mpsc::test_producers() {
+  int_queue_type queue;
+
+  pthread_t     threads[producer_count];
+  producer_args args[producer_count];
+
+  for (int i = 0; i < producer_count; i++) {
+    args[i].queue = &queue;
+    args[i].id = i;
+
+    CPPUNIT_ASSERT(pthread_create(&threads[i], NULL, &queue_mpsc_producer, &args[i]) == 0);
+  }
+
+  int next_seq[producer_count] = { 0 };
+  int received = 0;
+  int value = 0;
+
+  while (received < producer_count * producer_items) {
+    if (!queue.pop_front(&value))
+      continue;
+
+    int id = value / producer_items;
+    int seq = value % producer_items;
+
+    CPPUNIT_ASSERT(id >= 0 && id < producer_count);
+    CPPUNIT_ASSERT(seq == next_seq[id]);
+
+    next_seq[id]++;
+    received++;
+  }
+
+  CPPUNIT_ASSERT(queue.empty());
+
+  for (int i = 0; i < producer_count; i++)
+    pthread_join(threads[i], NULL);
+
+  for (int i = 0; i < producer_count; i++)
+    CPPUNIT_ASSERT(next_seq[i] == producer_items);
+}
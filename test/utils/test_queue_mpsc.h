@@ -0,0 +1,16 @@
+#include "helpers/test_fixture.h"
+
+class test_queue_mpsc : public test_fixture {
+  CPPUNIT_TEST_SUITE(test_queue_mpsc);
+
+  CPPUNIT_TEST(test_basic);
+  CPPUNIT_TEST(test_fifo);
+  CPPUNIT_TEST(test_producers);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basic();
+  void test_fifo();
+  void test_producers();
+};